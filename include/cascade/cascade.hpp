@@ -1,17 +1,30 @@
 #pragma once
 #include <map>
+#include <set>
+#include <vector>
 #include <memory>
 #include <string>
 #include <time.h>
 #include <iostream>
 #include <tuple>
 #include <optional>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <nlohmann/json.hpp>
 
 #include <derecho/core/derecho.hpp>
 #include <derecho/mutils-serialization/SerializationSupport.hpp>
 #include <derecho/persistent/Persistent.hpp>
 
 #include <cascade/config.h>
+#include <cascade/detail/flat_hash_map.hpp>
+#include <cascade/detail/radix_tree_map.hpp>
+#include <cascade/detail/blob_codec.hpp>
+#include <cascade/detail/blob_patch.hpp>
 
 namespace derecho {
 namespace cascade {
@@ -22,6 +35,360 @@ namespace cascade {
     class ICascadeContext: public derecho::DeserializationContext {};
 
 #define CURRENT_VERSION     (persistent::INVALID_VERSION)
+
+    /**
+     * ReadConsistency
+     *
+     * The consistency levels of the local read path (get_local/get_size_local). A local read is served from the kv_map
+     * of the contacted replica instead of an ordered send to the whole shard. The replica does not wait for its
+     * delivered frontier to catch up: a read it cannot serve from its local state falls back to get(key,
+     * CURRENT_VERSION), which is linearizable, and which blocks the handler on an ordered send like any ordered read.
+     * - ReadYourWrites:    The replica serves the read if its delivered frontier covers the request point, which is a
+     *                      version the caller has observed and passes along, for example, the version returned by its
+     *                      latest put. The store does not track the versions a client has observed. The read sees that
+     *                      version or a later one. If the request point is INVALID_VERSION, the read goes to the ordered
+     *                      path.
+     * - RecentlyDelivered: The replica serves the read if it has delivered an ordered message in the last
+     *                      'max_staleness_us' microseconds of its local clock. This bounds how long the replica has been
+     *                      idle, not how far it lags the shard.
+     * - Local:             The replica serves the read with whatever state it has.
+     * Bounded staleness is out of scope: a replica only knows its own frontier, so no level bounds how far its state
+     * lags the other replicas of the shard, in versions or in time. A caller that needs such a bound passes the shard
+     * version it knows of as the request point of ReadYourWrites.
+     */
+    enum class ReadConsistency : uint32_t {
+        ReadYourWrites = 0,
+        RecentlyDelivered = 1,
+        Local = 2,
+    };
+
+    /**
+     * DeliveredFrontier
+     *
+     * DeliveredFrontier tracks the latest ordered message delivered to a replica and the local time of that delivery.
+     * The ordered handlers advance it; the local read path tests it.
+     */
+    class DeliveredFrontier {
+    private:
+        mutable std::mutex              frontier_mutex;
+        persistent::version_t           version;
+        uint64_t                        delivered_us;
+    public:
+        /**
+         * Constructor
+         */
+        DeliveredFrontier();
+        /**
+         * advance the frontier to 'ver'. Only the ordered handlers call this.
+         * @param ver   The version of the ordered message delivered.
+         */
+        void advance(const persistent::version_t& ver);
+        /**
+         * Test if a read of the given consistency can be served locally right now, without waiting for the frontier to
+         * advance.
+         * @param consistency       The consistency level
+         * @param read_point        The request point for ReadConsistency::ReadYourWrites
+         * @param max_staleness_us  The idle bound for ReadConsistency::RecentlyDelivered
+         *
+         * @return true if the local state satisfies the consistency level, otherwise false.
+         */
+        bool can_serve(const ReadConsistency& consistency,
+                  const persistent::version_t& read_point,
+                  const uint64_t& max_staleness_us) const;
+        /**
+         * Get the version of the last ordered message delivered.
+         */
+        persistent::version_t get_version() const;
+    };
+
+    /**
+     * KVIndex
+     *
+     * KVIndex is the type of kv_map in VolatileCascadeStore and DeltaCascadeStoreCore. If ENABLE_UINT64_HASH_INDEX is
+     * defined, the stores with uint64_t keys use FlatHashMap, whose iteration order is unspecified: a key scan selects
+     * the next keys in a pass over the whole map, unless the subgroup opts in to a side index of the ordered keys (see
+     * load_ordered_scans()). If ENABLE_STRING_RADIX_INDEX is defined, the stores with std::string keys use RadixTreeMap,
+     * which compresses the shared prefixes of path-like keys. Otherwise, and for the other key types, std::map is used.
+     */
+    template <typename KT, typename VT>
+    struct KVIndexSelector {
+        using type = std::map<KT,VT>;
+    };
+#ifdef ENABLE_UINT64_HASH_INDEX
+    template <typename VT>
+    struct KVIndexSelector<uint64_t,VT> {
+        using type = FlatHashMap<uint64_t,VT>;
+    };
+#endif
+#ifdef ENABLE_STRING_RADIX_INDEX
+    template <typename VT>
+    struct KVIndexSelector<std::string,VT> {
+        using type = RadixTreeMap<VT>;
+    };
+#endif
+    template <typename KT, typename VT>
+    using KVIndex = typename KVIndexSelector<KT,VT>::type;
+
+#define CONF_SCAN_MAX_PAGE_BYTES    "CASCADE/scan_max_page_bytes"
+#define DEFAULT_SCAN_MAX_PAGE_BYTES (4096)
+
+    /**
+     * ScanPage
+     *
+     * A page of a key scan. The keys are in ascending order. Pass the last key as 'start_after' to get the next page.
+     */
+    template <typename KT, typename VT>
+    class ScanPage : public mutils::ByteRepresentable {
+    public:
+        std::vector<KT> keys;
+        /* the values of the keys if the scan asks for values, otherwise empty */
+        std::vector<VT> values;
+        /* true if there are more keys after this page */
+        bool has_more;
+
+        ScanPage(): has_more(false) {}
+        ScanPage(const std::vector<KT>& _keys, const std::vector<VT>& _values, bool _has_more):
+            keys(_keys), values(_values), has_more(_has_more) {}
+
+        DEFAULT_SERIALIZATION_SUPPORT(ScanPage,keys,values,has_more);
+    };
+
+    /**
+     * Scan a page of a kv_map in ascending key order.
+     * @param kv_map        The kv_map
+     * @param prefix        Only the keys starting with 'prefix' are returned. It must be empty unless KT is
+     *                      std::string.
+     * @param start_after   The page starts after this key, or from the beginning if it is *IK.
+     * @param limit         The maximum number of keys in the page
+     * @param with_values   If true, the page has the values of the keys.
+     * @param max_bytes     The page stops growing when its serialized size reaches max_bytes, but always has at
+     *                      least one key unless the scan is over.
+     *
+     * @return the page
+     */
+    template <typename KT, typename VT, KT* IK, typename MapType>
+    ScanPage<KT,VT> scan_kv_map(const MapType& kv_map, const std::string& prefix, const KT& start_after,
+                                const uint32_t& limit, bool with_values, const uint64_t& max_bytes);
+
+    /**
+     * Get the page size limit of the scans, CONF_SCAN_MAX_PAGE_BYTES.
+     */
+    inline uint64_t get_scan_max_page_bytes();
+
+/* the per subgroup opt-in to the side index of the ordered keys, a boolean in the layout dict of a subgroup */
+#define JSON_CONF_ORDERED_SCANS     "ordered_scans"
+
+    /**
+     * Load whether a subgroup keeps a side index of the ordered keys in a kv_map without key order, so that a scan
+     * page costs O(log n) instead of a pass over the whole map: the "ordered_scans" flag in the layout of the
+     * subgroup, false by default.
+     * @param subgroup_id   The subgroup id.
+     */
+    bool load_ordered_scans(const derecho::subgroup_id_t subgroup_id);
+
+    /**
+     * Make a kv_map keep the side index of its ordered keys, if it has no key order by itself and does not keep it
+     * yet. The caller holds the kv_map exclusively.
+     * @param kv_map        The kv_map
+     */
+    template <typename MapType>
+    void keep_key_order(MapType& kv_map);
+
+    /**
+     * QueryProjection decides what a shard query returns for each matching object.
+     * - Object:    the objects.
+     * - Metadata:  the objects without blob, and the blob sizes. The VT type must implement IHasBlob, otherwise the
+     *              objects are returned as they are.
+     * - Size:      the blob sizes, or the serialized sizes if VT does not implement IHasBlob.
+     * - Key:       the keys only.
+     */
+    enum class QueryProjection : uint32_t {
+        Object = 0,
+        Metadata = 1,
+        Size = 2,
+        Key = 3,
+    };
+
+    /**
+     * QueryAggregate folds the matching objects into one value on the shard. A shard query with an aggregate returns
+     * no keys or values.
+     */
+    enum class QueryAggregate : uint32_t {
+        None = 0,
+        Count = 1,
+        Sum = 2,
+        Min = 3,
+        Max = 4,
+    };
+
+    /**
+     * QueryField is the field of an object an aggregate is computed over.
+     * - BlobSize:  the blob size, or the serialized size if VT does not implement IHasBlob.
+     * - Timestamp: the timestamp in microseconds, 0 if VT does not implement IKeepTimestamp.
+     * - Version:   the version, 0 if VT does not implement IKeepVersion.
+     */
+    enum class QueryField : uint32_t {
+        BlobSize = 0,
+        Timestamp = 1,
+        Version = 2,
+    };
+
+    /**
+     * ShardQuery
+     *
+     * A shard query is evaluated on the shard so that only the matching objects, or an aggregate of them, travel back
+     * to the client. An object matches if it is not null and it satisfies all the predicates below:
+     * - key_prefix:        the key starts with key_prefix. It must be empty unless KT is std::string.
+     * - key_lower/upper:   key_lower <= key <= key_upper, if has_key_lower/has_key_upper is set.
+     * - blob_prefix:       the blob starts with blob_prefix.
+     * - blob_lower/upper:  blob_lower <= blob <= blob_upper in lexicographical order, if has_blob_lower/has_blob_upper
+     *                      is set.
+     * - min/max_timestamp_us: min_timestamp_us <= timestamp <= max_timestamp_us, if VT implements IKeepTimestamp.
+     * The blob predicates only match if VT implements IHasBlob.
+     */
+    template <typename KT>
+    class ShardQuery : public mutils::ByteRepresentable {
+    public:
+        std::string     key_prefix;
+        bool            has_key_lower;
+        KT              key_lower;
+        bool            has_key_upper;
+        KT              key_upper;
+        std::string     blob_prefix;
+        bool            has_blob_lower;
+        std::string     blob_lower;
+        bool            has_blob_upper;
+        std::string     blob_upper;
+        uint64_t        min_timestamp_us;
+        uint64_t        max_timestamp_us;
+        QueryProjection projection;
+        QueryAggregate  aggregate;
+        QueryField      aggregate_field;
+
+        /* the default query matches all objects and returns them */
+        ShardQuery():
+            has_key_lower(false),key_lower(),has_key_upper(false),key_upper(),
+            has_blob_lower(false),has_blob_upper(false),
+            min_timestamp_us(0),max_timestamp_us(std::numeric_limits<uint64_t>::max()),
+            projection(QueryProjection::Object),aggregate(QueryAggregate::None),aggregate_field(QueryField::BlobSize) {}
+        ShardQuery(const std::string& _key_prefix,
+                   bool _has_key_lower, const KT& _key_lower, bool _has_key_upper, const KT& _key_upper,
+                   const std::string& _blob_prefix,
+                   bool _has_blob_lower, const std::string& _blob_lower,
+                   bool _has_blob_upper, const std::string& _blob_upper,
+                   uint64_t _min_timestamp_us, uint64_t _max_timestamp_us,
+                   QueryProjection _projection, QueryAggregate _aggregate, QueryField _aggregate_field):
+            key_prefix(_key_prefix),
+            has_key_lower(_has_key_lower),key_lower(_key_lower),has_key_upper(_has_key_upper),key_upper(_key_upper),
+            blob_prefix(_blob_prefix),
+            has_blob_lower(_has_blob_lower),blob_lower(_blob_lower),
+            has_blob_upper(_has_blob_upper),blob_upper(_blob_upper),
+            min_timestamp_us(_min_timestamp_us),max_timestamp_us(_max_timestamp_us),
+            projection(_projection),aggregate(_aggregate),aggregate_field(_aggregate_field) {}
+
+        /**
+         * Test if an object matches the predicates.
+         * @param key
+         * @param value
+         *
+         * @return true if it matches.
+         */
+        template <typename VT>
+        bool match(const KT& key, const VT& value) const;
+
+        DEFAULT_SERIALIZATION_SUPPORT(ShardQuery,key_prefix,has_key_lower,key_lower,has_key_upper,key_upper,
+                                      blob_prefix,has_blob_lower,blob_lower,has_blob_upper,blob_upper,
+                                      min_timestamp_us,max_timestamp_us,projection,aggregate,aggregate_field);
+    };
+
+    /**
+     * QueryPage
+     *
+     * A page of the result of a shard query. The keys are in ascending order. Pass the last key as 'start_after' to get
+     * the next page. 'values' is filled for QueryProjection::Object and QueryProjection::Metadata; 'sizes' is filled for
+     * QueryProjection::Metadata and QueryProjection::Size. A query with an aggregate returns only 'aggregate_value' and
+     * 'num_matches', the number of objects folded into it; the aggregate of Min or Max is meaningless if 'num_matches'
+     * is 0.
+     */
+    template <typename KT, typename VT>
+    class QueryPage : public mutils::ByteRepresentable {
+    public:
+        std::vector<KT>         keys;
+        std::vector<VT>         values;
+        std::vector<uint64_t>   sizes;
+        uint64_t                aggregate_value;
+        uint64_t                num_matches;
+        /* true if there might be more matches after this page */
+        bool                    has_more;
+
+        QueryPage(): aggregate_value(0), num_matches(0), has_more(false) {}
+        QueryPage(const std::vector<KT>& _keys, const std::vector<VT>& _values, const std::vector<uint64_t>& _sizes,
+                  uint64_t _aggregate_value, uint64_t _num_matches, bool _has_more):
+            keys(_keys), values(_values), sizes(_sizes),
+            aggregate_value(_aggregate_value), num_matches(_num_matches), has_more(_has_more) {}
+
+        DEFAULT_SERIALIZATION_SUPPORT(QueryPage,keys,values,sizes,aggregate_value,num_matches,has_more);
+    };
+
+    /**
+     * Evaluate a shard query over a kv_map. Like scan_kv_map, the matches are paged in ascending key order, unless the
+     * query has an aggregate, which is computed over all the matches in one page.
+     * @param kv_map        The kv_map
+     * @param query         The query
+     * @param start_after   The page starts after this key, or from the beginning if it is *IK.
+     * @param limit         The maximum number of matches in the page, 0 for no limit other than max_bytes.
+     * @param max_bytes     The page stops growing when its serialized size reaches max_bytes, but always has at
+     *                      least one match unless there is no more.
+     *
+     * @return the page
+     */
+    template <typename KT, typename VT, KT* IK, typename MapType>
+    QueryPage<KT,VT> query_kv_map(const MapType& kv_map, const ShardQuery<KT>& query, const KT& start_after,
+                                  const uint32_t& limit, const uint64_t& max_bytes);
+
+    /**
+     * ObjectMetadata
+     *
+     * The fixed-size header of an object, returned by head() without the blob. The fields a VT type does not keep,
+     * according to IKeepVersion/IKeepTimestamp/IKeepPreviousVersion/IHasBlob, are INVALID_VERSION or 0.
+     */
+    struct ObjectMetadata {
+        persistent::version_t   version;
+        uint64_t                timestamp_us;
+        persistent::version_t   previous_version;
+        persistent::version_t   previous_version_by_key;
+        /* the size of the blob */
+        uint64_t                blob_size;
+        /* the size of the serialized object with its blob uncompressed, as get_size() returns */
+        uint64_t                object_size;
+        bool                    is_null;
+    };
+
+    inline std::ostream& operator<<(std::ostream& out, const ObjectMetadata& m) {
+        out << "ObjectMetadata{ver: 0x" << std::hex << m.version << std::dec
+            << ", ts(us): " << m.timestamp_us
+            << ", prev_ver: " << std::hex << m.previous_version << std::dec
+            << ", prev_ver_by_key: " << std::hex << m.previous_version_by_key << std::dec
+            << ", blob_size: " << m.blob_size
+            << ", object_size: " << m.object_size
+            << ", is_null: " << (m.is_null ? "true" : "false") << "}";
+        return out;
+    }
+
+    /**
+     * Get the metadata of an object.
+     * @param value     The object
+     *
+     * @return the metadata
+     */
+    template <typename KT, typename VT>
+    ObjectMetadata get_object_metadata(const VT& value);
+
+    /**
+     * Get the metadata of a key without value.
+     */
+    inline ObjectMetadata get_null_object_metadata();
+
     /**
      * CriticalDataPathObserver
      *
@@ -54,6 +421,94 @@ namespace cascade {
                                   ICascadeContext* cascade_ctxt) {}
     };
 
+    /**
+     * SecondaryIndexExtractor
+     *
+     * @tparam CascadeType - the SecondaryIndexExtractor for corresponding cascade type.
+     *
+     * A SecondaryIndexExtractor derives the secondary keys of an object, by which lookup_by_index() finds it. Like the
+     * CriticalDataPathObserver, it is loaded from the ondata library. The stores call it in the ordered handlers with
+     * kv_map_mutex held, so it must be deterministic and cheap.
+     */
+    template<typename CascadeType>
+    class SecondaryIndexExtractor: public derecho::DeserializationContext {
+    public:
+        /**
+         * Extract the secondary keys of an object. The default extracts none, so that nothing is indexed.
+         *
+         * @param subgroup_idx
+         * @param shard_idx
+         * @param key
+         * @param value
+         *
+         * @return the secondary keys of the object, an object without any is not in the index.
+         */
+        virtual std::vector<std::string> operator () (const uint32_t subgroup_idx,
+                                                      const uint32_t shard_idx,
+                                                      const typename CascadeType::KeyType& key,
+                                                      const typename CascadeType::ObjectType& value) {
+            return {};
+        }
+    };
+
+    /**
+     * SecondaryIndex
+     *
+     * SecondaryIndex maps the secondary keys of the objects in a shard to their primary keys. It is built from the
+     * whole kv_map by the first lookup, once the subgroup and the shard of the store are known, and follows the updates
+     * of kv_map afterwards; before that, the updates are ignored. The stores guard it with kv_map_mutex.
+     */
+    template <typename KT, typename VT, KT* IK>
+    class SecondaryIndex {
+    public:
+        using ExtractFunc = std::function<std::vector<std::string>(const KT&, const VT&)>;
+    private:
+        /* the extractor bound to the subgroup and the shard, empty until the index is built */
+        ExtractFunc extract;
+        /* secondary key -> primary keys */
+        std::map<std::string,std::set<KT>> index;
+        /* primary key -> secondary keys, to drop the stale entries on update */
+        std::map<KT,std::vector<std::string>> secondary_keys;
+    public:
+        /**
+         * @return true if the index is built.
+         */
+        bool is_built() const;
+        /**
+         * Build the index from a kv_map.
+         * @param _extract  The extractor, kept to index the updates.
+         * @param kv_map
+         */
+        template <typename MapType>
+        void build(const ExtractFunc& _extract, const MapType& kv_map);
+        /**
+         * Index a put.
+         * @param key
+         * @param value
+         */
+        void on_update(const KT& key, const VT& value);
+        /**
+         * Drop a removed or evicted key.
+         * @param key
+         */
+        void on_erase(const KT& key);
+        /**
+         * Look up a page of the objects with a secondary key, in ascending primary key order. The page is bounded like
+         * scan_kv_map().
+         * @param kv_map        The kv_map of the indexed objects.
+         * @param secondary_key
+         * @param start_after   The last primary key of the previous page, or *IK for the first page.
+         * @param limit         The maximum number of keys in the page, 0 for no limit other than max_bytes.
+         * @param with_values   If true, the page has the values of the keys.
+         * @param max_bytes     The size limit of the page.
+         *
+         * @return the page
+         */
+        template <typename MapType>
+        ScanPage<KT,VT> lookup(const MapType& kv_map, const std::string& secondary_key, const KT& start_after,
+                               const uint32_t& limit, bool with_values, const uint64_t& max_bytes) const;
+    };
+
     /**
      * The cascade store interface.
      * @tparam KT The type of the key
@@ -89,13 +544,36 @@ namespace cascade {
         /**
          * remove(const KT&)
          *
-         * Remove a value by key. The key will still be in the map with an empty value.
+         * Remove a value by key. The log keeps the removal, the current state drops the key.
          *
          * @param key
          *
-         * @return a tuple including version number (version_t) and a timestamp in microseconds.
+         * @return a tuple including version number (version_t) and a timestamp in microseconds. Removing an absent key
+         *         changes nothing, but still gets a version, so that a repeated remove succeeds.
          */
         virtual std::tuple<persistent::version_t,uint64_t> remove(const KT& key) const = 0;
+        /**
+         * put_batch(const std::vector<VT>&)
+         *
+         * Put a list of values in a single ordered send. The values share one version, and are applied in the order of
+         * the list. A key is put at most once per batch, since the values of one version cannot chain to each other;
+         * the later values of a repeated key are rejected.
+         *
+         * @param values
+         *
+         * @return a tuple of version number and timestamp for each value. A rejected value gets INVALID_VERSION.
+         */
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> put_batch(const std::vector<VT>& values) const = 0;
+        /**
+         * remove_batch(const std::vector<KT>&)
+         *
+         * Remove a list of keys in a single ordered send. The removals share one version.
+         *
+         * @param keys
+         *
+         * @return a tuple of version number and timestamp for each key, an absent key included.
+         */
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> remove_batch(const std::vector<KT>& keys) const = 0;
         /**
          * get(const KT&,const persistent::version_t&)
          *
@@ -106,24 +584,34 @@ namespace cascade {
          * @param exact The exact match flag: this function try to return the value of that key at the 'ver'. If such a
          *              value does not exists and exact is true, it will throw an exception. If such a value does not
          *              exists and exact is false, it will return the latest state of the value for 'key' before 'ver'.
-         *              The former case is very efficient but the latter one is not because of reconstructing the state.
-         *              Please note that the current Persistent<T> in derecho will reconstruct the state at 'ver' from
-         *              the beginning of the log entry if 'ver' != CURRENT_VERSION, which is extremely inefficient.
-         *              TODO: use checkpoint cache to accelerate that process.
+         *              Please note that PersistentCascadeStore finds the latter in the version index of 'key' with a
+         *              binary search.
          *
          * @return a value
          *
          * @throws std::runtime_error, if requested value is not found.
          */
         virtual const VT get(const KT& key, const persistent::version_t& ver, bool exact=false) const = 0;
+        /**
+         * multi_get(const std::vector<KT>&,const persistent::version_t&)
+         *
+         * Get the values of a list of keys in one request.
+         *
+         * @param keys
+         * @param ver   Version: if version == CURRENT_VERSION, get the latest values with a single ordered send.
+         *              Otherwise, get the latest value of each key no later than 'ver', as get(key,ver,false) does.
+         *
+         * @return the values in the order of 'keys'. A missing key gets an invalid value.
+         */
+        virtual std::vector<VT> multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const = 0;
         /**
          * get(const KT&, const uint64_t& ts_us)
          * 
          * Get a value by key and timestamp.
          *
-         * Please note that the current Persistent<T> in derecho will reconstruct the state at 'ts_us' from the
-         * beginning of the log entry, which is extremely inefficient. TODO: use checkpoint cache to accelerate that
-         * process.
+         * Please note that PersistentCascadeStore finds the value in the version index of 'key' with a binary search if VT
+         * implements IKeepTimestamp. Otherwise, it reconstructs the state at 'ts_us', replaying the log from the nearest
+         * earlier checkpoint in its CheckpointCache.
          *
          * @param key
          * @param ts_us - timestamp in microsecond
@@ -137,9 +625,8 @@ namespace cascade {
          * List keys at version.
          *
          * @param ver - Version, if version  == CURRENT_VERSION, get the latest list of keys.
-         *              Please note that the current Persistent<T> in derecho will reconstruct the state at 'ver' from
-         *              the beginning of the log entry if 'ver' != CURRENT_VERSION, which is extremely inefficient.
-         *              TODO: use checkpoint cache to accelerate that process.
+         *              Please note that PersistentCascadeStore reconstructs the state at 'ver' if 'ver' !=
+         *              CURRENT_VERSION, replaying the log from the nearest earlier checkpoint in its CheckpointCache.
          *
          * @return a list of keys.
          */
@@ -149,15 +636,74 @@ namespace cascade {
          *
          * List keys by timestamp
          *
-         * Please note that the current Persistent<T> in derecho will reconstruct the state at 'ts_us' from the
-         * beginning of the log entry, which is extremely inefficient. TODO: use checkpoint cache to accelerate that
-         * process.
+         * Please note that PersistentCascadeStore reconstructs the state at 'ts_us', replaying the log from the nearest
+         * earlier checkpoint in its CheckpointCache.
          *
          * @param ts_us - timestamp in microsecond
          *
          * @return a list of keys.
          */
         virtual std::vector<KT> list_keys_by_time(const uint64_t& ts_us) const = 0;
+        /**
+         * version_at_time(const uint64_t&)
+         *
+         * Resolve a timestamp to the version of the latest state no later than it, so that the reads of many keys at
+         * that time can use the version instead. The stores without log do not support this.
+         *
+         * @param ts_us - timestamp in microsecond
+         *
+         * @return the version, or persistent::INVALID_VERSION if there is no state at the timestamp.
+         */
+        virtual persistent::version_t version_at_time(const uint64_t& ts_us) const = 0;
+        /**
+         * scan(const std::string&,const KT&,const uint32_t&,bool,const persistent::version_t&)
+         *
+         * Scan the keys, and optionally the values, page by page in ascending key order. A page is bounded by 'limit'
+         * and by CONF_SCAN_MAX_PAGE_BYTES, so that it fits in a reply.
+         *
+         * @param prefix        Only the keys starting with 'prefix' are returned. It must be empty unless KT is
+         *                      std::string.
+         * @param start_after   The last key of the previous page, or *IK for the first page.
+         * @param limit         The maximum number of keys in the page, 0 for no limit other than the page size.
+         * @param with_values   If true, the page has the values of the keys.
+         * @param ver           Version, if version == CURRENT_VERSION, scan the latest state.
+         *
+         * @return a page of keys.
+         */
+        virtual ScanPage<KT,VT> scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                     bool with_values, const persistent::version_t& ver) const = 0;
+        /**
+         * query(const ShardQuery<KT>&,const KT&,const uint32_t&,const persistent::version_t&)
+         *
+         * Evaluate a query on the shard and return a page of the matches, or the aggregate of all matches. Please see
+         * ShardQuery for the predicates. The matches are paged like scan().
+         *
+         * @param query         The query
+         * @param start_after   The last key of the previous page, or *IK for the first page.
+         * @param limit         The maximum number of matches in the page, 0 for no limit other than the page size.
+         * @param ver           Version, if version == CURRENT_VERSION, query the latest state.
+         *
+         * @return a page of matches.
+         */
+        virtual QueryPage<KT,VT> query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit,
+                                       const persistent::version_t& ver) const = 0;
+        /**
+         * lookup_by_index(const std::string&,const KT&,const uint32_t&,bool,const persistent::version_t&)
+         *
+         * Look up the objects by a secondary key derived by the SecondaryIndexExtractor of the store, page by page in
+         * ascending key order. The pages are bounded like scan(). Nothing is found without an extractor.
+         *
+         * @param secondary_key The secondary key
+         * @param start_after   The last key of the previous page, or *IK for the first page.
+         * @param limit         The maximum number of keys in the page, 0 for no limit other than the page size.
+         * @param with_values   If true, the page has the values of the keys.
+         * @param ver           Version, only CURRENT_VERSION is supported.
+         *
+         * @return a page of keys.
+         */
+        virtual ScanPage<KT,VT> lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                const uint32_t& limit, bool with_values,
+                                                const persistent::version_t& ver) const = 0;
         /**
          * get_size(const KT&,const persistent::version_t&,bool)
          *
@@ -168,10 +714,8 @@ namespace cascade {
          * @param exact The exact match flag: this function try to return the value of that key at the 'ver'. If such a
          *              value does not exists and exact is true, it will throw an exception. If such a value does not
          *              exists and exact is false, it will return the latest state of the value for 'key' before 'ver'.
-         *              The former case is very efficient but the latter one is not because of reconstructing the state.
-         *              Please note that the current Persistent<T> in derecho will reconstruct the state at 'ver' from
-         *              the beginning of the log entry if 'ver' != CURRENT_VERSION, which is extremely inefficient.
-         *              TODO: use checkpoint cache to accelerate that process.
+         *              Please note that PersistentCascadeStore finds the latter in the version index of 'key' with a
+         *              binary search.
          *
          * @return the size of serialized value.
          */
@@ -181,9 +725,9 @@ namespace cascade {
          *
          * Get size by timestamp
          *
-         * Please note that the current Persistent<T> in derecho will reconstruct the state at 'ts_us' from the
-         * beginning of the log entry, which is extremely inefficient. TODO: use checkpoint cache to accelerate that
-         * process.
+         * Please note that PersistentCascadeStore finds the value in the version index of 'key' with a binary search if VT
+         * implements IKeepTimestamp. Otherwise, it reconstructs the state at 'ts_us', replaying the log from the nearest
+         * earlier checkpoint in its CheckpointCache.
          *
          * @param key
          * @param ts_us - timestamp in microsecond
@@ -191,6 +735,41 @@ namespace cascade {
          * @return the size of serialized value.
          */
         virtual uint64_t get_size_by_time(const KT& key, const uint64_t& ts_us) const = 0;
+        /**
+         * head(const KT&,const persistent::version_t&,bool)
+         *
+         * Get the metadata of a value by version, without the blob. Please see get() for the arguments.
+         *
+         * @return the metadata of the value. It is null if there is no such value.
+         */
+        virtual ObjectMetadata head(const KT& key, const persistent::version_t& ver, bool exact=false) const = 0;
+        /**
+         * get_local(const KT&,const ReadConsistency&,const persistent::version_t&,const uint64_t&)
+         *
+         * Get the latest value of a key from the local state of the contacted replica. Unlike get(key,CURRENT_VERSION),
+         * which issues an ordered send to the whole shard, get_local does not talk to other replicas unless the local
+         * state does not satisfy the consistency level. In that case it falls back to get(key,CURRENT_VERSION), and
+         * blocks until the shard delivers it. Please see ReadConsistency for details.
+         *
+         * @param key
+         * @param consistency       The consistency level
+         * @param read_point        The request point for ReadConsistency::ReadYourWrites
+         * @param max_staleness_us  The idle bound in microseconds for ReadConsistency::RecentlyDelivered
+         *
+         * @return a value
+         */
+        virtual const VT get_local(const KT& key, const ReadConsistency& consistency,
+                                   const persistent::version_t& read_point, const uint64_t& max_staleness_us) const = 0;
+        /**
+         * get_size_local(const KT&,const ReadConsistency&,const persistent::version_t&,const uint64_t&)
+         *
+         * Get the size of the latest value of a key from the local state of the contacted replica. Please see get_local
+         * for the arguments.
+         *
+         * @return the size of serialized value.
+         */
+        virtual uint64_t get_size_local(const KT& key, const ReadConsistency& consistency,
+                                        const persistent::version_t& read_point, const uint64_t& max_staleness_us) const = 0;
 
     protected:
         /**
@@ -205,21 +784,193 @@ namespace cascade {
          * @return a tuple including version number (version_t) and a timestamp in microseconds.
          */
         virtual std::tuple<persistent::version_t,uint64_t> ordered_remove(const KT& key) = 0;
+        /**
+         * ordered_put_batch
+         * @param values
+         * @return a tuple of version number and timestamp for each value.
+         */
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_put_batch(const std::vector<VT>& values) = 0;
+        /**
+         * ordered_remove_batch
+         * @param keys
+         * @return a tuple of version number and timestamp for each key.
+         */
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_remove_batch(const std::vector<KT>& keys) = 0;
         /**
          * ordered_get
          * @param key
          * @return a value
          */
         virtual const VT ordered_get(const KT& key) = 0;
+        /**
+         * ordered_multi_get
+         * @param keys
+         * @return the values in the order of 'keys'
+         */
+        virtual std::vector<VT> ordered_multi_get(const std::vector<KT>& keys) = 0;
         /**
          * ordered_list_keys
          * @return a list of keys.
          */
         virtual std::vector<KT> ordered_list_keys() = 0;
+        /**
+         * ordered_scan
+         * @return a page of keys.
+         */
+        virtual ScanPage<KT,VT> ordered_scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                             bool with_values) = 0;
+        /**
+         * ordered_query
+         * @return a page of matches.
+         */
+        virtual QueryPage<KT,VT> ordered_query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit) = 0;
+        /**
+         * ordered_lookup_by_index
+         * @return a page of keys.
+         */
+        virtual ScanPage<KT,VT> ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                        const uint32_t& limit, bool with_values) = 0;
         /**
          * ordered_get_size
          */
         virtual uint64_t ordered_get_size(const KT& key) = 0;
+        /**
+         * ordered_head
+         */
+        virtual ObjectMetadata ordered_head(const KT& key) = 0;
+    };
+
+#define CONF_VCS_MAX_BYTES          "CASCADE/vcs_max_bytes"
+#define CONF_VCS_OBJECT_TTL_SEC     "CASCADE/vcs_object_ttl_sec"
+#define DEFAULT_VCS_MAX_BYTES       (0)
+#define DEFAULT_VCS_OBJECT_TTL_SEC  (0)
+#define CONF_VCS_STATE_TRANSFER_CHUNK_BYTES     "CASCADE/vcs_state_transfer_chunk_bytes"
+#define CONF_VCS_STATE_TRANSFER_MAX_RETRIES     "CASCADE/vcs_state_transfer_max_retries"
+#define DEFAULT_VCS_STATE_TRANSFER_CHUNK_BYTES  (0)
+#define DEFAULT_VCS_STATE_TRANSFER_MAX_RETRIES  (100)
+
+    /**
+     * Get the chunk size of the state transfer of VolatileCascadeStore, CONF_VCS_STATE_TRANSFER_CHUNK_BYTES. Zero means
+     * the whole kv_map goes with the state transferred by derecho.
+     */
+    inline uint64_t get_vcs_state_transfer_chunk_bytes();
+
+    /**
+     * Get the number of pulls in a row that may fail before a new replica gives up its chunked state transfer,
+     * CONF_VCS_STATE_TRANSFER_MAX_RETRIES.
+     */
+    inline uint32_t get_vcs_state_transfer_max_retries();
+
+    /**
+     * StateChunk
+     *
+     * A chunk of the state of a VolatileCascadeStore pulled by a new replica: a page of kv_map and the version of the
+     * last update applied to kv_map when the page was read, so that the page is the state of its keys at that version.
+     */
+    template <typename KT, typename VT>
+    class StateChunk : public mutils::ByteRepresentable {
+    public:
+        /* false if the replica is transferring its own state, so ask another one */
+        bool                    ready;
+        persistent::version_t   version;
+        ScanPage<KT,VT>         page;
+
+        StateChunk(): ready(false), version(persistent::INVALID_VERSION) {}
+        StateChunk(bool _ready, const persistent::version_t& _version, const ScanPage<KT,VT>& _page):
+            ready(_ready), version(_version), page(_page) {}
+
+        DEFAULT_SERIALIZATION_SUPPORT(StateChunk,ready,version,page);
+    };
+
+    /**
+     * ClockEvictionPolicy
+     *
+     * ClockEvictionPolicy lets a VolatileCascadeStore shard behave like a cache. It caps the serialized size of the keys
+     * and values at CONF_VCS_MAX_BYTES, and expires an object CONF_VCS_OBJECT_TTL_SEC seconds after its last update.
+     * Zero disables the corresponding limit. The expired keys are evicted first. Then the CLOCK algorithm picks the
+     * victims until the shard fits in the budget: the hand sweeps a ring of the keys, clearing the reference bit of a
+     * key if it is set, and evicting the key otherwise. Updates and ordered reads set the reference bit.
+     *
+     * Only the ordered handlers drive the policy, with the timestamps of the ordered messages, so that all replicas
+     * evict the same keys. The local read path does not touch it. The ring is part of the state of the store, so that a
+     * new replica continues with the same decisions; the other members are derived from the ring.
+     */
+    template <typename KT>
+    class ClockEvictionPolicy : public mutils::ByteRepresentable {
+    private:
+        static constexpr uint8_t SLOT_VALID = 0x1;
+        static constexpr uint8_t SLOT_REFERENCED = 0x2;
+        /* the ring, in slots */
+        std::vector<KT>         ring_keys;
+        std::vector<uint64_t>   ring_sizes;
+        /* the time a key expires, 0 for never */
+        std::vector<uint64_t>   ring_expire_us;
+        std::vector<uint8_t>    ring_flags;
+        uint64_t                hand;
+        uint64_t                total_bytes;
+        /* key -> slot */
+        KVIndex<KT,uint64_t>    slots;
+        /* the invalid slots, reused from the lowest */
+        std::set<uint64_t>      free_slots;
+        /* (expire_us, slot) */
+        std::set<std::pair<uint64_t,uint64_t>> expiry_index;
+        uint64_t                max_bytes;
+        uint64_t                ttl_us;
+        /* load the limits from the configuration */
+        void load_config();
+        /* release a slot */
+        void release(const uint64_t slot);
+    public:
+        /**
+         * Test if any limit is enabled. If not, the policy does nothing.
+         */
+        bool is_enabled() const;
+        /**
+         * A key is updated by an ordered handler.
+         * @param key
+         * @param size      The serialized size of the key and the value
+         * @param now_us    The timestamp of the update
+         */
+        void on_update(const KT& key, const uint64_t& size, const uint64_t& now_us);
+        /**
+         * A key is read by an ordered handler.
+         * @param key
+         */
+        void on_access(const KT& key);
+        /**
+         * A key is dropped from the store other than by evict().
+         * @param key
+         */
+        void on_erase(const KT& key);
+        /**
+         * Pick the victims: the keys expired at now_us, and then the keys picked by the CLOCK hand until the total size
+         * fits in the budget. The victims are dropped from the policy; the caller drops them from the store.
+         * @param now_us    The timestamp of the ordered message being delivered
+         *
+         * @return the victims
+         */
+        std::vector<KT> evict(const uint64_t& now_us);
+        /**
+         * Get the total size of the tracked keys.
+         */
+        uint64_t get_total_bytes() const;
+        /**
+         * Replace the limits loaded from the configuration, for a user other than VolatileCascadeStore.
+         * @param _max_bytes
+         * @param _ttl_us
+         */
+        void set_limits(const uint64_t _max_bytes, const uint64_t _ttl_us);
+
+        DEFAULT_SERIALIZATION_SUPPORT(ClockEvictionPolicy,ring_keys,ring_sizes,ring_expire_us,ring_flags,hand,total_bytes);
+
+        /* constructors */
+        ClockEvictionPolicy();
+        ClockEvictionPolicy(const std::vector<KT>& _ring_keys,
+                            const std::vector<uint64_t>& _ring_sizes,
+                            const std::vector<uint64_t>& _ring_expire_us,
+                            const std::vector<uint8_t>& _ring_flags,
+                            const uint64_t _hand,
+                            const uint64_t _total_bytes);
     };
 
     /**
@@ -227,6 +978,22 @@ namespace cascade {
      * 
      * VolatileCascadeStore is highly efficient by manage all the data only in the memory without implementing the heavy
      * log mechanism. Reading by version or time will always return invlaid value.
+     *
+     * If CONF_VCS_STATE_TRANSFER_CHUNK_BYTES is set, the state transferred by derecho to a new replica leaves kv_map
+     * out, so that the view change does not wait for it. The new replica then pulls kv_map from the other members of
+     * the shard in chunks of that size, in key order. The last key applied is the cursor, so the transfer resumes from
+     * another member if one fails. After CONF_VCS_STATE_TRANSFER_MAX_RETRIES failures in a row, the transfer gives up
+     * with an error, and the replica stays marked as transferring, so that it never serves its incomplete state.
+     *
+     * A chunk is the state of its keys at the version the sender has applied when reading it. The new replica applies
+     * it once it has delivered that version itself, so that the chunk and the ordered updates delivered to the new
+     * replica never overlap. The ordered handlers never block on the transfer:
+     * - the ordered updates apply as usual. A key they touch keeps the value of the new replica, unless an update
+     *   depends on a previous value not pulled yet; such a key is uncertain until a chunk, or a pull of the uncertain
+     *   keys at the end of the transfer, brings its state at a version no older than its last update;
+     * - the replies of the new replica might depend on the keys not pulled yet, so the members issuing the ordered
+     *   sends pick the replies of the other members, and the local reads of the new replica fall back to the ordered
+     *   ones.
      */
     template <typename KT, typename VT, KT* IK, VT* IV>
     class VolatileCascadeStore : public ICascadeStore<KT, VT, IK, IV>,
@@ -235,49 +1002,227 @@ namespace cascade {
     public:
         /* group reference */
         using derecho::GroupReference::group;
-        /* volatile cascade store in memory */
-        std::map<KT,VT> kv_map;
+        /* volatile cascade store in memory, holding the live keys only */
+        KVIndex<KT,VT> kv_map;
         /* record the version of latest update */
         persistent::version_t update_version;
         /* watcher */
         CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cascade_watcher_ptr;
         /* cascade context */
         ICascadeContext* cascade_context_ptr;
+        /* secondary index extractor */
+        SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* secondary_index_extractor_ptr;
+        /* the secondary index, guarded by kv_map_mutex */
+        SecondaryIndex<KT,VT,IK> secondary_index;
+        /* kv_map_mutex guards kv_map against the local read path, which runs concurrently with the ordered handlers */
+        mutable std::shared_mutex kv_map_mutex;
+        /* the delivered frontier for the local read path */
+        DeliveredFrontier frontier;
+        /* the scan order of the subgroup, loaded by the first ordered put once the group is known */
+        bool scan_config_loaded;
+        bool ordered_scans;
+        /* the memory budget and the TTL */
+        ClockEvictionPolicy<KT> eviction_policy;
+        /* the version of the last update to kv_map, evictions included, guarded by kv_map_mutex */
+        persistent::version_t state_version;
+        /* true while this replica pulls kv_map from the other members of the shard */
+        std::atomic<bool> transfer_active;
+        /* the state_version transferred by derecho, which this replica never delivers */
+        persistent::version_t transfer_base_version;
+        /* the last key pulled, from which the transfer resumes */
+        KT transfer_cursor;
+        /* true once the chunks have covered all the keys */
+        bool transfer_swept;
+        /* true if the transfer gave up and left kv_map incomplete, guarded by kv_map_mutex */
+        bool transfer_failed;
+        /* the keys updated, removed or evicted during the transfer, with the version of the last update, guarded by
+         * kv_map_mutex */
+        KVIndex<KT,persistent::version_t> transfer_touched;
+        /* the touched keys whose value depends on a previous value not pulled yet, guarded by kv_map_mutex */
+        std::map<KT,persistent::version_t> transfer_uncertain;
+        std::atomic<bool> transfer_thread_alive;
+        mutable std::mutex transfer_mutex;
+        mutable std::condition_variable transfer_cv;
+        std::thread transfer_thread;
         
         REGISTER_RPC_FUNCTIONS(VolatileCascadeStore,
                                P2P_TARGETS(
                                    put,
                                    remove,
+                                   put_batch,
+                                   remove_batch,
                                    get,
+                                   multi_get,
                                    get_by_time,
                                    list_keys,
                                    list_keys_by_time,
+                                   version_at_time,
+                                   scan,
+                                   query,
+                                   lookup_by_index,
                                    get_size,
-                                   get_size_by_time),
+                                   get_size_by_time,
+                                   head,
+                                   get_local,
+                                   get_size_local,
+                                   get_state_chunk,
+                                   get_state_objects),
                                ORDERED_TARGETS(
                                    ordered_put,
                                    ordered_remove,
+                                   ordered_put_batch,
+                                   ordered_remove_batch,
                                    ordered_get,
+                                   ordered_multi_get,
                                    ordered_list_keys,
-                                   ordered_get_size));
+                                   ordered_scan,
+                                   ordered_query,
+                                   ordered_lookup_by_index,
+                                   ordered_get_size,
+                                   ordered_head));
         virtual std::tuple<persistent::version_t,uint64_t> put(const VT& value) const override;
         virtual std::tuple<persistent::version_t,uint64_t> remove(const KT& key) const override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> put_batch(const std::vector<VT>& values) const override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> remove_batch(const std::vector<KT>& keys) const override;
         virtual const VT get(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual std::vector<VT> multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const override;
         virtual const VT get_by_time(const KT& key, const uint64_t& ts_us) const override;
         virtual std::vector<KT> list_keys(const persistent::version_t& ver) const override;
         virtual std::vector<KT> list_keys_by_time(const uint64_t& ts_us) const override;
+        virtual persistent::version_t version_at_time(const uint64_t& ts_us) const override;
+        virtual ScanPage<KT,VT> scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                     bool with_values, const persistent::version_t& ver) const override;
+        virtual QueryPage<KT,VT> query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit,
+                                       const persistent::version_t& ver) const override;
+        virtual ScanPage<KT,VT> lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                const uint32_t& limit, bool with_values,
+                                                const persistent::version_t& ver) const override;
         virtual uint64_t get_size(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
         virtual uint64_t get_size_by_time(const KT& key, const uint64_t& ts_us) const override;
+        virtual ObjectMetadata head(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual const VT get_local(const KT& key, const ReadConsistency& consistency,
+                                   const persistent::version_t& read_point, const uint64_t& max_staleness_us) const override;
+        virtual uint64_t get_size_local(const KT& key, const ReadConsistency& consistency,
+                                        const persistent::version_t& read_point, const uint64_t& max_staleness_us) const override;
         virtual std::tuple<persistent::version_t,uint64_t> ordered_put(const VT& value) override;
         virtual std::tuple<persistent::version_t,uint64_t> ordered_remove(const KT& key) override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_put_batch(const std::vector<VT>& values) override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_remove_batch(const std::vector<KT>& keys) override;
         virtual const VT ordered_get(const KT& key) override;
+        virtual std::vector<VT> ordered_multi_get(const std::vector<KT>& keys) override;
         virtual std::vector<KT> ordered_list_keys() override;
+        virtual ScanPage<KT,VT> ordered_scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                             bool with_values) override;
+        virtual QueryPage<KT,VT> ordered_query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit) override;
+        virtual ScanPage<KT,VT> ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                        const uint32_t& limit, bool with_values) override;
         virtual uint64_t ordered_get_size(const KT& key) override;
+        virtual ObjectMetadata ordered_head(const KT& key) override;
 
-        // serialization support
-        DEFAULT_SERIALIZE(kv_map,update_version);
-
-        static std::unique_ptr<VolatileCascadeStore> from_bytes(mutils::DeserializationManager* dsm, char const* buf);
+        /**
+         * Apply a put to kv_map with a given version and timestamp, and notify the critical data path observer.
+         * @param value
+         * @param version_and_timestamp
+         *
+         * @return false if the put is rejected by previous version verification.
+         */
+        bool apply_ordered_put(const VT& value, const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Apply a remove to kv_map with a given version and timestamp, and notify the critical data path observer.
+         * @param key
+         * @param version_and_timestamp
+         *
+         * @return false if there is no such key.
+         */
+        bool apply_ordered_remove(const KT& key, const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Build secondary_index with the extractor if it is not built yet. Called with kv_map_mutex locked exclusively.
+         */
+        void build_secondary_index();
+        /**
+         * Evict the expired keys and the keys over the memory budget, as picked by eviction_policy. Only the ordered
+         * handlers call this, with the version and timestamp of the message being delivered.
+         * @param version_and_timestamp
+         */
+        void evict(const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Wait for the replies of an ordered send and pick the one to return. A replica transferring its state might
+         * not have the keys a reply depends on, so the reply of this replica is picked unless it is transferring, in
+         * which case the reply of another member is.
+         * @param results       The results of the ordered send.
+         * @param wait_for_all  If true, wait for all the replies, not only the picked one.
+         *
+         * @return the picked reply.
+         */
+        template <typename ReplyType>
+        ReplyType pick_reply(derecho::rpc::QueryResults<ReplyType>& results, bool wait_for_all) const;
+
+        /**
+         * Get a chunk of kv_map for a new replica, in ascending key order.
+         * @param start_after   The cursor, the last key of the previous chunk, or *IK for the first chunk.
+         * @param max_bytes     The size limit of the chunk.
+         *
+         * @return the chunk, which is not ready if this replica is transferring its own state.
+         *
+         * A replica serving the chunks keeps the side index of the ordered keys from then on (see KVIndex), so that a
+         * chunk does not cost a pass over the whole kv_map.
+         */
+        StateChunk<KT,VT> get_state_chunk(const KT& start_after, const uint64_t& max_bytes);
+        /**
+         * Get some objects for a new replica, which are uncertain after the chunks have covered them.
+         * @param keys
+         *
+         * @return a chunk of the keys found, like get_state_chunk().
+         */
+        StateChunk<KT,VT> get_state_objects(const std::vector<KT>& keys) const;
+        /**
+         * Adopt the state of a key pulled from another replica. Called with kv_map_mutex locked exclusively.
+         * @param key
+         * @param value     The value of the key, or nullptr if the other replica does not have the key.
+         */
+        void adopt_state(const KT& key, VT* value);
+        /**
+         * Apply a chunk, which covers the keys after transfer_cursor up to its last key, or all of them if it is the
+         * last chunk. Called with kv_map_mutex locked exclusively, after this replica has delivered chunk.version.
+         * @param chunk
+         */
+        void apply_state_chunk(StateChunk<KT,VT>& chunk);
+        /**
+         * Apply the objects pulled for some uncertain keys. Called with kv_map_mutex locked exclusively, after this
+         * replica has delivered chunk.version.
+         * @param keys      The keys pulled.
+         * @param chunk     The objects found.
+         */
+        void apply_state_objects(const std::vector<KT>& keys, StateChunk<KT,VT>& chunk);
+        /**
+         * Record a key touched by the ordered handlers during the transfer. Called with kv_map_mutex locked
+         * exclusively.
+         * @param key
+         * @param version
+         * @param depends_on_previous   True if the update depends on the previous value of the key, like an update
+         *                              verifying or keeping the previous version.
+         */
+        void touch_during_transfer(const KT& key, const persistent::version_t& version, bool depends_on_previous);
+        /**
+         * Wait until this replica has delivered a version, so that the updates in a chunk of that version are not
+         * delivered again after it is applied.
+         * @param version
+         *
+         * @return false if it times out or the store is shutting down.
+         */
+        bool wait_for_delivery(const persistent::version_t& version);
+        /**
+         * The transfer thread: pull kv_map chunk by chunk from the other members of the shard, then the keys left
+         * uncertain.
+         */
+        void state_transfer_loop();
+
+        // serialization support
+        std::size_t to_bytes(char* buf) const;
+        void post_object(const std::function<void(char const* const, std::size_t)>& f) const;
+        std::size_t bytes_size() const;
+
+        static std::unique_ptr<VolatileCascadeStore> from_bytes(mutils::DeserializationManager* dsm, char const* buf);
 
         DEFAULT_DESERIALIZE_NOALLOC(VolatileCascadeStore);
 
@@ -285,15 +1230,127 @@ namespace cascade {
 
         /* constructors */
         VolatileCascadeStore(CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
-                             ICascadeContext* cc=nullptr);
-        VolatileCascadeStore(const std::map<KT,VT>& _kvm,
+                             ICascadeContext* cc=nullptr,
+                             SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* sie=nullptr);
+        VolatileCascadeStore(const KVIndex<KT,VT>& _kvm,
                              persistent::version_t _uv,
                              CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
-                             ICascadeContext* cc=nullptr); // copy kv_map
-        VolatileCascadeStore(std::map<KT,VT>&& _kvm,
+                             ICascadeContext* cc=nullptr,
+                             SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* sie=nullptr); // copy kv_map
+        VolatileCascadeStore(KVIndex<KT,VT>&& _kvm,
                              persistent::version_t _uv,
+                             ClockEvictionPolicy<KT>&& _ep,
                              CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
-                             ICascadeContext* cc=nullptr); // move kv_map
+                             ICascadeContext* cc=nullptr,
+                             SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* sie=nullptr); // move kv_map and eviction policy
+        /* destructor */
+        virtual ~VolatileCascadeStore();
+    };
+
+#define CONF_WIRE_COMPRESSION_CODEC     "CASCADE/wire_compression_codec"
+#define CONF_LOG_COMPRESSION_CODEC      "CASCADE/log_compression_codec"
+#define CONF_COMPRESSION_MIN_BYTES      "CASCADE/compression_min_bytes"
+#define DEFAULT_WIRE_COMPRESSION_CODEC  BLOB_CODEC_NAME_NONE
+#define DEFAULT_LOG_COMPRESSION_CODEC   BLOB_CODEC_NAME_NONE
+#define DEFAULT_COMPRESSION_MIN_BYTES   (4096)
+/* the per subgroup log compression in the layout dict of a subgroup, with the keys below */
+#define JSON_CONF_COMPRESSION               "compression"
+#define JSON_CONF_COMPRESSION_CODEC         "codec"
+#define JSON_CONF_COMPRESSION_MIN_BYTES     "min_bytes"
+
+    /**
+     * Get the compression of the blobs serialized out of any BlobCompressionScope, which are the put/get payloads on
+     * the wire: CONF_WIRE_COMPRESSION_CODEC and CONF_COMPRESSION_MIN_BYTES. It is loaded once per process.
+     */
+    const BlobCompression& get_wire_compression();
+
+    /**
+     * Get the size of an object serialized with its blobs raw. The in-memory sizes, like get_size(), head() and the
+     * eviction and checkpoint accounting, use it, so that they neither depend on the wire compression of the node nor
+     * compress the blobs to measure them.
+     * @param object    The object
+     */
+    template <typename T>
+    std::size_t get_raw_size(const T& object);
+
+    /**
+     * Load the compression of the blobs in the log of a subgroup: CONF_LOG_COMPRESSION_CODEC and
+     * CONF_COMPRESSION_MIN_BYTES, overridden by the "compression" dict in the layout of the subgroup.
+     * @param subgroup_id   The subgroup id.
+     */
+    BlobCompression load_log_compression(const derecho::subgroup_id_t subgroup_id);
+
+#define CONF_DELTA_BUFFER_POOL_MB       "CASCADE/delta_buffer_pool_mb"
+#define DEFAULT_DELTA_BUFFER_POOL_MB    (64)
+
+    /**
+     * DeltaBufferPool
+     *
+     * DeltaBufferPool keeps the idle delta buffers of the persistent stores in the process, in power-of-two size
+     * classes. A delta growing past its buffer takes one of the size class it needs from the pool and returns the old
+     * one, instead of realloc'ing and copying the old capacity, and it returns a big buffer after the delta is
+     * finalized, so that a shard which once logged a big object does not hold a big buffer forever. The idle buffers
+     * are capped at CONF_DELTA_BUFFER_POOL_MB; the buffers beyond that are freed.
+     */
+    class DeltaBufferPool {
+    private:
+        std::mutex pool_mutex;
+        /* size class -> idle buffers */
+        std::map<std::size_t,std::vector<char*>> idle_buffers;
+        std::size_t idle_bytes;
+        std::size_t capacity;
+        DeltaBufferPool();
+    public:
+        /**
+         * Get the pool of the process.
+         */
+        static DeltaBufferPool& get();
+        /**
+         * Get the size class of a buffer holding 'size' bytes: the next power of two, at least
+         * DEFAULT_DELTA_BUFFER_CAPACITY.
+         * @param size
+         */
+        static std::size_t get_size_class(const std::size_t size);
+        /**
+         * Take a buffer of a size class, allocating one if the pool has none.
+         * @param size_class
+         *
+         * @return the buffer, throws derecho::derecho_exception if it cannot be allocated.
+         */
+        char* acquire(const std::size_t size_class);
+        /**
+         * Give a buffer of a size class back to the pool.
+         * @param buffer
+         * @param size_class
+         */
+        void release(char* buffer, const std::size_t size_class);
+    };
+
+    /* the first word of a log entry of DeltaCascadeStoreCore, which the entries of earlier releases do not have */
+#define DELTA_FORMAT_MAGIC (0x3147454c54444343ull)
+    /**
+     * LoggedObjects is a log entry of DeltaCascadeStoreCore read back: the objects updated in its version, in the order
+     * they are applied. It reads both layouts of the entries:
+     * 1) [DELTA_FORMAT_MAGIC:u64][num_objects:size_t][value_1]...[value_n], written by this release;
+     * 2) [value], the single object of the entries of earlier releases.
+     * An entry of an earlier release starting with DELTA_FORMAT_MAGIC would be misread. The objects of cascade start
+     * with their version, which would need a view id over 800 million to match it.
+     */
+    template <typename VT>
+    class LoggedObjects : public mutils::ByteRepresentable {
+    public:
+        std::vector<VT> values;
+
+        // serialization support, in the layout of this release
+        std::size_t to_bytes(char* buf) const;
+        void post_object(const std::function<void(char const* const, std::size_t)>& f) const;
+        std::size_t bytes_size() const;
+        static std::unique_ptr<LoggedObjects> from_bytes(mutils::DeserializationManager* dsm, char const* buf);
+        DEFAULT_DESERIALIZE_NOALLOC(LoggedObjects);
+        void ensure_registered(mutils::DeserializationManager&) {}
+
+        LoggedObjects() = default;
+        LoggedObjects(std::vector<VT>&& _values);
     };
 
     /**
@@ -330,29 +1387,73 @@ namespace cascade {
             char        first_data_byte;
         };
         
-        std::map<KT,VT> kv_map;
+        KVIndex<KT,VT> kv_map;
+        /* the compression of the blobs in the delta, set by PersistentCascadeStore for its subgroup */
+        BlobCompression log_compression;
+        /* applyDelta skips the log while PersistentCascadeStore recovers the state from a snapshot and the log tail */
+        bool replay_deferred;
 
         //////////////////////////////////////////////////////////////////////////
-        // Delta is represented by an operation id and a list of
-        // argument. The operation id (OPID) is a 4 bytes integer.
-        // 1) put(const Object& object):
-        // [OPID:PUT]   [value]
-        // 2) remove(const KT& key)
-        // [OPID:REMOVE][key]
-        // 3) get(const KT& key)
-        // no need to prepare a delta
+        // Delta is DELTA_FORMAT_MAGIC and a serialized std::vector<VT> holding
+        // the objects updated in a version, in the order they are applied:
+        // [DELTA_FORMAT_MAGIC:u64][num_objects:size_t][value_1]...[value_n]
+        // 1) put(const Object& object): one object
+        // 2) remove(const KT& key): one null object
+        // 3) put_batch/remove_batch: one object per accepted operation
+        // 4) get(const KT& key): no object
+        // A put may be logged with a BlobPatch against the previous version of
+        // the key, which replaying the log in order restores from kv_map.
+        // Every version has a delta, even with no object, so that the log can
+        // be replayed entry by entry. A batch holds at most one object per
+        // key. The log is read back as LoggedObjects, which also reads the
+        // entries of earlier releases, a single serialized VT without the
+        // magic, so that their logs are replayed as they are.
         ///////////////////////////////////////////////////////////////////////////
         virtual void finalizeCurrentDelta(const persistent::DeltaFinalizer& df) override;
         virtual void applyDelta(char const* const delta) override;
         static std::unique_ptr<DeltaCascadeStoreCore<KT,VT,IK,IV>> create(mutils::DeserializationManager* dm);
         /**
-         * apply put to current state
+         * apply put to current state. A null object removes the key from the current state; the tombstone stays in
+         * the log only.
          */
         void apply_ordered_put(const VT& value);
+        /**
+         * apply put to current state, moving the value into kv_map.
+         */
+        void apply_ordered_put(VT&& value);
+        /**
+         * append an object to the delta of the current version
+         */
+        void append_to_delta(const VT& value);
+        /**
+         * append an object to the delta of the current version as a BlobPatch against the current value of its key,
+         * if the patch is under half of the blob.
+         * @return true if the patch is appended, false if nothing is appended.
+         */
+        bool append_patch_to_delta(const VT& value);
+        /**
+         * restore the full blob of an object logged as a BlobPatch.
+         * @param value     The object with the patch, which gets the full blob.
+         * @param base      The previous version of the key.
+         * @throw derecho::derecho_exception if the patch does not fit the base.
+         */
+        static void restore_blob(VT& value, const VT& base);
+        /**
+         * make room in the delta for objects of 'size' serialized bytes, so that appending them does not grow the
+         * buffer.
+         */
+        void reserve_delta(const std::size_t size);
         /**
          * Ordered put, and generate a delta.
+         * @param value
+         * @param prever            The latest version of the store
+         * @param prev_ver_by_key   The latest version of the key, including a remove, or INVALID_VERSION. kv_map
+         *                          does not know it for a removed key, so the caller passes it.
+         * @param log_as_patch      Log the object as a BlobPatch against the current value of the key, if VT
+         *                          implements IHasBlobPatch and the patch pays off.
          */
-        virtual bool ordered_put(const VT& value, persistent::version_t prever);
+        virtual bool ordered_put(const VT& value, persistent::version_t prever, persistent::version_t prev_ver_by_key,
+                                 bool log_as_patch = false);
         /**
          * Ordered remove, and generate a delta.
          */
@@ -360,34 +1461,467 @@ namespace cascade {
         /**
          * ordered get, no need to generate a delta.
          */
-        virtual const VT ordered_get(const KT& key);
+        virtual const VT ordered_get(const KT& key) const;
+        virtual std::vector<VT> ordered_multi_get(const std::vector<KT>& keys) const;
         /**
          * ordered list_keys, no need to generate a delta.
          */
-        virtual std::vector<KT> ordered_list_keys();
+        virtual std::vector<KT> ordered_list_keys() const;
         /**
          * ordered get_size, not need to generate a delta.
          */
-        virtual uint64_t ordered_get_size(const KT& key);
+        virtual uint64_t ordered_get_size(const KT& key) const;
+        /**
+         * ordered head, not need to generate a delta.
+         */
+        virtual ObjectMetadata ordered_head(const KT& key) const;
 
         // serialization supports
         DEFAULT_SERIALIZATION_SUPPORT(DeltaCascadeStoreCore, kv_map);
 
         // constructors
         DeltaCascadeStoreCore();
-        DeltaCascadeStoreCore(const std::map<KT,VT>& _kv_map);
-        DeltaCascadeStoreCore(std::map<KT,VT>&& _kv_map);
+        DeltaCascadeStoreCore(const KVIndex<KT,VT>& _kv_map);
+        DeltaCascadeStoreCore(KVIndex<KT,VT>&& _kv_map);
 
         // destructor
         virtual ~DeltaCascadeStoreCore();
     };
 
+#define CONF_CHECKPOINT_INTERVAL_VERSIONS   "CASCADE/checkpoint_interval_versions"
+#define CONF_CHECKPOINT_INTERVAL_SEC        "CASCADE/checkpoint_interval_sec"
+#define CONF_CHECKPOINT_CACHE_SIZE_MB       "CASCADE/checkpoint_cache_size_mb"
+#define DEFAULT_CHECKPOINT_INTERVAL_VERSIONS    (100000)
+#define DEFAULT_CHECKPOINT_INTERVAL_SEC         (0)
+#define DEFAULT_CHECKPOINT_CACHE_SIZE_MB        (1024)
+
+    /**
+     * CheckpointCache
+     *
+     * CheckpointCache keeps the materialized states of a PersistentCascadeStore at some log indexes in memory, so that a
+     * temporal query replays the log from the nearest earlier checkpoint instead of the beginning of the log. The
+     * replays leave the checkpoints behind: one every CONF_CHECKPOINT_INTERVAL_VERSIONS log entries or every
+     * CONF_CHECKPOINT_INTERVAL_SEC seconds of log time, whichever comes first. The replay targets themselves are not
+     * cached unless they fall on that stride, so a scan over the history does not evict the checkpoints. Zero
+     * disables the corresponding interval. Once the total size of the checkpoints exceeds
+     * CONF_CHECKPOINT_CACHE_SIZE_MB, the checkpoint closest to its predecessor is evicted, so that the rest stay spread
+     * over the log. The checkpoints are immutable and shared by the readers.
+     */
+    template <typename CoreType>
+    class CheckpointCache {
+    private:
+        struct Checkpoint {
+            std::shared_ptr<const CoreType> state;
+            uint64_t timestamp_us;
+            uint64_t size;
+        };
+        mutable std::mutex cache_mutex;
+        /* log index -> checkpoint */
+        std::map<int64_t,Checkpoint> checkpoints;
+        uint64_t total_size;
+        int64_t interval_versions;
+        uint64_t interval_us;
+        uint64_t capacity;
+        /* evict checkpoints until the total size fits in capacity. The caller must hold cache_mutex. */
+        void evict();
+    public:
+        /**
+         * Constructor, loading the intervals and the capacity from the configuration.
+         */
+        CheckpointCache();
+        /**
+         * Find the nearest checkpoint at or before a log index.
+         * @param index     The log index
+         *
+         * @return a tuple of the index, the log timestamp, and the state of the checkpoint. The state is nullptr if
+         *         there is no such checkpoint.
+         */
+        std::tuple<int64_t,uint64_t,std::shared_ptr<const CoreType>> find(const int64_t& index) const;
+        /**
+         * Test if a replay should leave a checkpoint at a log index.
+         * @param index             The log index just replayed
+         * @param timestamp_us      The log timestamp of that index
+         * @param last_index        The log index of the last checkpoint
+         * @param last_timestamp_us The log timestamp of the last checkpoint
+         *
+         * @return true if a checkpoint is due.
+         */
+        bool is_due(const int64_t& index, const uint64_t& timestamp_us,
+                    const int64_t& last_index, const uint64_t& last_timestamp_us) const;
+        /**
+         * Put a checkpoint to the cache.
+         * @param index         The log index
+         * @param timestamp_us  The log timestamp of that index
+         * @param state         The state after replaying the log up to 'index'
+         */
+        void put(const int64_t& index, const uint64_t& timestamp_us, const std::shared_ptr<const CoreType>& state);
+        /**
+         * Drop the checkpoints before a log index, after the log is truncated there.
+         * @param index     The log index
+         */
+        void erase_before(const int64_t& index);
+    };
+
+#define CONF_GROUP_LAYOUT                   "CASCADE/group_layout"
+#define JSON_CONF_LAYOUT                    "layout"
+#define CONF_RETENTION_VERSIONS_PER_KEY     "CASCADE/retention_versions_per_key"
+#define CONF_RETENTION_SEC                  "CASCADE/retention_sec"
+#define CONF_RETENTION_LOG_SIZE_MB          "CASCADE/retention_log_size_mb"
+#define CONF_RETENTION_CHECK_INTERVAL_SEC   "CASCADE/retention_check_interval_sec"
+#define DEFAULT_RETENTION_VERSIONS_PER_KEY      (0)
+#define DEFAULT_RETENTION_SEC                   (0)
+#define DEFAULT_RETENTION_LOG_SIZE_MB           (0)
+#define DEFAULT_RETENTION_CHECK_INTERVAL_SEC    (60)
+#define CONF_SNAPSHOT_INTERVAL_VERSIONS     "CASCADE/snapshot_interval_versions"
+#define CONF_RECOVERY_THREADS               "CASCADE/recovery_threads"
+#define DEFAULT_SNAPSHOT_INTERVAL_VERSIONS      (0)
+#define DEFAULT_RECOVERY_THREADS                (0)
+/* the per subgroup retention in the layout dict of a subgroup, with the keys below */
+#define JSON_CONF_RETENTION                     "retention"
+#define JSON_CONF_RETENTION_VERSIONS_PER_KEY    "versions_per_key"
+#define JSON_CONF_RETENTION_SEC                 "sec"
+#define JSON_CONF_RETENTION_LOG_SIZE_MB         "log_size_mb"
+#define JSON_CONF_RETENTION_SNAPSHOT_INTERVAL_VERSIONS  "snapshot_interval_versions"
+#define CONF_DELTA_ENCODING_FULL_IMAGE_INTERVAL     "CASCADE/delta_encoding_full_image_interval"
+#define CONF_DELTA_ENCODING_MIN_BYTES               "CASCADE/delta_encoding_min_bytes"
+#define DEFAULT_DELTA_ENCODING_FULL_IMAGE_INTERVAL      (0)
+#define DEFAULT_DELTA_ENCODING_MIN_BYTES                (4096)
+/* the per subgroup delta encoding in the layout dict of a subgroup, with the keys below */
+#define JSON_CONF_DELTA_ENCODING                    "delta_encoding"
+#define JSON_CONF_DELTA_ENCODING_FULL_IMAGE_INTERVAL    "full_image_interval"
+#define JSON_CONF_DELTA_ENCODING_MIN_BYTES              "min_bytes"
+#define CONF_BLOB_TIER_CACHE_MB                     "CASCADE/blob_tier_cache_mb"
+#define CONF_BLOB_TIER_MIN_BYTES                    "CASCADE/blob_tier_min_bytes"
+#define DEFAULT_BLOB_TIER_CACHE_MB                      (0)
+#define DEFAULT_BLOB_TIER_MIN_BYTES                     (4096)
+/* the per subgroup blob tier in the layout dict of a subgroup, with the keys below */
+#define JSON_CONF_BLOB_TIER                         "blob_tier"
+#define JSON_CONF_BLOB_TIER_CACHE_MB                    "cache_mb"
+#define JSON_CONF_BLOB_TIER_MIN_BYTES                   "min_bytes"
+
+    /**
+     * Get the layout dict of a subgroup from CONF_GROUP_LAYOUT.
+     * @param subgroup_id   The subgroup id. The subgroup ids follow the order of the types in the layout, and then
+     *                      the order of the subgroups of a type.
+     * @return the layout dict, or a null json if the layout is not configured.
+     */
+    nlohmann::json get_subgroup_layout(const derecho::subgroup_id_t subgroup_id);
+
+    /**
+     * Sync the directory of a file, so that the file created or renamed there survives a crash.
+     * @param path  The path of the file
+     *
+     * @return true on success.
+     */
+    bool sync_parent_directory(const std::string& path);
+
+    /**
+     * RetentionPolicy
+     *
+     * RetentionPolicy decides how much of the log of a PersistentCascadeStore shard to keep. There are two keep rules
+     * and a cap, zero disables each of them:
+     * - versions_per_key:  keep the latest N versions of every key, the current one included.
+     * - retention_us:      keep the log entries newer than this many microseconds.
+     * - log_size_cap:      keep the log under this many bytes, dropping the oldest entries first, even if a keep rule
+     *                      wants them.
+     * If both keep rules are enabled, an entry wanted by either is kept. Independent of them, snapshot_interval_versions
+     * saves the state every that many log entries without truncating the log, so that a restart replays the log tail
+     * only. The defaults are in the [CASCADE] section of the configuration, and a subgroup overrides them with a
+     * "retention" dict in its layout.
+     */
+    struct RetentionPolicy {
+        uint64_t versions_per_key;
+        uint64_t retention_us;
+        uint64_t log_size_cap;
+        uint64_t snapshot_interval_versions;
+        uint64_t check_interval_sec;
+        /**
+         * Constructor, loading the defaults from the configuration.
+         */
+        RetentionPolicy();
+        /**
+         * Override the defaults with the "retention" dict in the layout of a subgroup.
+         * @param subgroup_id   The subgroup id. The subgroup ids follow the order of the types in the layout, and then
+         *                      the order of the subgroups of a type.
+         */
+        void load_subgroup_override(const derecho::subgroup_id_t subgroup_id);
+        /**
+         * Test if the log is truncated or snapshotted at all.
+         */
+        bool is_enabled() const;
+    };
+
+    /**
+     * DeltaEncoding
+     *
+     * DeltaEncoding decides when PersistentCascadeStore logs a put as a BlobPatch against the previous version of the
+     * key instead of the full object. A blob of at least min_bytes bytes is patched unless the version is the
+     * full_image_interval-th of the key, which keeps the full object so that a versioned read restores a blob from
+     * fewer than full_image_interval patches; after the log is truncated, fewer than twice as many. A patch is logged
+     * only if it is under half of the blob. full_image_interval of 0 or 1 disables it. The defaults are in the
+     * [CASCADE] section of the configuration, and a subgroup overrides them with a "delta_encoding" dict in its layout.
+     */
+    struct DeltaEncoding {
+        uint64_t full_image_interval;
+        uint64_t min_bytes;
+        /**
+         * Constructor, loading the defaults from the configuration.
+         */
+        DeltaEncoding();
+        /**
+         * Override the defaults with the "delta_encoding" dict in the layout of a subgroup.
+         * @param subgroup_id   The subgroup id.
+         */
+        void load_subgroup_override(const derecho::subgroup_id_t subgroup_id);
+        /**
+         * Test if any put is logged as a patch.
+         */
+        bool is_enabled() const;
+    };
+
+    /**
+     * BlobTier
+     *
+     * BlobTier lets a PersistentCascadeStore shard hold more blobs than the memory. The keys and the metadata of the
+     * objects stay in the current state, and so do the hot blobs, up to cache_mb megabytes. The CLOCK algorithm (see
+     * ClockEvictionPolicy) picks the cold blobs, which move to a value file next to the log. The value file is mapped
+     * into memory, and the objects in the current state refer to their cold blobs there (see IHasBlobReference), so the
+     * reads, scans, and queries load them on demand through the page cache. Only the blobs of at least min_bytes bytes
+     * are tiered. cache_mb of 0 disables it. The defaults are in the [CASCADE] section of the configuration, and a
+     * subgroup overrides them with a "blob_tier" dict in its layout.
+     *
+     * The value file is a cache of the current state. A clean shutdown saves the state with the layout of the value
+     * file, and the next run maps it if the saved state still matches the log and the value file; otherwise both are
+     * discarded, and the value file is rebuilt from the log. The saved state is removed before the value file first
+     * changes, so that a crash never leaves a stale one behind.
+     *
+     * The value file is allocated in segments of SEGMENT_SIZE bytes, or of the blob size for a larger blob, each mapped
+     * on its own. A segment is released once all its blobs are updated or removed, and a segment more than half free is
+     * compacted into the active one. Only the ordered handlers and the recovery update the tier, with kv_map_mutex
+     * locked exclusively; the local read path only marks the blobs it reads.
+     *
+     * The temporal queries and the snapshots of the log retention still materialize whole states in memory, so they
+     * are limited to the shards fitting in the memory.
+     */
+    template <typename KT>
+    class BlobTier {
+    public:
+        static constexpr uint64_t SEGMENT_SIZE = 256ull << 20;
+    private:
+        static constexpr uint64_t NO_SEGMENT = std::numeric_limits<uint64_t>::max();
+        struct Segment {
+            /* the mapped segment, nullptr once released */
+            char*       base;
+            uint64_t    file_offset;
+            uint64_t    capacity;
+            /* the bytes allocated, and the bytes of the live blobs */
+            uint64_t    used;
+            uint64_t    live;
+        };
+        struct ColdBlob {
+            uint64_t    segment;
+            uint64_t    offset;
+            uint64_t    size;
+        };
+        /* guards all the members below, since the local read path marks the blobs concurrently */
+        mutable std::mutex      tier_mutex;
+        uint64_t                cache_bytes;
+        uint64_t                min_bytes;
+        std::atomic<bool>       opened;
+        std::string             value_file;
+        int                     fd;
+        uint64_t                file_size;
+        /* the hot blobs in the heap */
+        ClockEvictionPolicy<KT> hot_blobs;
+        /* the cold blobs in the value file */
+        KVIndex<KT,ColdBlob>    cold_blobs;
+        std::vector<Segment>    segments;
+        /* the released segments of SEGMENT_SIZE bytes, whose file ranges are reused */
+        std::vector<uint64_t>   free_segments;
+        /* the segment the small blobs go to, or NO_SEGMENT */
+        uint64_t                active_segment;
+        uint64_t                cold_bytes;
+        /* the state saved with the layout of the value file, which is removed before the value file first changes.
+         * The value file is kept on destruction while the saved state matches it, for the next run to map it. */
+        std::string             state_file;
+        bool                    has_saved_state;
+        /* allocate a segment of 'capacity' bytes, returns its index or segments.size() on failure */
+        uint64_t allocate_segment(const uint64_t capacity);
+        /* release a segment without live blobs */
+        void release_segment(const uint64_t segment);
+        /* copy a blob into the value file, returns the copy or nullptr on failure */
+        const char* append(const KT& key, const char* bytes, const uint64_t size);
+        /* drop the cold blob of a key */
+        void drop(const KT& key);
+        /* unmap the segments and close the value file, keeping it on disk */
+        void close_value_file();
+        /* remove the saved state before the value file changes. An unused value file is truncated then. */
+        void invalidate_saved_state();
+    public:
+        /**
+         * Constructor, loading the defaults from the configuration.
+         */
+        BlobTier();
+        /**
+         * Override the defaults with the "blob_tier" dict in the layout of a subgroup.
+         * @param subgroup_id   The subgroup id.
+         */
+        void load_subgroup_override(const derecho::subgroup_id_t subgroup_id);
+        /**
+         * Test if the blobs are tiered.
+         */
+        bool is_enabled() const;
+        /**
+         * Test if the value file is open.
+         */
+        bool is_open() const;
+        /**
+         * Open the value file without any cold blob. The file left by the last run, and the state saved with it, are
+         * left alone until the first cold blob is written, so that a store which never tiers a blob keeps them.
+         * @param path          The path of the value file
+         * @param state_path    The path of the state saved with it
+         *
+         * @return true on success.
+         */
+        bool open(const std::string& path, const std::string& state_path);
+        /**
+         * Map the value file left by the last run, with the layout saved by save().
+         * @param path          The path of the value file
+         * @param state_path    The path of the state saved with it
+         * @param buf           The layout
+         *
+         * @return the size of the layout, or 0 if the value file does not match it.
+         */
+        std::size_t reopen(const std::string& path, const std::string& state_path, const char* buf);
+        /**
+         * Flush the value file and write its layout: the segments and the place of each cold blob.
+         * @param write_func    void(char const* const, std::size_t)
+         *
+         * @return true on success.
+         */
+        template <typename WriteFunc>
+        bool save(const WriteFunc& write_func);
+        /**
+         * Keep the value file on destruction, once its layout is saved to the state file.
+         */
+        void keep_value_file();
+        /**
+         * Get the cold blob of a key.
+         * @param key
+         * @param size      The size of the blob, set if the key has a cold blob.
+         *
+         * @return the blob in the value file, or nullptr if the key has no cold blob.
+         */
+        const char* get_cold_blob(const KT& key, uint64_t& size) const;
+        /**
+         * A key gets a blob in the heap, dropping its cold blob if any.
+         * @param key
+         * @param blob_size
+         */
+        void on_update(const KT& key, const uint64_t& blob_size);
+        /**
+         * A key is read.
+         * @param key
+         */
+        void on_access(const KT& key);
+        /**
+         * A key is removed from the current state.
+         * @param key
+         */
+        void on_erase(const KT& key);
+        /**
+         * Pick the hot blobs to move out of the heap until the hot blobs fit in the cache. The victims are dropped from
+         * the cache; the caller moves them with put_cold().
+         *
+         * @return the keys of the victims
+         */
+        std::vector<KT> evict();
+        /**
+         * Move a blob into the value file.
+         * @param key
+         * @param bytes
+         * @param size
+         *
+         * @return the blob in the value file, or nullptr if the value file is full or not open.
+         */
+        const char* put_cold(const KT& key, const char* bytes, const uint64_t& size);
+        /**
+         * Compact a segment more than half free, if any, into the active segment.
+         * @param repoint   void(const KT& key, const char* bytes, const uint64_t& size), called with the new place of
+         *                  each moved blob before its old place is released.
+         */
+        template <typename RepointFunc>
+        void compact(const RepointFunc& repoint);
+        /**
+         * Get the total size of the hot blobs and of the cold blobs.
+         */
+        uint64_t get_hot_bytes() const;
+        uint64_t get_cold_bytes() const;
+
+        // destructor, which removes the value file unless the saved state still matches it
+        virtual ~BlobTier();
+    };
+
+    /**
+     * TimeVersionIndex
+     *
+     * TimeVersionIndex resolves a timestamp to the version of the latest update no later than it, with a binary search
+     * in the timestamps and versions of the updates of a PersistentCascadeStore shard, one sample per log entry with
+     * updates. The HLC timestamps grow with the versions, so the samples are in the order of both.
+     *
+     * The index is complete if it has every update since the base state. On recovery, this is only known if the
+     * objects keep their timestamps; otherwise the index starts with the first update after the recovery, and the log
+     * resolves the earlier timestamps.
+     */
+    class TimeVersionIndex {
+    private:
+        /* an update in the log */
+        struct Sample {
+            uint64_t timestamp_us;
+            persistent::version_t version;
+        };
+        std::vector<Sample> samples;
+        bool complete;
+    public:
+        TimeVersionIndex();
+        /**
+         * Drop all samples.
+         * @param _complete     True if the samples appended next start from the base state.
+         */
+        void clear(const bool _complete);
+        /**
+         * Append an update, ignoring the versions no later than the last one, like the other updates in a batch.
+         * @param version
+         * @param timestamp_us
+         */
+        void append(const persistent::version_t& version, const uint64_t& timestamp_us);
+        /**
+         * Drop the updates truncated from the log up to a version, except the latest one, which the base state has.
+         * A timestamp before the latest truncated update then resolves to nothing, since the log no longer has it.
+         * @param version
+         */
+        void trim(const persistent::version_t& version);
+        /**
+         * @return true if the index resolves the timestamp.
+         */
+        bool covers(const uint64_t& ts_us) const;
+        /**
+         * @return the version of the latest update no later than the timestamp, or persistent::INVALID_VERSION if
+         *         there is no such update.
+         */
+        persistent::version_t find(const uint64_t& ts_us) const;
+        /**
+         * @return the number of samples.
+         */
+        std::size_t size() const;
+    };
+
     /**
      * template for persistent cascade stores.
      * 
      * PersistentCascadeStore is full-fledged implementation with log mechansim. Data can be stored in different
      * persistent devices including file system(persistent::ST_FILE) or SPDK(persistent::ST_SPDK). Please note that the
-     * data is cached in memory too.
+     * data is cached in memory too, unless the blob tier (see BlobTier) moves the cold blobs to a value file.
      */
     template <typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST=persistent::ST_FILE>
     class PersistentCascadeStore : public ICascadeStore<KT, VT, IK, IV>,
@@ -400,36 +1934,298 @@ namespace cascade {
         CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>* cascade_watcher_ptr;
         /* cascade context */
         ICascadeContext* cascade_context_ptr;
+        /* secondary index extractor */
+        SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>* secondary_index_extractor_ptr;
+        /* the secondary index, guarded by kv_map_mutex */
+        SecondaryIndex<KT,VT,IK> secondary_index;
+        /* kv_map_mutex guards the current state against the local read path */
+        mutable std::shared_mutex kv_map_mutex;
+        /* the delivered frontier for the local read path */
+        DeliveredFrontier frontier;
+        /* the log compression, delta encoding and scan order of the subgroup, loaded by the first ordered put once the
+         * group is known */
+        bool log_config_loaded;
+        DeltaEncoding delta_encoding;
+        bool ordered_scans;
+        /* the hot and cold blobs of the current state, and the value file of the cold ones. The value file is named
+         * once the subgroup is known, like base_file. A clean shutdown saves the current state with the layout of the
+         * value file in value_file + ".state", which lets the next run map the cold blobs instead of loading them. */
+        BlobTier<KT> blob_tier;
+        std::string value_file;
+        /* the checkpoints for the temporal queries */
+        mutable CheckpointCache<DeltaCascadeStoreCore<KT,VT,IK,IV>> checkpoint_cache;
+        /* an update of a key in the log */
+        struct KeyVersion {
+            persistent::version_t version;
+            uint64_t timestamp_us;
+        };
+        /* key -> the updates of the key in version order, guarded by kv_map_mutex. A removed key stays here after
+         * its tombstone is dropped from the current state, so the historical reads still find it. */
+        KVIndex<KT,std::vector<KeyVersion>> version_index;
+        /* the timestamps of the updates in the log, guarded by kv_map_mutex */
+        TimeVersionIndex time_index;
+        /* the log retention of this subgroup, loaded by the retention thread */
+        RetentionPolicy retention_policy;
+        /* The state at base_index is saved in base_file, the snapshot for restart, and the log might be truncated up
+         * to base_index. base_index is persistent::INVALID_INDEX if there is no snapshot. Guarded by kv_map_mutex. */
+        int64_t base_index;
+        persistent::version_t base_version;
+        uint64_t base_timestamp_us;
+        std::string base_file;
+        /* log index -> the size of the log entry, for the log size cap. Used by the retention thread only. */
+        std::map<int64_t,uint64_t> log_entry_sizes;
+        /* the retention thread checkpoints the state and truncates the log without blocking the ordered handlers */
+        std::atomic<bool> retention_thread_alive;
+        std::mutex retention_mutex;
+        std::condition_variable retention_cv;
+        std::thread retention_thread;
+        /* the time spent on recovering the state in the constructor */
+        uint64_t recovery_time_us;
         
         REGISTER_RPC_FUNCTIONS(PersistentCascadeStore,
                                P2P_TARGETS(
                                    put,
                                    remove,
+                                   put_batch,
+                                   remove_batch,
                                    get,
+                                   multi_get,
                                    get_by_time,
                                    list_keys,
                                    list_keys_by_time,
+                                   version_at_time,
+                                   scan,
+                                   query,
+                                   lookup_by_index,
                                    get_size,
-                                   get_size_by_time),
+                                   get_size_by_time,
+                                   head,
+                                   get_local,
+                                   get_size_local),
                                ORDERED_TARGETS(
                                    ordered_put,
                                    ordered_remove,
+                                   ordered_put_batch,
+                                   ordered_remove_batch,
                                    ordered_get,
+                                   ordered_multi_get,
                                    ordered_list_keys,
-                                   ordered_get_size));
+                                   ordered_scan,
+                                   ordered_query,
+                                   ordered_lookup_by_index,
+                                   ordered_get_size,
+                                   ordered_head));
         virtual std::tuple<persistent::version_t,uint64_t> put(const VT& value) const override;
         virtual std::tuple<persistent::version_t,uint64_t> remove(const KT& key) const override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> put_batch(const std::vector<VT>& values) const override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> remove_batch(const std::vector<KT>& keys) const override;
         virtual const VT get(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual std::vector<VT> multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const override;
         virtual const VT get_by_time(const KT& key, const uint64_t& ts_us) const override;
         virtual std::vector<KT> list_keys(const persistent::version_t& ver) const override;
         virtual std::vector<KT> list_keys_by_time(const uint64_t& ts_us) const override;
+        virtual persistent::version_t version_at_time(const uint64_t& ts_us) const override;
+        virtual ScanPage<KT,VT> scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                     bool with_values, const persistent::version_t& ver) const override;
+        virtual QueryPage<KT,VT> query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit,
+                                       const persistent::version_t& ver) const override;
+        virtual ScanPage<KT,VT> lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                const uint32_t& limit, bool with_values,
+                                                const persistent::version_t& ver) const override;
         virtual uint64_t get_size(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
         virtual uint64_t get_size_by_time(const KT& key, const uint64_t& ts_us) const override;
+        virtual ObjectMetadata head(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual const VT get_local(const KT& key, const ReadConsistency& consistency,
+                                   const persistent::version_t& read_point, const uint64_t& max_staleness_us) const override;
+        virtual uint64_t get_size_local(const KT& key, const ReadConsistency& consistency,
+                                        const persistent::version_t& read_point, const uint64_t& max_staleness_us) const override;
         virtual std::tuple<persistent::version_t,uint64_t> ordered_put(const VT& value) override;
         virtual std::tuple<persistent::version_t,uint64_t> ordered_remove(const KT& key) override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_put_batch(const std::vector<VT>& values) override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_remove_batch(const std::vector<KT>& keys) override;
         virtual const VT ordered_get(const KT& key) override;
+        virtual std::vector<VT> ordered_multi_get(const std::vector<KT>& keys) override;
         virtual std::vector<KT> ordered_list_keys() override;
+        virtual ScanPage<KT,VT> ordered_scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                             bool with_values) override;
+        virtual QueryPage<KT,VT> ordered_query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit) override;
+        virtual ScanPage<KT,VT> ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                        const uint32_t& limit, bool with_values) override;
         virtual uint64_t ordered_get_size(const KT& key) override;
+        virtual ObjectMetadata ordered_head(const KT& key) override;
+
+        /**
+         * Apply a put to the persistent core with a given version and timestamp, and notify the critical data path
+         * observer.
+         * @param value
+         * @param version_and_timestamp
+         *
+         * @return false if the put is rejected by previous version verification.
+         */
+        bool apply_ordered_put(const VT& value, const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Apply a remove to the persistent core with a given version and timestamp, and notify the critical data path
+         * observer.
+         * @param key
+         * @param version_and_timestamp
+         *
+         * @return false if there is no such key or the key has been removed.
+         */
+        bool apply_ordered_remove(const KT& key, const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Build secondary_index with the extractor if it is not built yet. Called with kv_map_mutex locked exclusively.
+         */
+        void build_secondary_index();
+
+        /**
+         * Open the value file of the blob tier, and track the blobs in the current state, moving the cold ones out.
+         * Called with kv_map_mutex locked exclusively.
+         */
+        void init_blob_tier();
+        /**
+         * Move the cold blobs in the current state to the value file until the hot ones fit in the blob tier, and
+         * compact the value file. Called with kv_map_mutex locked exclusively.
+         */
+        void evict_blobs();
+        /**
+         * Save the current state and the layout of the value file, keeping the value file for the next run. The state
+         * is only read: the cold blobs are cut out of the saved copy. Called by the destructor.
+         */
+        void save_blob_tier_state();
+        /**
+         * Load the state saved by save_blob_tier_state() in the last run, mapping the cold blobs in the value file.
+         * The saved state stays on disk until the value file changes. If it does not match the log or the value file,
+         * both are discarded. Called with kv_map_mutex locked exclusively.
+         *
+         * @return the log index of the state, or persistent::INVALID_INDEX if there is no saved state matching the log.
+         */
+        int64_t load_blob_tier_state();
+        /**
+         * Write the version index up to a version: [number of keys]([key][number of versions]([version][timestamp])*)*
+         * Called with kv_map_mutex locked.
+         * @param write_func    void(char const* const, std::size_t)
+         * @param version       The version
+         */
+        template <typename WriteFunc>
+        void post_version_index(const WriteFunc& write_func, const persistent::version_t& version) const;
+        /**
+         * Read the version index written by post_version_index(). Called with kv_map_mutex locked exclusively.
+         * @param buf
+         *
+         * @return the number of bytes read.
+         */
+        std::size_t load_version_index(const char* buf);
+
+        /**
+         * Get the index of the latest log entry no later than a version.
+         * @param ver   The version
+         *
+         * @return the log index, or persistent::INVALID_INDEX if there is no such entry.
+         */
+        int64_t get_index_at_version(const persistent::version_t& ver) const;
+        /**
+         * Get the state after the log entry at an index, replaying the log from the nearest earlier checkpoint.
+         * @param index The log index. persistent::INVALID_INDEX stands for the state before the first log entry.
+         *
+         * @return the state, which may be shared with the checkpoint cache.
+         */
+        std::shared_ptr<const DeltaCascadeStoreCore<KT,VT,IK,IV>> get_state_at_index(const int64_t& index) const;
+        /**
+         * Get the version of the latest update of a key no later than a version, from the version index.
+         * @param key   The key
+         * @param ver   The version
+         *
+         * @return the version of the update, or persistent::INVALID_VERSION if there is no such update.
+         */
+        persistent::version_t get_key_version_at_version(const KT& key, const persistent::version_t& ver) const;
+        /**
+         * Get the value of a key from the delta of a version.
+         * @param key   The key
+         * @param ver   The version
+         *
+         * @return the value, or an invalid value if the version does not update the key.
+         */
+        const VT get_from_delta(const KT& key, const persistent::version_t& ver) const;
+        /**
+         * Get the size of the value of a key from the delta of a version.
+         * @param key   The key
+         * @param ver   The version
+         *
+         * @return the size of serialized value, or 0 if the version does not update the key.
+         */
+        uint64_t get_size_from_delta(const KT& key, const persistent::version_t& ver) const;
+        /**
+         * Get the metadata of the value of a key from the delta of a version.
+         * @param key   The key
+         * @param ver   The version
+         *
+         * @return the metadata, which is null if the version does not update the key.
+         */
+        ObjectMetadata head_from_delta(const KT& key, const persistent::version_t& ver) const;
+        /**
+         * Get the version of the latest update of a key no later than a timestamp, from the version index.
+         * @param key   The key
+         * @param ts_us The timestamp in microseconds
+         *
+         * @return the version of the update, or persistent::INVALID_VERSION if there is no such update.
+         */
+        persistent::version_t get_key_version_at_time(const KT& key, const uint64_t& ts_us) const;
+        /**
+         * Rebuild the version index from the log on recovery.
+         */
+        void rebuild_version_index();
+        /**
+         * Rebuild the time index from the version index on recovery.
+         */
+        void rebuild_time_index();
+        /**
+         * Get the index of the latest log entry no later than a timestamp.
+         * @param ts_us The timestamp in microseconds
+         *
+         * @return the log index, base_index if the entry is truncated, or persistent::INVALID_INDEX if there is no
+         *         such entry.
+         */
+        int64_t get_index_at_time(const uint64_t& ts_us) const;
+        /**
+         * Test if the log entry of a version is truncated, so that the value is in the base state.
+         * @param ver   The version
+         */
+        bool is_truncated(const persistent::version_t& ver) const;
+        /**
+         * Get the state at base_index, loading it from base_file if it is not in the checkpoint cache.
+         *
+         * @return the state, or nullptr if the log has never been truncated.
+         */
+        std::shared_ptr<const DeltaCascadeStoreCore<KT,VT,IK,IV>> get_base_state() const;
+        /**
+         * Find the log index to truncate to, following the retention policy.
+         *
+         * @return the log index, or persistent::INVALID_INDEX if there is nothing to truncate.
+         */
+        int64_t get_truncation_index();
+        /**
+         * Save the state and the version index at a log index to base_file, and make it the base state.
+         * @param index The log index
+         *
+         * @return true on success.
+         */
+        bool save_base_state(const int64_t& index);
+        /**
+         * Save the base state at a log index, then truncate the log up to that index and drop the versions of the keys
+         * before it from the version index, keeping the latest one.
+         * @param index The log index
+         */
+        void truncate_log(const int64_t& index);
+        /**
+         * The retention thread, waking up every check_interval_sec seconds.
+         */
+        void retention_loop();
+        /**
+         * Recover the state on restart: load the state saved by a clean shutdown of the blob tier, or else the snapshot
+         * in base_file, and replay the log after it. The log entries are deserialized by CONF_RECOVERY_THREADS
+         * threads, 0 for one per core, and applied in order.
+         */
+        void recover_state();
 
         // serialization support
         DEFAULT_SERIALIZE(persistent_core);
@@ -443,15 +2239,402 @@ namespace cascade {
         // constructors
         PersistentCascadeStore(persistent::PersistentRegistry *pr,
                                CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
-                               ICascadeContext* cc=nullptr);
+                               ICascadeContext* cc=nullptr,
+                               SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>* sie=nullptr);
         PersistentCascadeStore(persistent::Persistent<DeltaCascadeStoreCore<KT,VT,IK,IV>,ST>&& _persistent_core,
                                CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
-                               ICascadeContext* cc=nullptr); // move persistent_core
+                               ICascadeContext* cc=nullptr,
+                               SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>* sie=nullptr); // move persistent_core
 
         // destructor
         virtual ~PersistentCascadeStore();
     };
 
+#define CONF_WBCS_FLUSH_INTERVAL_MS         "CASCADE/wbcs_flush_interval_ms"
+#define CONF_WBCS_MAX_PENDING_MB            "CASCADE/wbcs_max_pending_mb"
+#define CONF_WBCS_COMPACTION_MIN_MB         "CASCADE/wbcs_compaction_min_mb"
+#define DEFAULT_WBCS_FLUSH_INTERVAL_MS          (10)
+#define DEFAULT_WBCS_MAX_PENDING_MB             (64)
+#define DEFAULT_WBCS_COMPACTION_MIN_MB          (64)
+#define CONF_WBCS_RECONCILE_MAX_RETRIES     "CASCADE/wbcs_reconcile_max_retries"
+#define DEFAULT_WBCS_RECONCILE_MAX_RETRIES      (100)
+/* the per subgroup write-behind log in the layout dict of a subgroup, with the keys below */
+#define JSON_CONF_WRITE_BEHIND                  "write_behind"
+#define JSON_CONF_WRITE_BEHIND_FLUSH_INTERVAL_MS    "flush_interval_ms"
+#define JSON_CONF_WRITE_BEHIND_MAX_PENDING_MB       "max_pending_mb"
+
+    /**
+     * WriteBehindLog is the local append-only file of a WriteBehindCascadeStore replica. The ordered handlers append
+     * the updates to a pending buffer in memory, and the write-behind thread writes the buffer to the file and syncs
+     * it every flush_interval_ms milliseconds, so that many updates share one fdatasync(). An ordered handler finding
+     * more than max_pending_bytes pending wakes the write-behind thread up, and the updates sent through the replica
+     * wait meanwhile, which bounds the updates a crash loses to those of the last flush interval and about
+     * max_pending_bytes.
+     *
+     * A record is [payload size:u64][checksum of the payload:u64][payload], and the payload is
+     * [PUT][version][value] or [REMOVE][version][key]. A torn record at the tail, left by a crash, is cut off on
+     * recovery. Once the file has doubled since it was last rewritten, and is over compaction_min_bytes, the
+     * write-behind thread rewrites it with the current state.
+     */
+    template <typename KT, typename VT>
+    class WriteBehindLog {
+    public:
+        static constexpr uint8_t RECORD_PUT = 0;
+        static constexpr uint8_t RECORD_REMOVE = 1;
+    private:
+        static constexpr std::size_t RECORD_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint64_t);
+        /* guards all the members below */
+        mutable std::mutex          log_mutex;
+        /* notified when the pending buffer is flushed or dropped */
+        mutable std::condition_variable flushed_cv;
+        uint64_t                    flush_interval_ms;
+        uint64_t                    max_pending_bytes;
+        uint64_t                    compaction_min_bytes;
+        std::string                 log_file;
+        int                         fd;
+        /* the size of the file, and its size when it was last rewritten */
+        uint64_t                    file_size;
+        uint64_t                    compacted_size;
+        /* the records not written yet */
+        std::vector<char>           pending;
+        /* true until the directory entry of the file, created or renamed, is synced */
+        bool                        needs_directory_sync;
+        /* the checksum of a record payload, FNV-1a */
+        static uint64_t checksum(const char* bytes, const std::size_t size);
+        /* append a record to a buffer */
+        template <typename T>
+        static void append_record(std::vector<char>& buf, const uint8_t& type, const persistent::version_t& version,
+                                  const T& object);
+        /* write a buffer to a file, with log_mutex unlocked */
+        static bool write_all(const int _fd, const char* bytes, std::size_t size);
+    public:
+        /**
+         * Constructor, loading the defaults from the configuration.
+         */
+        WriteBehindLog();
+        /**
+         * Override the defaults with the "write_behind" dict in the layout of a subgroup.
+         * @param subgroup_id   The subgroup id.
+         */
+        void load_subgroup_override(const derecho::subgroup_id_t subgroup_id);
+        /**
+         * Test if the file is open.
+         */
+        bool is_open() const;
+        /**
+         * Open the file and replay it, cutting off a torn tail.
+         * @param path          The path of the file
+         * @param on_put        void(VT&& value, const persistent::version_t& version)
+         * @param on_remove     void(const KT& key, const persistent::version_t& version)
+         *
+         * @return true on success.
+         */
+        template <typename PutFunc, typename RemoveFunc>
+        bool open(const std::string& path, const PutFunc& on_put, const RemoveFunc& on_remove);
+        /**
+         * Get the size of the pending buffer. Called with the state locked against the updates, which append under
+         * the same lock, to tell the records a copy of the state includes from those appended after it.
+         */
+        std::size_t get_pending_size() const;
+        /**
+         * Replace the file with a copy of the state, dropping the pending records the copy includes. Called by the
+         * write-behind thread only, without any lock on the state, so the updates go on appending to the pending
+         * buffer meanwhile.
+         * @param path              The path of the file
+         * @param kv_map            The copy of the state
+         * @param version           The version of the state
+         * @param included_pending  The size of the pending buffer when the state was copied
+         *
+         * @return true on success. On failure, the file and the pending buffer are left as they were.
+         */
+        bool rewrite(const std::string& path, const KVIndex<KT,VT>& kv_map, const persistent::version_t& version,
+                     const std::size_t included_pending);
+        /**
+         * Append a put to the pending buffer.
+         * @param value
+         * @param version
+         */
+        void append_put(const VT& value, const persistent::version_t& version);
+        /**
+         * Append a remove to the pending buffer.
+         * @param key
+         * @param version
+         */
+        void append_remove(const KT& key, const persistent::version_t& version);
+        /**
+         * Test if the pending buffer is over max_pending_bytes.
+         */
+        bool is_full() const;
+        /**
+         * Wait until the pending buffer is under max_pending_bytes, or the file is not open. The updates sent through
+         * the replica call this before sending, without holding any lock.
+         */
+        void wait_for_room() const;
+        /**
+         * Write the pending buffer to the file and sync it, and the directory entry of the file once it is created or
+         * rewritten. Called by the write-behind thread only.
+         *
+         * @return true on success.
+         */
+        bool flush();
+        /**
+         * Test if the file has grown enough to be rewritten.
+         */
+        bool needs_compaction() const;
+        /**
+         * Get the flush interval in milliseconds.
+         */
+        uint64_t get_flush_interval_ms() const;
+
+        // destructor, which closes the file without flushing it
+        virtual ~WriteBehindLog();
+    };
+
+    /**
+     * Get the number of failed pulls or polls in a row after which a WriteBehindCascadeStore replica stops reconciling
+     * its recovered state, CONF_WBCS_RECONCILE_MAX_RETRIES.
+     */
+    inline uint32_t get_wbcs_reconcile_max_retries();
+
+    /**
+     * template write-behind cascade stores.
+     *
+     * WriteBehindCascadeStore keeps the data in memory like VolatileCascadeStore, and its updates complete as fast.
+     * Each replica also writes the updates behind to a local append-only file (see WriteBehindLog), and recovers its
+     * state from the file on restart. A crash loses the updates of the last flush interval at most; a clean shutdown
+     * loses none. Like VolatileCascadeStore, it keeps no versions, so reading by version or time returns invalid
+     * values.
+     *
+     * The file is named after the subgroup, like the log of PersistentCascadeStore. A replica that receives the state
+     * from the shard on joining rewrites its file with that state once the subgroup is known.
+     *
+     * After a full restart, each replica recovers what it had flushed, so the replicas may differ by the updates lost
+     * in a crash. Before taking any request, the replicas of a shard reconcile: they elect the one that recovered
+     * the highest version, the lowest node id among equals, and those behind it pull its recovered state chunk by
+     * chunk and rewrite their files with it. Each replica then polls the others until they have all reconciled their
+     * states. Meanwhile, the requests sent through the replica fail with derecho::derecho_exception, to be retried,
+     * instead of blocking the P2P and ordered delivery threads the reconciliation relies on. A member of the shard
+     * sending ordered updates itself bypasses this: they are delivered as usual, the elected replica stops serving its
+     * recovered state once it has delivered one, and a replica that has delivered one while pulling keeps its own
+     * state. A replica that fails to reconcile after CONF_WBCS_RECONCILE_MAX_RETRIES failures in a row goes on with
+     * its own recovered state, and logs an error.
+     */
+    template <typename KT, typename VT, KT* IK, VT* IV>
+    class WriteBehindCascadeStore : public ICascadeStore<KT, VT, IK, IV>,
+                                    public mutils::ByteRepresentable,
+                                    public derecho::GroupReference {
+    public:
+        /* group reference */
+        using derecho::GroupReference::group;
+        /* the state in memory, holding the live keys only */
+        KVIndex<KT,VT> kv_map;
+        /* record the version of latest update */
+        persistent::version_t update_version;
+        /* watcher */
+        CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>* cascade_watcher_ptr;
+        /* cascade context */
+        ICascadeContext* cascade_context_ptr;
+        /* secondary index extractor */
+        SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>* secondary_index_extractor_ptr;
+        /* the secondary index, guarded by kv_map_mutex */
+        SecondaryIndex<KT,VT,IK> secondary_index;
+        /* kv_map_mutex guards kv_map against the local read path and the write-behind thread */
+        mutable std::shared_mutex kv_map_mutex;
+        /* the delivered frontier for the local read path */
+        DeliveredFrontier frontier;
+        /* the scan order of the subgroup, loaded by the first ordered put once the group is known */
+        bool scan_config_loaded;
+        bool ordered_scans;
+        /* the local file, named by the constructor, or by the write-behind thread once the subgroup is known */
+        WriteBehindLog<KT,VT> write_behind_log;
+        std::string log_file;
+        /* the write-behind thread flushes the pending updates and rewrites the file */
+        std::atomic<bool> write_behind_thread_alive;
+        mutable std::mutex write_behind_mutex;
+        mutable std::condition_variable write_behind_cv;
+        std::thread write_behind_thread;
+        /* the version recovered from the local file, or INVALID_VERSION if the state is transferred */
+        persistent::version_t recovered_version;
+        /* true until this replica has reconciled its recovered state with the shard */
+        std::atomic<bool> state_reconciled;
+        /* true until every replica of the shard has reconciled its recovered state, and the requests fail meanwhile */
+        std::atomic<bool> reconciling;
+
+        REGISTER_RPC_FUNCTIONS(WriteBehindCascadeStore,
+                               P2P_TARGETS(
+                                   put,
+                                   remove,
+                                   put_batch,
+                                   remove_batch,
+                                   get,
+                                   multi_get,
+                                   get_by_time,
+                                   list_keys,
+                                   list_keys_by_time,
+                                   version_at_time,
+                                   scan,
+                                   query,
+                                   lookup_by_index,
+                                   get_size,
+                                   get_size_by_time,
+                                   head,
+                                   get_local,
+                                   get_size_local,
+                                   get_reconcile_status,
+                                   get_recovered_chunk),
+                               ORDERED_TARGETS(
+                                   ordered_put,
+                                   ordered_remove,
+                                   ordered_put_batch,
+                                   ordered_remove_batch,
+                                   ordered_get,
+                                   ordered_multi_get,
+                                   ordered_list_keys,
+                                   ordered_scan,
+                                   ordered_query,
+                                   ordered_lookup_by_index,
+                                   ordered_get_size,
+                                   ordered_head));
+        virtual std::tuple<persistent::version_t,uint64_t> put(const VT& value) const override;
+        virtual std::tuple<persistent::version_t,uint64_t> remove(const KT& key) const override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> put_batch(const std::vector<VT>& values) const override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> remove_batch(const std::vector<KT>& keys) const override;
+        virtual const VT get(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual std::vector<VT> multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const override;
+        virtual const VT get_by_time(const KT& key, const uint64_t& ts_us) const override;
+        virtual std::vector<KT> list_keys(const persistent::version_t& ver) const override;
+        virtual std::vector<KT> list_keys_by_time(const uint64_t& ts_us) const override;
+        virtual persistent::version_t version_at_time(const uint64_t& ts_us) const override;
+        virtual ScanPage<KT,VT> scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                     bool with_values, const persistent::version_t& ver) const override;
+        virtual QueryPage<KT,VT> query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit,
+                                       const persistent::version_t& ver) const override;
+        virtual ScanPage<KT,VT> lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                const uint32_t& limit, bool with_values,
+                                                const persistent::version_t& ver) const override;
+        virtual uint64_t get_size(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual uint64_t get_size_by_time(const KT& key, const uint64_t& ts_us) const override;
+        virtual ObjectMetadata head(const KT& key, const persistent::version_t& ver, bool exact=false) const override;
+        virtual const VT get_local(const KT& key, const ReadConsistency& consistency,
+                                   const persistent::version_t& read_point, const uint64_t& max_staleness_us) const override;
+        virtual uint64_t get_size_local(const KT& key, const ReadConsistency& consistency,
+                                        const persistent::version_t& read_point, const uint64_t& max_staleness_us) const override;
+        virtual std::tuple<persistent::version_t,uint64_t> ordered_put(const VT& value) override;
+        virtual std::tuple<persistent::version_t,uint64_t> ordered_remove(const KT& key) override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_put_batch(const std::vector<VT>& values) override;
+        virtual std::vector<std::tuple<persistent::version_t,uint64_t>> ordered_remove_batch(const std::vector<KT>& keys) override;
+        virtual const VT ordered_get(const KT& key) override;
+        virtual std::vector<VT> ordered_multi_get(const std::vector<KT>& keys) override;
+        virtual std::vector<KT> ordered_list_keys() override;
+        virtual ScanPage<KT,VT> ordered_scan(const std::string& prefix, const KT& start_after, const uint32_t& limit,
+                                             bool with_values) override;
+        virtual QueryPage<KT,VT> ordered_query(const ShardQuery<KT>& query, const KT& start_after, const uint32_t& limit) override;
+        virtual ScanPage<KT,VT> ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                        const uint32_t& limit, bool with_values) override;
+        virtual uint64_t ordered_get_size(const KT& key) override;
+        virtual ObjectMetadata ordered_head(const KT& key) override;
+
+        /**
+         * Apply a put to kv_map with a given version and timestamp, append it to the write-behind log, and notify the
+         * critical data path observer.
+         * @param value
+         * @param version_and_timestamp
+         *
+         * @return false if the put is rejected by previous version verification.
+         */
+        bool apply_ordered_put(const VT& value, const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Apply a remove to kv_map with a given version and timestamp, append it to the write-behind log, and notify
+         * the critical data path observer.
+         * @param key
+         * @param version_and_timestamp
+         *
+         * @return false if there is no such key.
+         */
+        bool apply_ordered_remove(const KT& key, const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp);
+        /**
+         * Build secondary_index with the extractor if it is not built yet. Called with kv_map_mutex locked exclusively.
+         */
+        void build_secondary_index();
+        /**
+         * The write-behind thread: flush the pending updates every flush interval, and rewrite the file once it has
+         * grown enough. A replica with a transferred state rewrites its file first, once the subgroup is known.
+         */
+        void write_behind_loop();
+        /**
+         * Wake up the write-behind thread if the pending updates are over the limit, without waiting for it. The
+         * ordered handlers call this after applying their updates, without holding kv_map_mutex.
+         */
+        void wake_write_behind() const;
+        /**
+         * Wake up the write-behind thread and wait if the pending updates are over the limit. The updates sent through
+         * this replica call this before sending, so that the ordered delivery never waits for the file.
+         */
+        void wait_for_write_behind() const;
+        /**
+         * Check that the shard has reconciled its recovered state. The requests sent through this replica call this
+         * first.
+         * @throw derecho::derecho_exception while the shard is reconciling.
+         */
+        void check_reconciled() const;
+        /**
+         * Get the reconciliation status of this replica.
+         *
+         * @return the version recovered from the local file, or INVALID_VERSION if the state is transferred, and true
+         *         if this replica has not reconciled its own state yet.
+         */
+        std::tuple<persistent::version_t,bool> get_reconcile_status() const;
+        /**
+         * Get a chunk of the recovered state for a replica behind this one, in ascending key order.
+         * @param start_after   The cursor, the last key of the previous chunk, or *IK for the first chunk.
+         * @param max_bytes     The size limit of the chunk.
+         *
+         * @return the chunk of the recovered state at its version, which is not ready once this replica has
+         *         delivered an update, or after the reconciliation.
+         *
+         * Like VolatileCascadeStore::get_state_chunk(), a replica serving the chunks keeps the side index of the
+         * ordered keys from then on.
+         */
+        StateChunk<KT,VT> get_recovered_chunk(const KT& start_after, const uint64_t& max_bytes);
+        /**
+         * Reconcile the recovered state with the shard: elect the replica that recovered the highest version, then
+         * pull its state if this replica is behind it. Called by the write-behind thread once the subgroup is known,
+         * before it writes anything.
+         *
+         * @return true if the state is replaced, so that the file has to be rewritten.
+         */
+        bool reconcile_recovered_state();
+        /**
+         * Wait until the other replicas of the shard have reconciled their recovered states, polling them. Called by
+         * the write-behind thread after reconcile_recovered_state(), before the requests are let through.
+         */
+        void wait_for_shard_reconciliation();
+
+        // serialization support
+        std::size_t to_bytes(char* buf) const;
+        void post_object(const std::function<void(char const* const, std::size_t)>& f) const;
+        std::size_t bytes_size() const;
+
+        static std::unique_ptr<WriteBehindCascadeStore> from_bytes(mutils::DeserializationManager* dsm, char const* buf);
+
+        DEFAULT_DESERIALIZE_NOALLOC(WriteBehindCascadeStore);
+
+        void ensure_registered(mutils::DeserializationManager&) {}
+
+        /* constructors */
+        WriteBehindCascadeStore(persistent::PersistentRegistry* pr,
+                                CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
+                                ICascadeContext* cc=nullptr,
+                                SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>* sie=nullptr); // recover from the local file
+        WriteBehindCascadeStore(KVIndex<KT,VT>&& _kvm,
+                                persistent::version_t _uv,
+                                CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>* cw=nullptr,
+                                ICascadeContext* cc=nullptr,
+                                SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>* sie=nullptr); // move the transferred kv_map
+        /* destructor, which flushes the pending updates */
+        virtual ~WriteBehindCascadeStore();
+    };
+
     /**
      * Interfaces for ValueTypes, derive them to enable corresponding features.
      */
@@ -553,6 +2736,14 @@ namespace cascade {
          * @param prev_ver_by_key   The previous version of the same key in VT object
          */
         virtual void set_previous_version(persistent::version_t prev_ver, persistent::version_t perv_ver_by_key) const = 0;
+        /**
+         * get_previous_version() returns the previous version in the shard
+         */
+        virtual persistent::version_t get_previous_version() const = 0;
+        /**
+         * get_previous_version_by_key() returns the previous version of the same key
+         */
+        virtual persistent::version_t get_previous_version_by_key() const = 0;
     };
 
     /**
@@ -579,6 +2770,73 @@ namespace cascade {
         virtual bool verify_previous_version(persistent::version_t prev_ver, persistent::version_t prev_ver_by_key) const = 0;
     };
 
+    /**
+     * If the VT template type of PersistentCascadeStore/VolatileCascadeStore implements IHasBlob interface, a shard
+     * query (see ShardQuery) can evaluate the blob predicates and projections on the shard.
+     */
+    class IHasBlob {
+    public:
+        /**
+         * get_blob_bytes() returns the bytes of the blob.
+         */
+        virtual const char* get_blob_bytes() const = 0;
+        /**
+         * get_blob_size() returns the size of the blob.
+         */
+        virtual std::size_t get_blob_size() const = 0;
+        /**
+         * clear_blob() drops the blob, leaving the metadata of the object. It is called on a copy of the object for
+         * QueryProjection::Metadata.
+         */
+        virtual void clear_blob() = 0;
+    };
+
+    /**
+     * If the VT template type of PersistentCascadeStore implements IHasBlob, IKeepPreviousVersion, and IHasBlobPatch,
+     * the store can log an update of a key as a BlobPatch against the previous version of the key (see DeltaEncoding).
+     * Only the log holds patches: the current state and the objects returned by the store have full blobs.
+     */
+    class IHasBlobPatch {
+    public:
+        /**
+         * is_blob_patch() tests if the blob is a BlobPatch against the blob of the previous version of the key.
+         */
+        virtual bool is_blob_patch() const = 0;
+        /**
+         * set_blob() replaces the blob with a copy of the bytes.
+         * @param bytes
+         * @param size
+         * @param is_patch  If the bytes are a BlobPatch.
+         */
+        virtual void set_blob(const char* bytes, const std::size_t size, const bool is_patch) = 0;
+    };
+
+    /**
+     * If the VT template type of PersistentCascadeStore implements IHasBlob and IHasBlobReference, the blob tier (see
+     * BlobTier) moves the cold blobs out of the heap, and the objects in the current state refer to them. A copy of such
+     * an object owns a copy of the blob.
+     */
+    class IHasBlobReference {
+    public:
+        /**
+         * set_blob_reference() replaces the blob with a reference to bytes it does not own, which outlive the object.
+         * @param bytes
+         * @param size
+         */
+        virtual void set_blob_reference(const char* bytes, const std::size_t size) = 0;
+        /**
+         * post_object_without_blob() serializes the object as if its blob were empty, leaving the object as it is.
+         * @param f
+         */
+        virtual void post_object_without_blob(const std::function<void(char const* const, std::size_t)>& f) const = 0;
+    };
+
+    /**
+     * Test if an object holds a BlobPatch. It is always false if VT does not implement IHasBlobPatch.
+     */
+    template <typename VT>
+    bool is_blob_patch(const VT& value);
+
 } // namespace cascade
 } // namespace derecho
 #include "detail/cascade_impl.hpp"
@@ -0,0 +1,365 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace derecho {
+namespace cascade {
+
+/* the codec ids stored in a compressed blob. 0 means no compression. */
+#define BLOB_CODEC_NONE         (0)
+#define BLOB_CODEC_LZ           (1)
+#define BLOB_CODEC_NAME_NONE    "none"
+#define BLOB_CODEC_NAME_LZ      "lz"
+
+    /**
+     * IBlobCodec
+     *
+     * A compression codec for the blob payloads. A codec is stateless and called from many threads at the same time.
+     */
+    class IBlobCodec {
+    public:
+        /**
+         * The worst case compressed size of 'raw_size' bytes, so that compress() never runs out of room.
+         */
+        virtual std::size_t max_compressed_size(const std::size_t raw_size) const = 0;
+        /**
+         * Compress the bytes.
+         * @param src           The raw bytes
+         * @param src_size      The number of raw bytes
+         * @param dst           The buffer for the compressed bytes
+         * @param dst_capacity  The size of dst
+         * @return the number of compressed bytes, or 0 if they do not fit in dst.
+         */
+        virtual std::size_t compress(const char* src, const std::size_t src_size,
+                                     char* dst, const std::size_t dst_capacity) const = 0;
+        /**
+         * Decompress the bytes.
+         * @param src           The compressed bytes
+         * @param src_size      The number of compressed bytes
+         * @param dst           The buffer for the raw bytes
+         * @param raw_size      The number of raw bytes, which is known from the blob header.
+         * @return true if src decompresses to exactly raw_size bytes, false if src is corrupted.
+         */
+        virtual bool decompress(const char* src, const std::size_t src_size,
+                                char* dst, const std::size_t raw_size) const = 0;
+
+        virtual ~IBlobCodec() = default;
+    };
+
+    /**
+     * LZBlobCodec
+     *
+     * The built-in codec, an LZ77 byte codec in the LZ4 block layout. The compressed bytes are a list of sequences:
+     * [token][literal length extension][literals][offset:2 bytes][match length extension]
+     * The high four bits of the token are the literal length, the low four bits are the match length minus
+     * MIN_MATCH, and 15 means the length goes on in the extension bytes, which are added up until a byte other than
+     * 255. The last sequence has literals only. Matches are found with a hash table of the four byte prefixes, with a
+     * window of 64KB. The compressor skips faster through bytes that do not match, so incompressible data costs
+     * little time.
+     */
+    class LZBlobCodec : public IBlobCodec {
+        static constexpr std::size_t MIN_MATCH = 4;
+        static constexpr std::size_t MAX_OFFSET = 65535;
+        static constexpr uint32_t HASH_BITS = 12;
+
+        static inline uint32_t read32(const uint8_t* p) {
+            uint32_t v;
+            memcpy(&v,p,sizeof(v));
+            return v;
+        }
+
+        static inline uint32_t hash(const uint32_t v) {
+            return (v * 2654435761U) >> (32 - HASH_BITS);
+        }
+
+        /* write a length extension, return false if it does not fit. */
+        static inline bool write_length(std::size_t len, uint8_t*& op, const uint8_t* oend) {
+            while (len >= 255) {
+                if (op >= oend) {
+                    return false;
+                }
+                *op++ = 255;
+                len -= 255;
+            }
+            if (op >= oend) {
+                return false;
+            }
+            *op++ = static_cast<uint8_t>(len);
+            return true;
+        }
+
+        /* read a length extension, return false if it runs over the input. */
+        static inline bool read_length(std::size_t& len, const uint8_t*& ip, const uint8_t* iend) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return false;
+                }
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+            return true;
+        }
+
+        /* write a sequence: the literals [literal,literal+literal_len), then a match unless match_len is 0. */
+        static inline bool write_sequence(const uint8_t* literal, const std::size_t literal_len,
+                                          const std::size_t offset, const std::size_t match_len,
+                                          uint8_t*& op, const uint8_t* oend) {
+            if (op >= oend) {
+                return false;
+            }
+            uint8_t* token = op++;
+            *token = static_cast<uint8_t>(std::min<std::size_t>(literal_len,15) << 4);
+            if (literal_len >= 15 && !write_length(literal_len - 15,op,oend)) {
+                return false;
+            }
+            if (static_cast<std::size_t>(oend - op) < literal_len) {
+                return false;
+            }
+            memcpy(op,literal,literal_len);
+            op += literal_len;
+            if (match_len == 0) {
+                return true;
+            }
+            if (oend - op < 2) {
+                return false;
+            }
+            *op++ = static_cast<uint8_t>(offset & 0xff);
+            *op++ = static_cast<uint8_t>(offset >> 8);
+            std::size_t len_code = match_len - MIN_MATCH;
+            *token |= static_cast<uint8_t>(std::min<std::size_t>(len_code,15));
+            return (len_code < 15) || write_length(len_code - 15,op,oend);
+        }
+
+    public:
+        virtual std::size_t max_compressed_size(const std::size_t raw_size) const override {
+            return raw_size + raw_size / 255 + 16;
+        }
+
+        virtual std::size_t compress(const char* src, const std::size_t src_size,
+                                     char* dst, const std::size_t dst_capacity) const override {
+            if (src_size > UINT32_MAX) {
+                // the hash table keeps 32-bit positions.
+                return 0;
+            }
+            const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+            uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+            const uint8_t* oend = op + dst_capacity;
+            uint32_t table[1 << HASH_BITS];
+            std::fill(table,table + (1 << HASH_BITS),0);
+            std::size_t anchor = 0;
+            std::size_t pos = 0;
+            while (pos + MIN_MATCH <= src_size) {
+                uint32_t sequence = read32(in + pos);
+                uint32_t h = hash(sequence);
+                std::size_t candidate = table[h];
+                table[h] = static_cast<uint32_t>(pos);
+                if (candidate < pos && pos - candidate <= MAX_OFFSET && read32(in + candidate) == sequence) {
+                    std::size_t match_len = MIN_MATCH;
+                    while (pos + match_len < src_size && in[candidate + match_len] == in[pos + match_len]) {
+                        match_len ++;
+                    }
+                    if (!write_sequence(in + anchor,pos - anchor,pos - candidate,match_len,op,oend)) {
+                        return 0;
+                    }
+                    pos += match_len;
+                    anchor = pos;
+                } else {
+                    // step further the longer nothing matches.
+                    pos += 1 + ((pos - anchor) >> 6);
+                }
+            }
+            if (anchor < src_size && !write_sequence(in + anchor,src_size - anchor,0,0,op,oend)) {
+                return 0;
+            }
+            return static_cast<std::size_t>(op - reinterpret_cast<uint8_t*>(dst));
+        }
+
+        virtual bool decompress(const char* src, const std::size_t src_size,
+                                char* dst, const std::size_t raw_size) const override {
+            const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+            const uint8_t* iend = ip + src_size;
+            uint8_t* ostart = reinterpret_cast<uint8_t*>(dst);
+            uint8_t* op = ostart;
+            const uint8_t* oend = ostart + raw_size;
+            while (ip < iend) {
+                const uint8_t token = *ip++;
+                std::size_t literal_len = token >> 4;
+                if (literal_len == 15 && !read_length(literal_len,ip,iend)) {
+                    return false;
+                }
+                if (static_cast<std::size_t>(iend - ip) < literal_len ||
+                    static_cast<std::size_t>(oend - op) < literal_len) {
+                    return false;
+                }
+                memcpy(op,ip,literal_len);
+                ip += literal_len;
+                op += literal_len;
+                if (ip == iend) {
+                    // the last sequence.
+                    break;
+                }
+                if (iend - ip < 2) {
+                    return false;
+                }
+                std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+                ip += 2;
+                std::size_t match_len = token & 0xf;
+                if (match_len == 15 && !read_length(match_len,ip,iend)) {
+                    return false;
+                }
+                match_len += MIN_MATCH;
+                if (offset == 0 || offset > static_cast<std::size_t>(op - ostart) ||
+                    static_cast<std::size_t>(oend - op) < match_len) {
+                    return false;
+                }
+                const uint8_t* match = op - offset;
+                if (offset >= match_len) {
+                    memcpy(op,match,match_len);
+                    op += match_len;
+                } else {
+                    // the match overlaps the output, repeating the last 'offset' bytes.
+                    for (std::size_t i = 0; i < match_len; i++) {
+                        *op++ = match[i];
+                    }
+                }
+            }
+            return op == oend;
+        }
+    };
+
+    /**
+     * BlobCodecRegistry
+     *
+     * The codecs known to the process, by id and by name. The id goes with every compressed blob, so a codec must be
+     * registered with the same id on all nodes before any blob is serialized with it, and it can not be replaced. The
+     * built-in codecs are "none"(0) and "lz"(1).
+     */
+    class BlobCodecRegistry {
+        struct Registry {
+            std::mutex mutex;
+            std::array<std::atomic<IBlobCodec*>,256> codecs;
+            std::map<std::string,uint8_t> ids;
+            std::vector<std::unique_ptr<IBlobCodec>> owned_codecs;
+            Registry() {
+                for (auto& codec: codecs) {
+                    codec.store(nullptr);
+                }
+                ids.emplace(BLOB_CODEC_NAME_NONE,BLOB_CODEC_NONE);
+                owned_codecs.emplace_back(std::make_unique<LZBlobCodec>());
+                codecs[BLOB_CODEC_LZ].store(owned_codecs.back().get());
+                ids.emplace(BLOB_CODEC_NAME_LZ,BLOB_CODEC_LZ);
+            }
+        };
+
+        static Registry& get_registry() {
+            static Registry registry;
+            return registry;
+        }
+
+    public:
+        /**
+         * Register a codec.
+         * @param codec_id  The id stored in the compressed blobs, which must not be taken.
+         * @param name      The name used in the configuration, which must not be taken.
+         * @param codec     The codec
+         */
+        static void register_codec(const uint8_t codec_id, const std::string& name, std::unique_ptr<IBlobCodec>&& codec) {
+            auto& registry = get_registry();
+            std::lock_guard<std::mutex> lck(registry.mutex);
+            if (codec_id == BLOB_CODEC_NONE || registry.codecs[codec_id].load() != nullptr ||
+                registry.ids.find(name) != registry.ids.end()) {
+                throw std::invalid_argument("blob codec id " + std::to_string(codec_id) + " or name " + name +
+                                            " is taken.");
+            }
+            registry.owned_codecs.emplace_back(std::move(codec));
+            registry.codecs[codec_id].store(registry.owned_codecs.back().get());
+            registry.ids.emplace(name,codec_id);
+        }
+
+        /**
+         * Get a codec by id.
+         * @return the codec, or nullptr for BLOB_CODEC_NONE and the unknown ids.
+         */
+        static IBlobCodec* get(const uint8_t codec_id) {
+            return get_registry().codecs[codec_id].load(std::memory_order_acquire);
+        }
+
+        /**
+         * Get the id of a codec by name.
+         * @throw std::invalid_argument if no codec has the name.
+         */
+        static uint8_t get_id(const std::string& name) {
+            auto& registry = get_registry();
+            std::lock_guard<std::mutex> lck(registry.mutex);
+            auto it = registry.ids.find(name);
+            if (it == registry.ids.end()) {
+                throw std::invalid_argument("unknown blob codec: " + name);
+            }
+            return it->second;
+        }
+    };
+
+    /**
+     * BlobCompression
+     *
+     * When to compress a blob on serialization: with codec_id, if the blob has at least min_bytes bytes. A blob is
+     * sent or logged compressed only if that saves an eighth of it; otherwise decompressing it on every read costs
+     * more than the bytes saved.
+     */
+    struct BlobCompression {
+        uint8_t codec_id;
+        uint64_t min_bytes;
+
+        BlobCompression(): codec_id(BLOB_CODEC_NONE), min_bytes(0) {}
+        BlobCompression(const uint8_t _codec_id, const uint64_t _min_bytes):
+            codec_id(_codec_id), min_bytes(_min_bytes) {}
+
+        /**
+         * Test if a blob of 'size' bytes should be compressed.
+         */
+        bool applies_to(const std::size_t size) const {
+            return (codec_id != BLOB_CODEC_NONE) && (size > 0) && (size >= min_bytes);
+        }
+    };
+
+    /**
+     * BlobCompressionScope
+     *
+     * The blobs serialized by a thread follow the compression of the innermost BlobCompressionScope alive in the
+     * thread, or the process-wide wire compression out of any scope. DeltaCascadeStoreCore puts the objects in its
+     * delta in the scope of the log compression of its subgroup.
+     */
+    class BlobCompressionScope {
+        static inline thread_local const BlobCompression* current_compression = nullptr;
+        const BlobCompression* outer_compression;
+
+    public:
+        BlobCompressionScope(const BlobCompression& compression): outer_compression(current_compression) {
+            current_compression = &compression;
+        }
+        BlobCompressionScope(const BlobCompressionScope&) = delete;
+        BlobCompressionScope& operator=(const BlobCompressionScope&) = delete;
+        ~BlobCompressionScope() {
+            current_compression = outer_compression;
+        }
+
+        /**
+         * The compression of the innermost scope in this thread, or nullptr out of any scope.
+         */
+        static const BlobCompression* current() {
+            return current_compression;
+        }
+    };
+
+}  // namespace cascade
+}  // namespace derecho
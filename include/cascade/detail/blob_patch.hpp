@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace derecho {
+namespace cascade {
+
+    /**
+     * BlobPatch
+     *
+     * A binary patch of a blob against a base blob. The patch is the target size, followed by the operations that
+     * build the target from left to right:
+     * [target_size:varint]([COPY:1 byte][base_offset:varint][length:varint] | [ADD:1 byte][length:varint][bytes])*
+     * The encoder indexes the base by the hash of every BLOCK_SIZE-th block, and scans the target for the blocks,
+     * extending a block match both ways to a COPY. The bytes out of any match are ADDed. An edit of a few bytes in a
+     * large blob makes a patch of a few COPYs and a short ADD.
+     */
+    class BlobPatch {
+        static constexpr std::size_t BLOCK_SIZE = 16;
+        static constexpr uint32_t MAX_HASH_BITS = 22;
+        static constexpr uint8_t OP_COPY = 0;
+        static constexpr uint8_t OP_ADD = 1;
+
+        static inline uint32_t hash_block(const char* p, const uint32_t hash_bits) {
+            uint64_t v[2];
+            memcpy(v,p,sizeof(v));
+            uint64_t h = (v[0] ^ (v[1] * 0x9e3779b97f4a7c15LLU)) * 0xff51afd7ed558ccdLLU;
+            return static_cast<uint32_t>(h >> (64 - hash_bits));
+        }
+
+        static inline void write_varint(std::vector<char>& out, uint64_t v) {
+            while (v >= 0x80) {
+                out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+                v >>= 7;
+            }
+            out.push_back(static_cast<char>(v));
+        }
+
+        static inline bool read_varint(const char*& p, const char* end, uint64_t& v) {
+            v = 0;
+            for (uint32_t shift = 0; shift < 64; shift += 7) {
+                if (p >= end) {
+                    return false;
+                }
+                uint8_t b = static_cast<uint8_t>(*p++);
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if ((b & 0x80) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static inline void write_add(std::vector<char>& patch, const char* bytes, const std::size_t length) {
+            if (length > 0) {
+                patch.push_back(static_cast<char>(OP_ADD));
+                write_varint(patch,length);
+                patch.insert(patch.end(),bytes,bytes + length);
+            }
+        }
+
+    public:
+        /**
+         * Encode a target blob as a patch against a base blob.
+         * @param base              The base bytes
+         * @param base_size         The number of base bytes
+         * @param target            The target bytes
+         * @param target_size       The number of target bytes
+         * @param patch             The patch, replaced
+         * @param max_patch_size    The encoder gives up once the patch grows beyond this size.
+         * @return true if the patch is encoded within max_patch_size.
+         */
+        static bool encode(const char* base, const std::size_t base_size,
+                           const char* target, const std::size_t target_size,
+                           std::vector<char>& patch, const std::size_t max_patch_size) {
+            patch.clear();
+            if (base_size > UINT32_MAX) {
+                // the index keeps 32-bit positions.
+                return false;
+            }
+            write_varint(patch,target_size);
+            // index the base blocks. A slot keeps the position + 1 of the last block with its hash, 0 if none.
+            std::size_t num_blocks = base_size / BLOCK_SIZE;
+            uint32_t hash_bits = 4;
+            while (hash_bits < MAX_HASH_BITS && (1ull << hash_bits) < num_blocks * 2) {
+                hash_bits ++;
+            }
+            std::vector<uint32_t> table(1ull << hash_bits,0);
+            for (std::size_t block = 0; block < num_blocks; block++) {
+                table[hash_block(base + block*BLOCK_SIZE,hash_bits)] = static_cast<uint32_t>(block*BLOCK_SIZE + 1);
+            }
+            std::size_t pos = 0;
+            std::size_t pending = 0;
+            while (num_blocks > 0 && pos + BLOCK_SIZE <= target_size) {
+                uint32_t slot = table[hash_block(target + pos,hash_bits)];
+                if (slot == 0 || memcmp(base + slot - 1,target + pos,BLOCK_SIZE) != 0) {
+                    pos ++;
+                    continue;
+                }
+                std::size_t base_pos = slot - 1;
+                // extend the match backward into the pending bytes, and forward.
+                while (pos > pending && base_pos > 0 && base[base_pos - 1] == target[pos - 1]) {
+                    pos --;
+                    base_pos --;
+                }
+                std::size_t length = BLOCK_SIZE;
+                while (pos + length < target_size && base_pos + length < base_size &&
+                       base[base_pos + length] == target[pos + length]) {
+                    length ++;
+                }
+                write_add(patch,target + pending,pos - pending);
+                patch.push_back(static_cast<char>(OP_COPY));
+                write_varint(patch,base_pos);
+                write_varint(patch,length);
+                pos += length;
+                pending = pos;
+                if (patch.size() > max_patch_size) {
+                    return false;
+                }
+            }
+            write_add(patch,target + pending,target_size - pending);
+            return patch.size() <= max_patch_size;
+        }
+
+        /**
+         * Decode a patch against its base blob.
+         * @param base          The base bytes
+         * @param base_size     The number of base bytes
+         * @param patch         The patch bytes
+         * @param patch_size    The number of patch bytes
+         * @param target        The target, replaced
+         * @return true if the patch is decoded, false if it is corrupted or does not fit the base.
+         */
+        static bool decode(const char* base, const std::size_t base_size,
+                           const char* patch, const std::size_t patch_size,
+                           std::vector<char>& target) {
+            const char* p = patch;
+            const char* end = patch + patch_size;
+            uint64_t target_size;
+            target.clear();
+            if (!read_varint(p,end,target_size)) {
+                return false;
+            }
+            // every COPY takes at least 3 patch bytes for at most base_size bytes, and every ADD brings its bytes
+            // along, so a larger target size is corrupted. It is checked before anything is allocated for it.
+            const uint64_t max_copies = static_cast<uint64_t>(end - p) / 3;
+            if (base_size > 0 && max_copies > (UINT64_MAX - patch_size) / base_size) {
+                return false;
+            }
+            if (target_size > max_copies * base_size + patch_size) {
+                return false;
+            }
+            target.reserve(std::min<uint64_t>(target_size,base_size + patch_size));
+            while (p < end) {
+                uint8_t op = static_cast<uint8_t>(*p++);
+                uint64_t offset = 0;
+                uint64_t length = 0;
+                if (op == OP_COPY) {
+                    if (!read_varint(p,end,offset) || !read_varint(p,end,length) ||
+                        offset > base_size || length > base_size - offset ||
+                        length > target_size - target.size()) {
+                        return false;
+                    }
+                    target.insert(target.end(),base + offset,base + offset + length);
+                } else if (op == OP_ADD) {
+                    if (!read_varint(p,end,length) || length > static_cast<uint64_t>(end - p) ||
+                        length > target_size - target.size()) {
+                        return false;
+                    }
+                    target.insert(target.end(),p,p + length);
+                    p += length;
+                } else {
+                    return false;
+                }
+            }
+            return target.size() == target_size;
+        }
+    };
+
+}  // namespace cascade
+}  // namespace derecho
@@ -1,6 +1,20 @@
 #pragma once
 #include <memory>
 #include <map>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <chrono>
+#include <string_view>
+#include <fstream>
+#include <cstdio>
+#include <cerrno>
+#include <typeindex>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <derecho/utils/time.h>
 
 namespace derecho {
 namespace cascade {
@@ -12,6 +26,47 @@ namespace cascade {
 #define debug_enter_func() dbg_default_debug("Entering {}.")
 #define debug_leave_func() dbg_default_debug("Leaving {}.")
 
+///////////////////////////////////////////////////////////////////////////////
+// 0 - Delivered Frontier Implementation
+///////////////////////////////////////////////////////////////////////////////
+
+inline DeliveredFrontier::DeliveredFrontier():
+    version(persistent::INVALID_VERSION),
+    delivered_us(0) {}
+
+inline void DeliveredFrontier::advance(const persistent::version_t& ver) {
+    std::lock_guard<std::mutex> lck(frontier_mutex);
+    if (ver > version) {
+        version = ver;
+    }
+    delivered_us = get_time()/1000;
+}
+
+inline bool DeliveredFrontier::can_serve(const ReadConsistency& consistency,
+                                         const persistent::version_t& read_point,
+                                         const uint64_t& max_staleness_us) const {
+    switch(consistency) {
+    case ReadConsistency::ReadYourWrites:
+        if (read_point == persistent::INVALID_VERSION) {
+            // we don't know the request point, go to the ordered path.
+            return false;
+        } else {
+            // do not wait for the frontier to catch up, a replica behind goes to the ordered path.
+            std::lock_guard<std::mutex> lck(frontier_mutex);
+            return (version >= read_point);
+        }
+    case ReadConsistency::RecentlyDelivered:
+        {
+            std::lock_guard<std::mutex> lck(frontier_mutex);
+            return (get_time()/1000 <= delivered_us + max_staleness_us);
+        }
+    case ReadConsistency::Local:
+        return true;
+    default:
+        return false;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // 1 - Volatile Cascade Store Implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,12 +76,8 @@ std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::pu
     debug_enter_func_with_args("value.get_key_ref={}",value.get_key_ref());
     derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
     auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_put)>(value);
-    auto& replies = results.get();
-    std::tuple<persistent::version_t,uint64_t> ret(CURRENT_VERSION,0);
-    // TODO: verfiy consistency ?
-    for (auto& reply_pair : replies) {
-        ret = reply_pair.second.get();
-    }
+    // TODO: verify consistency ?
+    auto ret = pick_reply(results,true);
     debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(ret),std::get<1>(ret));
     return ret;
 }
@@ -36,16 +87,34 @@ std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::re
     debug_enter_func_with_args("key={}",key);
     derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
     auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_remove)>(key);
-    auto& replies = results.get();
-    std::tuple<persistent::version_t,uint64_t> ret(CURRENT_VERSION,0);
     // TODO: verify consistency ?
-    for (auto& reply_pair : replies) {
-        ret = reply_pair.second.get();
-    }
+    auto ret = pick_reply(results,true);
     debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(ret),std::get<1>(ret));
     return ret;
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> VolatileCascadeStore<KT,VT,IK,IV>::put_batch(const std::vector<VT>& values) const {
+    debug_enter_func_with_args("num_objects={}",values.size());
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_put_batch)>(values);
+    // TODO: verify consistency ?
+    auto ret = pick_reply(results,true);
+    debug_leave_func();
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> VolatileCascadeStore<KT,VT,IK,IV>::remove_batch(const std::vector<KT>& keys) const {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_remove_batch)>(keys);
+    // TODO: verify consistency ?
+    auto ret = pick_reply(results,true);
+    debug_leave_func();
+    return ret;
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 const VT VolatileCascadeStore<KT,VT,IK,IV>::get(const KT& key, const persistent::version_t& ver, bool) const {
     debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
@@ -55,13 +124,23 @@ const VT VolatileCascadeStore<KT,VT,IK,IV>::get(const KT& key, const persistent:
     }
     derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
     auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_get)>(key);
-    auto& replies = results.get();
     // TODO: verify consistency ?
-    // for (auto& reply_pair : replies) {
-    //     ret = reply_pair.second.get();
-    // }
     debug_leave_func();
-    return replies.begin()->second.get();
+    return pick_reply(results,false);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<VT> VolatileCascadeStore<KT,VT,IK,IV>::multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const {
+    debug_enter_func_with_args("num_keys={},ver=0x{:x}",keys.size(),ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned multi_get, ver=0x{:x}", ver);
+        return std::vector<VT>(keys.size(),*IV);
+    }
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_multi_get)>(keys);
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return pick_reply(results,false);
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
@@ -82,14 +161,9 @@ std::vector<KT> VolatileCascadeStore<KT,VT,IK,IV>::list_keys(const persistent::v
     }
     derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
     auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_list_keys)>();
-    auto& replies = results.get();
-    std::vector<KT> ret;
-    // TODO: verfity consistency ?
-    for (auto& reply_pair : replies) {
-        ret = reply_pair.second.get();
-    }
+    // TODO: verify consistency ?
     debug_leave_func();
-    return ret;
+    return pick_reply(results,false);
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
@@ -100,6 +174,64 @@ std::vector<KT> VolatileCascadeStore<KT,VT,IK,IV>::list_keys_by_time(const uint6
     return {};
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+persistent::version_t VolatileCascadeStore<KT,VT,IK,IV>::version_at_time(const uint64_t& ts_us) const {
+    // VolatileCascadeStore does not support this.
+    debug_enter_func_with_args("ts_us=0x{:x}", ts_us);
+    debug_leave_func();
+    return persistent::INVALID_VERSION;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::scan(const std::string& prefix, const KT& start_after,
+                                                        const uint32_t& limit, bool with_values,
+                                                        const persistent::version_t& ver) const {
+    debug_enter_func_with_args("prefix={},start_after={},limit={},with_values={},ver=0x{:x}",
+                               prefix,start_after,limit,with_values,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned scan, ver=0x{:x}", ver);
+        return {};
+    }
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_scan)>(prefix,start_after,limit,with_values);
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return pick_reply(results,false);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+QueryPage<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::query(const ShardQuery<KT>& query, const KT& start_after,
+                                                          const uint32_t& limit, const persistent::version_t& ver) const {
+    debug_enter_func_with_args("start_after={},limit={},ver=0x{:x}",start_after,limit,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned query, ver=0x{:x}", ver);
+        return {};
+    }
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_query)>(query,start_after,limit);
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return pick_reply(results,false);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                                   const uint32_t& limit, bool with_values,
+                                                                   const persistent::version_t& ver) const {
+    debug_enter_func_with_args("secondary_key={},start_after={},limit={},with_values={},ver=0x{:x}",
+                               secondary_key,start_after,limit,with_values,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned lookup, ver=0x{:x}", ver);
+        return {};
+    }
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_lookup_by_index)>(secondary_key,start_after,
+                                                                                            limit,with_values);
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return pick_reply(results,false);
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 uint64_t VolatileCascadeStore<KT,VT,IK,IV>::get_size(const KT& key, const persistent::version_t& ver, bool) const {
     debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
@@ -109,13 +241,9 @@ uint64_t VolatileCascadeStore<KT,VT,IK,IV>::get_size(const KT& key, const persis
     }
     derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
     auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_get_size)>(key);
-    auto& replies = results.get();
     // TODO: verify consistency ?
-    // for (auto& reply_pair : replies) {
-    //     ret = reply_pair.second.get();
-    // }
     debug_leave_func();
-    return replies.begin()->second.get();
+    return pick_reply(results,false);
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
@@ -127,11 +255,81 @@ uint64_t VolatileCascadeStore<KT,VT,IK,IV>::get_size_by_time(const KT& key, cons
     return 0;
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+ObjectMetadata VolatileCascadeStore<KT,VT,IK,IV>::head(const KT& key, const persistent::version_t& ver, bool) const {
+    debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned head, ver=0x{:x}", ver);
+        return get_null_object_metadata();
+    }
+    derecho::Replicated<VolatileCascadeStore>& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_head)>(key);
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return pick_reply(results,false);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+const VT VolatileCascadeStore<KT,VT,IK,IV>::get_local(const KT& key, const ReadConsistency& consistency,
+                                                      const persistent::version_t& read_point,
+                                                      const uint64_t& max_staleness_us) const {
+    debug_enter_func_with_args("key={},consistency={},read_point=0x{:x},max_staleness_us={}",
+                               key,static_cast<uint32_t>(consistency),read_point,max_staleness_us);
+    if (!frontier.can_serve(consistency,read_point,max_staleness_us)) {
+        debug_leave_func_with_value("local state does not satisfy consistency level {}, fall back to ordered get.",
+                                    static_cast<uint32_t>(consistency));
+        return get(key,CURRENT_VERSION);
+    }
+    if (transfer_active) {
+        debug_leave_func_with_value("local state is being transferred, fall back to ordered get, key={}",key);
+        return get(key,CURRENT_VERSION);
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func_with_value("key={}",key);
+        return it->second;
+    }
+    debug_leave_func();
+    return *IV;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+uint64_t VolatileCascadeStore<KT,VT,IK,IV>::get_size_local(const KT& key, const ReadConsistency& consistency,
+                                                           const persistent::version_t& read_point,
+                                                           const uint64_t& max_staleness_us) const {
+    debug_enter_func_with_args("key={},consistency={},read_point=0x{:x},max_staleness_us={}",
+                               key,static_cast<uint32_t>(consistency),read_point,max_staleness_us);
+    if (!frontier.can_serve(consistency,read_point,max_staleness_us)) {
+        debug_leave_func_with_value("local state does not satisfy consistency level {}, fall back to ordered get_size.",
+                                    static_cast<uint32_t>(consistency));
+        return get_size(key,CURRENT_VERSION);
+    }
+    if (transfer_active) {
+        debug_leave_func_with_value("local state is being transferred, fall back to ordered get_size, key={}",key);
+        return get_size(key,CURRENT_VERSION);
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func_with_value("key={}",key);
+        return get_raw_size(it->second);
+    }
+    debug_leave_func();
+    return 0;
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 std::vector<KT> VolatileCascadeStore<KT,VT,IK,IV>::ordered_list_keys() {
     std::vector<KT> key_list;
     debug_enter_func();
-    for(auto kv: this->kv_map) {
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    // the state transfer thread might be writing kv_map.
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    key_list.reserve(this->kv_map.size());
+    for(const auto& kv: this->kv_map) {
         key_list.push_back(kv.first);
     }
     debug_leave_func();
@@ -139,17 +337,71 @@ std::vector<KT> VolatileCascadeStore<KT,VT,IK,IV>::ordered_list_keys() {
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
-std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::ordered_put(const VT& value) {
-    debug_enter_func_with_args("key={}",value.get_key_ref());
+ScanPage<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::ordered_scan(const std::string& prefix, const KT& start_after,
+                                                                const uint32_t& limit, bool with_values) {
+    debug_enter_func_with_args("prefix={},start_after={},limit={},with_values={}",prefix,start_after,limit,with_values);
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto page = scan_kv_map<KT,VT,IK>(this->kv_map,prefix,start_after,limit,with_values,get_scan_max_page_bytes());
+    rlck.unlock();
+    debug_leave_func_with_value("{} keys, has_more={}",page.keys.size(),page.has_more);
+    return page;
+}
 
-    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+template<typename KT, typename VT, KT* IK, VT* IV>
+QueryPage<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::ordered_query(const ShardQuery<KT>& query, const KT& start_after,
+                                                                  const uint32_t& limit) {
+    debug_enter_func_with_args("start_after={},limit={}",start_after,limit);
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto page = query_kv_map<KT,VT,IK>(this->kv_map,query,start_after,limit,get_scan_max_page_bytes());
+    rlck.unlock();
+    debug_leave_func_with_value("{} keys, {} matches, has_more={}",page.keys.size(),page.num_matches,page.has_more);
+    return page;
+}
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                                           const uint32_t& limit, bool with_values) {
+    debug_enter_func_with_args("secondary_key={},start_after={},limit={},with_values={}",
+                               secondary_key,start_after,limit,with_values);
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    // the first lookup builds the index.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    build_secondary_index();
+    auto page = secondary_index.lookup(this->kv_map,secondary_key,start_after,limit,with_values,
+                                       get_scan_max_page_bytes());
+    wlck.unlock();
+    debug_leave_func_with_value("{} keys, has_more={}",page.keys.size(),page.has_more);
+    return page;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+bool VolatileCascadeStore<KT,VT,IK,IV>::apply_ordered_put(const VT& value,
+        const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
     if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
         value.set_version(std::get<0>(version_and_timestamp));
     }
     if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
         value.set_timestamp(std::get<1>(version_and_timestamp));
     }
+    if (!scan_config_loaded) {
+        auto subgroup_id = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_subgroup_id();
+        ordered_scans = load_ordered_scans(subgroup_id);
+        scan_config_loaded = true;
+    }
+    // the state transfer thread might be writing kv_map.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (ordered_scans) {
+        // a transferred state starts without the side index.
+        keep_key_order(this->kv_map);
+    }
     // Verify previous version MUST happen before update previous versions.
     if constexpr (std::is_base_of<IVerifyPreviousVersion,VT>::value) {
         bool verify_result;
@@ -159,8 +411,9 @@ std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::or
             verify_result = value.verify_previous_version(this->update_version,persistent::INVALID_VERSION);
         }
         if (!verify_result) {
-            // reject the update by returning an invalid version and timestamp
-            return {persistent::INVALID_VERSION,0};
+            // a rejected put depends on the previous version as much as an accepted one.
+            touch_during_transfer(value.get_key_ref(),std::get<0>(version_and_timestamp),true);
+            return false;
         }
     }
     if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
@@ -171,31 +424,44 @@ std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::or
         }
     }
     this->kv_map.erase(value.get_key_ref()); // remove
-    this->kv_map.emplace(value.get_key_ref(), value); // copy constructor
+    // copy constructor: the blob is copied out of the message buffer once, its later copies share the stored bytes.
+    auto stored = this->kv_map.emplace(value.get_key_ref(), value).first;
+    // the observer gets the stored object, whose copies do not copy the blob again.
+    std::optional<VT> observed_value;
+    if (cascade_watcher_ptr) {
+        observed_value.emplace(stored->second);
+    }
     this->update_version = std::get<0>(version_and_timestamp);
+    this->state_version = std::get<0>(version_and_timestamp);
+    secondary_index.on_update(value.get_key_ref(),value);
+    // the previous version of the key comes from the object, which might not be transferred yet.
+    touch_during_transfer(value.get_key_ref(),std::get<0>(version_and_timestamp),
+                          std::is_base_of<IVerifyPreviousVersion,VT>::value ||
+                          std::is_base_of<IKeepPreviousVersion,VT>::value);
+    wlck.unlock();
+    eviction_policy.on_update(value.get_key_ref(),
+                              mutils::bytes_size(value.get_key_ref()) + get_raw_size(value),
+                              std::get<1>(version_and_timestamp));
 
     if (cascade_watcher_ptr) {
         (*cascade_watcher_ptr)(
             // group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_subgroup_id(), // this is subgroup id
             this->subgroup_index, // this is subgroup index
             group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_shard_num(),
-            value.get_key_ref(), value, cascade_context_ptr);
+            value.get_key_ref(), *observed_value, cascade_context_ptr);
     }
-
-    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
-
-    return version_and_timestamp;
+    return true;
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
-std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::ordered_remove(const KT& key) {
-    debug_enter_func_with_args("key={}",key);
-
-    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
-
+bool VolatileCascadeStore<KT,VT,IK,IV>::apply_ordered_remove(const KT& key,
+        const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
+    // the state transfer thread might be writing kv_map.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
     if (this->kv_map.find(key)==this->kv_map.end()) {
-        debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
-        return version_and_timestamp;
+        // the key is gone anyway, so that a chunk pulled later does not bring it back.
+        touch_during_transfer(key,std::get<0>(version_and_timestamp),false);
+        return false;
     }
 
     auto value = create_null_object_cb<KT,VT,IK,IV>(key);
@@ -207,15 +473,17 @@ std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::or
         value.set_timestamp(std::get<1>(version_and_timestamp));
     }
     if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
-        if (this->kv_map.find(key)!=this->kv_map.end()) {
-            value.set_previous_version(this->update_version,this->kv_map.at(key).get_version());
-        } else {
-            value.set_previous_version(this->update_version,persistent::INVALID_VERSION);
-        }
+        value.set_previous_version(this->update_version,this->kv_map.at(key).get_version());
     }
-    this->kv_map.erase(key); // remove
-    this->kv_map.emplace(key, value);
+    // Derecho delivers an ordered message only when it is stable in the shard, so the tombstone is dropped right away;
+    // the watcher still sees it.
+    this->kv_map.erase(key);
     this->update_version = std::get<0>(version_and_timestamp);
+    this->state_version = std::get<0>(version_and_timestamp);
+    secondary_index.on_erase(key);
+    touch_during_transfer(key,std::get<0>(version_and_timestamp),false);
+    wlck.unlock();
+    eviction_policy.on_erase(key);
 
     if (cascade_watcher_ptr) {
         (*cascade_watcher_ptr)(
@@ -224,17 +492,131 @@ std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::or
             group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_shard_num(),
             key, value,cascade_context_ptr);
     }
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::build_secondary_index() {
+    if (secondary_index_extractor_ptr == nullptr || secondary_index.is_built()) {
+        return;
+    }
+    auto extractor_ptr = secondary_index_extractor_ptr;
+    const uint32_t subgroup_index = this->subgroup_index;
+    const uint32_t shard_num = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_shard_num();
+    secondary_index.build([extractor_ptr,subgroup_index,shard_num](const KT& key, const VT& value){
+                              return (*extractor_ptr)(subgroup_index,shard_num,key,value);
+                          },this->kv_map);
+    dbg_default_debug("{} indexed {} keys.", __func__, this->kv_map.size());
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::evict(const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
+    if (!eviction_policy.is_enabled()) {
+        return;
+    }
+    auto victims = eviction_policy.evict(std::get<1>(version_and_timestamp));
+    if (victims.empty()) {
+        return;
+    }
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    for (const auto& key: victims) {
+        this->kv_map.erase(key);
+        touch_during_transfer(key,std::get<0>(version_and_timestamp),false);
+        secondary_index.on_erase(key);
+    }
+    this->state_version = std::get<0>(version_and_timestamp);
+    wlck.unlock();
+    dbg_default_debug("{} evicted {} keys, {} bytes left.", __func__, victims.size(), eviction_policy.get_total_bytes());
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::ordered_put(const VT& value) {
+    debug_enter_func_with_args("key={}",value.get_key_ref());
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+
+    bool accepted = apply_ordered_put(value,version_and_timestamp);
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    if (!accepted) {
+        // reject the update by returning an invalid version and timestamp
+        debug_leave_func_with_value("rejected version=0x{:x}",std::get<0>(version_and_timestamp));
+        return {persistent::INVALID_VERSION,0};
+    }
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return version_and_timestamp;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,uint64_t> VolatileCascadeStore<KT,VT,IK,IV>::ordered_remove(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+
+    apply_ordered_remove(key,version_and_timestamp);
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
 
     debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
     
     return version_and_timestamp;
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> VolatileCascadeStore<KT,VT,IK,IV>::ordered_put_batch(const std::vector<VT>& values) {
+    debug_enter_func_with_args("num_objects={}",values.size());
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    ret.reserve(values.size());
+    // a key is put once per batch: a repeated put would share the version of the first one and chain to it as its
+    // own previous version by key.
+    std::set<KT> batch_keys;
+    for (const auto& value: values) {
+        if (batch_keys.insert(value.get_key_ref()).second && apply_ordered_put(value,version_and_timestamp)) {
+            ret.emplace_back(version_and_timestamp);
+        } else {
+            ret.emplace_back(persistent::INVALID_VERSION,0);
+        }
+    }
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> VolatileCascadeStore<KT,VT,IK,IV>::ordered_remove_batch(const std::vector<KT>& keys) {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+
+    for (const auto& key: keys) {
+        apply_ordered_remove(key,version_and_timestamp);
+    }
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return std::vector<std::tuple<persistent::version_t,uint64_t>>(keys.size(),version_and_timestamp);
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 const VT VolatileCascadeStore<KT,VT,IK,IV>::ordered_get(const KT& key) {
     debug_enter_func_with_args("key={}",key);
 
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
     if (this->kv_map.find(key) != this->kv_map.end()) {
+        eviction_policy.on_access(key);
         debug_leave_func_with_value("key={}",key);
         return this->kv_map.at(key);
     } else {
@@ -243,81 +625,268 @@ const VT VolatileCascadeStore<KT,VT,IK,IV>::ordered_get(const KT& key) {
     }
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<VT> VolatileCascadeStore<KT,VT,IK,IV>::ordered_multi_get(const std::vector<KT>& keys) {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    std::vector<VT> values;
+    values.reserve(keys.size());
+    for (const auto& key: keys) {
+        auto it = this->kv_map.find(key);
+        if (it != this->kv_map.end()) {
+            eviction_policy.on_access(key);
+            values.emplace_back(it->second);
+        } else {
+            values.emplace_back(*IV);
+        }
+    }
+    debug_leave_func();
+    return values;
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 uint64_t VolatileCascadeStore<KT,VT,IK,IV>::ordered_get_size(const KT& key) {
     debug_enter_func_with_args("key={}",key);
 
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
     if (this->kv_map.find(key) != this->kv_map.end()) {
-        return mutils::bytes_size(this->kv_map.at(key));
+        return get_raw_size(this->kv_map.at(key));
     } else {
         debug_leave_func();
         return 0;
     }
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+ObjectMetadata VolatileCascadeStore<KT,VT,IK,IV>::ordered_head(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    auto version_and_timestamp = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index).get_next_version();
+    evict(version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func();
+        return get_object_metadata<KT,VT>(it->second);
+    }
+    debug_leave_func();
+    return get_null_object_metadata();
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 std::unique_ptr<VolatileCascadeStore<KT,VT,IK,IV>> VolatileCascadeStore<KT,VT,IK,IV>::from_bytes(
     mutils::DeserializationManager* dsm, 
     char const* buf) {
-    auto kv_map_ptr = mutils::from_bytes<std::map<KT,VT>>(dsm,buf);
-    auto update_version_ptr = mutils::from_bytes<persistent::version_t>(dsm,buf+mutils::bytes_size(*kv_map_ptr));
+    std::size_t offset = 0;
+    auto update_version_ptr = mutils::from_bytes<persistent::version_t>(dsm,buf);
+    offset += mutils::bytes_size(*update_version_ptr);
+    auto state_version_ptr = mutils::from_bytes<persistent::version_t>(dsm,buf+offset);
+    offset += mutils::bytes_size(*state_version_ptr);
+    auto eviction_policy_ptr = mutils::from_bytes<ClockEvictionPolicy<KT>>(dsm,buf+offset);
+    offset += mutils::bytes_size(*eviction_policy_ptr);
+    bool with_kv_map = *mutils::from_bytes<bool>(dsm,buf+offset);
+    offset += mutils::bytes_size(with_kv_map);
+    // without kv_map, it is pulled from the other replicas after the view change.
+    auto kv_map_ptr = with_kv_map ? mutils::from_bytes<KVIndex<KT,VT>>(dsm,buf+offset) :
+                                    std::make_unique<KVIndex<KT,VT>>();
     auto volatile_cascade_store_ptr =
         std::make_unique<VolatileCascadeStore>(std::move(*kv_map_ptr),
                                                *update_version_ptr,
+                                               std::move(*eviction_policy_ptr),
                                                dsm->registered<CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>>()?&(dsm->mgr<CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>>()):nullptr,
-                                               dsm->registered<ICascadeContext>()?&(dsm->mgr<ICascadeContext>()):nullptr);
+                                               dsm->registered<ICascadeContext>()?&(dsm->mgr<ICascadeContext>()):nullptr,
+                                               dsm->registered<SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>>()?&(dsm->mgr<SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>>()):nullptr);
+    volatile_cascade_store_ptr->state_version = *state_version_ptr;
+    if (!with_kv_map) {
+        volatile_cascade_store_ptr->transfer_active = true;
+        volatile_cascade_store_ptr->transfer_base_version = *state_version_ptr;
+        volatile_cascade_store_ptr->transfer_thread =
+            std::thread(&VolatileCascadeStore::state_transfer_loop,volatile_cascade_store_ptr.get());
+    }
     return volatile_cascade_store_ptr;
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+    // kv_map goes last, so that it can be left out for the chunked state transfer.
+    bool with_kv_map = (get_vcs_state_transfer_chunk_bytes() == 0);
+    mutils::post_object(f,update_version);
+    mutils::post_object(f,state_version);
+    mutils::post_object(f,eviction_policy);
+    mutils::post_object(f,with_kv_map);
+    if (with_kv_map) {
+        mutils::post_object(f,kv_map);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::size_t VolatileCascadeStore<KT,VT,IK,IV>::bytes_size() const {
+    bool with_kv_map = (get_vcs_state_transfer_chunk_bytes() == 0);
+    return mutils::bytes_size(update_version) + mutils::bytes_size(state_version) + mutils::bytes_size(eviction_policy) +
+           mutils::bytes_size(with_kv_map) + (with_kv_map ? mutils::bytes_size(kv_map) : 0);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::size_t VolatileCascadeStore<KT,VT,IK,IV>::to_bytes(char* buf) const {
+    std::size_t offset = 0;
+    post_object([buf,&offset](char const* const bytes, std::size_t size){
+        memcpy(buf + offset,bytes,size);
+        offset += size;
+    });
+    return offset;
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV>
 VolatileCascadeStore<KT,VT,IK,IV>::VolatileCascadeStore(
     CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cw,
-    ICascadeContext* cc):
+    ICascadeContext* cc,
+    SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* sie):
     update_version(persistent::INVALID_VERSION),
     cascade_watcher_ptr(cw),
-    cascade_context_ptr(cc) {
+    cascade_context_ptr(cc),
+    secondary_index_extractor_ptr(sie),
+    scan_config_loaded(false),
+    ordered_scans(false),
+    state_version(persistent::INVALID_VERSION),
+    transfer_active(false),
+    transfer_base_version(persistent::INVALID_VERSION),
+    transfer_cursor(*IK),
+    transfer_swept(false),
+    transfer_failed(false),
+    transfer_thread_alive(true) {
     debug_enter_func();
     debug_leave_func();
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
 VolatileCascadeStore<KT,VT,IK,IV>::VolatileCascadeStore(
-    const std::map<KT,VT>& _kvm,
+    const KVIndex<KT,VT>& _kvm,
     persistent::version_t _uv,
     CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cw,
-    ICascadeContext* cc):
+    ICascadeContext* cc,
+    SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* sie):
     kv_map(_kvm),
     update_version(_uv),
     cascade_watcher_ptr(cw),
-    cascade_context_ptr(cc) {
+    cascade_context_ptr(cc),
+    secondary_index_extractor_ptr(sie),
+    scan_config_loaded(false),
+    ordered_scans(false),
+    state_version(_uv),
+    transfer_active(false),
+    transfer_base_version(persistent::INVALID_VERSION),
+    transfer_cursor(*IK),
+    transfer_swept(false),
+    transfer_failed(false),
+    transfer_thread_alive(true) {
     debug_enter_func_with_args("copy to kv_map, size={}",kv_map.size());
+    // track the keys in the iteration order of kv_map; the objects without timestamp never expire.
+    for (const auto& kv: kv_map) {
+        uint64_t ts_us = 0;
+        if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+            ts_us = kv.second.get_timestamp();
+        }
+        eviction_policy.on_update(kv.first,mutils::bytes_size(kv.first)+get_raw_size(kv.second),ts_us);
+    }
     debug_leave_func();
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
 VolatileCascadeStore<KT,VT,IK,IV>::VolatileCascadeStore(
-    std::map<KT,VT>&& _kvm,
+    KVIndex<KT,VT>&& _kvm,
     persistent::version_t _uv,
+    ClockEvictionPolicy<KT>&& _ep,
     CriticalDataPathObserver<VolatileCascadeStore<KT,VT,IK,IV>>* cw,
-    ICascadeContext* cc):
+    ICascadeContext* cc,
+    SecondaryIndexExtractor<VolatileCascadeStore<KT,VT,IK,IV>>* sie):
     kv_map(std::move(_kvm)),
     update_version(_uv),
     cascade_watcher_ptr(cw),
-    cascade_context_ptr(cc) {
+    cascade_context_ptr(cc),
+    secondary_index_extractor_ptr(sie),
+    scan_config_loaded(false),
+    ordered_scans(false),
+    eviction_policy(std::move(_ep)),
+    state_version(_uv),
+    transfer_active(false),
+    transfer_base_version(persistent::INVALID_VERSION),
+    transfer_cursor(*IK),
+    transfer_swept(false),
+    transfer_failed(false),
+    transfer_thread_alive(true) {
     debug_enter_func_with_args("move to kv_map, size={}",kv_map.size());
     debug_leave_func();
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV>
+VolatileCascadeStore<KT,VT,IK,IV>::~VolatileCascadeStore() {
+    std::unique_lock<std::mutex> lck(transfer_mutex);
+    transfer_thread_alive = false;
+    lck.unlock();
+    transfer_cv.notify_all();
+    if (transfer_thread.joinable()) {
+        transfer_thread.join();
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // 2 - Persistent Cascade Store Implementation
 ///////////////////////////////////////////////////////////////////////////////
-template <typename KT, typename VT, KT* IK, VT* IV>
-void DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::set_data_len(const size_t& dlen) {
-    assert(capacity >= dlen);
-    this->len = dlen;
+template <typename VT>
+LoggedObjects<VT>::LoggedObjects(std::vector<VT>&& _values):
+    values(std::move(_values)) {}
+
+template <typename VT>
+std::size_t LoggedObjects<VT>::to_bytes(char* buf) const {
+    std::size_t offset = 0;
+    post_object([buf,&offset](char const* const bytes, std::size_t size){
+        memcpy(buf + offset,bytes,size);
+        offset += size;
+    });
+    return offset;
 }
 
-template <typename KT, typename VT, KT* IK, VT* IV>
+template <typename VT>
+void LoggedObjects<VT>::post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+    const uint64_t magic = DELTA_FORMAT_MAGIC;
+    mutils::post_object(f,magic);
+    mutils::post_object(f,values);
+}
+
+template <typename VT>
+std::size_t LoggedObjects<VT>::bytes_size() const {
+    return sizeof(uint64_t) + mutils::bytes_size(values);
+}
+
+template <typename VT>
+std::unique_ptr<LoggedObjects<VT>> LoggedObjects<VT>::from_bytes(mutils::DeserializationManager* dsm, char const* buf) {
+    uint64_t magic;
+    memcpy(&magic,buf,sizeof(magic));
+    if (magic == DELTA_FORMAT_MAGIC) {
+        auto values_ptr = mutils::from_bytes<std::vector<VT>>(dsm,buf + sizeof(magic));
+        return std::make_unique<LoggedObjects>(std::move(*values_ptr));
+    }
+    // an entry of an earlier release, with a single object.
+    std::vector<VT> values;
+    values.emplace_back(std::move(*mutils::from_bytes<VT>(dsm,buf)));
+    return std::make_unique<LoggedObjects>(std::move(values));
+}
+
+template <typename KT, typename VT, KT* IK, VT* IV>
+void DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::set_data_len(const size_t& dlen) {
+    assert(capacity >= dlen);
+    this->len = dlen;
+}
+
+template <typename KT, typename VT, KT* IK, VT* IV>
 char* DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::data_ptr() {
     assert(buffer != nullptr);
     return buffer;
@@ -325,27 +894,20 @@ char* DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::data_ptr() {
 
 template <typename KT, typename VT, KT* IK, VT *IV>
 void DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::calibrate(const size_t& dlen) {
-    size_t new_cap = dlen;
-    if(this->capacity >= new_cap) {
-        return;
-    }
-    // calculate new capacity
-    int width = sizeof(size_t) << 3;
-    int right_shift_bits = 1;
-    new_cap--;
-    while(right_shift_bits < width) {
-        new_cap |= new_cap >> right_shift_bits;
-        right_shift_bits = right_shift_bits << 1;
-    }
-    new_cap++;
-    // resize
-    this->buffer = (char*)realloc(buffer, new_cap);
-    if(this->buffer == nullptr) {
-        dbg_default_crit("{}:{} Failed to allocate delta buffer. errno={}", __FILE__, __LINE__, errno);
-        throw derecho::derecho_exception("Failed to allocate delta buffer.");
-    } else {
-        this->capacity = new_cap;
+    if(this->capacity >= dlen) {
+        return;
+    }
+    // swap in a buffer of the new size class, copying the data only.
+    size_t new_cap = DeltaBufferPool::get_size_class(dlen);
+    char* new_buffer = DeltaBufferPool::get().acquire(new_cap);
+    if (this->len > 0) {
+        memcpy(new_buffer,this->buffer,this->len);
+    }
+    if (this->buffer != nullptr) {
+        DeltaBufferPool::get().release(this->buffer,this->capacity);
     }
+    this->buffer = new_buffer;
+    this->capacity = new_cap;
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
@@ -360,40 +922,142 @@ void DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::clean() {
 
 template <typename KT, typename VT, KT* IK, VT *IV>
 void DeltaCascadeStoreCore<KT,VT,IK,IV>::_Delta::destroy() {
-    if(this->capacity > 0) {
-        free(this->buffer);
+    if(this->buffer != nullptr) {
+        DeltaBufferPool::get().release(this->buffer,this->capacity);
+        this->buffer = nullptr;
+        this->capacity = 0;
     }
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
 void DeltaCascadeStoreCore<KT,VT,IK,IV>::initialize_delta() {
-    delta.buffer = (char*)malloc(DEFAULT_DELTA_BUFFER_CAPACITY);
-    if (delta.buffer == nullptr) {
-        dbg_default_crit("{}:{} Failed to allocate delta buffer. errno={}", __FILE__, __LINE__, errno);
-        throw derecho::derecho_exception("Failed to allocate delta buffer.");
-    }
+    delta.buffer = DeltaBufferPool::get().acquire(DEFAULT_DELTA_BUFFER_CAPACITY);
     delta.capacity = DEFAULT_DELTA_BUFFER_CAPACITY;
     delta.len = 0;
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
 void DeltaCascadeStoreCore<KT,VT,IK,IV>::finalizeCurrentDelta(const persistent::DeltaFinalizer& df) {
+    if (this->delta.is_empty()) {
+        // a version without object still logs an empty list.
+        *reinterpret_cast<uint64_t*>(this->delta.data_ptr()) = DELTA_FORMAT_MAGIC;
+        *reinterpret_cast<std::size_t*>(this->delta.data_ptr() + sizeof(uint64_t)) = 0;
+        this->delta.set_data_len(sizeof(uint64_t) + sizeof(std::size_t));
+    }
     df(this->delta.buffer, this->delta.len);
     this->delta.clean();
+    if (this->delta.capacity > DEFAULT_DELTA_BUFFER_CAPACITY) {
+        // give the big buffer to the next big delta of any shard.
+        this->delta.destroy();
+        this->delta.calibrate(DEFAULT_DELTA_BUFFER_CAPACITY);
+    }
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
 void DeltaCascadeStoreCore<KT,VT,IK,IV>::applyDelta(char const* const delta) {
-    apply_ordered_put(*mutils::from_bytes<VT>(nullptr,delta));
-    mutils::deserialize_and_run(nullptr,delta,[this](const VT& value){
-        this->apply_ordered_put(value);
+    if (this->replay_deferred) {
+        return;
+    }
+    mutils::deserialize_and_run(nullptr,delta,[this](const LoggedObjects<VT>& logged){
+        for (const auto& value: logged.values) {
+            this->apply_ordered_put(value);
+        }
     });
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
 void DeltaCascadeStoreCore<KT,VT,IK,IV>::apply_ordered_put(const VT& value) {
+    if (is_blob_patch(value)) {
+        VT full_value(value);
+        apply_ordered_put(std::move(full_value));
+        return;
+    }
+    this->kv_map.erase(value.get_key_ref());
+    // a null object is a tombstone: the log keeps it, the current state does not.
+    if (!value.is_null()) {
+        this->kv_map.emplace(value.get_key_ref(),value);
+    }
+}
+
+template <typename KT, typename VT, KT* IK, VT *IV>
+void DeltaCascadeStoreCore<KT,VT,IK,IV>::apply_ordered_put(VT&& value) {
+    if constexpr (std::is_base_of<IHasBlobPatch,VT>::value) {
+        if (value.is_blob_patch()) {
+            // replaying the log in order, kv_map has the previous version of the key.
+            auto it = this->kv_map.find(value.get_key_ref());
+            if (it == this->kv_map.end()) {
+                throw derecho::derecho_exception("Failed to restore a patched object: its previous version is missing.");
+            }
+            restore_blob(value,it->second);
+        }
+    }
     this->kv_map.erase(value.get_key_ref());
-    this->kv_map.emplace(value.get_key_ref(),value);
+    if (!value.is_null()) {
+        KT key = value.get_key_ref();
+        this->kv_map.emplace(std::move(key),std::move(value));
+    }
+}
+
+template <typename KT, typename VT, KT* IK, VT *IV>
+void DeltaCascadeStoreCore<KT,VT,IK,IV>::append_to_delta(const VT& value) {
+    BlobCompressionScope compression_scope(log_compression);
+    // the layout is the same as serializing a LoggedObjects.
+    if (this->delta.is_empty()) {
+        this->delta.calibrate(sizeof(uint64_t) + sizeof(std::size_t));
+        *reinterpret_cast<uint64_t*>(this->delta.data_ptr()) = DELTA_FORMAT_MAGIC;
+        *reinterpret_cast<std::size_t*>(this->delta.data_ptr() + sizeof(uint64_t)) = 0;
+        this->delta.set_data_len(sizeof(uint64_t) + sizeof(std::size_t));
+    }
+    std::size_t value_size = mutils::bytes_size(value);
+    this->delta.calibrate(this->delta.len + value_size);
+    mutils::to_bytes(value,this->delta.data_ptr() + this->delta.len);
+    this->delta.set_data_len(this->delta.len + value_size);
+    (*reinterpret_cast<std::size_t*>(this->delta.data_ptr() + sizeof(uint64_t))) ++;
+}
+
+template <typename KT, typename VT, KT* IK, VT *IV>
+bool DeltaCascadeStoreCore<KT,VT,IK,IV>::append_patch_to_delta(const VT& value) {
+    if constexpr (std::is_base_of<IHasBlobPatch,VT>::value && std::is_base_of<IHasBlob,VT>::value) {
+        auto it = this->kv_map.find(value.get_key_ref());
+        if (it == this->kv_map.end() || it->second.is_null()) {
+            return false;
+        }
+        std::vector<char> patch;
+        if (!BlobPatch::encode(it->second.get_blob_bytes(),it->second.get_blob_size(),
+                               value.get_blob_bytes(),value.get_blob_size(),
+                               patch,value.get_blob_size()/2)) {
+            return false;
+        }
+        VT logged_value(value);
+        logged_value.set_blob(patch.data(),patch.size(),true);
+        append_to_delta(logged_value);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+template <typename KT, typename VT, KT* IK, VT *IV>
+void DeltaCascadeStoreCore<KT,VT,IK,IV>::restore_blob(VT& value, const VT& base) {
+    if constexpr (std::is_base_of<IHasBlobPatch,VT>::value && std::is_base_of<IHasBlob,VT>::value) {
+        if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
+            if (base.get_version() != value.get_previous_version_by_key()) {
+                throw derecho::derecho_exception("Failed to restore a patched object: its previous version is missing.");
+            }
+        }
+        std::vector<char> blob;
+        if (!BlobPatch::decode(base.get_blob_bytes(),base.get_blob_size(),
+                               value.get_blob_bytes(),value.get_blob_size(),blob)) {
+            throw derecho::derecho_exception("Failed to restore a patched object: the patch is corrupted.");
+        }
+        value.set_blob(blob.data(),blob.size(),false);
+    }
+}
+
+template <typename KT, typename VT, KT* IK, VT *IV>
+void DeltaCascadeStoreCore<KT,VT,IK,IV>::reserve_delta(const std::size_t size) {
+    // an empty delta gets the magic and the object count first.
+    this->delta.calibrate((this->delta.is_empty() ? (sizeof(uint64_t) + sizeof(std::size_t)) : this->delta.len) + size);
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
@@ -408,32 +1072,22 @@ std::unique_ptr<DeltaCascadeStoreCore<KT,VT,IK,IV>> DeltaCascadeStoreCore<KT,VT,
 }
 
 template <typename KT, typename VT, KT* IK, VT *IV>
-bool DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_put(const VT& value, persistent::version_t prev_ver) {
+bool DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_put(const VT& value, persistent::version_t prev_ver,
+                                                     persistent::version_t prev_ver_by_key, bool log_as_patch) {
     // verify version MUST happen before updating it's previous versions (prev_ver,prev_ver_by_key).
     if constexpr (std::is_base_of<IVerifyPreviousVersion,VT>::value) {
-        bool verify_result;
-        if (kv_map.find(value.get_key_ref())!=this->kv_map.end()) {
-            verify_result = value.verify_previous_version(prev_ver,this->kv_map.at(value.get_key_ref()).get_version());
-        } else {
-            verify_result = value.verify_previous_version(prev_ver,persistent::INVALID_VERSION);
-        }
-        if (!verify_result) {
+        if (!value.verify_previous_version(prev_ver,prev_ver_by_key)) {
             // reject the package if verify failed.
             return false;
         }
     }
     if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
-        persistent::version_t prev_ver_by_key = persistent::INVALID_VERSION;
-        if (kv_map.find(value.get_key_ref()) != kv_map.end()) {
-            prev_ver_by_key = kv_map.at(value.get_key_ref()).get_version();
-        }
         value.set_previous_version(prev_ver,prev_ver_by_key);
     }
     // create delta.
-    assert(this->delta.is_empty());
-    this->delta.calibrate(mutils::bytes_size(value));
-    mutils::to_bytes(value,this->delta.data_ptr());
-    this->delta.set_data_len(mutils::bytes_size(value));
+    if (!log_as_patch || !append_patch_to_delta(value)) {
+        append_to_delta(value);
+    }
     // apply_ordered_put
     apply_ordered_put(value);
     return true;
@@ -442,12 +1096,8 @@ bool DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_put(const VT& value, persistent
 template <typename KT, typename VT, KT* IK, VT *IV>
 bool DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_remove(const VT& value, persistent::version_t prev_ver) {
     auto& key = value.get_key_ref();
-    // test if key exists
+    // test if key exists. Tombstones are not kept in kv_map, so a removed key is absent as well.
     if  (kv_map.find(key) == kv_map.end()) {
-        // skip it when no such key.
-        return false;
-    } else if (kv_map.at(key).is_null()) {
-        // and skip the keys has been deleted already.
         return false;
     }
 
@@ -455,17 +1105,14 @@ bool DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_remove(const VT& value, persist
         value.set_previous_version(prev_ver,kv_map.at(key).get_version());
     }
     // create delta.
-    assert(this->delta.is_empty());
-    this->delta.calibrate(mutils::bytes_size(value));
-    mutils::to_bytes(value,this->delta.data_ptr());
-    this->delta.set_data_len(mutils::bytes_size(value));
+    append_to_delta(value);
     // apply_ordered_put
     apply_ordered_put(value);
     return true;
 }
 
 template <typename KT, typename VT, KT* IK, VT* IV>
-const VT DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_get(const KT& key) {
+const VT DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_get(const KT& key) const {
     if (kv_map.find(key) != kv_map.end()) {
         return kv_map.at(key);
     } else {
@@ -474,7 +1121,22 @@ const VT DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_get(const KT& key) {
 }
 
 template <typename KT, typename VT, KT* IK, VT* IV>
-std::vector<KT> DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_list_keys() {
+std::vector<VT> DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_multi_get(const std::vector<KT>& keys) const {
+    std::vector<VT> values;
+    values.reserve(keys.size());
+    for (const auto& key: keys) {
+        auto it = kv_map.find(key);
+        if (it != kv_map.end()) {
+            values.emplace_back(it->second);
+        } else {
+            values.emplace_back(*IV);
+        }
+    }
+    return values;
+}
+
+template <typename KT, typename VT, KT* IK, VT* IV>
+std::vector<KT> DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_list_keys() const {
     std::vector<KT> key_list;
     for (auto& kv: kv_map) {
         key_list.push_back(kv.first);
@@ -483,34 +1145,42 @@ std::vector<KT> DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_list_keys() {
 }
 
 template <typename KT, typename VT, KT* IK, VT* IV>
-uint64_t DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_get_size(const KT& key) {
+uint64_t DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_get_size(const KT& key) const {
     if (kv_map.find(key) != kv_map.end()) {
-        return mutils::bytes_size(kv_map.at(key));
+        return get_raw_size(kv_map.at(key));
     } else {
         return 0;
     }
 }
 
 template <typename KT, typename VT, KT* IK, VT* IV>
-DeltaCascadeStoreCore<KT,VT,IK,IV>::DeltaCascadeStoreCore() {
+ObjectMetadata DeltaCascadeStoreCore<KT,VT,IK,IV>::ordered_head(const KT& key) const {
+    auto it = kv_map.find(key);
+    if (it != kv_map.end()) {
+        return get_object_metadata<KT,VT>(it->second);
+    } else {
+        return get_null_object_metadata();
+    }
+}
+
+template <typename KT, typename VT, KT* IK, VT* IV>
+DeltaCascadeStoreCore<KT,VT,IK,IV>::DeltaCascadeStoreCore(): replay_deferred(false) {
     initialize_delta();
 }
 
 template <typename KT, typename VT, KT* IK, VT* IV>
-DeltaCascadeStoreCore<KT,VT,IK,IV>::DeltaCascadeStoreCore(const std::map<KT,VT>& _kv_map): kv_map(_kv_map) {
+DeltaCascadeStoreCore<KT,VT,IK,IV>::DeltaCascadeStoreCore(const KVIndex<KT,VT>& _kv_map): kv_map(_kv_map), replay_deferred(false) {
     initialize_delta();
 }
 
 template <typename KT, typename VT, KT* IK, VT* IV>
-DeltaCascadeStoreCore<KT,VT,IK,IV>::DeltaCascadeStoreCore(std::map<KT,VT>&& _kv_map): kv_map(_kv_map) {
+DeltaCascadeStoreCore<KT,VT,IK,IV>::DeltaCascadeStoreCore(KVIndex<KT,VT>&& _kv_map): kv_map(std::move(_kv_map)), replay_deferred(false) {
     initialize_delta();
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV>
 DeltaCascadeStoreCore<KT,VT,IK,IV>::~DeltaCascadeStoreCore() {
-    if (this->delta.buffer != nullptr) {
-        free(this->delta.buffer);
-    }
+    this->delta.destroy();
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
@@ -543,28 +1213,50 @@ std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST
     return ret;
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::vector<std::tuple<persistent::version_t,uint64_t>> PersistentCascadeStore<KT,VT,IK,IV,ST>::put_batch(const std::vector<VT>& values) const {
+    debug_enter_func_with_args("num_objects={}",values.size());
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_put_batch)>(values);
+    auto& replies = results.get();
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    // TODO: verify consistency ?
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func();
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::vector<std::tuple<persistent::version_t,uint64_t>> PersistentCascadeStore<KT,VT,IK,IV,ST>::remove_batch(const std::vector<KT>& keys) const {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_remove_batch)>(keys);
+    auto& replies = results.get();
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    // TODO: verify consistency ?
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func();
+    return ret;
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::get(const KT& key, const persistent::version_t& ver, bool exact) const {
     debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
     if (ver != CURRENT_VERSION) {
         debug_leave_func();
-        return persistent_core.template getDelta<VT>(ver, [&key,ver,exact,this](const VT& v){
-                if (key == v.get_key_ref()) {
-                    return v;
-                } else {
-                    if (exact) {
-                        // return invalid object for EXACT search.
-                        return *IV;
-                    } else {
-                        // fall back to the slow path.
-                        auto versioned_state_ptr = persistent_core.get(ver);
-                        if (versioned_state_ptr->kv_map.find(key) != versioned_state_ptr->kv_map.end()) {
-                            return versioned_state_ptr->kv_map.at(key);
-                        }
-                        return *IV;
-                    }
-                }
-            });
+        if (exact) {
+            // return invalid object for EXACT search if 'ver' does not update 'key'.
+            return get_from_delta(key,ver);
+        }
+        persistent::version_t key_ver = get_key_version_at_version(key,ver);
+        if (key_ver == persistent::INVALID_VERSION) {
+            return *IV;
+        }
+        return get_from_delta(key,key_ver);
     }
     derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
     auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_get)>(key);
@@ -577,19 +1269,44 @@ const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::get(const KT& key, const persis
     return replies.begin()->second.get();
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::vector<VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const {
+    debug_enter_func_with_args("num_keys={},ver=0x{:x}",keys.size(),ver);
+    if (ver != CURRENT_VERSION) {
+        std::vector<VT> values;
+        values.reserve(keys.size());
+        for (const auto& key: keys) {
+            values.emplace_back(get(key,ver,false));
+        }
+        debug_leave_func();
+        return values;
+    }
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_multi_get)>(keys);
+    auto& replies = results.get();
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::get_by_time(const KT& key, const uint64_t& ts_us) const {
     debug_enter_func_with_args("key={},ts_us={}",key,ts_us);
-    const HLC hlc(ts_us,0ull);
     try {
         debug_leave_func();
-        uint64_t idx = persistent_core.getIndexAtTime({ts_us,0});
+        if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+            persistent::version_t key_ver = get_key_version_at_time(key,ts_us);
+            if (key_ver == persistent::INVALID_VERSION) {
+                return *IV;
+            }
+            return get_from_delta(key,key_ver);
+        }
+        // the version index has no timestamps, use the log.
+        int64_t idx = get_index_at_time(ts_us);
         if (idx == persistent::INVALID_INDEX) {
             return *IV;
         } else {
-            // Reconstructing the state is extremely slow!!!
-            // TODO: get the version at time ts_us, and go back from there.
-            auto versioned_state_ptr = persistent_core.get(hlc);
+            auto versioned_state_ptr = get_state_at_index(idx);
             if (versioned_state_ptr->kv_map.find(key) != versioned_state_ptr->kv_map.end()) {
                 return versioned_state_ptr->kv_map.at(key);
             }
@@ -609,9 +1326,13 @@ uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_size(const KT& key, const p
     debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
     if (ver != CURRENT_VERSION) {
         if (exact) {
-            return persistent_core.template getDelta<VT>(ver,[](const VT& value){return mutils::bytes_size(value);});
+            return get_size_from_delta(key,ver);
         } else {
-            return mutils::bytes_size(persistent_core.get(ver)->kv_map.at(key));
+            persistent::version_t key_ver = get_key_version_at_version(key,ver);
+            if (key_ver == persistent::INVALID_VERSION) {
+                return 0;
+            }
+            return get_size_from_delta(key,key_ver);
         }
     }
     derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
@@ -628,10 +1349,23 @@ uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_size(const KT& key, const p
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_size_by_time(const KT& key, const uint64_t& ts_us) const {
     debug_enter_func_with_args("key={},ts_us={}",key,ts_us);
-    const HLC hlc(ts_us,0ull);
     try {
+        if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+            persistent::version_t key_ver = get_key_version_at_time(key,ts_us);
+            debug_leave_func();
+            if (key_ver == persistent::INVALID_VERSION) {
+                return 0;
+            }
+            return get_size_from_delta(key,key_ver);
+        }
+        // the version index has no timestamps, use the log.
+        int64_t idx = get_index_at_time(ts_us);
+        if (idx == persistent::INVALID_INDEX) {
+            debug_leave_func();
+            return 0;
+        }
         debug_leave_func();
-        return mutils::bytes_size(persistent_core.get(hlc)->kv_map.at(key));
+        return get_raw_size(get_state_at_index(idx)->kv_map.at(key));
     } catch (const int64_t &ex) {
         dbg_default_warn("temporal query throws exception:0x{:x}. key={}, ts={}", ex, key, ts_us);
     } catch (...) {
@@ -641,13 +1375,68 @@ uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_size_by_time(const KT& key,
     return 0;
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+ObjectMetadata PersistentCascadeStore<KT,VT,IK,IV,ST>::head(const KT& key, const persistent::version_t& ver, bool exact) const {
+    debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func();
+        if (exact) {
+            return head_from_delta(key,ver);
+        }
+        persistent::version_t key_ver = get_key_version_at_version(key,ver);
+        if (key_ver == persistent::INVALID_VERSION) {
+            return get_null_object_metadata();
+        }
+        return head_from_delta(key,key_ver);
+    }
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_head)>(key);
+    auto& replies = results.get();
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::get_local(const KT& key, const ReadConsistency& consistency,
+                                                           const persistent::version_t& read_point,
+                                                           const uint64_t& max_staleness_us) const {
+    debug_enter_func_with_args("key={},consistency={},read_point=0x{:x},max_staleness_us={}",
+                               key,static_cast<uint32_t>(consistency),read_point,max_staleness_us);
+    if (!frontier.can_serve(consistency,read_point,max_staleness_us)) {
+        debug_leave_func_with_value("local state does not satisfy consistency level {}, fall back to ordered get.",
+                                    static_cast<uint32_t>(consistency));
+        return get(key,CURRENT_VERSION);
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    blob_tier.on_access(key);
+    debug_leave_func();
+    return this->persistent_core->ordered_get(key);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_size_local(const KT& key, const ReadConsistency& consistency,
+                                                                const persistent::version_t& read_point,
+                                                                const uint64_t& max_staleness_us) const {
+    debug_enter_func_with_args("key={},consistency={},read_point=0x{:x},max_staleness_us={}",
+                               key,static_cast<uint32_t>(consistency),read_point,max_staleness_us);
+    if (!frontier.can_serve(consistency,read_point,max_staleness_us)) {
+        debug_leave_func_with_value("local state does not satisfy consistency level {}, fall back to ordered get_size.",
+                                    static_cast<uint32_t>(consistency));
+        return get_size(key,CURRENT_VERSION);
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    debug_leave_func();
+    return this->persistent_core->ordered_get_size(key);
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 std::vector<KT> PersistentCascadeStore<KT,VT,IK,IV,ST>::list_keys(const persistent::version_t& ver) const {
     debug_enter_func_with_args("ver=0x{:x}.",ver);
     if (ver != CURRENT_VERSION) {
         std::vector<KT> key_list;
-        auto kv_map = persistent_core.get(ver)->kv_map;
-        for (auto& kv:kv_map) {
+        auto versioned_state_ptr = get_state_at_index(get_index_at_version(ver));
+        for (auto& kv:versioned_state_ptr->kv_map) {
             key_list.push_back(kv.first);
         }
         debug_leave_func();
@@ -661,14 +1450,55 @@ std::vector<KT> PersistentCascadeStore<KT,VT,IK,IV,ST>::list_keys(const persiste
     return replies.begin()->second.get();
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+persistent::version_t PersistentCascadeStore<KT,VT,IK,IV,ST>::version_at_time(const uint64_t& ts_us) const {
+    debug_enter_func_with_args("ts_us={}",ts_us);
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    if (time_index.covers(ts_us)) {
+        persistent::version_t ver = time_index.find(ts_us);
+        // the latest truncated update is no later than the base state, which has the same state.
+        if (ver != persistent::INVALID_VERSION && base_index != persistent::INVALID_INDEX && ver < base_version) {
+            ver = base_version;
+        }
+        debug_leave_func_with_value("version=0x{:x}",ver);
+        return ver;
+    }
+    rlck.unlock();
+    // the time index starts after ts_us, use the log.
+    try {
+        int64_t idx = persistent_core.getIndexAtTime(HLC(ts_us,0ull));
+        if (idx != persistent::INVALID_INDEX) {
+            persistent::version_t ver = persistent_core.getVersionAtIndex(idx);
+            debug_leave_func_with_value("version=0x{:x}",ver);
+            return ver;
+        }
+    } catch (const int64_t &ex) {
+        dbg_default_warn("temporal query throws exception:0x{:x}. ts={}", ex, ts_us);
+    } catch (...) {
+        dbg_default_warn("temporal query throws unknown exception. ts={}", ts_us);
+    }
+    // the entry might be truncated into the base state.
+    rlck.lock();
+    if (base_index != persistent::INVALID_INDEX && ts_us >= base_timestamp_us) {
+        debug_leave_func_with_value("version=0x{:x}",base_version);
+        return base_version;
+    }
+    debug_leave_func();
+    return persistent::INVALID_VERSION;
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 std::vector<KT> PersistentCascadeStore<KT,VT,IK,IV,ST>::list_keys_by_time(const uint64_t& ts_us) const {
     debug_enter_func_with_args("ts_us={}",ts_us);
-    const HLC hlc(ts_us,0ull);
     try {
-        auto kv_map = persistent_core.get(hlc)->kv_map;
+        int64_t idx = get_index_at_time(ts_us);
+        if (idx == persistent::INVALID_INDEX) {
+            debug_leave_func();
+            return {};
+        }
+        auto versioned_state_ptr = get_state_at_index(idx);
         std::vector<KT> key_list;
-        for(auto& kv:kv_map) {
+        for(auto& kv:versioned_state_ptr->kv_map) {
             key_list.push_back(kv.first);
         }
         debug_leave_func();
@@ -683,20 +1513,126 @@ std::vector<KT> PersistentCascadeStore<KT,VT,IK,IV,ST>::list_keys_by_time(const
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
-std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_put(const VT& value) {
-    debug_enter_func_with_args("key={}",value.get_key_ref());
-    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version();
+ScanPage<KT,VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::scan(const std::string& prefix, const KT& start_after,
+                                                             const uint32_t& limit, bool with_values,
+                                                             const persistent::version_t& ver) const {
+    debug_enter_func_with_args("prefix={},start_after={},limit={},with_values={},ver=0x{:x}",
+                               prefix,start_after,limit,with_values,ver);
+    if (ver != CURRENT_VERSION) {
+        auto versioned_state_ptr = get_state_at_index(get_index_at_version(ver));
+        debug_leave_func();
+        return scan_kv_map<KT,VT,IK>(versioned_state_ptr->kv_map,prefix,start_after,limit,with_values,
+                                     get_scan_max_page_bytes());
+    }
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_scan)>(prefix,start_after,limit,with_values);
+    auto& replies = results.get();
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+QueryPage<KT,VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::query(const ShardQuery<KT>& query, const KT& start_after,
+                                                               const uint32_t& limit,
+                                                               const persistent::version_t& ver) const {
+    debug_enter_func_with_args("start_after={},limit={},ver=0x{:x}",start_after,limit,ver);
+    if (ver != CURRENT_VERSION) {
+        auto versioned_state_ptr = get_state_at_index(get_index_at_version(ver));
+        debug_leave_func();
+        return query_kv_map<KT,VT,IK>(versioned_state_ptr->kv_map,query,start_after,limit,get_scan_max_page_bytes());
+    }
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_query)>(query,start_after,limit);
+    auto& replies = results.get();
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+ScanPage<KT,VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                                        const uint32_t& limit, bool with_values,
+                                                                        const persistent::version_t& ver) const {
+    debug_enter_func_with_args("secondary_key={},start_after={},limit={},with_values={},ver=0x{:x}",
+                               secondary_key,start_after,limit,with_values,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned lookup, ver=0x{:x}", ver);
+        return {};
+    }
+    derecho::Replicated<PersistentCascadeStore>& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_lookup_by_index)>(secondary_key,start_after,
+                                                                                            limit,with_values);
+    auto& replies = results.get();
+    // TODO: verify consistency ?
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+bool PersistentCascadeStore<KT,VT,IK,IV,ST>::apply_ordered_put(const VT& value,
+        const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
     if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
         value.set_version(std::get<0>(version_and_timestamp));
     }
     if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
         value.set_timestamp(std::get<1>(version_and_timestamp));
     }
-    if (this->persistent_core->ordered_put(value,this->persistent_core.getLatestVersion()) == false) {
-        // verification failed. S we return invalid versions.
-        debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
-        return {persistent::INVALID_VERSION,0};
+    const bool first_put = !log_config_loaded;
+    if (first_put) {
+        auto subgroup_id = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_subgroup_id();
+        this->persistent_core->log_compression = load_log_compression(subgroup_id);
+        delta_encoding.load_subgroup_override(subgroup_id);
+        blob_tier.load_subgroup_override(subgroup_id);
+        ordered_scans = load_ordered_scans(subgroup_id);
+        if (value_file.empty()) {
+            value_file = persistent::getPersFilePath() + "/" +
+                         persistent::PersistentRegistry::generate_prefix(
+                             std::type_index(typeid(PersistentCascadeStore)),this->subgroup_index,
+                             group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_shard_num()) +
+                         ".values";
+        }
+        log_config_loaded = true;
+    }
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (first_put) {
+        // the subgroup might enable the blob tier after the recovery.
+        init_blob_tier();
+    }
+    if (ordered_scans) {
+        // a recovered or transferred state starts without the side index.
+        keep_key_order(this->persistent_core->kv_map);
+    }
+    // version_index still knows the keys whose tombstones are dropped from the current state.
+    persistent::version_t prev_ver_by_key = persistent::INVALID_VERSION;
+    bool log_as_patch = false;
+    auto vi_it = version_index.find(value.get_key_ref());
+    if (vi_it != version_index.end() && !vi_it->second.empty()) {
+        prev_ver_by_key = vi_it->second.back().version;
+        if constexpr (std::is_base_of<IHasBlobPatch,VT>::value && std::is_base_of<IHasBlob,VT>::value &&
+                      std::is_base_of<IKeepPreviousVersion,VT>::value) {
+            // every full_image_interval-th version of a key is logged in full.
+            log_as_patch = delta_encoding.is_enabled() &&
+                           value.get_blob_size() >= delta_encoding.min_bytes &&
+                           (vi_it->second.size() % delta_encoding.full_image_interval) != 0;
+        }
+    }
+    if (this->persistent_core->ordered_put(value,this->persistent_core.getLatestVersion(),prev_ver_by_key,
+                                           log_as_patch) == false) {
+        // verification failed.
+        return false;
+    }
+    auto& key_versions = version_index[value.get_key_ref()];
+    if (key_versions.empty() || key_versions.back().version != std::get<0>(version_and_timestamp)) {
+        key_versions.push_back({std::get<0>(version_and_timestamp),std::get<1>(version_and_timestamp)});
     }
+    time_index.append(std::get<0>(version_and_timestamp),std::get<1>(version_and_timestamp));
+    secondary_index.on_update(value.get_key_ref(),value);
+    if constexpr (std::is_base_of<IHasBlob,VT>::value) {
+        blob_tier.on_update(value.get_key_ref(),value.get_blob_size());
+        evict_blobs();
+    }
+    wlck.unlock();
     if (cascade_watcher_ptr) {
         (*cascade_watcher_ptr)(
             // group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_subgroup_id(), // this is subgroup id
@@ -704,16 +1640,12 @@ std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST
             group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_shard_num(),
             value.get_key_ref(), value, cascade_context_ptr);
     }
-
-    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
-
-    return version_and_timestamp;
+    return true;
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
-std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_remove(const KT& key) {
-    debug_enter_func_with_args("key={}",key);
-    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version();
+bool PersistentCascadeStore<KT,VT,IK,IV,ST>::apply_ordered_remove(const KT& key,
+        const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
     auto value = create_null_object_cb<KT,VT,IK,IV>(key);
     if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
         value.set_version(std::get<0>(version_and_timestamp));
@@ -721,14 +1653,52 @@ std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST
     if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
         value.set_timestamp(std::get<1>(version_and_timestamp));
     }
-    if(this->persistent_core->ordered_remove(value,this->persistent_core.getLatestVersion())) {
-        if (cascade_watcher_ptr) {
-            (*cascade_watcher_ptr)(
-                // group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_subgroup_id(), // this is subgroup id
-                this->subgroup_index,
-                group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_shard_num(),
-                key, value, cascade_context_ptr);
-        }
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (this->persistent_core->ordered_remove(value,this->persistent_core.getLatestVersion()) == false) {
+        return false;
+    }
+    auto& key_versions = version_index[key];
+    if (key_versions.empty() || key_versions.back().version != std::get<0>(version_and_timestamp)) {
+        key_versions.push_back({std::get<0>(version_and_timestamp),std::get<1>(version_and_timestamp)});
+    }
+    time_index.append(std::get<0>(version_and_timestamp),std::get<1>(version_and_timestamp));
+    blob_tier.on_erase(key);
+    secondary_index.on_erase(key);
+    wlck.unlock();
+    if (cascade_watcher_ptr) {
+        (*cascade_watcher_ptr)(
+            // group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_subgroup_id(), // this is subgroup id
+            this->subgroup_index,
+            group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_shard_num(),
+            key, value, cascade_context_ptr);
+    }
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::build_secondary_index() {
+    if (secondary_index_extractor_ptr == nullptr || secondary_index.is_built()) {
+        return;
+    }
+    auto extractor_ptr = secondary_index_extractor_ptr;
+    const uint32_t subgroup_index = this->subgroup_index;
+    const uint32_t shard_num = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_shard_num();
+    secondary_index.build([extractor_ptr,subgroup_index,shard_num](const KT& key, const VT& value){
+                              return (*extractor_ptr)(subgroup_index,shard_num,key,value);
+                          },this->persistent_core->kv_map);
+    dbg_default_debug("{} indexed {} keys.", __func__, this->persistent_core->kv_map.size());
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_put(const VT& value) {
+    debug_enter_func_with_args("key={}",value.get_key_ref());
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version();
+    bool accepted = apply_ordered_put(value,version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    if (!accepted) {
+        // verification failed. S we return invalid versions.
+        debug_leave_func_with_value("rejected version=0x{:x}",std::get<0>(version_and_timestamp));
+        return {persistent::INVALID_VERSION,0};
     }
 
     debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
@@ -737,32 +1707,432 @@ std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST
 }
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
-const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_get(const KT& key) {
+std::tuple<persistent::version_t,uint64_t> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_remove(const KT& key) {
     debug_enter_func_with_args("key={}",key);
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version();
+    apply_ordered_remove(key,version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return version_and_timestamp;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::vector<std::tuple<persistent::version_t,uint64_t>> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_put_batch(const std::vector<VT>& values) {
+    debug_enter_func_with_args("num_objects={}",values.size());
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version();
+    // size the delta for the whole batch at once, by the raw sizes, which bound the compressed ones.
+    std::size_t batch_size = 0;
+    for (const auto& value: values) {
+        batch_size += get_raw_size(value);
+    }
+    this->persistent_core->reserve_delta(batch_size);
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    ret.reserve(values.size());
+    // a key is put once per batch: a repeated put would share the version of the first one and chain to it as its
+    // own previous version by key.
+    std::set<KT> batch_keys;
+    for (const auto& value: values) {
+        if (batch_keys.insert(value.get_key_ref()).second && apply_ordered_put(value,version_and_timestamp)) {
+            ret.emplace_back(version_and_timestamp);
+        } else {
+            ret.emplace_back(persistent::INVALID_VERSION,0);
+        }
+    }
+    frontier.advance(std::get<0>(version_and_timestamp));
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::vector<std::tuple<persistent::version_t,uint64_t>> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_remove_batch(const std::vector<KT>& keys) {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version();
+    for (const auto& key: keys) {
+        apply_ordered_remove(key,version_and_timestamp);
+    }
+    frontier.advance(std::get<0>(version_and_timestamp));
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return std::vector<std::tuple<persistent::version_t,uint64_t>>(keys.size(),version_and_timestamp);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_get(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+    blob_tier.on_access(key);
 
     debug_leave_func();
 
     return this->persistent_core->ordered_get(key);
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::vector<VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_multi_get(const std::vector<KT>& keys) {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+    for (const auto& key: keys) {
+        blob_tier.on_access(key);
+    }
+
+    debug_leave_func();
+
+    return this->persistent_core->ordered_multi_get(keys);
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_get_size(const KT& key) {
     debug_enter_func_with_args("key={}",key);
 
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+
     debug_leave_func();
 
     return this->persistent_core->ordered_get_size(key);
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+ObjectMetadata PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_head(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+
+    debug_leave_func();
+
+    return this->persistent_core->ordered_head(key);
+}
+
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 std::vector<KT> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_list_keys() {
     debug_enter_func();
 
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+
     debug_leave_func();
 
     return this->persistent_core->ordered_list_keys();
 }
 
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+ScanPage<KT,VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_scan(const std::string& prefix, const KT& start_after,
+                                                                     const uint32_t& limit, bool with_values) {
+    debug_enter_func_with_args("prefix={},start_after={},limit={},with_values={}",prefix,start_after,limit,with_values);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+
+    auto page = scan_kv_map<KT,VT,IK>(this->persistent_core->kv_map,prefix,start_after,limit,with_values,
+                                      get_scan_max_page_bytes());
+    debug_leave_func_with_value("{} keys, has_more={}",page.keys.size(),page.has_more);
+    return page;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+QueryPage<KT,VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_query(const ShardQuery<KT>& query, const KT& start_after,
+                                                                       const uint32_t& limit) {
+    debug_enter_func_with_args("start_after={},limit={}",start_after,limit);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+
+    auto page = query_kv_map<KT,VT,IK>(this->persistent_core->kv_map,query,start_after,limit,get_scan_max_page_bytes());
+    debug_leave_func_with_value("{} keys, {} matches, has_more={}",page.keys.size(),page.num_matches,page.has_more);
+    return page;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+ScanPage<KT,VT> PersistentCascadeStore<KT,VT,IK,IV,ST>::ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                                                const uint32_t& limit, bool with_values) {
+    debug_enter_func_with_args("secondary_key={},start_after={},limit={},with_values={}",
+                               secondary_key,start_after,limit,with_values);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index).get_next_version()));
+
+    // the first lookup builds the index.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    build_secondary_index();
+    auto page = secondary_index.lookup(this->persistent_core->kv_map,secondary_key,start_after,limit,with_values,
+                                       get_scan_max_page_bytes());
+    wlck.unlock();
+    debug_leave_func_with_value("{} keys, has_more={}",page.keys.size(),page.has_more);
+    return page;
+}
+
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+int64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_index_at_version(const persistent::version_t& ver) const {
+    int64_t lo = persistent_core.getEarliestIndex();
+    int64_t hi = persistent_core.getLatestIndex();
+    if (lo == persistent::INVALID_INDEX || hi == persistent::INVALID_INDEX ||
+        persistent_core.getVersionAtIndex(lo) > ver) {
+        // the entry might be truncated into the base state.
+        std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+        if (base_index != persistent::INVALID_INDEX && ver >= base_version) {
+            return base_index;
+        }
+        return persistent::INVALID_INDEX;
+    }
+    // the versions in the log are monotonic, find the last index whose version is no later than 'ver'.
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo + 1)/2;
+        if (persistent_core.getVersionAtIndex(mid) <= ver) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::shared_ptr<const DeltaCascadeStoreCore<KT,VT,IK,IV>> PersistentCascadeStore<KT,VT,IK,IV,ST>::get_state_at_index(
+        const int64_t& index) const {
+    using CoreType = DeltaCascadeStoreCore<KT,VT,IK,IV>;
+    debug_enter_func_with_args("index={}",index);
+    if (index == persistent::INVALID_INDEX) {
+        debug_leave_func();
+        return std::make_shared<const CoreType>();
+    }
+    auto [checkpoint_index,checkpoint_timestamp_us,checkpoint_state] = checkpoint_cache.find(index);
+    if (checkpoint_state && checkpoint_index == index) {
+        debug_leave_func_with_value("checkpoint hit at index {}",index);
+        return checkpoint_state;
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    int64_t log_base_index = base_index;
+    uint64_t log_base_timestamp_us = base_timestamp_us;
+    rlck.unlock();
+    if (log_base_index != persistent::INVALID_INDEX && index >= log_base_index &&
+        (!checkpoint_state || checkpoint_index < log_base_index)) {
+        // the log up to the base is truncated, replay from the base state.
+        checkpoint_state = get_base_state();
+        checkpoint_index = log_base_index;
+        checkpoint_timestamp_us = log_base_timestamp_us;
+        if (index == log_base_index) {
+            debug_leave_func_with_value("base state at index {}",index);
+            return checkpoint_state;
+        }
+    }
+    std::shared_ptr<CoreType> state;
+    int64_t next_index;
+    if (checkpoint_state) {
+        state = std::make_shared<CoreType>(checkpoint_state->kv_map);
+        next_index = checkpoint_index + 1;
+    } else {
+        state = std::make_shared<CoreType>();
+        next_index = persistent_core.getEarliestIndex();
+        checkpoint_index = next_index - 1;
+        checkpoint_timestamp_us = 0;
+    }
+    uint64_t timestamp_us = checkpoint_timestamp_us;
+    // replay the log from the checkpoint, leaving checkpoints behind for the following queries.
+    for (int64_t i = next_index; i <= index; i++) {
+        persistent_core.template getDeltaByIndex<LoggedObjects<VT>>(i,[&state,&timestamp_us](const LoggedObjects<VT>& logged){
+            for (const auto& value: logged.values) {
+                if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+                    timestamp_us = value.get_timestamp();
+                }
+                state->apply_ordered_put(value);
+            }
+        });
+        if (i < index && checkpoint_cache.is_due(i,timestamp_us,checkpoint_index,checkpoint_timestamp_us)) {
+            checkpoint_cache.put(i,timestamp_us,std::make_shared<const CoreType>(state->kv_map));
+            checkpoint_index = i;
+            checkpoint_timestamp_us = timestamp_us;
+        }
+    }
+    std::shared_ptr<const CoreType> target_state = std::move(state);
+    // the cache only takes checkpoints at the stride, so that a scan over the history does not evict them with its
+    // read targets.
+    if (checkpoint_cache.is_due(index,timestamp_us,checkpoint_index,checkpoint_timestamp_us)) {
+        checkpoint_cache.put(index,timestamp_us,target_state);
+    }
+    debug_leave_func_with_value("replayed {} log entries",index - next_index + 1);
+    return target_state;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+const VT PersistentCascadeStore<KT,VT,IK,IV,ST>::get_from_delta(const KT& key, const persistent::version_t& ver) const {
+    if (is_truncated(ver)) {
+        auto base_state_ptr = get_base_state();
+        auto it = base_state_ptr->kv_map.find(key);
+        if (it != base_state_ptr->kv_map.end()) {
+            if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
+                if (it->second.get_version() != ver) {
+                    return *IV;
+                }
+            }
+            return it->second;
+        }
+        return *IV;
+    }
+    VT value = persistent_core.template getDelta<LoggedObjects<VT>>(ver,[&key](const LoggedObjects<VT>& logged){
+        // a batch updates a key at most once.
+        for (auto it = logged.values.rbegin(); it != logged.values.rend(); it++) {
+            if (it->get_key_ref() == key) {
+                return *it;
+            }
+        }
+        return *IV;
+    });
+    if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
+        if (is_blob_patch(value)) {
+            // restore the blob from the previous version of the key, which is restored the same way.
+            const VT base = get_from_delta(key,value.get_previous_version_by_key());
+            if (!base.is_valid() || is_blob_patch(base)) {
+                dbg_default_error("{}: failed to restore key:{} at version:0x{:x}, its previous version is missing.",
+                                  __func__, key, ver);
+                return *IV;
+            }
+            try {
+                DeltaCascadeStoreCore<KT,VT,IK,IV>::restore_blob(value,base);
+            } catch (const std::exception& ex) {
+                dbg_default_error("{}: failed to restore key:{} at version:0x{:x}: {}", __func__, key, ver, ex.what());
+                return *IV;
+            }
+        }
+    }
+    return value;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+uint64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_size_from_delta(const KT& key, const persistent::version_t& ver) const {
+    if (is_truncated(ver)) {
+        const VT value = get_from_delta(key,ver);
+        return value.is_valid() ? static_cast<uint64_t>(get_raw_size(value)) : 0;
+    }
+    bool is_patch = false;
+    uint64_t size = persistent_core.template getDelta<LoggedObjects<VT>>(ver,[&key,&is_patch](const LoggedObjects<VT>& logged){
+        for (auto it = logged.values.rbegin(); it != logged.values.rend(); it++) {
+            if (it->get_key_ref() == key) {
+                is_patch = is_blob_patch(*it);
+                return static_cast<uint64_t>(get_raw_size(*it));
+            }
+        }
+        return static_cast<uint64_t>(0);
+    });
+    if (is_patch) {
+        const VT value = get_from_delta(key,ver);
+        return value.is_valid() ? static_cast<uint64_t>(get_raw_size(value)) : 0;
+    }
+    return size;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+ObjectMetadata PersistentCascadeStore<KT,VT,IK,IV,ST>::head_from_delta(const KT& key, const persistent::version_t& ver) const {
+    if (is_truncated(ver)) {
+        const VT value = get_from_delta(key,ver);
+        return value.is_valid() ? get_object_metadata<KT,VT>(value) : get_null_object_metadata();
+    }
+    bool is_patch = false;
+    ObjectMetadata metadata = persistent_core.template getDelta<LoggedObjects<VT>>(ver,[&key,&is_patch](const LoggedObjects<VT>& logged){
+        for (auto it = logged.values.rbegin(); it != logged.values.rend(); it++) {
+            if (it->get_key_ref() == key) {
+                is_patch = is_blob_patch(*it);
+                return get_object_metadata<KT,VT>(*it);
+            }
+        }
+        return get_null_object_metadata();
+    });
+    if (is_patch) {
+        // the blob size is the restored one.
+        const VT value = get_from_delta(key,ver);
+        return value.is_valid() ? get_object_metadata<KT,VT>(value) : get_null_object_metadata();
+    }
+    return metadata;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+persistent::version_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_key_version_at_version(
+        const KT& key, const persistent::version_t& ver) const {
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = version_index.find(key);
+    if (it == version_index.end()) {
+        return persistent::INVALID_VERSION;
+    }
+    auto& key_versions = it->second;
+    auto kv_it = std::upper_bound(key_versions.begin(),key_versions.end(),ver,
+                                  [](const persistent::version_t& v, const KeyVersion& kv){return v < kv.version;});
+    if (kv_it == key_versions.begin()) {
+        return persistent::INVALID_VERSION;
+    }
+    return std::prev(kv_it)->version;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+persistent::version_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_key_version_at_time(
+        const KT& key, const uint64_t& ts_us) const {
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = version_index.find(key);
+    if (it == version_index.end()) {
+        return persistent::INVALID_VERSION;
+    }
+    auto& key_versions = it->second;
+    auto kv_it = std::upper_bound(key_versions.begin(),key_versions.end(),ts_us,
+                                  [](const uint64_t& ts, const KeyVersion& kv){return ts < kv.timestamp_us;});
+    if (kv_it == key_versions.begin()) {
+        return persistent::INVALID_VERSION;
+    }
+    return std::prev(kv_it)->version;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::rebuild_version_index() {
+    debug_enter_func();
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    version_index.clear();
+    int64_t earliest_index = persistent_core.getEarliestIndex();
+    int64_t latest_index = persistent_core.getLatestIndex();
+    if (earliest_index != persistent::INVALID_INDEX && latest_index != persistent::INVALID_INDEX) {
+        for (int64_t i = earliest_index; i <= latest_index; i++) {
+            persistent::version_t ver = persistent_core.getVersionAtIndex(i);
+            persistent_core.template getDeltaByIndex<LoggedObjects<VT>>(i,[this,&ver](const LoggedObjects<VT>& logged){
+                for (const auto& value: logged.values) {
+                    uint64_t timestamp_us = 0;
+                    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+                        timestamp_us = value.get_timestamp();
+                    }
+                    auto& key_versions = this->version_index[value.get_key_ref()];
+                    if (key_versions.empty() || key_versions.back().version != ver) {
+                        key_versions.push_back({ver,timestamp_us});
+                    }
+                }
+            });
+        }
+    }
+    debug_leave_func_with_value("{} keys",version_index.size());
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::rebuild_time_index() {
+    debug_enter_func();
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    // without the timestamps of the objects, the time index starts with the next update.
+    time_index.clear(std::is_base_of<IKeepTimestamp,VT>::value);
+    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+        std::vector<std::pair<persistent::version_t,uint64_t>> updates;
+        for (const auto& kv: version_index) {
+            for (const auto& key_version: kv.second) {
+                updates.emplace_back(key_version.version,key_version.timestamp_us);
+            }
+        }
+        std::sort(updates.begin(),updates.end());
+        for (const auto& update: updates) {
+            time_index.append(update.first,update.second);
+        }
+        // the version index keeps the latest truncated version of every key, but the base state only has the
+        // latest of them all.
+        if (base_index != persistent::INVALID_INDEX) {
+            time_index.trim(base_version);
+        }
+    }
+    debug_leave_func_with_value("{} updates",time_index.size());
+}
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 std::unique_ptr<PersistentCascadeStore<KT,VT,IK,IV,ST>> PersistentCascadeStore<KT,VT,IK,IV,ST>::from_bytes(mutils::DeserializationManager* dsm, char const* buf) {
@@ -770,7 +2140,8 @@ std::unique_ptr<PersistentCascadeStore<KT,VT,IK,IV,ST>> PersistentCascadeStore<K
     auto persistent_cascade_store_ptr =
         std::make_unique<PersistentCascadeStore>(std::move(*persistent_core_ptr),
                                                  dsm->registered<CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>>()?&(dsm->mgr<CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>>()):nullptr,
-                                                 dsm->registered<ICascadeContext>()?&(dsm->mgr<ICascadeContext>()):nullptr);
+                                                 dsm->registered<ICascadeContext>()?&(dsm->mgr<ICascadeContext>()):nullptr,
+                                                 dsm->registered<SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>>()?&(dsm->mgr<SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>>()):nullptr);
     return persistent_cascade_store_ptr;
 }
 
@@ -778,15 +2149,37 @@ template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
 PersistentCascadeStore<KT,VT,IK,IV,ST>::PersistentCascadeStore(
                                                persistent::PersistentRegistry* pr,
                                                CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>* cw,
-                                               ICascadeContext* cc):
+                                               ICascadeContext* cc,
+                                               SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>* sie):
                                                persistent_core(
-                                                   [](){
-                                                       return std::make_unique<DeltaCascadeStoreCore<KT,VT,IK,IV>>();
+                                                   [first = std::make_shared<bool>(true)](){
+                                                       auto core = std::make_unique<DeltaCascadeStoreCore<KT,VT,IK,IV>>();
+                                                       // the current state is recovered by recover_state(), not by
+                                                       // replaying the whole log.
+                                                       core->replay_deferred = *first;
+                                                       *first = false;
+                                                       return core;
                                                    },
                                                    nullptr,
                                                    pr),
                                                cascade_watcher_ptr(cw),
-                                               cascade_context_ptr(cc) {}
+                                               cascade_context_ptr(cc),
+                                               secondary_index_extractor_ptr(sie),
+                                               log_config_loaded(false),
+                                               ordered_scans(false),
+                                               value_file(persistent::getPersFilePath() + "/" +
+                                                          pr->get_subgroup_prefix() + ".values"),
+                                               base_index(persistent::INVALID_INDEX),
+                                               base_version(persistent::INVALID_VERSION),
+                                               base_timestamp_us(0),
+                                               base_file(persistent::getPersFilePath() + "/" +
+                                                         pr->get_subgroup_prefix() + ".base"),
+                                               retention_thread_alive(true),
+                                               recovery_time_us(0) {
+    recover_state();
+    rebuild_time_index();
+    retention_thread = std::thread(&PersistentCascadeStore::retention_loop,this);
+}
 
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
@@ -794,13 +2187,3696 @@ PersistentCascadeStore<KT,VT,IK,IV,ST>::PersistentCascadeStore(
                                                persistent::Persistent<DeltaCascadeStoreCore<KT,VT,IK,IV>,ST>&&
                                                _persistent_core,
                                                CriticalDataPathObserver<PersistentCascadeStore<KT,VT,IK,IV>>* cw,
-                                               ICascadeContext* cc):
+                                               ICascadeContext* cc,
+                                               SecondaryIndexExtractor<PersistentCascadeStore<KT,VT,IK,IV>>* sie):
                                                persistent_core(std::move(_persistent_core)),
                                                cascade_watcher_ptr(cw),
-                                               cascade_context_ptr(cc) {}
+                                               cascade_context_ptr(cc),
+                                               secondary_index_extractor_ptr(sie),
+                                               log_config_loaded(false),
+                                               ordered_scans(false),
+                                               base_index(persistent::INVALID_INDEX),
+                                               base_version(persistent::INVALID_VERSION),
+                                               base_timestamp_us(0),
+                                               retention_thread_alive(true),
+                                               recovery_time_us(0) {
+    rebuild_version_index();
+    rebuild_time_index();
+    // base_file is named by the retention thread, and value_file by the first ordered put, once the subgroup is known.
+    retention_thread = std::thread(&PersistentCascadeStore::retention_loop,this);
+}
 
 template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
-PersistentCascadeStore<KT,VT,IK,IV,ST>::~PersistentCascadeStore() {}
+PersistentCascadeStore<KT,VT,IK,IV,ST>::~PersistentCascadeStore() {
+    std::unique_lock<std::mutex> lck(retention_mutex);
+    retention_thread_alive = false;
+    lck.unlock();
+    retention_cv.notify_all();
+    if (retention_thread.joinable()) {
+        retention_thread.join();
+    }
+    save_blob_tier_state();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 3 - Checkpoint Cache Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename CoreType>
+CheckpointCache<CoreType>::CheckpointCache():
+    total_size(0),
+    interval_versions(DEFAULT_CHECKPOINT_INTERVAL_VERSIONS),
+    interval_us(DEFAULT_CHECKPOINT_INTERVAL_SEC*1000000ull),
+    capacity(DEFAULT_CHECKPOINT_CACHE_SIZE_MB*1024ull*1024ull) {
+    if (derecho::hasCustomizedConfKey(CONF_CHECKPOINT_INTERVAL_VERSIONS)) {
+        interval_versions = static_cast<int64_t>(derecho::getConfUInt64(CONF_CHECKPOINT_INTERVAL_VERSIONS));
+    }
+    if (derecho::hasCustomizedConfKey(CONF_CHECKPOINT_INTERVAL_SEC)) {
+        interval_us = derecho::getConfUInt64(CONF_CHECKPOINT_INTERVAL_SEC)*1000000ull;
+    }
+    if (derecho::hasCustomizedConfKey(CONF_CHECKPOINT_CACHE_SIZE_MB)) {
+        capacity = derecho::getConfUInt64(CONF_CHECKPOINT_CACHE_SIZE_MB)*1024ull*1024ull;
+    }
+}
+
+template <typename CoreType>
+void CheckpointCache<CoreType>::evict() {
+    while (total_size > capacity && !checkpoints.empty()) {
+        auto victim = checkpoints.begin();
+        if (checkpoints.size() > 1) {
+            // evict the checkpoint closest to its predecessor, the earliest one competes with the log head.
+            int64_t min_gap = victim->first + 1;
+            for (auto it = std::next(checkpoints.begin()); it != checkpoints.end(); it++) {
+                int64_t gap = it->first - std::prev(it)->first;
+                if (gap < min_gap) {
+                    min_gap = gap;
+                    victim = it;
+                }
+            }
+        }
+        dbg_default_trace("evict checkpoint at index {}, size={}.",victim->first,victim->second.size);
+        total_size -= victim->second.size;
+        checkpoints.erase(victim);
+    }
+}
+
+template <typename CoreType>
+std::tuple<int64_t,uint64_t,std::shared_ptr<const CoreType>> CheckpointCache<CoreType>::find(const int64_t& index) const {
+    std::lock_guard<std::mutex> lck(cache_mutex);
+    auto it = checkpoints.upper_bound(index);
+    if (it == checkpoints.begin()) {
+        return {persistent::INVALID_INDEX,0,nullptr};
+    }
+    it--;
+    return {it->first,it->second.timestamp_us,it->second.state};
+}
+
+template <typename CoreType>
+bool CheckpointCache<CoreType>::is_due(const int64_t& index, const uint64_t& timestamp_us,
+                                       const int64_t& last_index, const uint64_t& last_timestamp_us) const {
+    if (capacity == 0) {
+        return false;
+    }
+    if (interval_versions > 0 && index - last_index >= interval_versions) {
+        return true;
+    }
+    if (interval_us > 0 && timestamp_us >= last_timestamp_us + interval_us) {
+        return true;
+    }
+    return false;
+}
+
+template <typename CoreType>
+void CheckpointCache<CoreType>::put(const int64_t& index, const uint64_t& timestamp_us,
+                                    const std::shared_ptr<const CoreType>& state) {
+    if (capacity == 0) {
+        return;
+    }
+    uint64_t size = get_raw_size(state->kv_map);
+    std::lock_guard<std::mutex> lck(cache_mutex);
+    if (checkpoints.find(index) != checkpoints.end()) {
+        // another reader has done the same replay.
+        return;
+    }
+    checkpoints.emplace(index,Checkpoint{state,timestamp_us,size});
+    total_size += size;
+    evict();
+}
+
+template <typename CoreType>
+void CheckpointCache<CoreType>::erase_before(const int64_t& index) {
+    std::lock_guard<std::mutex> lck(cache_mutex);
+    while (!checkpoints.empty() && checkpoints.begin()->first < index) {
+        total_size -= checkpoints.begin()->second.size;
+        checkpoints.erase(checkpoints.begin());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 4 - Key Scan Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename MapType, typename KT, typename = void>
+struct is_ordered_kv_index : std::false_type {};
+
+template <typename MapType, typename KT>
+struct is_ordered_kv_index<MapType,KT,
+    std::void_t<decltype(std::declval<const MapType&>().lower_bound(std::declval<const KT&>()))>> : std::true_type {};
+
+template <typename MapType, typename = void>
+struct has_key_order_index : std::false_type {};
+
+template <typename MapType>
+struct has_key_order_index<MapType,std::void_t<decltype(std::declval<const MapType&>().key_order_begin())>> :
+    std::true_type {};
+
+template <typename KT>
+inline bool key_has_prefix(const KT& key, const std::string& prefix) {
+    if constexpr (std::is_same<KT,std::string>::value) {
+        return key.compare(0,prefix.size(),prefix) == 0;
+    } else {
+        return true;
+    }
+}
+
+inline uint64_t get_scan_max_page_bytes() {
+    static const uint64_t max_page_bytes = derecho::hasCustomizedConfKey(CONF_SCAN_MAX_PAGE_BYTES) ?
+                                           derecho::getConfUInt64(CONF_SCAN_MAX_PAGE_BYTES) : DEFAULT_SCAN_MAX_PAGE_BYTES;
+    return max_page_bytes;
+}
+
+inline bool load_ordered_scans(const derecho::subgroup_id_t subgroup_id) {
+    auto subgroup_layout = get_subgroup_layout(subgroup_id);
+    if (subgroup_layout.is_object() && subgroup_layout.contains(JSON_CONF_ORDERED_SCANS)) {
+        return subgroup_layout[JSON_CONF_ORDERED_SCANS].get<bool>();
+    }
+    return false;
+}
+
+template <typename MapType>
+void keep_key_order(MapType& kv_map) {
+    if constexpr (has_key_order_index<MapType>::value) {
+        kv_map.keep_key_order(true);
+    }
+}
+
+/**
+ * Walk the entries from 'begin' to 'end', which are in ascending key order, after 'start_after'. 'lower_bound' finds
+ * the first entry no less than a key.
+ */
+template <typename KT, KT* IK, typename Iterator, typename LowerBoundFunc, typename FilterFunc, typename VisitFunc>
+bool walk_in_key_order(const Iterator& begin, const Iterator& end, const LowerBoundFunc& lower_bound,
+                       const std::string& prefix, const KT& start_after,
+                       const FilterFunc& filter, const VisitFunc& visit) {
+    auto it = begin;
+    if (start_after == *IK) {
+        if constexpr (std::is_same<KT,std::string>::value) {
+            it = lower_bound(prefix);
+        }
+    } else {
+        it = lower_bound(start_after);
+        if (it != end && it->first == start_after) {
+            it++;
+        }
+        if constexpr (std::is_same<KT,std::string>::value) {
+            if (start_after < prefix) {
+                it = lower_bound(prefix);
+            }
+        }
+    }
+    // the keys with the prefix are contiguous in key order.
+    for (; it != end && key_has_prefix(it->first,prefix); it++) {
+        if (filter(it->first,it->second) && !visit(it->first,it->second)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* the number of keys an unordered kv_map selects in a pass of a walk */
+#define SCAN_SELECTION_KEYS (1024)
+
+/**
+ * Walk the entries of a kv_map after 'start_after' in ascending key order, skipping those with a key without 'prefix'
+ * or rejected by 'filter'. The walk stops when 'visit' returns false.
+ *
+ * @return true if the walk stops before the end, meaning there might be more entries.
+ */
+template <typename KT, typename VT, KT* IK, typename MapType, typename FilterFunc, typename VisitFunc>
+bool walk_kv_map(const MapType& kv_map, const std::string& prefix, const KT& start_after,
+                 const FilterFunc& filter, const VisitFunc& visit) {
+    if constexpr (is_ordered_kv_index<MapType,KT>::value) {
+        return walk_in_key_order<KT,IK>(kv_map.begin(),kv_map.end(),
+                                        [&kv_map](const KT& key){return kv_map.lower_bound(key);},
+                                        prefix,start_after,filter,visit);
+    } else {
+        if constexpr (has_key_order_index<MapType>::value) {
+            if (kv_map.keeps_key_order()) {
+                return walk_in_key_order<KT,IK>(kv_map.key_order_begin(),kv_map.key_order_end(),
+                                                [&kv_map](const KT& key){return kv_map.key_order_lower_bound(key);},
+                                                prefix,start_after,filter,visit);
+            }
+        }
+        // otherwise, each pass over the whole map selects the next SCAN_SELECTION_KEYS matching entries in a max-heap.
+        using Entry = typename MapType::value_type;
+        auto key_less = [](const Entry* lhs, const Entry* rhs){return lhs->first < rhs->first;};
+        std::vector<const Entry*> selected;
+        selected.reserve(SCAN_SELECTION_KEYS);
+        bool from_start = (start_after == *IK);
+        KT cursor = start_after;
+        while (true) {
+            selected.clear();
+            for (const auto& kv: kv_map) {
+                if ((from_start || cursor < kv.first) && key_has_prefix(kv.first,prefix) &&
+                    (selected.size() < SCAN_SELECTION_KEYS || kv.first < selected.front()->first) &&
+                    filter(kv.first,kv.second)) {
+                    if (selected.size() == SCAN_SELECTION_KEYS) {
+                        std::pop_heap(selected.begin(),selected.end(),key_less);
+                        selected.pop_back();
+                    }
+                    selected.emplace_back(&kv);
+                    std::push_heap(selected.begin(),selected.end(),key_less);
+                }
+            }
+            std::sort_heap(selected.begin(),selected.end(),key_less);
+            for (const Entry* entry: selected) {
+                if (!visit(entry->first,entry->second)) {
+                    return true;
+                }
+            }
+            if (selected.size() < SCAN_SELECTION_KEYS) {
+                return false;
+            }
+            cursor = selected.back()->first;
+            from_start = false;
+        }
+    }
+}
+
+template <typename KT, typename VT, KT* IK, typename MapType>
+ScanPage<KT,VT> scan_kv_map(const MapType& kv_map, const std::string& prefix, const KT& start_after,
+                            const uint32_t& limit, bool with_values, const uint64_t& max_bytes) {
+    ScanPage<KT,VT> page;
+    uint64_t page_bytes = 0;
+    // limit == 0 leaves the page bounded by max_bytes only.
+    const std::size_t max_keys = (limit == 0) ? std::numeric_limits<std::size_t>::max() : limit;
+    // add an entry to the page, returns false if the page is full.
+    auto add_to_page = [&](const KT& key, const VT& value) {
+        if (page.keys.size() >= max_keys || (!page.keys.empty() && page_bytes >= max_bytes)) {
+            return false;
+        }
+        page.keys.emplace_back(key);
+        page_bytes += mutils::bytes_size(key);
+        if (with_values) {
+            page.values.emplace_back(value);
+            page_bytes += get_raw_size(value);
+        }
+        return true;
+    };
+    page.has_more = walk_kv_map<KT,VT,IK>(kv_map,prefix,start_after,
+                                          [](const KT&, const VT&){return true;},add_to_page);
+    return page;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 5 - Shard Query Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename VT>
+inline uint64_t get_query_field(const VT& value, const QueryField& field) {
+    switch (field) {
+    case QueryField::BlobSize:
+        if constexpr (std::is_base_of<IHasBlob,VT>::value) {
+            return value.get_blob_size();
+        } else {
+            return get_raw_size(value);
+        }
+    case QueryField::Timestamp:
+        if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+            return value.get_timestamp();
+        } else {
+            return 0;
+        }
+    case QueryField::Version:
+        if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
+            return static_cast<uint64_t>(value.get_version());
+        } else {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+template <typename KT>
+template <typename VT>
+bool ShardQuery<KT>::match(const KT& key, const VT& value) const {
+    if constexpr (std::is_base_of<ICascadeObject<KT>,VT>::value) {
+        if (value.is_null()) {
+            return false;
+        }
+    }
+    if (!key_has_prefix(key,key_prefix) ||
+        (has_key_lower && key < key_lower) ||
+        (has_key_upper && key_upper < key)) {
+        return false;
+    }
+    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+        uint64_t ts_us = value.get_timestamp();
+        if (ts_us < min_timestamp_us || ts_us > max_timestamp_us) {
+            return false;
+        }
+    }
+    if (blob_prefix.empty() && !has_blob_lower && !has_blob_upper) {
+        return true;
+    }
+    if constexpr (std::is_base_of<IHasBlob,VT>::value) {
+        // compare the blob in place without copying it.
+        const std::string_view blob(value.get_blob_bytes(),value.get_blob_size());
+        return (blob.compare(0,blob_prefix.size(),blob_prefix) == 0) &&
+               (!has_blob_lower || blob.compare(blob_lower) >= 0) &&
+               (!has_blob_upper || blob.compare(blob_upper) <= 0);
+    } else {
+        return false;
+    }
+}
+
+template <typename KT, typename VT, KT* IK, typename MapType>
+QueryPage<KT,VT> query_kv_map(const MapType& kv_map, const ShardQuery<KT>& query, const KT& start_after,
+                              const uint32_t& limit, const uint64_t& max_bytes) {
+    QueryPage<KT,VT> page;
+    auto filter = [&query](const KT& key, const VT& value) {
+        return query.template match<VT>(key,value);
+    };
+    // an aggregate is folded over all the matches regardless of the key order.
+    if (query.aggregate != QueryAggregate::None) {
+        for (const auto& kv: kv_map) {
+            if (!filter(kv.first,kv.second)) {
+                continue;
+            }
+            uint64_t field = get_query_field(kv.second,query.aggregate_field);
+            switch (query.aggregate) {
+            case QueryAggregate::Sum:
+                page.aggregate_value += field;
+                break;
+            case QueryAggregate::Min:
+                page.aggregate_value = (page.num_matches == 0) ? field : std::min(page.aggregate_value,field);
+                break;
+            case QueryAggregate::Max:
+                page.aggregate_value = (page.num_matches == 0) ? field : std::max(page.aggregate_value,field);
+                break;
+            default:
+                break;
+            }
+            page.num_matches ++;
+        }
+        if (query.aggregate == QueryAggregate::Count) {
+            page.aggregate_value = page.num_matches;
+        }
+        return page;
+    }
+    uint64_t page_bytes = 0;
+    const std::size_t max_keys = (limit == 0) ? std::numeric_limits<std::size_t>::max() : limit;
+    auto add_to_page = [&](const KT& key, const VT& value) {
+        if (page.keys.size() >= max_keys || (!page.keys.empty() && page_bytes >= max_bytes)) {
+            return false;
+        }
+        page.keys.emplace_back(key);
+        page_bytes += mutils::bytes_size(key);
+        switch (query.projection) {
+        case QueryProjection::Object:
+            page.values.emplace_back(value);
+            page_bytes += get_raw_size(value);
+            break;
+        case QueryProjection::Metadata:
+            page.values.emplace_back(value);
+            if constexpr (std::is_base_of<IHasBlob,VT>::value) {
+                page.values.back().clear_blob();
+            }
+            page.sizes.emplace_back(get_query_field(value,QueryField::BlobSize));
+            page_bytes += get_raw_size(page.values.back()) + sizeof(uint64_t);
+            break;
+        case QueryProjection::Size:
+            page.sizes.emplace_back(get_query_field(value,QueryField::BlobSize));
+            page_bytes += sizeof(uint64_t);
+            break;
+        case QueryProjection::Key:
+            break;
+        }
+        page.num_matches ++;
+        return true;
+    };
+    page.has_more = walk_kv_map<KT,VT,IK>(kv_map,query.key_prefix,start_after,filter,add_to_page);
+    return page;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 6 - Object Metadata Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename KT, typename VT>
+ObjectMetadata get_object_metadata(const VT& value) {
+    ObjectMetadata metadata = get_null_object_metadata();
+    if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
+        metadata.version = value.get_version();
+    }
+    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+        metadata.timestamp_us = value.get_timestamp();
+    }
+    if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
+        metadata.previous_version = value.get_previous_version();
+        metadata.previous_version_by_key = value.get_previous_version_by_key();
+    }
+    if constexpr (std::is_base_of<IHasBlob,VT>::value) {
+        metadata.blob_size = value.get_blob_size();
+    }
+    metadata.object_size = get_raw_size(value);
+    if constexpr (std::is_base_of<ICascadeObject<KT>,VT>::value) {
+        metadata.is_null = value.is_null();
+    } else {
+        metadata.is_null = false;
+    }
+    return metadata;
+}
+
+inline ObjectMetadata get_null_object_metadata() {
+    return ObjectMetadata{persistent::INVALID_VERSION,0,persistent::INVALID_VERSION,persistent::INVALID_VERSION,0,0,true};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 7 - Clock Eviction Policy Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename KT>
+ClockEvictionPolicy<KT>::ClockEvictionPolicy():
+    hand(0),
+    total_bytes(0) {
+    load_config();
+}
+
+template <typename KT>
+ClockEvictionPolicy<KT>::ClockEvictionPolicy(const std::vector<KT>& _ring_keys,
+                                             const std::vector<uint64_t>& _ring_sizes,
+                                             const std::vector<uint64_t>& _ring_expire_us,
+                                             const std::vector<uint8_t>& _ring_flags,
+                                             const uint64_t _hand,
+                                             const uint64_t _total_bytes):
+    ring_keys(_ring_keys),
+    ring_sizes(_ring_sizes),
+    ring_expire_us(_ring_expire_us),
+    ring_flags(_ring_flags),
+    hand(_hand),
+    total_bytes(_total_bytes) {
+    load_config();
+    // rebuild the derived members from the ring.
+    for (uint64_t slot = 0; slot < ring_keys.size(); slot++) {
+        if (ring_flags[slot] & SLOT_VALID) {
+            slots.emplace(ring_keys[slot],slot);
+            if (ring_expire_us[slot] != 0) {
+                expiry_index.emplace(ring_expire_us[slot],slot);
+            }
+        } else {
+            free_slots.emplace(slot);
+        }
+    }
+}
+
+template <typename KT>
+void ClockEvictionPolicy<KT>::load_config() {
+    max_bytes = derecho::hasCustomizedConfKey(CONF_VCS_MAX_BYTES) ?
+                derecho::getConfUInt64(CONF_VCS_MAX_BYTES) : DEFAULT_VCS_MAX_BYTES;
+    ttl_us = (derecho::hasCustomizedConfKey(CONF_VCS_OBJECT_TTL_SEC) ?
+              derecho::getConfUInt64(CONF_VCS_OBJECT_TTL_SEC) : DEFAULT_VCS_OBJECT_TTL_SEC) * 1000000ull;
+}
+
+template <typename KT>
+bool ClockEvictionPolicy<KT>::is_enabled() const {
+    return (max_bytes > 0) || (ttl_us > 0);
+}
+
+template <typename KT>
+void ClockEvictionPolicy<KT>::release(const uint64_t slot) {
+    slots.erase(ring_keys[slot]);
+    if (ring_expire_us[slot] != 0) {
+        expiry_index.erase({ring_expire_us[slot],slot});
+    }
+    total_bytes -= ring_sizes[slot];
+    ring_keys[slot] = KT{};
+    ring_sizes[slot] = 0;
+    ring_expire_us[slot] = 0;
+    ring_flags[slot] = 0;
+    free_slots.emplace(slot);
+}
+
+template <typename KT>
+void ClockEvictionPolicy<KT>::on_update(const KT& key, const uint64_t& size, const uint64_t& now_us) {
+    if (!is_enabled()) {
+        return;
+    }
+    uint64_t slot;
+    auto it = slots.find(key);
+    if (it != slots.end()) {
+        slot = it->second;
+        if (ring_expire_us[slot] != 0) {
+            expiry_index.erase({ring_expire_us[slot],slot});
+        }
+        total_bytes -= ring_sizes[slot];
+    } else if (!free_slots.empty()) {
+        slot = *free_slots.begin();
+        free_slots.erase(free_slots.begin());
+        ring_keys[slot] = key;
+        slots.emplace(key,slot);
+    } else {
+        slot = ring_keys.size();
+        ring_keys.emplace_back(key);
+        ring_sizes.emplace_back(0);
+        ring_expire_us.emplace_back(0);
+        ring_flags.emplace_back(0);
+        slots.emplace(key,slot);
+    }
+    ring_sizes[slot] = size;
+    ring_expire_us[slot] = (ttl_us > 0) ? (now_us + ttl_us) : 0;
+    ring_flags[slot] = SLOT_VALID | SLOT_REFERENCED;
+    if (ring_expire_us[slot] != 0) {
+        expiry_index.emplace(ring_expire_us[slot],slot);
+    }
+    total_bytes += size;
+}
+
+template <typename KT>
+void ClockEvictionPolicy<KT>::on_access(const KT& key) {
+    auto it = slots.find(key);
+    if (it != slots.end()) {
+        ring_flags[it->second] |= SLOT_REFERENCED;
+    }
+}
+
+template <typename KT>
+void ClockEvictionPolicy<KT>::on_erase(const KT& key) {
+    auto it = slots.find(key);
+    if (it != slots.end()) {
+        release(it->second);
+    }
+}
+
+template <typename KT>
+std::vector<KT> ClockEvictionPolicy<KT>::evict(const uint64_t& now_us) {
+    std::vector<KT> victims;
+    // 1 - the expired keys
+    while (!expiry_index.empty() && expiry_index.begin()->first <= now_us) {
+        uint64_t slot = expiry_index.begin()->second;
+        victims.emplace_back(ring_keys[slot]);
+        release(slot);
+    }
+    // 2 - the CLOCK hand. A full sweep clears all the reference bits, so it takes at most two sweeps to find a victim.
+    if (max_bytes > 0) {
+        while (total_bytes > max_bytes && !slots.empty()) {
+            if (hand >= ring_keys.size()) {
+                hand = 0;
+            }
+            uint8_t& flags = ring_flags[hand];
+            if (flags & SLOT_VALID) {
+                if (flags & SLOT_REFERENCED) {
+                    flags &= ~SLOT_REFERENCED;
+                } else {
+                    victims.emplace_back(ring_keys[hand]);
+                    release(hand);
+                }
+            }
+            hand ++;
+        }
+    }
+    return victims;
+}
+
+template <typename KT>
+uint64_t ClockEvictionPolicy<KT>::get_total_bytes() const {
+    return total_bytes;
+}
+
+template <typename KT>
+void ClockEvictionPolicy<KT>::set_limits(const uint64_t _max_bytes, const uint64_t _ttl_us) {
+    max_bytes = _max_bytes;
+    ttl_us = _ttl_us;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 8 - Log Retention Implementation
+///////////////////////////////////////////////////////////////////////////////
+inline RetentionPolicy::RetentionPolicy():
+    versions_per_key(DEFAULT_RETENTION_VERSIONS_PER_KEY),
+    retention_us(DEFAULT_RETENTION_SEC*1000000ull),
+    log_size_cap(DEFAULT_RETENTION_LOG_SIZE_MB*1024ull*1024ull),
+    snapshot_interval_versions(DEFAULT_SNAPSHOT_INTERVAL_VERSIONS),
+    check_interval_sec(DEFAULT_RETENTION_CHECK_INTERVAL_SEC) {
+    if (derecho::hasCustomizedConfKey(CONF_RETENTION_VERSIONS_PER_KEY)) {
+        versions_per_key = derecho::getConfUInt64(CONF_RETENTION_VERSIONS_PER_KEY);
+    }
+    if (derecho::hasCustomizedConfKey(CONF_RETENTION_SEC)) {
+        retention_us = derecho::getConfUInt64(CONF_RETENTION_SEC)*1000000ull;
+    }
+    if (derecho::hasCustomizedConfKey(CONF_RETENTION_LOG_SIZE_MB)) {
+        log_size_cap = derecho::getConfUInt64(CONF_RETENTION_LOG_SIZE_MB)*1024ull*1024ull;
+    }
+    if (derecho::hasCustomizedConfKey(CONF_SNAPSHOT_INTERVAL_VERSIONS)) {
+        snapshot_interval_versions = derecho::getConfUInt64(CONF_SNAPSHOT_INTERVAL_VERSIONS);
+    }
+    if (derecho::hasCustomizedConfKey(CONF_RETENTION_CHECK_INTERVAL_SEC)) {
+        check_interval_sec = derecho::getConfUInt64(CONF_RETENTION_CHECK_INTERVAL_SEC);
+    }
+    if (check_interval_sec == 0) {
+        check_interval_sec = DEFAULT_RETENTION_CHECK_INTERVAL_SEC;
+    }
+}
+
+inline nlohmann::json get_subgroup_layout(const derecho::subgroup_id_t subgroup_id) {
+    if (!derecho::hasCustomizedConfKey(CONF_GROUP_LAYOUT) || derecho::getConfString(CONF_GROUP_LAYOUT).empty()) {
+        return nlohmann::json();
+    }
+    auto group_layout = nlohmann::json::parse(derecho::getConfString(CONF_GROUP_LAYOUT));
+    derecho::subgroup_id_t id = 0;
+    for (const auto& type_layout: group_layout) {
+        for (const auto& subgroup_layout: type_layout[JSON_CONF_LAYOUT]) {
+            if (id++ == subgroup_id) {
+                return subgroup_layout;
+            }
+        }
+    }
+    return nlohmann::json();
+}
+
+inline bool sync_parent_directory(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    const std::string dir = (slash == std::string::npos) ? "." : path.substr(0,std::max<std::size_t>(slash,1));
+    int dir_fd = ::open(dir.c_str(),O_RDONLY|O_DIRECTORY);
+    if (dir_fd < 0) {
+        return false;
+    }
+    const bool synced = (fsync(dir_fd) == 0);
+    ::close(dir_fd);
+    return synced;
+}
+
+inline void RetentionPolicy::load_subgroup_override(const derecho::subgroup_id_t subgroup_id) {
+    auto subgroup_layout = get_subgroup_layout(subgroup_id);
+    if (!subgroup_layout.is_object() || !subgroup_layout.contains(JSON_CONF_RETENTION)) {
+        return;
+    }
+    const auto& retention = subgroup_layout[JSON_CONF_RETENTION];
+    if (retention.contains(JSON_CONF_RETENTION_VERSIONS_PER_KEY)) {
+        versions_per_key = retention[JSON_CONF_RETENTION_VERSIONS_PER_KEY].get<uint64_t>();
+    }
+    if (retention.contains(JSON_CONF_RETENTION_SEC)) {
+        retention_us = retention[JSON_CONF_RETENTION_SEC].get<uint64_t>()*1000000ull;
+    }
+    if (retention.contains(JSON_CONF_RETENTION_LOG_SIZE_MB)) {
+        log_size_cap = retention[JSON_CONF_RETENTION_LOG_SIZE_MB].get<uint64_t>()*1024ull*1024ull;
+    }
+    if (retention.contains(JSON_CONF_RETENTION_SNAPSHOT_INTERVAL_VERSIONS)) {
+        snapshot_interval_versions = retention[JSON_CONF_RETENTION_SNAPSHOT_INTERVAL_VERSIONS].get<uint64_t>();
+    }
+}
+
+inline bool RetentionPolicy::is_enabled() const {
+    return (versions_per_key > 0) || (retention_us > 0) || (log_size_cap > 0) || (snapshot_interval_versions > 0);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+int64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_index_at_time(const uint64_t& ts_us) const {
+    // the log entries after the latest update no later than ts_us have the same state.
+    persistent::version_t ver = version_at_time(ts_us);
+    if (ver == persistent::INVALID_VERSION) {
+        return persistent::INVALID_INDEX;
+    }
+    return get_index_at_version(ver);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+bool PersistentCascadeStore<KT,VT,IK,IV,ST>::is_truncated(const persistent::version_t& ver) const {
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    if (base_index == persistent::INVALID_INDEX || ver > base_version) {
+        return false;
+    }
+    rlck.unlock();
+    // a crash between saving the base state and truncating the log leaves the entry in both.
+    int64_t earliest_index = persistent_core.getEarliestIndex();
+    return (earliest_index == persistent::INVALID_INDEX || persistent_core.getVersionAtIndex(earliest_index) > ver);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::shared_ptr<const DeltaCascadeStoreCore<KT,VT,IK,IV>> PersistentCascadeStore<KT,VT,IK,IV,ST>::get_base_state() const {
+    using CoreType = DeltaCascadeStoreCore<KT,VT,IK,IV>;
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    int64_t index = base_index;
+    uint64_t timestamp_us = base_timestamp_us;
+    rlck.unlock();
+    if (index == persistent::INVALID_INDEX) {
+        return nullptr;
+    }
+    auto [checkpoint_index,checkpoint_timestamp_us,checkpoint_state] = checkpoint_cache.find(index);
+    if (checkpoint_state && checkpoint_index == index) {
+        return checkpoint_state;
+    }
+    // the checkpoint cache has evicted it, load it from base_file.
+    std::ifstream ifs(base_file,std::ios::binary|std::ios::ate);
+    std::vector<char> buf(ifs ? static_cast<std::size_t>(ifs.tellg()) : 0);
+    if (!ifs || !ifs.seekg(0).read(buf.data(),buf.size())) {
+        dbg_default_error("{}: failed to load the base state from {}.", __func__, base_file);
+        return std::make_shared<const CoreType>();
+    }
+    std::size_t offset = sizeof(int64_t) + sizeof(persistent::version_t) + sizeof(uint64_t);
+    std::shared_ptr<const CoreType> state =
+        std::make_shared<const CoreType>(std::move(*mutils::from_bytes<KVIndex<KT,VT>>(nullptr,buf.data()+offset)));
+    checkpoint_cache.put(index,timestamp_us,state);
+    return state;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+int64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::get_truncation_index() {
+    int64_t earliest_index = persistent_core.getEarliestIndex();
+    int64_t latest_index = persistent_core.getLatestIndex();
+    if (earliest_index == persistent::INVALID_INDEX || latest_index == persistent::INVALID_INDEX ||
+        earliest_index >= latest_index) {
+        return persistent::INVALID_INDEX;
+    }
+    // the latest entry always stays in the log, and only the persisted entries are truncated.
+    int64_t max_index = latest_index - 1;
+    persistent::version_t persisted_version = persistent_core.getLastPersistedVersion();
+    if (persisted_version == persistent::INVALID_VERSION) {
+        return persistent::INVALID_INDEX;
+    }
+    if (persistent_core.getVersionAtIndex(max_index) > persisted_version) {
+        max_index = get_index_at_version(persisted_version);
+        if (max_index == persistent::INVALID_INDEX || max_index < earliest_index) {
+            return persistent::INVALID_INDEX;
+        }
+    }
+    // 1 - the keep rules: truncate up to the entry before the oldest one they keep.
+    bool has_keep_rule = (retention_policy.versions_per_key > 0);
+    int64_t keep_index = max_index;
+    if (retention_policy.versions_per_key > 1) {
+        // the base state keeps the last truncated version of a key, the log keeps the rest.
+        bool found = false;
+        persistent::version_t oldest_kept_version = persistent::INVALID_VERSION;
+        std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+        for (const auto& kv: version_index) {
+            const auto& key_versions = kv.second;
+            if (key_versions.size() < 2) {
+                continue;
+            }
+            std::size_t pos = (key_versions.size() > retention_policy.versions_per_key) ?
+                              (key_versions.size() - retention_policy.versions_per_key + 1) : 1;
+            if (!found || key_versions[pos].version < oldest_kept_version) {
+                oldest_kept_version = key_versions[pos].version;
+                found = true;
+            }
+        }
+        rlck.unlock();
+        if (found) {
+            keep_index = std::min(keep_index,get_index_at_version(oldest_kept_version) - 1);
+        }
+    }
+    if (retention_policy.retention_us > 0) {
+        has_keep_rule = true;
+        uint64_t now_us = get_time()/1000;
+        int64_t age_index = persistent::INVALID_INDEX;
+        if (now_us > retention_policy.retention_us) {
+            age_index = persistent_core.getIndexAtTime(HLC(now_us - retention_policy.retention_us,0ull));
+        }
+        if (age_index == persistent::INVALID_INDEX || age_index < earliest_index) {
+            keep_index = earliest_index - 1;
+        } else {
+            keep_index = std::min(keep_index,age_index);
+        }
+    }
+    int64_t index = has_keep_rule ? keep_index : (earliest_index - 1);
+    // 2 - the log size cap: truncate the oldest entries beyond it.
+    if (retention_policy.log_size_cap > 0) {
+        log_entry_sizes.erase(log_entry_sizes.begin(),log_entry_sizes.lower_bound(earliest_index));
+        int64_t next_index = log_entry_sizes.empty() ? earliest_index : (log_entry_sizes.rbegin()->first + 1);
+        for (int64_t i = next_index; i <= latest_index; i++) {
+            persistent_core.template getDeltaByIndex<LoggedObjects<VT>>(i,[this,&i](const LoggedObjects<VT>& logged){
+                // the raw size, which bounds the logged one.
+                this->log_entry_sizes.emplace(i,get_raw_size(logged.values));
+            });
+        }
+        uint64_t log_size = 0;
+        for (auto it = log_entry_sizes.rbegin(); it != log_entry_sizes.rend(); it++) {
+            log_size += it->second;
+            if (log_size > retention_policy.log_size_cap) {
+                index = std::max(index,it->first);
+                break;
+            }
+        }
+    }
+    index = std::min(index,max_index);
+    if (index < earliest_index) {
+        return persistent::INVALID_INDEX;
+    }
+    return index;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+bool PersistentCascadeStore<KT,VT,IK,IV,ST>::save_base_state(const int64_t& index) {
+    debug_enter_func_with_args("index={}",index);
+    persistent::version_t version = persistent_core.getVersionAtIndex(index);
+    auto state = get_state_at_index(index);
+    uint64_t timestamp_us = base_timestamp_us;
+    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+        // the timestamp of the latest object no later than the index.
+        bool found = false;
+        for (int64_t i = index; i >= persistent_core.getEarliestIndex() && !found; i--) {
+            persistent_core.template getDeltaByIndex<LoggedObjects<VT>>(i,[&timestamp_us,&found](const LoggedObjects<VT>& logged){
+                if (!logged.values.empty()) {
+                    timestamp_us = logged.values.back().get_timestamp();
+                    found = true;
+                }
+            });
+        }
+    }
+    std::string tmp_file = base_file + ".tmp";
+    FILE* fp = fopen(tmp_file.c_str(),"wb");
+    if (fp == nullptr) {
+        dbg_default_error("{}: failed to open {}.", __func__, tmp_file);
+        debug_leave_func_with_value("{}",false);
+        return false;
+    }
+    bool saved = true;
+    auto write_file = [&saved,fp](char const* const bytes, std::size_t size){
+        saved = saved && (fwrite(bytes,1,size,fp) == size);
+    };
+    mutils::post_object(write_file,index);
+    mutils::post_object(write_file,version);
+    mutils::post_object(write_file,timestamp_us);
+    mutils::post_object(write_file,state->kv_map);
+    // the version index up to the base state, so that a restart does not scan the log for it.
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    post_version_index(write_file,version);
+    rlck.unlock();
+    saved = saved && (fflush(fp) == 0) && (fsync(fileno(fp)) == 0);
+    fclose(fp);
+    // the log is truncated after the base state, so the rename must survive a crash.
+    if (!saved || std::rename(tmp_file.c_str(),base_file.c_str()) != 0 || !sync_parent_directory(base_file)) {
+        dbg_default_error("{}: failed to save the base state to {}.", __func__, base_file);
+        std::remove(tmp_file.c_str());
+        debug_leave_func_with_value("{}",false);
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    base_index = index;
+    base_version = version;
+    base_timestamp_us = timestamp_us;
+    wlck.unlock();
+    checkpoint_cache.put(index,timestamp_us,state);
+    dbg_default_info("{}: saved the state at index {}, version 0x{:x}.", __func__, index, version);
+    debug_leave_func_with_value("{}",true);
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::truncate_log(const int64_t& index) {
+    debug_enter_func_with_args("index={}",index);
+    // 1 - save the base state, which survives a crash before the log is truncated.
+    if (!save_base_state(index)) {
+        debug_leave_func();
+        return;
+    }
+    persistent::version_t version = persistent_core.getVersionAtIndex(index);
+    auto state = get_base_state();
+    checkpoint_cache.erase_before(index);
+    // 2 - truncate the log.
+    persistent_core.trim(version);
+    // 3 - keep the latest truncated version of a key, which is in the base state, and drop the removed keys.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    std::vector<KT> removed_keys;
+    for (auto& kv: version_index) {
+        auto& key_versions = kv.second;
+        auto it = std::upper_bound(key_versions.begin(),key_versions.end(),version,
+                                   [](const persistent::version_t& v, const KeyVersion& key_version){
+                                       return v < key_version.version;
+                                   });
+        if (it == key_versions.begin()) {
+            continue;
+        }
+        key_versions.erase(key_versions.begin(),std::prev(it));
+        if (key_versions.size() == 1 && state->kv_map.find(kv.first) == state->kv_map.end()) {
+            removed_keys.emplace_back(kv.first);
+        }
+    }
+    for (const auto& key: removed_keys) {
+        version_index.erase(key);
+    }
+    time_index.trim(version);
+    wlck.unlock();
+    dbg_default_info("{}: truncated the log up to index {}, version 0x{:x}.", __func__, index, version);
+    debug_leave_func();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::retention_loop() {
+    std::unique_lock<std::mutex> lck(retention_mutex);
+    // wait for the group, which is set after the constructor.
+    while (retention_thread_alive && group == nullptr) {
+        retention_cv.wait_for(lck,std::chrono::seconds(1),[this](){return !retention_thread_alive;});
+    }
+    if (!retention_thread_alive) {
+        return;
+    }
+    auto& subgroup_handle = group->template get_subgroup<PersistentCascadeStore>(this->subgroup_index);
+    retention_policy.load_subgroup_override(subgroup_handle.get_subgroup_id());
+    if (!retention_policy.is_enabled()) {
+        return;
+    }
+    if (base_file.empty()) {
+        base_file = persistent::getPersFilePath() + "/" +
+                    persistent::PersistentRegistry::generate_prefix(std::type_index(typeid(PersistentCascadeStore)),
+                                                                    this->subgroup_index,
+                                                                    subgroup_handle.get_shard_num()) + ".base";
+    }
+    while (retention_thread_alive) {
+        if (retention_cv.wait_for(lck,std::chrono::seconds(retention_policy.check_interval_sec),
+                                  [this](){return !retention_thread_alive;})) {
+            break;
+        }
+        try {
+            int64_t index = get_truncation_index();
+            if (index != persistent::INVALID_INDEX) {
+                truncate_log(index);
+            } else if (retention_policy.snapshot_interval_versions > 0) {
+                // snapshot the persisted state for restart, the log stays as it is.
+                persistent::version_t persisted_version = persistent_core.getLastPersistedVersion();
+                if (persisted_version != persistent::INVALID_VERSION) {
+                    index = get_index_at_version(persisted_version);
+                }
+                // base_index is only updated by this thread.
+                if (index != persistent::INVALID_INDEX &&
+                    (base_index == persistent::INVALID_INDEX ||
+                     index >= base_index + static_cast<int64_t>(retention_policy.snapshot_interval_versions))) {
+                    save_base_state(index);
+                }
+            }
+        } catch (const std::exception& ex) {
+            dbg_default_warn("{}: failed to truncate the log: {}", __func__, ex.what());
+        } catch (...) {
+            dbg_default_warn("{}: failed to truncate the log with unknown exception.", __func__);
+        }
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::recover_state() {
+    debug_enter_func();
+    uint64_t start_us = get_time()/1000;
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    auto& kv_map = this->persistent_core->kv_map;
+    kv_map.clear();
+    version_index.clear();
+    int64_t earliest_index = persistent_core.getEarliestIndex();
+    int64_t latest_index = persistent_core.getLatestIndex();
+    // 1 - map the state left by a clean shutdown, or else load the snapshot:
+    // [index][version][timestamp][kv_map][number of keys]([key][number of versions]([version][timestamp])*)*
+    const int64_t saved_index = load_blob_tier_state();
+    std::ifstream ifs;
+    if (saved_index == persistent::INVALID_INDEX) {
+        ifs.open(base_file,std::ios::binary|std::ios::ate);
+    }
+    if (ifs.is_open()) {
+        std::vector<char> buf(static_cast<std::size_t>(ifs.tellg()));
+        if (!ifs.seekg(0).read(buf.data(),buf.size())) {
+            dbg_default_error("{}: failed to load the base state from {}.", __func__, base_file);
+        } else {
+            std::size_t offset = 0;
+            int64_t index = *mutils::from_bytes<int64_t>(nullptr,buf.data()+offset);
+            offset += sizeof(int64_t);
+            persistent::version_t version = *mutils::from_bytes<persistent::version_t>(nullptr,buf.data()+offset);
+            offset += sizeof(persistent::version_t);
+            uint64_t timestamp_us = *mutils::from_bytes<uint64_t>(nullptr,buf.data()+offset);
+            offset += sizeof(uint64_t);
+            if (latest_index != persistent::INVALID_INDEX && persistent_core.getLatestVersion() < version) {
+                // the log is behind the snapshot, which happens only if the log lost its unpersisted tail.
+                dbg_default_warn("{}: the base state at version 0x{:x} is ahead of the log, ignored.", __func__, version);
+            } else {
+                auto kv_map_ptr = mutils::from_bytes<KVIndex<KT,VT>>(nullptr,buf.data()+offset);
+                offset += mutils::bytes_size(*kv_map_ptr);
+                kv_map = std::move(*kv_map_ptr);
+                if (offset < buf.size()) {
+                    offset += load_version_index(buf.data()+offset);
+                } else {
+                    // a base state saved without the version index: the keys take their versions in it.
+                    for (const auto& kv: kv_map) {
+                        persistent::version_t key_version = version;
+                        uint64_t key_timestamp_us = timestamp_us;
+                        if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
+                            key_version = kv.second.get_version();
+                        }
+                        if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+                            key_timestamp_us = kv.second.get_timestamp();
+                        }
+                        version_index[kv.first].push_back({key_version,key_timestamp_us});
+                    }
+                }
+                base_index = index;
+                base_version = version;
+                base_timestamp_us = timestamp_us;
+            }
+        }
+    }
+    // the blob tier keeps the cold blobs of the snapshot and of each window out of the heap.
+    init_blob_tier();
+    // 2 - replay the log after the snapshot. The entries are deserialized in parallel, window by window, and applied
+    // in order.
+    int64_t replay_index = earliest_index;
+    if (saved_index != persistent::INVALID_INDEX) {
+        replay_index = saved_index + 1;
+    } else if (base_index != persistent::INVALID_INDEX &&
+               (replay_index == persistent::INVALID_INDEX || base_index >= replay_index)) {
+        replay_index = base_index + 1;
+    }
+    uint32_t num_threads = std::thread::hardware_concurrency();
+    if (derecho::hasCustomizedConfKey(CONF_RECOVERY_THREADS) && derecho::getConfUInt32(CONF_RECOVERY_THREADS) > 0) {
+        num_threads = derecho::getConfUInt32(CONF_RECOVERY_THREADS);
+    }
+    num_threads = std::max(num_threads,1u);
+    int64_t num_replayed = 0;
+    if (replay_index != persistent::INVALID_INDEX && latest_index != persistent::INVALID_INDEX) {
+        const int64_t window_size = static_cast<int64_t>(num_threads)*1024;
+        std::vector<std::vector<VT>> window;
+        std::vector<persistent::version_t> window_versions;
+        for (int64_t window_start = replay_index; window_start <= latest_index; window_start += window_size) {
+            int64_t window_len = std::min(window_size,latest_index - window_start + 1);
+            window.assign(window_len,std::vector<VT>{});
+            window_versions.assign(window_len,persistent::INVALID_VERSION);
+            auto deserialize = [this,&window,&window_versions,window_start,window_len,num_threads](uint32_t tid){
+                for (int64_t i = tid; i < window_len; i += num_threads) {
+                    window_versions[i] = persistent_core.getVersionAtIndex(window_start + i);
+                    persistent_core.template getDeltaByIndex<LoggedObjects<VT>>(window_start + i,
+                        [&window,i](const LoggedObjects<VT>& logged){
+                            window[i] = logged.values;
+                        });
+                }
+            };
+            std::vector<std::thread> workers;
+            for (uint32_t tid = 1; tid < num_threads && tid < window_len; tid++) {
+                workers.emplace_back(deserialize,tid);
+            }
+            deserialize(0);
+            for (auto& worker: workers) {
+                worker.join();
+            }
+            for (int64_t i = 0; i < window_len; i++) {
+                for (auto& value: window[i]) {
+                    uint64_t timestamp_us = 0;
+                    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+                        timestamp_us = value.get_timestamp();
+                    }
+                    auto& key_versions = version_index[value.get_key_ref()];
+                    if (key_versions.empty() || key_versions.back().version != window_versions[i]) {
+                        key_versions.push_back({window_versions[i],timestamp_us});
+                    }
+                    if (!blob_tier.is_open()) {
+                        this->persistent_core->apply_ordered_put(std::move(value));
+                        continue;
+                    }
+                    const KT key = value.get_key_ref();
+                    this->persistent_core->apply_ordered_put(std::move(value));
+                    if constexpr (std::is_base_of<IHasBlob,VT>::value) {
+                        auto it = kv_map.find(key);
+                        if (it != kv_map.end()) {
+                            blob_tier.on_update(key,it->second.get_blob_size());
+                        } else {
+                            blob_tier.on_erase(key);
+                        }
+                    }
+                }
+            }
+            evict_blobs();
+            num_replayed += window_len;
+        }
+    }
+    this->persistent_core->replay_deferred = false;
+    recovery_time_us = get_time()/1000 - start_us;
+    dbg_default_info("{}: recovered {} keys in {} us from the base state at index {} and {} log entries with {} threads.",
+                     __func__, kv_map.size(), recovery_time_us, base_index, num_replayed, num_threads);
+    wlck.unlock();
+    debug_leave_func_with_value("{} keys",version_index.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 9 - Volatile State Transfer Implementation
+///////////////////////////////////////////////////////////////////////////////
+inline uint64_t get_vcs_state_transfer_chunk_bytes() {
+    static const uint64_t chunk_bytes = derecho::hasCustomizedConfKey(CONF_VCS_STATE_TRANSFER_CHUNK_BYTES) ?
+                                        derecho::getConfUInt64(CONF_VCS_STATE_TRANSFER_CHUNK_BYTES) :
+                                        DEFAULT_VCS_STATE_TRANSFER_CHUNK_BYTES;
+    return chunk_bytes;
+}
+
+inline uint32_t get_vcs_state_transfer_max_retries() {
+    static const uint32_t max_retries = derecho::hasCustomizedConfKey(CONF_VCS_STATE_TRANSFER_MAX_RETRIES) ?
+                                        derecho::getConfUInt32(CONF_VCS_STATE_TRANSFER_MAX_RETRIES) :
+                                        DEFAULT_VCS_STATE_TRANSFER_MAX_RETRIES;
+    return max_retries;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+template<typename ReplyType>
+ReplyType VolatileCascadeStore<KT,VT,IK,IV>::pick_reply(derecho::rpc::QueryResults<ReplyType>& results,
+                                                        bool wait_for_all) const {
+    auto& replies = results.get();
+    const node_id_t my_id = group->get_my_id();
+    const bool trust_myself = !transfer_active;
+    std::optional<std::decay_t<ReplyType>> picked;
+    std::optional<std::decay_t<ReplyType>> fallback;
+    for (auto& reply_pair : replies) {
+        if (picked && !wait_for_all) {
+            break;
+        }
+        auto reply = reply_pair.second.get();
+        if (!picked && ((reply_pair.first == my_id) == trust_myself)) {
+            picked.emplace(std::move(reply));
+        } else if (!fallback) {
+            fallback.emplace(std::move(reply));
+        }
+    }
+    return picked ? std::move(*picked) : std::move(*fallback);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+StateChunk<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::get_state_chunk(const KT& start_after, const uint64_t& max_bytes) {
+    debug_enter_func_with_args("start_after={},max_bytes={}",start_after,max_bytes);
+    if (transfer_active) {
+        debug_leave_func_with_value("{}","not ready");
+        return StateChunk<KT,VT>();
+    }
+    {
+        // the chunks page through the whole kv_map.
+        std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+        keep_key_order(this->kv_map);
+    }
+    // the page and state_version are read under the same lock, so the page is the state of its keys at that version.
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    StateChunk<KT,VT> chunk(true,this->state_version,
+                            scan_kv_map<KT,VT,IK>(this->kv_map,"",start_after,0,true,max_bytes));
+    rlck.unlock();
+    debug_leave_func_with_value("{} keys, version=0x{:x}, has_more={}",
+                                chunk.page.keys.size(),chunk.version,chunk.page.has_more);
+    return chunk;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+StateChunk<KT,VT> VolatileCascadeStore<KT,VT,IK,IV>::get_state_objects(const std::vector<KT>& keys) const {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+    if (transfer_active) {
+        debug_leave_func_with_value("{}","not ready");
+        return StateChunk<KT,VT>();
+    }
+    StateChunk<KT,VT> chunk;
+    chunk.ready = true;
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    chunk.version = this->state_version;
+    for (const auto& key: keys) {
+        auto it = this->kv_map.find(key);
+        if (it != this->kv_map.end()) {
+            chunk.page.keys.emplace_back(key);
+            chunk.page.values.emplace_back(it->second);
+        }
+    }
+    rlck.unlock();
+    debug_leave_func_with_value("{} keys found, version=0x{:x}",chunk.page.keys.size(),chunk.version);
+    return chunk;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::adopt_state(const KT& key, VT* value) {
+    if (value != nullptr) {
+        this->kv_map.erase(key);
+        secondary_index.on_update(key,*value);
+        this->kv_map.emplace(key,std::move(*value));
+    } else if (this->kv_map.erase(key) > 0) {
+        secondary_index.on_erase(key);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::apply_state_chunk(StateChunk<KT,VT>& chunk) {
+    auto& page = chunk.page;
+    // An uncertain key covered by the chunk and not updated since the chunk version takes the state in the chunk,
+    // where it might be absent.
+    auto it = (transfer_cursor == *IK) ? transfer_uncertain.begin() : transfer_uncertain.upper_bound(transfer_cursor);
+    auto last = page.has_more ? transfer_uncertain.upper_bound(page.keys.back()) : transfer_uncertain.end();
+    while (it != last) {
+        if (it->second <= chunk.version && !std::binary_search(page.keys.begin(),page.keys.end(),it->first)) {
+            adopt_state(it->first,nullptr);
+            it = transfer_uncertain.erase(it);
+        } else {
+            it++;
+        }
+    }
+    for (std::size_t i = 0; i < page.keys.size(); i++) {
+        auto uncertain_it = transfer_uncertain.find(page.keys[i]);
+        if (uncertain_it != transfer_uncertain.end()) {
+            if (uncertain_it->second <= chunk.version) {
+                adopt_state(page.keys[i],&page.values[i]);
+                transfer_uncertain.erase(uncertain_it);
+            }
+        } else if (transfer_touched.find(page.keys[i]) == transfer_touched.end()) {
+            // this replica has delivered chunk.version, so an untouched key has not changed since.
+            adopt_state(page.keys[i],&page.values[i]);
+        }
+        // otherwise the key is certain, and up to date on this replica.
+    }
+    if (!page.keys.empty()) {
+        transfer_cursor = page.keys.back();
+    }
+    if (!page.has_more) {
+        transfer_swept = true;
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::apply_state_objects(const std::vector<KT>& keys, StateChunk<KT,VT>& chunk) {
+    auto& page = chunk.page;
+    for (const auto& key: keys) {
+        auto uncertain_it = transfer_uncertain.find(key);
+        if (uncertain_it == transfer_uncertain.end() || uncertain_it->second > chunk.version) {
+            // updated again since the pull.
+            continue;
+        }
+        // the keys are pulled in ascending order, and found in the same order.
+        auto found = std::lower_bound(page.keys.begin(),page.keys.end(),key);
+        if (found != page.keys.end() && *found == key) {
+            adopt_state(key,&page.values[found - page.keys.begin()]);
+        } else {
+            adopt_state(key,nullptr);
+        }
+        transfer_uncertain.erase(uncertain_it);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::touch_during_transfer(const KT& key, const persistent::version_t& version,
+                                                              bool depends_on_previous) {
+    if (!transfer_active || transfer_failed) {
+        return;
+    }
+    // a key is certain once a chunk has covered it, or an update not depending on the previous value has set it.
+    auto uncertain_it = transfer_uncertain.find(key);
+    const bool covered = transfer_swept || (transfer_cursor != *IK && !(transfer_cursor < key));
+    const bool was_certain = (uncertain_it == transfer_uncertain.end()) &&
+                             (covered || transfer_touched.find(key) != transfer_touched.end());
+    transfer_touched.erase(key);
+    transfer_touched.emplace(key,version);
+    if (was_certain || !depends_on_previous) {
+        if (uncertain_it != transfer_uncertain.end()) {
+            transfer_uncertain.erase(uncertain_it);
+        }
+    } else {
+        transfer_uncertain[key] = version;
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+bool VolatileCascadeStore<KT,VT,IK,IV>::wait_for_delivery(const persistent::version_t& version) {
+    // the updates up to the state transferred by derecho are never delivered to this replica.
+    if (version <= transfer_base_version) {
+        return true;
+    }
+    // this replica delivers the same updates as the sender, usually a little later.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::unique_lock<std::mutex> lck(transfer_mutex);
+    while (frontier.get_version() < version) {
+        if (!transfer_thread_alive || std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        transfer_cv.wait_for(lck,std::chrono::milliseconds(1),[this](){return !transfer_thread_alive;});
+    }
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void VolatileCascadeStore<KT,VT,IK,IV>::state_transfer_loop() {
+    std::unique_lock<std::mutex> lck(transfer_mutex);
+    // wait for the group, which is set after the state is received.
+    while (transfer_thread_alive && group == nullptr) {
+        transfer_cv.wait_for(lck,std::chrono::seconds(1),[this](){return !transfer_thread_alive;});
+    }
+    lck.unlock();
+    uint64_t start_us = get_time()/1000;
+    uint64_t chunk_bytes = get_vcs_state_transfer_chunk_bytes();
+    if (chunk_bytes == 0) {
+        // the sender is configured differently.
+        chunk_bytes = get_scan_max_page_bytes();
+    }
+    const uint32_t max_retries = get_vcs_state_transfer_max_retries();
+    std::size_t num_chunks = 0;
+    std::size_t num_keys = 0;
+    uint32_t num_failures = 0;
+    bool done = false;
+    std::size_t member_pos = 0;
+    while (transfer_thread_alive && num_failures <= max_retries) {
+        // after the chunks, pull the keys left uncertain.
+        std::vector<KT> uncertain_keys;
+        std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+        if (transfer_swept) {
+            if (transfer_uncertain.empty()) {
+                // the ordered handlers touch the keys under kv_map_mutex, so no key turns uncertain any more.
+                transfer_active = false;
+                transfer_touched.clear();
+                done = true;
+                break;
+            }
+            for (const auto& kv: transfer_uncertain) {
+                uncertain_keys.emplace_back(kv.first);
+            }
+        }
+        const KT cursor = transfer_cursor;
+        wlck.unlock();
+        auto& subgroup_handle = group->template get_subgroup<VolatileCascadeStore>(this->subgroup_index);
+        std::vector<node_id_t> peers;
+        for (const auto& node_id: group->template get_subgroup_members<VolatileCascadeStore>(this->subgroup_index)
+                                  .at(subgroup_handle.get_shard_num())) {
+            if (node_id != group->get_my_id()) {
+                peers.emplace_back(node_id);
+            }
+        }
+        if (peers.empty()) {
+            dbg_default_error("{}: no member to transfer the state from.", __func__);
+            break;
+        }
+        node_id_t node_id = peers[member_pos % peers.size()];
+        bool progressed = false;
+        try {
+            StateChunk<KT,VT> chunk;
+            if (uncertain_keys.empty()) {
+                auto results = subgroup_handle.template p2p_send<RPC_NAME(get_state_chunk)>(node_id,cursor,chunk_bytes);
+                chunk = results.get().begin()->second.get();
+            } else {
+                auto results = subgroup_handle.template p2p_send<RPC_NAME(get_state_objects)>(node_id,uncertain_keys);
+                chunk = results.get().begin()->second.get();
+            }
+            if (chunk.ready && wait_for_delivery(chunk.version)) {
+                wlck.lock();
+                if (uncertain_keys.empty()) {
+                    apply_state_chunk(chunk);
+                    num_chunks ++;
+                    num_keys += chunk.page.keys.size();
+                    progressed = !chunk.page.keys.empty() || !chunk.page.has_more;
+                } else {
+                    // a key updated again since the pull stays uncertain.
+                    std::size_t num_uncertain = transfer_uncertain.size();
+                    apply_state_objects(uncertain_keys,chunk);
+                    progressed = (transfer_uncertain.size() < num_uncertain);
+                }
+                wlck.unlock();
+            }
+        } catch (const std::exception& ex) {
+            dbg_default_warn("{}: failed to pull from node {}: {}", __func__, node_id, ex.what());
+        }
+        if (progressed) {
+            num_failures = 0;
+        } else {
+            // retry from the cursor with the next member.
+            num_failures ++;
+            member_pos ++;
+            lck.lock();
+            transfer_cv.wait_for(lck,std::chrono::milliseconds(100),[this](){return !transfer_thread_alive;});
+            lck.unlock();
+        }
+    }
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (!done) {
+        // transfer_active stays set, so that this replica never serves the incomplete state.
+        transfer_failed = true;
+        transfer_touched.clear();
+        transfer_uncertain.clear();
+    }
+    std::size_t kv_map_size = this->kv_map.size();
+    wlck.unlock();
+    if (done) {
+        dbg_default_info("{}: pulled {} keys in {} chunks in {} us, {} keys in the shard.",
+                         __func__, num_keys, num_chunks, get_time()/1000 - start_us, kv_map_size);
+    } else if (transfer_thread_alive) {
+        dbg_default_error("{}: gave up after {} failed pulls in a row, with {} keys in {} chunks. The state is "
+                          "incomplete, so this replica neither serves the state transfer nor picks its own replies.",
+                          __func__, num_failures, num_keys, num_chunks);
+    } else {
+        dbg_default_info("{}: stopped after {} keys in {} chunks, the state is incomplete.",
+                         __func__, num_keys, num_chunks);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 10 - Delta Buffer Pool Implementation
+///////////////////////////////////////////////////////////////////////////////
+inline DeltaBufferPool::DeltaBufferPool():
+    idle_bytes(0),
+    capacity(DEFAULT_DELTA_BUFFER_POOL_MB*1024ull*1024ull) {
+    if (derecho::hasCustomizedConfKey(CONF_DELTA_BUFFER_POOL_MB)) {
+        capacity = derecho::getConfUInt64(CONF_DELTA_BUFFER_POOL_MB)*1024ull*1024ull;
+    }
+}
+
+inline DeltaBufferPool& DeltaBufferPool::get() {
+    // never destroyed, so that the stores destroyed at exit can still return their buffers.
+    static DeltaBufferPool* pool = new DeltaBufferPool();
+    return *pool;
+}
+
+inline std::size_t DeltaBufferPool::get_size_class(const std::size_t size) {
+    std::size_t size_class = DEFAULT_DELTA_BUFFER_CAPACITY;
+    while (size_class < size) {
+        size_class <<= 1;
+    }
+    return size_class;
+}
+
+inline char* DeltaBufferPool::acquire(const std::size_t size_class) {
+    std::unique_lock<std::mutex> lck(pool_mutex);
+    auto it = idle_buffers.find(size_class);
+    if (it != idle_buffers.end() && !it->second.empty()) {
+        char* buffer = it->second.back();
+        it->second.pop_back();
+        idle_bytes -= size_class;
+        return buffer;
+    }
+    lck.unlock();
+    char* buffer = static_cast<char*>(malloc(size_class));
+    if (buffer == nullptr) {
+        dbg_default_crit("{}:{} Failed to allocate delta buffer. errno={}", __FILE__, __LINE__, errno);
+        throw derecho::derecho_exception("Failed to allocate delta buffer.");
+    }
+    return buffer;
+}
+
+inline void DeltaBufferPool::release(char* buffer, const std::size_t size_class) {
+    std::unique_lock<std::mutex> lck(pool_mutex);
+    if (idle_bytes + size_class > capacity) {
+        lck.unlock();
+        free(buffer);
+        return;
+    }
+    idle_buffers[size_class].push_back(buffer);
+    idle_bytes += size_class;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 11 - Blob Compression Implementation
+///////////////////////////////////////////////////////////////////////////////
+/**
+ * Get the id of a codec by name, or BLOB_CODEC_NONE if there is no such codec.
+ */
+inline uint8_t get_blob_codec_id(const std::string& codec_name) {
+    try {
+        return BlobCodecRegistry::get_id(codec_name);
+    } catch (const std::invalid_argument& ex) {
+        dbg_default_warn("{}: {}, blobs are not compressed.", __func__, ex.what());
+        return BLOB_CODEC_NONE;
+    }
+}
+
+inline const BlobCompression& get_wire_compression() {
+    static const BlobCompression wire_compression = [](){
+        std::string codec_name = DEFAULT_WIRE_COMPRESSION_CODEC;
+        if (derecho::hasCustomizedConfKey(CONF_WIRE_COMPRESSION_CODEC)) {
+            codec_name = derecho::getConfString(CONF_WIRE_COMPRESSION_CODEC);
+        }
+        uint64_t min_bytes = DEFAULT_COMPRESSION_MIN_BYTES;
+        if (derecho::hasCustomizedConfKey(CONF_COMPRESSION_MIN_BYTES)) {
+            min_bytes = derecho::getConfUInt64(CONF_COMPRESSION_MIN_BYTES);
+        }
+        return BlobCompression(get_blob_codec_id(codec_name),min_bytes);
+    }();
+    return wire_compression;
+}
+
+template <typename T>
+std::size_t get_raw_size(const T& object) {
+    const BlobCompression raw;
+    BlobCompressionScope compression_scope(raw);
+    return mutils::bytes_size(object);
+}
+
+inline BlobCompression load_log_compression(const derecho::subgroup_id_t subgroup_id) {
+    std::string codec_name = DEFAULT_LOG_COMPRESSION_CODEC;
+    if (derecho::hasCustomizedConfKey(CONF_LOG_COMPRESSION_CODEC)) {
+        codec_name = derecho::getConfString(CONF_LOG_COMPRESSION_CODEC);
+    }
+    uint64_t min_bytes = DEFAULT_COMPRESSION_MIN_BYTES;
+    if (derecho::hasCustomizedConfKey(CONF_COMPRESSION_MIN_BYTES)) {
+        min_bytes = derecho::getConfUInt64(CONF_COMPRESSION_MIN_BYTES);
+    }
+    auto subgroup_layout = get_subgroup_layout(subgroup_id);
+    if (subgroup_layout.is_object() && subgroup_layout.contains(JSON_CONF_COMPRESSION)) {
+        const auto& compression = subgroup_layout[JSON_CONF_COMPRESSION];
+        if (compression.contains(JSON_CONF_COMPRESSION_CODEC)) {
+            codec_name = compression[JSON_CONF_COMPRESSION_CODEC].get<std::string>();
+        }
+        if (compression.contains(JSON_CONF_COMPRESSION_MIN_BYTES)) {
+            min_bytes = compression[JSON_CONF_COMPRESSION_MIN_BYTES].get<uint64_t>();
+        }
+    }
+    return BlobCompression(get_blob_codec_id(codec_name),min_bytes);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 12 - Delta Encoding Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename VT>
+bool is_blob_patch(const VT& value) {
+    if constexpr (std::is_base_of<IHasBlobPatch,VT>::value) {
+        return value.is_blob_patch();
+    } else {
+        return false;
+    }
+}
+
+inline DeltaEncoding::DeltaEncoding():
+    full_image_interval(DEFAULT_DELTA_ENCODING_FULL_IMAGE_INTERVAL),
+    min_bytes(DEFAULT_DELTA_ENCODING_MIN_BYTES) {
+    if (derecho::hasCustomizedConfKey(CONF_DELTA_ENCODING_FULL_IMAGE_INTERVAL)) {
+        full_image_interval = derecho::getConfUInt64(CONF_DELTA_ENCODING_FULL_IMAGE_INTERVAL);
+    }
+    if (derecho::hasCustomizedConfKey(CONF_DELTA_ENCODING_MIN_BYTES)) {
+        min_bytes = derecho::getConfUInt64(CONF_DELTA_ENCODING_MIN_BYTES);
+    }
+}
+
+inline void DeltaEncoding::load_subgroup_override(const derecho::subgroup_id_t subgroup_id) {
+    auto subgroup_layout = get_subgroup_layout(subgroup_id);
+    if (!subgroup_layout.is_object() || !subgroup_layout.contains(JSON_CONF_DELTA_ENCODING)) {
+        return;
+    }
+    const auto& delta_encoding = subgroup_layout[JSON_CONF_DELTA_ENCODING];
+    if (delta_encoding.contains(JSON_CONF_DELTA_ENCODING_FULL_IMAGE_INTERVAL)) {
+        full_image_interval = delta_encoding[JSON_CONF_DELTA_ENCODING_FULL_IMAGE_INTERVAL].get<uint64_t>();
+    }
+    if (delta_encoding.contains(JSON_CONF_DELTA_ENCODING_MIN_BYTES)) {
+        min_bytes = delta_encoding[JSON_CONF_DELTA_ENCODING_MIN_BYTES].get<uint64_t>();
+    }
+}
+
+inline bool DeltaEncoding::is_enabled() const {
+    return full_image_interval > 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 13 - Blob Tier Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename KT>
+BlobTier<KT>::BlobTier():
+    cache_bytes(DEFAULT_BLOB_TIER_CACHE_MB*1024ull*1024ull),
+    min_bytes(DEFAULT_BLOB_TIER_MIN_BYTES),
+    opened(false),
+    fd(-1),
+    file_size(0),
+    active_segment(NO_SEGMENT),
+    cold_bytes(0),
+    has_saved_state(false) {
+    if (derecho::hasCustomizedConfKey(CONF_BLOB_TIER_CACHE_MB)) {
+        cache_bytes = derecho::getConfUInt64(CONF_BLOB_TIER_CACHE_MB)*1024ull*1024ull;
+    }
+    if (derecho::hasCustomizedConfKey(CONF_BLOB_TIER_MIN_BYTES)) {
+        min_bytes = derecho::getConfUInt64(CONF_BLOB_TIER_MIN_BYTES);
+    }
+    hot_blobs.set_limits(cache_bytes,0);
+}
+
+template <typename KT>
+void BlobTier<KT>::load_subgroup_override(const derecho::subgroup_id_t subgroup_id) {
+    auto subgroup_layout = get_subgroup_layout(subgroup_id);
+    if (!subgroup_layout.is_object() || !subgroup_layout.contains(JSON_CONF_BLOB_TIER)) {
+        return;
+    }
+    const auto& blob_tier = subgroup_layout[JSON_CONF_BLOB_TIER];
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    if (blob_tier.contains(JSON_CONF_BLOB_TIER_CACHE_MB)) {
+        cache_bytes = blob_tier[JSON_CONF_BLOB_TIER_CACHE_MB].get<uint64_t>()*1024ull*1024ull;
+    }
+    if (blob_tier.contains(JSON_CONF_BLOB_TIER_MIN_BYTES)) {
+        min_bytes = blob_tier[JSON_CONF_BLOB_TIER_MIN_BYTES].get<uint64_t>();
+    }
+    hot_blobs.set_limits(cache_bytes,0);
+}
+
+template <typename KT>
+bool BlobTier<KT>::is_enabled() const {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    return cache_bytes > 0;
+}
+
+template <typename KT>
+bool BlobTier<KT>::is_open() const {
+    return opened.load();
+}
+
+template <typename KT>
+bool BlobTier<KT>::open(const std::string& path, const std::string& state_path) {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    if (fd >= 0) {
+        return true;
+    }
+    fd = ::open(path.c_str(),O_RDWR|O_CREAT,0644);
+    if (fd < 0) {
+        dbg_default_error("{}: failed to open the value file {}.", __func__, path);
+        return false;
+    }
+    value_file = path;
+    // a state saved by the last run may still match the file, until the first cold blob is written.
+    state_file = state_path;
+    has_saved_state = true;
+    file_size = 0;
+    active_segment = NO_SEGMENT;
+    opened = true;
+    return true;
+}
+
+template <typename KT>
+std::size_t BlobTier<KT>::reopen(const std::string& path, const std::string& state_path, const char* buf) {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    if (fd >= 0) {
+        return 0;
+    }
+    fd = ::open(path.c_str(),O_RDWR);
+    if (fd < 0) {
+        dbg_default_warn("{}: failed to open the value file {}.", __func__, path);
+        return 0;
+    }
+    value_file = path;
+    // [file size][number of segments]([mapped][file offset][capacity][used][live])*[number of free segments]([segment])*
+    // [active segment][number of cold blobs]([key][segment][offset][size])*
+    std::size_t offset = 0;
+    auto read = [buf,&offset](auto& v) {
+        v = *mutils::from_bytes<std::decay_t<decltype(v)>>(nullptr,buf+offset);
+        offset += mutils::bytes_size(v);
+    };
+    read(file_size);
+    struct stat st;
+    bool matched = (fstat(fd,&st) == 0 && static_cast<uint64_t>(st.st_size) >= file_size);
+    std::size_t num_segments = 0;
+    read(num_segments);
+    segments.resize(num_segments);
+    for (auto& seg: segments) {
+        bool mapped = false;
+        read(mapped);
+        read(seg.file_offset);
+        read(seg.capacity);
+        read(seg.used);
+        read(seg.live);
+        seg.base = nullptr;
+        if (matched && mapped) {
+            void* base = mmap(nullptr,seg.capacity,PROT_READ|PROT_WRITE,MAP_SHARED,fd,seg.file_offset);
+            if (base == MAP_FAILED) {
+                matched = false;
+            } else {
+                seg.base = static_cast<char*>(base);
+            }
+        }
+    }
+    std::size_t num_free_segments = 0;
+    read(num_free_segments);
+    free_segments.resize(num_free_segments);
+    for (auto& segment: free_segments) {
+        read(segment);
+    }
+    read(active_segment);
+    std::size_t num_cold_blobs = 0;
+    read(num_cold_blobs);
+    for (std::size_t i = 0; i < num_cold_blobs; i++) {
+        auto key_ptr = mutils::from_bytes<KT>(nullptr,buf+offset);
+        offset += mutils::bytes_size(*key_ptr);
+        ColdBlob cold_blob;
+        read(cold_blob.segment);
+        read(cold_blob.offset);
+        read(cold_blob.size);
+        if (cold_blob.segment >= segments.size() || segments[cold_blob.segment].base == nullptr) {
+            matched = false;
+        }
+        cold_bytes += cold_blob.size;
+        cold_blobs.emplace(std::move(*key_ptr),cold_blob);
+    }
+    if (!matched) {
+        dbg_default_warn("{}: the value file {} does not match its layout.", __func__, path);
+        close_value_file();
+        return 0;
+    }
+    state_file = state_path;
+    has_saved_state = true;
+    opened = true;
+    return offset;
+}
+
+template <typename KT>
+template <typename WriteFunc>
+bool BlobTier<KT>::save(const WriteFunc& write_func) {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    if (!opened) {
+        return false;
+    }
+    for (const auto& seg: segments) {
+        if (seg.base != nullptr && msync(seg.base,seg.capacity,MS_SYNC) != 0) {
+            dbg_default_error("{}: failed to flush the value file {}.", __func__, value_file);
+            return false;
+        }
+    }
+    if (fsync(fd) != 0) {
+        dbg_default_error("{}: failed to flush the value file {}.", __func__, value_file);
+        return false;
+    }
+    mutils::post_object(write_func,file_size);
+    mutils::post_object(write_func,segments.size());
+    for (const auto& seg: segments) {
+        mutils::post_object(write_func,seg.base != nullptr);
+        mutils::post_object(write_func,seg.file_offset);
+        mutils::post_object(write_func,seg.capacity);
+        mutils::post_object(write_func,seg.used);
+        mutils::post_object(write_func,seg.live);
+    }
+    mutils::post_object(write_func,free_segments.size());
+    for (const auto& segment: free_segments) {
+        mutils::post_object(write_func,segment);
+    }
+    mutils::post_object(write_func,active_segment);
+    mutils::post_object(write_func,cold_blobs.size());
+    for (const auto& kv: cold_blobs) {
+        mutils::post_object(write_func,kv.first);
+        mutils::post_object(write_func,kv.second.segment);
+        mutils::post_object(write_func,kv.second.offset);
+        mutils::post_object(write_func,kv.second.size);
+    }
+    return true;
+}
+
+template <typename KT>
+void BlobTier<KT>::keep_value_file() {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    has_saved_state = true;
+}
+
+template <typename KT>
+const char* BlobTier<KT>::get_cold_blob(const KT& key, uint64_t& size) const {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    auto it = cold_blobs.find(key);
+    if (it == cold_blobs.end()) {
+        return nullptr;
+    }
+    size = it->second.size;
+    return segments[it->second.segment].base + it->second.offset;
+}
+
+template <typename KT>
+void BlobTier<KT>::close_value_file() {
+    for (const auto& seg: segments) {
+        if (seg.base != nullptr) {
+            munmap(seg.base,seg.capacity);
+        }
+    }
+    segments.clear();
+    free_segments.clear();
+    cold_blobs.clear();
+    active_segment = NO_SEGMENT;
+    cold_bytes = 0;
+    file_size = 0;
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    opened = false;
+}
+
+template <typename KT>
+void BlobTier<KT>::invalidate_saved_state() {
+    if (!has_saved_state) {
+        return;
+    }
+    // the layout in the saved state stops matching the value file with the first change.
+    std::remove(state_file.c_str());
+    has_saved_state = false;
+    if (file_size == 0 && ftruncate(fd,0) != 0) {
+        dbg_default_warn("{}: failed to truncate the value file {}.", __func__, value_file);
+    }
+}
+
+template <typename KT>
+uint64_t BlobTier<KT>::allocate_segment(const uint64_t capacity) {
+    uint64_t segment = segments.size();
+    uint64_t file_offset = file_size;
+    if (capacity == SEGMENT_SIZE && !free_segments.empty()) {
+        segment = free_segments.back();
+        file_offset = segments[segment].file_offset;
+    }
+    // reserve the disk space up front, so that writing to the mapping does not fault on a full disk.
+    if (posix_fallocate(fd,file_offset,capacity) != 0) {
+        dbg_default_warn("{}: failed to allocate {} bytes in the value file {}.", __func__, capacity, value_file);
+        return segments.size();
+    }
+    void* base = mmap(nullptr,capacity,PROT_READ|PROT_WRITE,MAP_SHARED,fd,file_offset);
+    if (base == MAP_FAILED) {
+        dbg_default_warn("{}: failed to map {} bytes of the value file {}.", __func__, capacity, value_file);
+        fallocate(fd,FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,file_offset,capacity);
+        return segments.size();
+    }
+    if (segment == segments.size()) {
+        segments.push_back({});
+        file_size += capacity;
+    } else {
+        free_segments.pop_back();
+    }
+    segments[segment] = {static_cast<char*>(base),file_offset,capacity,0,0};
+    return segment;
+}
+
+template <typename KT>
+void BlobTier<KT>::release_segment(const uint64_t segment) {
+    invalidate_saved_state();
+    auto& seg = segments[segment];
+    munmap(seg.base,seg.capacity);
+    // give the disk space back, the file range stays for the next segment of the same size.
+    fallocate(fd,FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,seg.file_offset,seg.capacity);
+    seg.base = nullptr;
+    seg.used = 0;
+    seg.live = 0;
+    if (seg.capacity == SEGMENT_SIZE) {
+        free_segments.push_back(segment);
+    }
+    if (active_segment == segment) {
+        active_segment = NO_SEGMENT;
+    }
+}
+
+template <typename KT>
+const char* BlobTier<KT>::append(const KT& key, const char* bytes, const uint64_t size) {
+    invalidate_saved_state();
+    // 8-byte aligned blobs
+    const uint64_t aligned_size = (size + 7) & ~7ull;
+    uint64_t segment = active_segment;
+    if (aligned_size > SEGMENT_SIZE) {
+        // a large blob has a segment of its own.
+        const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        segment = allocate_segment((aligned_size + page_size - 1) / page_size * page_size);
+    } else if (segment == NO_SEGMENT || segments[segment].used + aligned_size > segments[segment].capacity) {
+        // seal the active segment. One emptied while it was active is released now.
+        const uint64_t sealed_segment = segment;
+        active_segment = NO_SEGMENT;
+        if (sealed_segment != NO_SEGMENT && segments[sealed_segment].live == 0) {
+            release_segment(sealed_segment);
+        }
+        segment = allocate_segment(SEGMENT_SIZE);
+        if (segment < segments.size()) {
+            active_segment = segment;
+        }
+    }
+    if (segment >= segments.size()) {
+        return nullptr;
+    }
+    auto& seg = segments[segment];
+    char* copy = seg.base + seg.used;
+    memcpy(copy,bytes,size);
+    cold_blobs[key] = {segment,seg.used,size};
+    seg.used += aligned_size;
+    seg.live += size;
+    cold_bytes += size;
+    return copy;
+}
+
+template <typename KT>
+void BlobTier<KT>::drop(const KT& key) {
+    auto it = cold_blobs.find(key);
+    if (it == cold_blobs.end()) {
+        return;
+    }
+    const uint64_t segment = it->second.segment;
+    segments[segment].live -= it->second.size;
+    cold_bytes -= it->second.size;
+    cold_blobs.erase(key);
+    if (segments[segment].live == 0 && segment != active_segment) {
+        release_segment(segment);
+    }
+}
+
+template <typename KT>
+void BlobTier<KT>::on_update(const KT& key, const uint64_t& blob_size) {
+    if (!opened) {
+        return;
+    }
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    drop(key);
+    if (cache_bytes > 0 && blob_size >= min_bytes && blob_size > 0) {
+        hot_blobs.on_update(key,blob_size,0);
+    } else {
+        hot_blobs.on_erase(key);
+    }
+}
+
+template <typename KT>
+void BlobTier<KT>::on_access(const KT& key) {
+    if (!opened) {
+        return;
+    }
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    hot_blobs.on_access(key);
+}
+
+template <typename KT>
+void BlobTier<KT>::on_erase(const KT& key) {
+    if (!opened) {
+        return;
+    }
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    drop(key);
+    hot_blobs.on_erase(key);
+}
+
+template <typename KT>
+std::vector<KT> BlobTier<KT>::evict() {
+    if (!opened) {
+        return {};
+    }
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    // the tier has no ttl, so the time does not matter.
+    return hot_blobs.evict(0);
+}
+
+template <typename KT>
+const char* BlobTier<KT>::put_cold(const KT& key, const char* bytes, const uint64_t& size) {
+    if (!opened) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    drop(key);
+    return append(key,bytes,size);
+}
+
+template <typename KT>
+template <typename RepointFunc>
+void BlobTier<KT>::compact(const RepointFunc& repoint) {
+    if (!opened) {
+        return;
+    }
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    // one segment at a time, so that an ordered handler does not copy more than a segment.
+    uint64_t victim = segments.size();
+    for (uint64_t segment = 0; segment < segments.size(); segment++) {
+        const auto& seg = segments[segment];
+        if (seg.base != nullptr && segment != active_segment && seg.capacity == SEGMENT_SIZE &&
+            seg.live < seg.used / 2) {
+            victim = segment;
+            break;
+        }
+    }
+    if (victim == segments.size()) {
+        return;
+    }
+    std::vector<std::pair<KT,ColdBlob>> moving;
+    for (const auto& kv: cold_blobs) {
+        if (kv.second.segment == victim) {
+            moving.emplace_back(kv.first,kv.second);
+        }
+    }
+    const char* victim_base = segments[victim].base;
+    for (const auto& [key,cold_blob]: moving) {
+        // appending may allocate a segment, which does not move the victim.
+        segments[victim].live -= cold_blob.size;
+        cold_bytes -= cold_blob.size;
+        const char* copy = append(key,victim_base + cold_blob.offset,cold_blob.size);
+        if (copy == nullptr) {
+            // out of space: leave the rest in place.
+            segments[victim].live += cold_blob.size;
+            cold_bytes += cold_blob.size;
+            return;
+        }
+        repoint(key,copy,cold_blob.size);
+    }
+    if (segments[victim].live == 0) {
+        release_segment(victim);
+    }
+}
+
+template <typename KT>
+uint64_t BlobTier<KT>::get_hot_bytes() const {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    return hot_blobs.get_total_bytes();
+}
+
+template <typename KT>
+uint64_t BlobTier<KT>::get_cold_bytes() const {
+    std::lock_guard<std::mutex> lck(tier_mutex);
+    return cold_bytes;
+}
+
+template <typename KT>
+BlobTier<KT>::~BlobTier() {
+    const bool remove_file = (fd >= 0 && !has_saved_state);
+    close_value_file();
+    if (remove_file) {
+        std::remove(value_file.c_str());
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::init_blob_tier() {
+    if constexpr (std::is_base_of<IHasBlob,VT>::value && std::is_base_of<IHasBlobReference,VT>::value) {
+        if (!blob_tier.is_enabled() || blob_tier.is_open() || value_file.empty()) {
+            return;
+        }
+        if (!blob_tier.open(value_file,value_file + ".state")) {
+            return;
+        }
+        for (const auto& kv: this->persistent_core->kv_map) {
+            if (!kv.second.is_null()) {
+                blob_tier.on_update(kv.first,kv.second.get_blob_size());
+            }
+        }
+        evict_blobs();
+        dbg_default_info("{}: {} bytes of hot blobs, {} bytes of cold blobs in {}.", __func__,
+                         blob_tier.get_hot_bytes(), blob_tier.get_cold_bytes(), value_file);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::evict_blobs() {
+    if constexpr (std::is_base_of<IHasBlob,VT>::value && std::is_base_of<IHasBlobReference,VT>::value) {
+        auto& kv_map = this->persistent_core->kv_map;
+        for (const auto& key: blob_tier.evict()) {
+            auto it = kv_map.find(key);
+            if (it == kv_map.end() || it->second.is_null()) {
+                continue;
+            }
+            const std::size_t blob_size = it->second.get_blob_size();
+            const char* bytes = blob_tier.put_cold(key,it->second.get_blob_bytes(),blob_size);
+            if (bytes == nullptr) {
+                // it stays in the heap until it is updated again.
+                dbg_default_warn("{}: failed to move the blob of key:{} to the value file.", __func__, key);
+                continue;
+            }
+            it->second.set_blob_reference(bytes,blob_size);
+        }
+        blob_tier.compact([&kv_map](const KT& key, const char* bytes, const uint64_t& size){
+            auto it = kv_map.find(key);
+            if (it != kv_map.end()) {
+                it->second.set_blob_reference(bytes,size);
+            }
+        });
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::save_blob_tier_state() {
+    if constexpr (std::is_base_of<IHasBlob,VT>::value && std::is_base_of<IHasBlobReference,VT>::value) {
+        std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+        int64_t index = persistent_core.getLatestIndex();
+        if (!blob_tier.is_open() || index == persistent::INVALID_INDEX) {
+            return;
+        }
+        persistent::version_t version = persistent_core.getVersionAtIndex(index);
+        const std::string state_file = value_file + ".state";
+        const std::string tmp_file = state_file + ".tmp";
+        FILE* fp = fopen(tmp_file.c_str(),"wb");
+        if (fp == nullptr) {
+            dbg_default_error("{}: failed to open {}.", __func__, tmp_file);
+            return;
+        }
+        bool saved = true;
+        auto write_file = [&saved,fp](char const* const bytes, std::size_t size){
+            saved = saved && (fwrite(bytes,1,size,fp) == size);
+        };
+        // [index][version][base index][base version][base timestamp][layout of the value file]
+        // [number of keys]([key][value])*[version index]
+        mutils::post_object(write_file,index);
+        mutils::post_object(write_file,version);
+        mutils::post_object(write_file,base_index);
+        mutils::post_object(write_file,base_version);
+        mutils::post_object(write_file,base_timestamp_us);
+        saved = saved && blob_tier.save(write_file);
+        // the cold blobs stay in the value file, so they are left out of the saved values.
+        const auto& kv_map = this->persistent_core->kv_map;
+        mutils::post_object(write_file,static_cast<std::size_t>(kv_map.size()));
+        for (const auto& kv: kv_map) {
+            mutils::post_object(write_file,kv.first);
+            uint64_t size = 0;
+            if (blob_tier.get_cold_blob(kv.first,size) != nullptr) {
+                kv.second.post_object_without_blob(write_file);
+            } else {
+                mutils::post_object(write_file,kv.second);
+            }
+        }
+        post_version_index(write_file,version);
+        saved = saved && (fflush(fp) == 0) && (fsync(fileno(fp)) == 0);
+        fclose(fp);
+        if (!saved || std::rename(tmp_file.c_str(),state_file.c_str()) != 0) {
+            dbg_default_error("{}: failed to save the state to {}.", __func__, state_file);
+            std::remove(tmp_file.c_str());
+            return;
+        }
+        blob_tier.keep_value_file();
+        dbg_default_info("{}: saved the state at index {}, version 0x{:x}, with {} bytes of cold blobs in {}.", __func__,
+                         index, version, blob_tier.get_cold_bytes(), value_file);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+int64_t PersistentCascadeStore<KT,VT,IK,IV,ST>::load_blob_tier_state() {
+    if constexpr (std::is_base_of<IHasBlob,VT>::value && std::is_base_of<IHasBlobReference,VT>::value) {
+        if (value_file.empty()) {
+            return persistent::INVALID_INDEX;
+        }
+        const std::string state_file = value_file + ".state";
+        std::ifstream ifs(state_file,std::ios::binary|std::ios::ate);
+        if (!ifs) {
+            return persistent::INVALID_INDEX;
+        }
+        std::vector<char> buf(static_cast<std::size_t>(ifs.tellg()));
+        const bool loaded = static_cast<bool>(ifs.seekg(0).read(buf.data(),buf.size()));
+        ifs.close();
+        // a saved state failing the validation is stale for good: it is removed, and the value file truncated.
+        auto discard = [this,&state_file,func=__func__](){
+            std::remove(state_file.c_str());
+            if (truncate(value_file.c_str(),0) != 0 && errno != ENOENT) {
+                dbg_default_warn("{}: failed to truncate the value file {}.", func, value_file);
+            }
+        };
+        if (!loaded) {
+            dbg_default_error("{}: failed to load the state from {}.", __func__, state_file);
+            discard();
+            return persistent::INVALID_INDEX;
+        }
+        std::size_t offset = 0;
+        int64_t index = *mutils::from_bytes<int64_t>(nullptr,buf.data()+offset);
+        offset += sizeof(int64_t);
+        persistent::version_t version = *mutils::from_bytes<persistent::version_t>(nullptr,buf.data()+offset);
+        offset += sizeof(persistent::version_t);
+        int64_t earliest_index = persistent_core.getEarliestIndex();
+        int64_t latest_index = persistent_core.getLatestIndex();
+        if (earliest_index == persistent::INVALID_INDEX || index < earliest_index || index > latest_index ||
+            persistent_core.getVersionAtIndex(index) != version) {
+            // the log lost its unpersisted tail, or was replaced.
+            dbg_default_warn("{}: the state at version 0x{:x} does not match the log, ignored.", __func__, version);
+            discard();
+            return persistent::INVALID_INDEX;
+        }
+        int64_t saved_base_index = *mutils::from_bytes<int64_t>(nullptr,buf.data()+offset);
+        offset += sizeof(int64_t);
+        persistent::version_t saved_base_version = *mutils::from_bytes<persistent::version_t>(nullptr,buf.data()+offset);
+        offset += sizeof(persistent::version_t);
+        uint64_t saved_base_timestamp_us = *mutils::from_bytes<uint64_t>(nullptr,buf.data()+offset);
+        offset += sizeof(uint64_t);
+        std::size_t layout_size = blob_tier.reopen(value_file,state_file,buf.data()+offset);
+        if (layout_size == 0) {
+            discard();
+            return persistent::INVALID_INDEX;
+        }
+        offset += layout_size;
+        auto& kv_map = this->persistent_core->kv_map;
+        KVIndex<KT,VT> saved_kv_map;
+        const std::size_t num_keys = *mutils::from_bytes<std::size_t>(nullptr,buf.data()+offset);
+        offset += sizeof(std::size_t);
+        for (std::size_t i = 0; i < num_keys; i++) {
+            auto key_ptr = mutils::from_bytes<KT>(nullptr,buf.data()+offset);
+            offset += mutils::bytes_size(*key_ptr);
+            auto value_ptr = mutils::from_bytes<VT>(nullptr,buf.data()+offset);
+            offset += mutils::bytes_size(*value_ptr);
+            saved_kv_map.emplace(std::move(*key_ptr),std::move(*value_ptr));
+        }
+        kv_map = std::move(saved_kv_map);
+        load_version_index(buf.data()+offset);
+        base_index = saved_base_index;
+        base_version = saved_base_version;
+        base_timestamp_us = saved_base_timestamp_us;
+        // point the values to their cold blobs, and track the hot ones.
+        for (auto& kv: kv_map) {
+            uint64_t size = 0;
+            const char* bytes = blob_tier.get_cold_blob(kv.first,size);
+            if (bytes != nullptr) {
+                kv.second.set_blob_reference(bytes,size);
+            } else if (!kv.second.is_null()) {
+                blob_tier.on_update(kv.first,kv.second.get_blob_size());
+            }
+        }
+        evict_blobs();
+        dbg_default_info("{}: mapped the state at index {}, version 0x{:x}, with {} bytes of cold blobs in {}.", __func__,
+                         index, version, blob_tier.get_cold_bytes(), value_file);
+        return index;
+    }
+    return persistent::INVALID_INDEX;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+template <typename WriteFunc>
+void PersistentCascadeStore<KT,VT,IK,IV,ST>::post_version_index(const WriteFunc& write_func,
+                                                                const persistent::version_t& version) const {
+    std::size_t num_keys = 0;
+    for (const auto& kv: version_index) {
+        if (!kv.second.empty() && kv.second.front().version <= version) {
+            num_keys ++;
+        }
+    }
+    mutils::post_object(write_func,num_keys);
+    for (const auto& kv: version_index) {
+        const auto& key_versions = kv.second;
+        std::size_t num_versions = 0;
+        while (num_versions < key_versions.size() && key_versions[num_versions].version <= version) {
+            num_versions ++;
+        }
+        if (num_versions == 0) {
+            continue;
+        }
+        mutils::post_object(write_func,kv.first);
+        mutils::post_object(write_func,num_versions);
+        for (std::size_t i = 0; i < num_versions; i++) {
+            mutils::post_object(write_func,key_versions[i].version);
+            mutils::post_object(write_func,key_versions[i].timestamp_us);
+        }
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV, persistent::StorageType ST>
+std::size_t PersistentCascadeStore<KT,VT,IK,IV,ST>::load_version_index(const char* buf) {
+    std::size_t offset = 0;
+    std::size_t num_keys = *mutils::from_bytes<std::size_t>(nullptr,buf+offset);
+    offset += sizeof(std::size_t);
+    for (std::size_t k = 0; k < num_keys; k++) {
+        auto key_ptr = mutils::from_bytes<KT>(nullptr,buf+offset);
+        offset += mutils::bytes_size(*key_ptr);
+        std::size_t num_versions = *mutils::from_bytes<std::size_t>(nullptr,buf+offset);
+        offset += sizeof(std::size_t);
+        std::vector<KeyVersion> key_versions(num_versions);
+        for (auto& key_version: key_versions) {
+            key_version.version = *mutils::from_bytes<persistent::version_t>(nullptr,buf+offset);
+            offset += sizeof(persistent::version_t);
+            key_version.timestamp_us = *mutils::from_bytes<uint64_t>(nullptr,buf+offset);
+            offset += sizeof(uint64_t);
+        }
+        version_index.emplace(std::move(*key_ptr),std::move(key_versions));
+    }
+    return offset;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 14 - Write-Behind Cascade Store Implementation
+///////////////////////////////////////////////////////////////////////////////
+inline uint32_t get_wbcs_reconcile_max_retries() {
+    static const uint32_t max_retries = derecho::hasCustomizedConfKey(CONF_WBCS_RECONCILE_MAX_RETRIES) ?
+                                        derecho::getConfUInt32(CONF_WBCS_RECONCILE_MAX_RETRIES) :
+                                        DEFAULT_WBCS_RECONCILE_MAX_RETRIES;
+    return max_retries;
+}
+
+template <typename KT, typename VT>
+WriteBehindLog<KT,VT>::WriteBehindLog():
+    flush_interval_ms(DEFAULT_WBCS_FLUSH_INTERVAL_MS),
+    max_pending_bytes(DEFAULT_WBCS_MAX_PENDING_MB*1024ull*1024ull),
+    compaction_min_bytes(DEFAULT_WBCS_COMPACTION_MIN_MB*1024ull*1024ull),
+    fd(-1),
+    file_size(0),
+    compacted_size(0),
+    needs_directory_sync(false) {
+    if (derecho::hasCustomizedConfKey(CONF_WBCS_FLUSH_INTERVAL_MS)) {
+        flush_interval_ms = derecho::getConfUInt64(CONF_WBCS_FLUSH_INTERVAL_MS);
+    }
+    if (derecho::hasCustomizedConfKey(CONF_WBCS_MAX_PENDING_MB)) {
+        max_pending_bytes = derecho::getConfUInt64(CONF_WBCS_MAX_PENDING_MB)*1024ull*1024ull;
+    }
+    if (derecho::hasCustomizedConfKey(CONF_WBCS_COMPACTION_MIN_MB)) {
+        compaction_min_bytes = derecho::getConfUInt64(CONF_WBCS_COMPACTION_MIN_MB)*1024ull*1024ull;
+    }
+    if (flush_interval_ms == 0) {
+        flush_interval_ms = DEFAULT_WBCS_FLUSH_INTERVAL_MS;
+    }
+}
+
+template <typename KT, typename VT>
+void WriteBehindLog<KT,VT>::load_subgroup_override(const derecho::subgroup_id_t subgroup_id) {
+    auto subgroup_layout = get_subgroup_layout(subgroup_id);
+    if (!subgroup_layout.is_object() || !subgroup_layout.contains(JSON_CONF_WRITE_BEHIND)) {
+        return;
+    }
+    const auto& write_behind = subgroup_layout[JSON_CONF_WRITE_BEHIND];
+    std::lock_guard<std::mutex> lck(log_mutex);
+    if (write_behind.contains(JSON_CONF_WRITE_BEHIND_FLUSH_INTERVAL_MS) &&
+        write_behind[JSON_CONF_WRITE_BEHIND_FLUSH_INTERVAL_MS].get<uint64_t>() > 0) {
+        flush_interval_ms = write_behind[JSON_CONF_WRITE_BEHIND_FLUSH_INTERVAL_MS].get<uint64_t>();
+    }
+    if (write_behind.contains(JSON_CONF_WRITE_BEHIND_MAX_PENDING_MB)) {
+        max_pending_bytes = write_behind[JSON_CONF_WRITE_BEHIND_MAX_PENDING_MB].get<uint64_t>()*1024ull*1024ull;
+    }
+}
+
+template <typename KT, typename VT>
+uint64_t WriteBehindLog<KT,VT>::checksum(const char* bytes, const std::size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(bytes[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template <typename KT, typename VT>
+template <typename T>
+void WriteBehindLog<KT,VT>::append_record(std::vector<char>& buf, const uint8_t& type,
+                                          const persistent::version_t& version, const T& object) {
+    const uint64_t payload_size = sizeof(uint8_t) + sizeof(persistent::version_t) + mutils::bytes_size(object);
+    const std::size_t offset = buf.size();
+    buf.resize(offset + RECORD_HEADER_SIZE + payload_size);
+    char* payload = buf.data() + offset + RECORD_HEADER_SIZE;
+    payload[0] = static_cast<char>(type);
+    memcpy(payload + sizeof(uint8_t),&version,sizeof(persistent::version_t));
+    mutils::to_bytes(object,payload + sizeof(uint8_t) + sizeof(persistent::version_t));
+    const uint64_t payload_checksum = checksum(payload,payload_size);
+    memcpy(buf.data() + offset,&payload_size,sizeof(uint64_t));
+    memcpy(buf.data() + offset + sizeof(uint64_t),&payload_checksum,sizeof(uint64_t));
+}
+
+template <typename KT, typename VT>
+bool WriteBehindLog<KT,VT>::write_all(const int _fd, const char* bytes, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(_fd,bytes,size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+template <typename KT, typename VT>
+bool WriteBehindLog<KT,VT>::is_open() const {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    return fd >= 0;
+}
+
+template <typename KT, typename VT>
+template <typename PutFunc, typename RemoveFunc>
+bool WriteBehindLog<KT,VT>::open(const std::string& path, const PutFunc& on_put, const RemoveFunc& on_remove) {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    if (fd >= 0) {
+        return true;
+    }
+    int _fd = ::open(path.c_str(),O_RDWR|O_CREAT|O_APPEND,0644);
+    struct stat st;
+    if (_fd < 0 || fstat(_fd,&st) != 0) {
+        dbg_default_error("{}: failed to open the write-behind log {}.", __func__, path);
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+        return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    uint64_t offset = 0;
+    uint64_t num_records = 0;
+    if (size > 0) {
+        void* base = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,_fd,0);
+        if (base == MAP_FAILED) {
+            dbg_default_error("{}: failed to map the write-behind log {}.", __func__, path);
+            ::close(_fd);
+            return false;
+        }
+        const char* buf = static_cast<const char*>(base);
+        // replay the records up to the first torn or corrupted one.
+        while (offset + RECORD_HEADER_SIZE <= size) {
+            uint64_t payload_size;
+            uint64_t payload_checksum;
+            memcpy(&payload_size,buf + offset,sizeof(uint64_t));
+            memcpy(&payload_checksum,buf + offset + sizeof(uint64_t),sizeof(uint64_t));
+            const char* payload = buf + offset + RECORD_HEADER_SIZE;
+            if (payload_size < sizeof(uint8_t) + sizeof(persistent::version_t) ||
+                payload_size > size - offset - RECORD_HEADER_SIZE ||
+                checksum(payload,payload_size) != payload_checksum) {
+                break;
+            }
+            const uint8_t type = static_cast<uint8_t>(payload[0]);
+            persistent::version_t version;
+            memcpy(&version,payload + sizeof(uint8_t),sizeof(persistent::version_t));
+            const char* object = payload + sizeof(uint8_t) + sizeof(persistent::version_t);
+            if (type == RECORD_PUT) {
+                on_put(std::move(*mutils::from_bytes<VT>(nullptr,object)),version);
+            } else if (type == RECORD_REMOVE) {
+                on_remove(*mutils::from_bytes<KT>(nullptr,object),version);
+            } else {
+                break;
+            }
+            offset += RECORD_HEADER_SIZE + payload_size;
+            num_records ++;
+        }
+        munmap(base,size);
+    }
+    if (offset < size) {
+        dbg_default_warn("{}: cut off {} bytes of torn records at the tail of {}.", __func__, size - offset, path);
+        if (ftruncate(_fd,offset) != 0) {
+            dbg_default_error("{}: failed to cut off the tail of {}.", __func__, path);
+            ::close(_fd);
+            return false;
+        }
+    }
+    fd = _fd;
+    log_file = path;
+    file_size = offset;
+    compacted_size = offset;
+    // the file may be new, so the first flush syncs its directory entry too.
+    needs_directory_sync = true;
+    dbg_default_info("{}: replayed {} records of {} bytes from {}.", __func__, num_records, offset, path);
+    return true;
+}
+
+template <typename KT, typename VT>
+std::size_t WriteBehindLog<KT,VT>::get_pending_size() const {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    return pending.size();
+}
+
+template <typename KT, typename VT>
+bool WriteBehindLog<KT,VT>::rewrite(const std::string& path, const KVIndex<KT,VT>& kv_map,
+                                    const persistent::version_t& version, const std::size_t included_pending) {
+    std::string tmp_file = path + ".tmp";
+    int tmp_fd = ::open(tmp_file.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if (tmp_fd < 0) {
+        dbg_default_error("{}: failed to open {}.", __func__, tmp_file);
+        return false;
+    }
+    // write the state in 1MB batches.
+    constexpr std::size_t batch_size = 1ull<<20;
+    std::vector<char> buf;
+    uint64_t size = 0;
+    bool saved = true;
+    for (const auto& kv: kv_map) {
+        append_record(buf,RECORD_PUT,version,kv.second);
+        if (buf.size() >= batch_size) {
+            saved = saved && write_all(tmp_fd,buf.data(),buf.size());
+            size += buf.size();
+            buf.clear();
+        }
+    }
+    saved = saved && write_all(tmp_fd,buf.data(),buf.size()) && (fdatasync(tmp_fd) == 0);
+    size += buf.size();
+    ::close(tmp_fd);
+    // open the copy before the rename, so that a failure leaves the old file in place.
+    int new_fd = saved ? ::open(tmp_file.c_str(),O_WRONLY|O_APPEND) : -1;
+    if (new_fd < 0 || std::rename(tmp_file.c_str(),path.c_str()) != 0) {
+        dbg_default_error("{}: failed to rewrite the write-behind log {}.", __func__, path);
+        if (new_fd >= 0) {
+            ::close(new_fd);
+        }
+        std::remove(tmp_file.c_str());
+        return false;
+    }
+    // the old file is gone once the rename is synced, which the next flush retries on failure.
+    const bool directory_synced = sync_parent_directory(path);
+    if (!directory_synced) {
+        dbg_default_error("{}: failed to sync the directory of {}.", __func__, path);
+    }
+    std::unique_lock<std::mutex> lck(log_mutex);
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = new_fd;
+    log_file = path;
+    file_size = size;
+    compacted_size = size;
+    needs_directory_sync = !directory_synced;
+    // only the write-behind thread drains the buffer, so the records appended since the copy are still after the
+    // included ones.
+    pending.erase(pending.begin(),pending.begin() + std::min(included_pending,pending.size()));
+    lck.unlock();
+    flushed_cv.notify_all();
+    dbg_default_info("{}: rewrote {} with {} keys, {} bytes.", __func__, path, kv_map.size(), size);
+    return true;
+}
+
+template <typename KT, typename VT>
+void WriteBehindLog<KT,VT>::append_put(const VT& value, const persistent::version_t& version) {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    append_record(pending,RECORD_PUT,version,value);
+}
+
+template <typename KT, typename VT>
+void WriteBehindLog<KT,VT>::append_remove(const KT& key, const persistent::version_t& version) {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    append_record(pending,RECORD_REMOVE,version,key);
+}
+
+template <typename KT, typename VT>
+bool WriteBehindLog<KT,VT>::is_full() const {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    return pending.size() > max_pending_bytes;
+}
+
+template <typename KT, typename VT>
+void WriteBehindLog<KT,VT>::wait_for_room() const {
+    std::unique_lock<std::mutex> lck(log_mutex);
+    // without the file, nothing drains the buffer.
+    flushed_cv.wait(lck,[this](){return pending.size() <= max_pending_bytes || fd < 0;});
+}
+
+template <typename KT, typename VT>
+bool WriteBehindLog<KT,VT>::flush() {
+    std::unique_lock<std::mutex> lck(log_mutex);
+    if (fd < 0 || (pending.empty() && !needs_directory_sync)) {
+        return true;
+    }
+    std::vector<char> buf;
+    buf.swap(pending);
+    const int _fd = fd;
+    const bool sync_directory = needs_directory_sync;
+    const std::string path = log_file;
+    lck.unlock();
+    bool flushed = write_all(_fd,buf.data(),buf.size()) && (fdatasync(_fd) == 0);
+    const bool directory_synced = !sync_directory || (flushed && sync_parent_directory(path));
+    lck.lock();
+    if (flushed) {
+        file_size += buf.size();
+        // the records are written, but not durable until the directory entry is.
+        if (directory_synced) {
+            needs_directory_sync = false;
+        } else {
+            dbg_default_error("{}: failed to sync the directory of {}.", __func__, log_file);
+            flushed = false;
+        }
+    } else {
+        // cut off what is written, and keep the records for the next flush.
+        dbg_default_error("{}: failed to flush {} bytes to {}.", __func__, buf.size(), log_file);
+        if (ftruncate(fd,file_size) != 0) {
+            dbg_default_error("{}: failed to cut off the tail of {}.", __func__, log_file);
+        }
+        buf.insert(buf.end(),pending.begin(),pending.end());
+        pending.swap(buf);
+    }
+    lck.unlock();
+    flushed_cv.notify_all();
+    return flushed;
+}
+
+template <typename KT, typename VT>
+bool WriteBehindLog<KT,VT>::needs_compaction() const {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    return (fd >= 0) && (file_size > compaction_min_bytes) && (file_size >= 2*compacted_size);
+}
+
+template <typename KT, typename VT>
+uint64_t WriteBehindLog<KT,VT>::get_flush_interval_ms() const {
+    std::lock_guard<std::mutex> lck(log_mutex);
+    return flush_interval_ms;
+}
+
+template <typename KT, typename VT>
+WriteBehindLog<KT,VT>::~WriteBehindLog() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,uint64_t> WriteBehindCascadeStore<KT,VT,IK,IV>::put(const VT& value) const {
+    debug_enter_func_with_args("value.get_key_ref={}",value.get_key_ref());
+    check_reconciled();
+    wait_for_write_behind();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_put)>(value);
+    auto& replies = results.get();
+    std::tuple<persistent::version_t,uint64_t> ret(CURRENT_VERSION,0);
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(ret),std::get<1>(ret));
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,uint64_t> WriteBehindCascadeStore<KT,VT,IK,IV>::remove(const KT& key) const {
+    debug_enter_func_with_args("key={}",key);
+    check_reconciled();
+    wait_for_write_behind();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_remove)>(key);
+    auto& replies = results.get();
+    std::tuple<persistent::version_t,uint64_t> ret(CURRENT_VERSION,0);
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(ret),std::get<1>(ret));
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> WriteBehindCascadeStore<KT,VT,IK,IV>::put_batch(const std::vector<VT>& values) const {
+    debug_enter_func_with_args("num_objects={}",values.size());
+    check_reconciled();
+    wait_for_write_behind();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_put_batch)>(values);
+    auto& replies = results.get();
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func();
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> WriteBehindCascadeStore<KT,VT,IK,IV>::remove_batch(const std::vector<KT>& keys) const {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+    check_reconciled();
+    wait_for_write_behind();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_remove_batch)>(keys);
+    auto& replies = results.get();
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func();
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+const VT WriteBehindCascadeStore<KT,VT,IK,IV>::get(const KT& key, const persistent::version_t& ver, bool) const {
+    debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned get, ver=0x{:x}", ver);
+        return *IV;
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_get)>(key);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<VT> WriteBehindCascadeStore<KT,VT,IK,IV>::multi_get(const std::vector<KT>& keys, const persistent::version_t& ver) const {
+    debug_enter_func_with_args("num_keys={},ver=0x{:x}",keys.size(),ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned multi_get, ver=0x{:x}", ver);
+        return std::vector<VT>(keys.size(),*IV);
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_multi_get)>(keys);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+const VT WriteBehindCascadeStore<KT,VT,IK,IV>::get_by_time(const KT& key, const uint64_t& ts_us) const {
+    // WriteBehindCascadeStore does not support this.
+    debug_enter_func();
+    debug_leave_func();
+
+    return *IV;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<KT> WriteBehindCascadeStore<KT,VT,IK,IV>::list_keys(const persistent::version_t& ver) const {
+    debug_enter_func_with_args("ver=0x{:x}",ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned list_keys, ver=0x{:x}", ver);
+        return {};
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_list_keys)>();
+    auto& replies = results.get();
+    std::vector<KT> ret;
+    for (auto& reply_pair : replies) {
+        ret = reply_pair.second.get();
+    }
+    debug_leave_func();
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<KT> WriteBehindCascadeStore<KT,VT,IK,IV>::list_keys_by_time(const uint64_t& ts_us) const {
+    // WriteBehindCascadeStore does not support this.
+    debug_enter_func_with_args("ts_us=0x{:x}", ts_us);
+    debug_leave_func();
+    return {};
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+persistent::version_t WriteBehindCascadeStore<KT,VT,IK,IV>::version_at_time(const uint64_t& ts_us) const {
+    // WriteBehindCascadeStore does not support this.
+    debug_enter_func_with_args("ts_us=0x{:x}", ts_us);
+    debug_leave_func();
+    return persistent::INVALID_VERSION;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::scan(const std::string& prefix, const KT& start_after,
+                                                           const uint32_t& limit, bool with_values,
+                                                           const persistent::version_t& ver) const {
+    debug_enter_func_with_args("prefix={},start_after={},limit={},with_values={},ver=0x{:x}",
+                               prefix,start_after,limit,with_values,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned scan, ver=0x{:x}", ver);
+        return {};
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_scan)>(prefix,start_after,limit,with_values);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+QueryPage<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::query(const ShardQuery<KT>& query, const KT& start_after,
+                                                             const uint32_t& limit, const persistent::version_t& ver) const {
+    debug_enter_func_with_args("start_after={},limit={},ver=0x{:x}",start_after,limit,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned query, ver=0x{:x}", ver);
+        return {};
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_query)>(query,start_after,limit);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                                      const uint32_t& limit, bool with_values,
+                                                                      const persistent::version_t& ver) const {
+    debug_enter_func_with_args("secondary_key={},start_after={},limit={},with_values={},ver=0x{:x}",
+                               secondary_key,start_after,limit,with_values,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned lookup, ver=0x{:x}", ver);
+        return {};
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_lookup_by_index)>(secondary_key,start_after,
+                                                                                            limit,with_values);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+uint64_t WriteBehindCascadeStore<KT,VT,IK,IV>::get_size(const KT& key, const persistent::version_t& ver, bool) const {
+    debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned get, ver=0x{:x}", ver);
+        return 0;
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_get_size)>(key);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+uint64_t WriteBehindCascadeStore<KT,VT,IK,IV>::get_size_by_time(const KT& key, const uint64_t& ts_us) const {
+    // WriteBehindCascadeStore does not support this.
+    debug_enter_func();
+
+    debug_leave_func();
+    return 0;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ObjectMetadata WriteBehindCascadeStore<KT,VT,IK,IV>::head(const KT& key, const persistent::version_t& ver, bool) const {
+    debug_enter_func_with_args("key={},ver=0x{:x}",key,ver);
+    if (ver != CURRENT_VERSION) {
+        debug_leave_func_with_value("Cannot support versioned head, ver=0x{:x}", ver);
+        return get_null_object_metadata();
+    }
+    check_reconciled();
+    derecho::Replicated<WriteBehindCascadeStore>& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    auto results = subgroup_handle.template ordered_send<RPC_NAME(ordered_head)>(key);
+    auto& replies = results.get();
+    debug_leave_func();
+    return replies.begin()->second.get();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+const VT WriteBehindCascadeStore<KT,VT,IK,IV>::get_local(const KT& key, const ReadConsistency& consistency,
+                                                         const persistent::version_t& read_point,
+                                                         const uint64_t& max_staleness_us) const {
+    debug_enter_func_with_args("key={},consistency={},read_point=0x{:x},max_staleness_us={}",
+                               key,static_cast<uint32_t>(consistency),read_point,max_staleness_us);
+    check_reconciled();
+    if (!frontier.can_serve(consistency,read_point,max_staleness_us)) {
+        debug_leave_func_with_value("local state does not satisfy consistency level {}, fall back to ordered get.",
+                                    static_cast<uint32_t>(consistency));
+        return get(key,CURRENT_VERSION);
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func_with_value("key={}",key);
+        return it->second;
+    }
+    debug_leave_func();
+    return *IV;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+uint64_t WriteBehindCascadeStore<KT,VT,IK,IV>::get_size_local(const KT& key, const ReadConsistency& consistency,
+                                                              const persistent::version_t& read_point,
+                                                              const uint64_t& max_staleness_us) const {
+    debug_enter_func_with_args("key={},consistency={},read_point=0x{:x},max_staleness_us={}",
+                               key,static_cast<uint32_t>(consistency),read_point,max_staleness_us);
+    check_reconciled();
+    if (!frontier.can_serve(consistency,read_point,max_staleness_us)) {
+        debug_leave_func_with_value("local state does not satisfy consistency level {}, fall back to ordered get_size.",
+                                    static_cast<uint32_t>(consistency));
+        return get_size(key,CURRENT_VERSION);
+    }
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func_with_value("key={}",key);
+        return get_raw_size(it->second);
+    }
+    debug_leave_func();
+    return 0;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+bool WriteBehindCascadeStore<KT,VT,IK,IV>::apply_ordered_put(const VT& value,
+        const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
+    if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
+        value.set_version(std::get<0>(version_and_timestamp));
+    }
+    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+        value.set_timestamp(std::get<1>(version_and_timestamp));
+    }
+    if (!scan_config_loaded) {
+        auto subgroup_id = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_subgroup_id();
+        ordered_scans = load_ordered_scans(subgroup_id);
+        scan_config_loaded = true;
+    }
+    // the write-behind thread might be rewriting the file with kv_map.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (ordered_scans) {
+        // a transferred state starts without the side index.
+        keep_key_order(this->kv_map);
+    }
+    // Verify previous version MUST happen before update previous versions.
+    if constexpr (std::is_base_of<IVerifyPreviousVersion,VT>::value) {
+        bool verify_result;
+        if (this->kv_map.find(value.get_key_ref())!=this->kv_map.end()) {
+            verify_result = value.verify_previous_version(this->update_version,this->kv_map.at(value.get_key_ref()).get_version());
+        } else {
+            verify_result = value.verify_previous_version(this->update_version,persistent::INVALID_VERSION);
+        }
+        if (!verify_result) {
+            return false;
+        }
+    }
+    if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
+        if (this->kv_map.find(value.get_key_ref())!=this->kv_map.end()) {
+            value.set_previous_version(this->update_version,this->kv_map.at(value.get_key_ref()).get_version());
+        } else {
+            value.set_previous_version(this->update_version,persistent::INVALID_VERSION);
+        }
+    }
+    this->kv_map.erase(value.get_key_ref()); // remove
+    // copy constructor: the blob is copied out of the message buffer once, its later copies share the stored bytes.
+    auto stored = this->kv_map.emplace(value.get_key_ref(), value).first;
+    // the observer gets the stored object, whose copies do not copy the blob again.
+    std::optional<VT> observed_value;
+    if (cascade_watcher_ptr) {
+        observed_value.emplace(stored->second);
+    }
+    this->update_version = std::get<0>(version_and_timestamp);
+    secondary_index.on_update(value.get_key_ref(),value);
+    // appended under kv_map_mutex, so that a rewrite of the file sees either both or neither.
+    write_behind_log.append_put(value,std::get<0>(version_and_timestamp));
+    wlck.unlock();
+
+    if (cascade_watcher_ptr) {
+        (*cascade_watcher_ptr)(
+            this->subgroup_index,
+            group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_shard_num(),
+            value.get_key_ref(), *observed_value, cascade_context_ptr);
+    }
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+bool WriteBehindCascadeStore<KT,VT,IK,IV>::apply_ordered_remove(const KT& key,
+        const std::tuple<persistent::version_t,uint64_t>& version_and_timestamp) {
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (this->kv_map.find(key)==this->kv_map.end()) {
+        return false;
+    }
+
+    auto value = create_null_object_cb<KT,VT,IK,IV>(key);
+
+    if constexpr (std::is_base_of<IKeepVersion,VT>::value) {
+        value.set_version(std::get<0>(version_and_timestamp));
+    }
+    if constexpr (std::is_base_of<IKeepTimestamp,VT>::value) {
+        value.set_timestamp(std::get<1>(version_and_timestamp));
+    }
+    if constexpr (std::is_base_of<IKeepPreviousVersion,VT>::value) {
+        value.set_previous_version(this->update_version,this->kv_map.at(key).get_version());
+    }
+    this->kv_map.erase(key);
+    this->update_version = std::get<0>(version_and_timestamp);
+    secondary_index.on_erase(key);
+    write_behind_log.append_remove(key,std::get<0>(version_and_timestamp));
+    wlck.unlock();
+
+    if (cascade_watcher_ptr) {
+        (*cascade_watcher_ptr)(
+            this->subgroup_index,
+            group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_shard_num(),
+            key, value,cascade_context_ptr);
+    }
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::build_secondary_index() {
+    if (secondary_index_extractor_ptr == nullptr || secondary_index.is_built()) {
+        return;
+    }
+    auto extractor_ptr = secondary_index_extractor_ptr;
+    const uint32_t subgroup_index = this->subgroup_index;
+    const uint32_t shard_num = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_shard_num();
+    secondary_index.build([extractor_ptr,subgroup_index,shard_num](const KT& key, const VT& value){
+                              return (*extractor_ptr)(subgroup_index,shard_num,key,value);
+                          },this->kv_map);
+    dbg_default_debug("{} indexed {} keys.", __func__, this->kv_map.size());
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::wake_write_behind() const {
+    // the write-behind thread holds write_behind_mutex while it writes, so the delivery does not lock it. A wakeup
+    // lost this way delays the flush to the end of the interval.
+    if (write_behind_log.is_full()) {
+        write_behind_cv.notify_all();
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::wait_for_write_behind() const {
+    if (!write_behind_log.is_full()) {
+        return;
+    }
+    {
+        // the write-behind thread tests is_full() with write_behind_mutex locked.
+        std::lock_guard<std::mutex> lck(write_behind_mutex);
+    }
+    write_behind_cv.notify_all();
+    write_behind_log.wait_for_room();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::check_reconciled() const {
+    if (reconciling) {
+        throw derecho::derecho_exception("The shard is reconciling its recovered state, retry later.");
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,bool> WriteBehindCascadeStore<KT,VT,IK,IV>::get_reconcile_status() const {
+    debug_enter_func();
+    debug_leave_func_with_value("recovered_version=0x{:x},state_reconciled={}",
+                                recovered_version,static_cast<bool>(state_reconciled));
+    return {recovered_version,!state_reconciled};
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+StateChunk<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::get_recovered_chunk(const KT& start_after,
+                                                                            const uint64_t& max_bytes) {
+    debug_enter_func_with_args("start_after={},max_bytes={}",start_after,max_bytes);
+    {
+        // the chunks page through the whole kv_map.
+        std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+        keep_key_order(this->kv_map);
+    }
+    // the ordered handlers update kv_map and update_version with kv_map_mutex locked exclusively.
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    if (!reconciling || this->update_version != recovered_version) {
+        debug_leave_func_with_value("{}","not ready");
+        return StateChunk<KT,VT>();
+    }
+    StateChunk<KT,VT> chunk(true,this->update_version,
+                            scan_kv_map<KT,VT,IK>(this->kv_map,"",start_after,0,true,max_bytes));
+    rlck.unlock();
+    debug_leave_func_with_value("{} keys, version=0x{:x}, has_more={}",
+                                chunk.page.keys.size(),chunk.version,chunk.page.has_more);
+    return chunk;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+bool WriteBehindCascadeStore<KT,VT,IK,IV>::reconcile_recovered_state() {
+    auto& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    const node_id_t my_id = group->get_my_id();
+    const std::vector<node_id_t> members =
+        group->template get_subgroup_members<WriteBehindCascadeStore>(this->subgroup_index)
+        .at(subgroup_handle.get_shard_num());
+    const uint32_t max_retries = get_wbcs_reconcile_max_retries();
+    uint32_t num_failures = 0;
+    auto back_off = [this,&num_failures](){
+        num_failures ++;
+        std::unique_lock<std::mutex> lck(write_behind_mutex);
+        write_behind_cv.wait_for(lck,std::chrono::milliseconds(100),[this](){return !write_behind_thread_alive;});
+    };
+    // 1 - elect the member that recovered the highest version, the one with the lowest node id among equals.
+    std::map<node_id_t,persistent::version_t> recovered_versions;
+    while (write_behind_thread_alive && num_failures <= max_retries &&
+           recovered_versions.size() < members.size()) {
+        try {
+            for (const auto& node_id: members) {
+                if (node_id == my_id) {
+                    recovered_versions[node_id] = recovered_version;
+                } else if (recovered_versions.find(node_id) == recovered_versions.end()) {
+                    auto results = subgroup_handle.template p2p_send<RPC_NAME(get_reconcile_status)>(node_id);
+                    recovered_versions[node_id] = std::get<0>(results.get().begin()->second.get());
+                }
+            }
+        } catch (const std::exception& ex) {
+            dbg_default_warn("{}: failed to get the recovered versions: {}", __func__, ex.what());
+            back_off();
+        }
+    }
+    if (recovered_versions.size() < members.size()) {
+        if (write_behind_thread_alive) {
+            dbg_default_error("{}: gave up the election after {} failures in a row, going on with the recovered "
+                              "state of version 0x{:x}.", __func__, num_failures, recovered_version);
+        }
+        return false;
+    }
+    node_id_t leader = recovered_versions.begin()->first;
+    persistent::version_t leader_version = recovered_versions.begin()->second;
+    for (const auto& kv: recovered_versions) {
+        if (kv.second > leader_version) {
+            leader = kv.first;
+            leader_version = kv.second;
+        }
+    }
+    num_failures = 0;
+    if (leader == my_id || leader_version == recovered_version) {
+        // the leader, or the same updates recovered, so the same state. The members behind pull it until the shard
+        // has reconciled, and until this member delivers an update.
+        return false;
+    }
+    // 2 - pull the recovered state of the leader.
+    uint64_t chunk_bytes = get_vcs_state_transfer_chunk_bytes();
+    if (chunk_bytes == 0) {
+        chunk_bytes = get_scan_max_page_bytes();
+    }
+    uint64_t start_us = get_time()/1000;
+    KVIndex<KT,VT> state;
+    KT cursor = *IK;
+    bool done = false;
+    std::size_t num_chunks = 0;
+    while (write_behind_thread_alive && num_failures <= max_retries && !done) {
+        try {
+            auto results = subgroup_handle.template p2p_send<RPC_NAME(get_recovered_chunk)>(leader,cursor,chunk_bytes);
+            StateChunk<KT,VT> chunk = results.get().begin()->second.get();
+            if (!chunk.ready || chunk.version != leader_version) {
+                // the leader has gone on, so its state is not the recovered one any more.
+                dbg_default_warn("{}: node {} does not serve the recovered state of version 0x{:x}.",
+                                 __func__, leader, leader_version);
+                back_off();
+                continue;
+            }
+            for (std::size_t i = 0; i < chunk.page.keys.size(); i++) {
+                state.emplace(chunk.page.keys[i],std::move(chunk.page.values[i]));
+            }
+            if (!chunk.page.keys.empty()) {
+                cursor = chunk.page.keys.back();
+            }
+            done = !chunk.page.has_more;
+            num_chunks ++;
+            num_failures = 0;
+        } catch (const std::exception& ex) {
+            dbg_default_warn("{}: failed to pull from node {}: {}", __func__, leader, ex.what());
+            back_off();
+        }
+    }
+    if (!done) {
+        if (write_behind_thread_alive) {
+            dbg_default_error("{}: gave up pulling the recovered state of version 0x{:x} from node {} after {} "
+                              "failures in a row, going on with the recovered state of version 0x{:x}.",
+                              __func__, leader_version, leader, num_failures, recovered_version);
+        }
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    if (this->update_version != recovered_version) {
+        // an update sent by a member of the shard itself is delivered and written behind already.
+        dbg_default_error("{}: delivered version 0x{:x} while pulling the recovered state of version 0x{:x} from "
+                          "node {}, going on with the recovered state of version 0x{:x}.", __func__,
+                          this->update_version, leader_version, leader, recovered_version);
+        return false;
+    }
+    if (secondary_index.is_built()) {
+        for (const auto& kv: this->kv_map) {
+            secondary_index.on_erase(kv.first);
+        }
+        for (const auto& kv: state) {
+            secondary_index.on_update(kv.first,kv.second);
+        }
+    }
+    this->kv_map = std::move(state);
+    this->update_version = leader_version;
+    const std::size_t kv_map_size = this->kv_map.size();
+    wlck.unlock();
+    dbg_default_info("{}: pulled {} keys of version 0x{:x} from node {} in {} chunks in {} us, replacing the recovered "
+                     "state of version 0x{:x}.", __func__, kv_map_size, leader_version, leader, num_chunks,
+                     get_time()/1000 - start_us, recovered_version);
+    return true;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::wait_for_shard_reconciliation() {
+    auto& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    const node_id_t my_id = group->get_my_id();
+    std::set<node_id_t> pending_members;
+    for (const auto& node_id: group->template get_subgroup_members<WriteBehindCascadeStore>(this->subgroup_index)
+                              .at(subgroup_handle.get_shard_num())) {
+        if (node_id != my_id) {
+            pending_members.emplace(node_id);
+        }
+    }
+    // the leader keeps serving its recovered state until then.
+    const uint32_t max_retries = get_wbcs_reconcile_max_retries();
+    uint32_t num_failures = 0;
+    while (write_behind_thread_alive && num_failures <= max_retries && !pending_members.empty()) {
+        try {
+            for (auto it = pending_members.begin(); it != pending_members.end();) {
+                auto results = subgroup_handle.template p2p_send<RPC_NAME(get_reconcile_status)>(*it);
+                if (std::get<1>(results.get().begin()->second.get())) {
+                    it ++;
+                } else {
+                    it = pending_members.erase(it);
+                }
+            }
+            num_failures = 0;
+        } catch (const std::exception& ex) {
+            dbg_default_warn("{}: failed to poll the members reconciling: {}", __func__, ex.what());
+            num_failures ++;
+        }
+        if (!pending_members.empty()) {
+            std::unique_lock<std::mutex> lck(write_behind_mutex);
+            write_behind_cv.wait_for(lck,std::chrono::milliseconds(100),[this](){return !write_behind_thread_alive;});
+        }
+    }
+    if (!pending_members.empty() && write_behind_thread_alive) {
+        dbg_default_error("{}: gave up waiting for {} members reconciling after {} failures in a row.",
+                          __func__, pending_members.size(), num_failures);
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,uint64_t> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_put(const VT& value) {
+    debug_enter_func_with_args("key={}",value.get_key_ref());
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version();
+
+    bool accepted = apply_ordered_put(value,version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    wake_write_behind();
+    if (!accepted) {
+        // reject the update by returning an invalid version and timestamp
+        debug_leave_func_with_value("rejected version=0x{:x}",std::get<0>(version_and_timestamp));
+        return {persistent::INVALID_VERSION,0};
+    }
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return version_and_timestamp;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::tuple<persistent::version_t,uint64_t> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_remove(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version();
+
+    apply_ordered_remove(key,version_and_timestamp);
+    frontier.advance(std::get<0>(version_and_timestamp));
+    wake_write_behind();
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return version_and_timestamp;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_put_batch(const std::vector<VT>& values) {
+    debug_enter_func_with_args("num_objects={}",values.size());
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version();
+
+    std::vector<std::tuple<persistent::version_t,uint64_t>> ret;
+    ret.reserve(values.size());
+    // a key is put once per batch: a repeated put would share the version of the first one and chain to it as its
+    // own previous version by key.
+    std::set<KT> batch_keys;
+    for (const auto& value: values) {
+        if (batch_keys.insert(value.get_key_ref()).second && apply_ordered_put(value,version_and_timestamp)) {
+            ret.emplace_back(version_and_timestamp);
+        } else {
+            ret.emplace_back(persistent::INVALID_VERSION,0);
+        }
+    }
+    frontier.advance(std::get<0>(version_and_timestamp));
+    wake_write_behind();
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return ret;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<std::tuple<persistent::version_t,uint64_t>> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_remove_batch(const std::vector<KT>& keys) {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+
+    std::tuple<persistent::version_t,uint64_t> version_and_timestamp = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version();
+
+    for (const auto& key: keys) {
+        apply_ordered_remove(key,version_and_timestamp);
+    }
+    frontier.advance(std::get<0>(version_and_timestamp));
+    wake_write_behind();
+
+    debug_leave_func_with_value("version=0x{:x},timestamp={}",std::get<0>(version_and_timestamp), std::get<1>(version_and_timestamp));
+
+    return std::vector<std::tuple<persistent::version_t,uint64_t>>(keys.size(),version_and_timestamp);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+const VT WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_get(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func_with_value("key={}",key);
+        return it->second;
+    }
+    debug_leave_func();
+    return *IV;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<VT> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_multi_get(const std::vector<KT>& keys) {
+    debug_enter_func_with_args("num_keys={}",keys.size());
+
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    std::vector<VT> values;
+    values.reserve(keys.size());
+    for (const auto& key: keys) {
+        auto it = this->kv_map.find(key);
+        if (it != this->kv_map.end()) {
+            values.emplace_back(it->second);
+        } else {
+            values.emplace_back(*IV);
+        }
+    }
+    debug_leave_func();
+    return values;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::vector<KT> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_list_keys() {
+    std::vector<KT> key_list;
+    debug_enter_func();
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    key_list.reserve(this->kv_map.size());
+    for(const auto& kv: this->kv_map) {
+        key_list.push_back(kv.first);
+    }
+    debug_leave_func();
+    return key_list;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_scan(const std::string& prefix, const KT& start_after,
+                                                                   const uint32_t& limit, bool with_values) {
+    debug_enter_func_with_args("prefix={},start_after={},limit={},with_values={}",prefix,start_after,limit,with_values);
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto page = scan_kv_map<KT,VT,IK>(this->kv_map,prefix,start_after,limit,with_values,get_scan_max_page_bytes());
+    debug_leave_func_with_value("{} keys, has_more={}",page.keys.size(),page.has_more);
+    return page;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+QueryPage<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_query(const ShardQuery<KT>& query, const KT& start_after,
+                                                                     const uint32_t& limit) {
+    debug_enter_func_with_args("start_after={},limit={}",start_after,limit);
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto page = query_kv_map<KT,VT,IK>(this->kv_map,query,start_after,limit,get_scan_max_page_bytes());
+    debug_leave_func_with_value("{} keys, {} matches, has_more={}",page.keys.size(),page.num_matches,page.has_more);
+    return page;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ScanPage<KT,VT> WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_lookup_by_index(const std::string& secondary_key, const KT& start_after,
+                                                                              const uint32_t& limit, bool with_values) {
+    debug_enter_func_with_args("secondary_key={},start_after={},limit={},with_values={}",
+                               secondary_key,start_after,limit,with_values);
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    // the first lookup builds the index.
+    std::unique_lock<std::shared_mutex> wlck(kv_map_mutex);
+    build_secondary_index();
+    auto page = secondary_index.lookup(this->kv_map,secondary_key,start_after,limit,with_values,
+                                       get_scan_max_page_bytes());
+    wlck.unlock();
+    debug_leave_func_with_value("{} keys, has_more={}",page.keys.size(),page.has_more);
+    return page;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+uint64_t WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_get_size(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func();
+        return get_raw_size(it->second);
+    }
+    debug_leave_func();
+    return 0;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+ObjectMetadata WriteBehindCascadeStore<KT,VT,IK,IV>::ordered_head(const KT& key) {
+    debug_enter_func_with_args("key={}",key);
+
+    frontier.advance(std::get<0>(group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index).get_next_version()));
+    std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+    auto it = this->kv_map.find(key);
+    if (it != this->kv_map.end()) {
+        debug_leave_func();
+        return get_object_metadata<KT,VT>(it->second);
+    }
+    debug_leave_func();
+    return get_null_object_metadata();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::write_behind_loop() {
+    std::unique_lock<std::mutex> lck(write_behind_mutex);
+    // wait for the group, which is set after the constructor.
+    while (write_behind_thread_alive && group == nullptr) {
+        write_behind_cv.wait_for(lck,std::chrono::seconds(1),[this](){return !write_behind_thread_alive;});
+    }
+    if (!write_behind_thread_alive) {
+        return;
+    }
+    auto& subgroup_handle = group->template get_subgroup<WriteBehindCascadeStore>(this->subgroup_index);
+    write_behind_log.load_subgroup_override(subgroup_handle.get_subgroup_id());
+    if (log_file.empty()) {
+        log_file = persistent::getPersFilePath() + "/" +
+                   persistent::PersistentRegistry::generate_prefix(std::type_index(typeid(WriteBehindCascadeStore)),
+                                                                   this->subgroup_index,
+                                                                   subgroup_handle.get_shard_num()) + ".wbl";
+    }
+    // a state pulled from another replica replaces the file first.
+    bool replaced = false;
+    if (reconciling) {
+        lck.unlock();
+        try {
+            replaced = reconcile_recovered_state();
+        } catch (const std::exception& ex) {
+            dbg_default_error("{}: failed to reconcile the recovered state: {}", __func__, ex.what());
+        }
+        state_reconciled = true;
+        try {
+            wait_for_shard_reconciliation();
+        } catch (const std::exception& ex) {
+            dbg_default_error("{}: failed to wait for the shard to reconcile: {}", __func__, ex.what());
+        }
+        lck.lock();
+        reconciling = false;
+    }
+    bool written = true;
+    while (write_behind_thread_alive) {
+        // after a failure, wait for the interval even if the pending buffer is full.
+        write_behind_cv.wait_for(lck,std::chrono::milliseconds(write_behind_log.get_flush_interval_ms()),
+                                 [this,&written,&replaced](){
+                                     return !write_behind_thread_alive ||
+                                            (written && (replaced || write_behind_log.is_full()));
+                                 });
+        if (!write_behind_thread_alive) {
+            break;
+        }
+        written = false;
+        try {
+            if (replaced || !write_behind_log.is_open() || write_behind_log.needs_compaction()) {
+                // a transferred state, or a grown file: a copy of the current state replaces the file and the
+                // pending updates it includes. The copies of the values share their bytes, and the copy is written
+                // without holding kv_map_mutex.
+                mkdir(persistent::getPersFilePath().c_str(),0755);
+                std::shared_lock<std::shared_mutex> rlck(kv_map_mutex);
+                const KVIndex<KT,VT> state(this->kv_map);
+                const persistent::version_t state_version = this->update_version;
+                const std::size_t included_pending = write_behind_log.get_pending_size();
+                rlck.unlock();
+                written = write_behind_log.rewrite(log_file,state,state_version,included_pending);
+                replaced = replaced && !written;
+            } else {
+                written = write_behind_log.flush();
+            }
+        } catch (const std::exception& ex) {
+            dbg_default_warn("{}: failed to write behind: {}", __func__, ex.what());
+        } catch (...) {
+            dbg_default_warn("{}: failed to write behind with unknown exception.", __func__);
+        }
+    }
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::unique_ptr<WriteBehindCascadeStore<KT,VT,IK,IV>> WriteBehindCascadeStore<KT,VT,IK,IV>::from_bytes(
+    mutils::DeserializationManager* dsm,
+    char const* buf) {
+    auto update_version_ptr = mutils::from_bytes<persistent::version_t>(dsm,buf);
+    auto kv_map_ptr = mutils::from_bytes<KVIndex<KT,VT>>(dsm,buf+mutils::bytes_size(*update_version_ptr));
+    auto write_behind_cascade_store_ptr =
+        std::make_unique<WriteBehindCascadeStore>(std::move(*kv_map_ptr),
+                                                  *update_version_ptr,
+                                                  dsm->registered<CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>>()?&(dsm->mgr<CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>>()):nullptr,
+                                                  dsm->registered<ICascadeContext>()?&(dsm->mgr<ICascadeContext>()):nullptr,
+                                                  dsm->registered<SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>>()?&(dsm->mgr<SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>>()):nullptr);
+    return write_behind_cascade_store_ptr;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+void WriteBehindCascadeStore<KT,VT,IK,IV>::post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+    mutils::post_object(f,update_version);
+    mutils::post_object(f,kv_map);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::size_t WriteBehindCascadeStore<KT,VT,IK,IV>::bytes_size() const {
+    return mutils::bytes_size(update_version) + mutils::bytes_size(kv_map);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+std::size_t WriteBehindCascadeStore<KT,VT,IK,IV>::to_bytes(char* buf) const {
+    std::size_t offset = 0;
+    post_object([buf,&offset](char const* const bytes, std::size_t size){
+        memcpy(buf + offset,bytes,size);
+        offset += size;
+    });
+    return offset;
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+WriteBehindCascadeStore<KT,VT,IK,IV>::WriteBehindCascadeStore(
+    persistent::PersistentRegistry* pr,
+    CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>* cw,
+    ICascadeContext* cc,
+    SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>* sie):
+    update_version(persistent::INVALID_VERSION),
+    cascade_watcher_ptr(cw),
+    cascade_context_ptr(cc),
+    secondary_index_extractor_ptr(sie),
+    scan_config_loaded(false),
+    ordered_scans(false),
+    log_file(persistent::getPersFilePath() + "/" + pr->get_subgroup_prefix() + ".wbl"),
+    write_behind_thread_alive(true),
+    recovered_version(persistent::INVALID_VERSION),
+    state_reconciled(false),
+    reconciling(true) {
+    debug_enter_func();
+    // the store has no persistent field, so the directory might not exist yet.
+    mkdir(persistent::getPersFilePath().c_str(),0755);
+    write_behind_log.open(log_file,
+        [this](VT&& value, const persistent::version_t& version){
+            this->kv_map.erase(value.get_key_ref());
+            this->kv_map.emplace(value.get_key_ref(),std::move(value));
+            this->update_version = std::max(this->update_version,version);
+        },
+        [this](const KT& key, const persistent::version_t& version){
+            this->kv_map.erase(key);
+            this->update_version = std::max(this->update_version,version);
+        });
+    recovered_version = update_version;
+    write_behind_thread = std::thread(&WriteBehindCascadeStore::write_behind_loop,this);
+    debug_leave_func_with_value("recovered {} keys from {}",kv_map.size(),log_file);
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+WriteBehindCascadeStore<KT,VT,IK,IV>::WriteBehindCascadeStore(
+    KVIndex<KT,VT>&& _kvm,
+    persistent::version_t _uv,
+    CriticalDataPathObserver<WriteBehindCascadeStore<KT,VT,IK,IV>>* cw,
+    ICascadeContext* cc,
+    SecondaryIndexExtractor<WriteBehindCascadeStore<KT,VT,IK,IV>>* sie):
+    kv_map(std::move(_kvm)),
+    update_version(_uv),
+    cascade_watcher_ptr(cw),
+    cascade_context_ptr(cc),
+    secondary_index_extractor_ptr(sie),
+    scan_config_loaded(false),
+    ordered_scans(false),
+    write_behind_thread_alive(true),
+    recovered_version(persistent::INVALID_VERSION),
+    state_reconciled(true),
+    reconciling(false) {
+    debug_enter_func_with_args("move to kv_map, size={}",kv_map.size());
+    // log_file is named, and rewritten with the transferred state, by the write-behind thread once the subgroup is
+    // known.
+    write_behind_thread = std::thread(&WriteBehindCascadeStore::write_behind_loop,this);
+    debug_leave_func();
+}
+
+template<typename KT, typename VT, KT* IK, VT* IV>
+WriteBehindCascadeStore<KT,VT,IK,IV>::~WriteBehindCascadeStore() {
+    std::unique_lock<std::mutex> lck(write_behind_mutex);
+    write_behind_thread_alive = false;
+    lck.unlock();
+    write_behind_cv.notify_all();
+    if (write_behind_thread.joinable()) {
+        write_behind_thread.join();
+    }
+    // a clean shutdown loses no update.
+    write_behind_log.flush();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 15 - Secondary Index Implementation
+///////////////////////////////////////////////////////////////////////////////
+template <typename KT, typename VT, KT* IK>
+bool SecondaryIndex<KT,VT,IK>::is_built() const {
+    return static_cast<bool>(extract);
+}
+
+template <typename KT, typename VT, KT* IK>
+template <typename MapType>
+void SecondaryIndex<KT,VT,IK>::build(const ExtractFunc& _extract, const MapType& kv_map) {
+    extract = _extract;
+    index.clear();
+    secondary_keys.clear();
+    for (const auto& kv: kv_map) {
+        on_update(kv.first,kv.second);
+    }
+}
+
+template <typename KT, typename VT, KT* IK>
+void SecondaryIndex<KT,VT,IK>::on_update(const KT& key, const VT& value) {
+    if (!extract) {
+        return;
+    }
+    on_erase(key);
+    auto keys = extract(key,value);
+    if (keys.empty()) {
+        return;
+    }
+    std::sort(keys.begin(),keys.end());
+    keys.erase(std::unique(keys.begin(),keys.end()),keys.end());
+    for (const auto& secondary_key: keys) {
+        index[secondary_key].insert(key);
+    }
+    secondary_keys.emplace(key,std::move(keys));
+}
+
+template <typename KT, typename VT, KT* IK>
+void SecondaryIndex<KT,VT,IK>::on_erase(const KT& key) {
+    auto it = secondary_keys.find(key);
+    if (it == secondary_keys.end()) {
+        return;
+    }
+    for (const auto& secondary_key: it->second) {
+        auto index_it = index.find(secondary_key);
+        if (index_it != index.end()) {
+            index_it->second.erase(key);
+            if (index_it->second.empty()) {
+                index.erase(index_it);
+            }
+        }
+    }
+    secondary_keys.erase(it);
+}
+
+template <typename KT, typename VT, KT* IK>
+template <typename MapType>
+ScanPage<KT,VT> SecondaryIndex<KT,VT,IK>::lookup(const MapType& kv_map, const std::string& secondary_key,
+                                                 const KT& start_after, const uint32_t& limit, bool with_values,
+                                                 const uint64_t& max_bytes) const {
+    ScanPage<KT,VT> page;
+    auto index_it = index.find(secondary_key);
+    if (index_it == index.end()) {
+        return page;
+    }
+    const auto& primary_keys = index_it->second;
+    auto it = (start_after == *IK) ? primary_keys.begin() : primary_keys.upper_bound(start_after);
+    uint64_t page_bytes = 0;
+    // limit == 0 leaves the page bounded by max_bytes only, like scan_kv_map().
+    const std::size_t max_keys = (limit == 0) ? std::numeric_limits<std::size_t>::max() : limit;
+    for (; it != primary_keys.end(); it++) {
+        if (page.keys.size() >= max_keys || (!page.keys.empty() && page_bytes >= max_bytes)) {
+            page.has_more = true;
+            break;
+        }
+        page.keys.emplace_back(*it);
+        page_bytes += mutils::bytes_size(*it);
+        if (with_values) {
+            // the index follows kv_map, so the key is always there.
+            const auto& value = kv_map.find(*it)->second;
+            page.values.emplace_back(value);
+            page_bytes += get_raw_size(value);
+        }
+    }
+    return page;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 16 - Time Version Index Implementation
+///////////////////////////////////////////////////////////////////////////////
+inline TimeVersionIndex::TimeVersionIndex(): complete(true) {}
+
+inline void TimeVersionIndex::clear(const bool _complete) {
+    samples.clear();
+    complete = _complete;
+}
+
+inline void TimeVersionIndex::append(const persistent::version_t& version, const uint64_t& timestamp_us) {
+    if (!samples.empty() && version <= samples.back().version) {
+        return;
+    }
+    samples.push_back({timestamp_us,version});
+}
+
+inline void TimeVersionIndex::trim(const persistent::version_t& version) {
+    auto it = std::upper_bound(samples.begin(),samples.end(),version,
+                               [](const persistent::version_t& v, const Sample& sample){
+                                   return v < sample.version;
+                               });
+    if (it == samples.begin()) {
+        return;
+    }
+    samples.erase(samples.begin(),std::prev(it));
+}
+
+inline bool TimeVersionIndex::covers(const uint64_t& ts_us) const {
+    return complete || (!samples.empty() && ts_us >= samples.front().timestamp_us);
+}
+
+inline persistent::version_t TimeVersionIndex::find(const uint64_t& ts_us) const {
+    auto it = std::upper_bound(samples.begin(),samples.end(),ts_us,
+                               [](const uint64_t& ts, const Sample& sample){
+                                   return ts < sample.timestamp_us;
+                               });
+    if (it == samples.begin()) {
+        return persistent::INVALID_VERSION;
+    }
+    return std::prev(it)->version;
+}
+
+inline std::size_t TimeVersionIndex::size() const {
+    return samples.size();
+}
 
 }//namespace cascade
 }//namespace derecho
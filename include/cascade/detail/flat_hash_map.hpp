@@ -0,0 +1,703 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <derecho/mutils-serialization/SerializationSupport.hpp>
+
+namespace derecho {
+namespace cascade {
+
+namespace flat_hash_detail {
+    /**
+     * The control bytes. A full slot stores the lower 7 bits of the hash (h2), so it is non-negative. An empty slot or a
+     * deleted slot (tombstone) is negative.
+     */
+    using ctrl_t = int8_t;
+    constexpr ctrl_t CTRL_EMPTY = static_cast<ctrl_t>(-128);
+    constexpr ctrl_t CTRL_DELETED = static_cast<ctrl_t>(-2);
+    /* the number of slots probed together */
+    constexpr std::size_t GROUP_WIDTH = 16;
+    /* maximum load factor is MAX_LOAD_NUMERATOR/MAX_LOAD_DENOMINATOR, tombstones included */
+    constexpr std::size_t MAX_LOAD_NUMERATOR = 7;
+    constexpr std::size_t MAX_LOAD_DENOMINATOR = 8;
+
+    /**
+     * Finalizer of MurmurHash3. Object keys are often sequential, which makes std::hash<uint64_t>, the identity function
+     * in libstdc++, a poor hash for open addressing.
+     */
+    inline uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdLLU;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53LLU;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * Group is a window of GROUP_WIDTH control bytes. The match functions return a bitmask with bit i set if the i-th
+     * control byte matches. With SSE2, a group is matched with a single compare.
+     */
+    class Group {
+#if defined(__SSE2__)
+        __m128i ctrl;
+    public:
+        explicit Group(const ctrl_t* pos): ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+        uint32_t match(ctrl_t h2) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2),ctrl)));
+        }
+        uint32_t match_empty() const {
+            return match(CTRL_EMPTY);
+        }
+        uint32_t match_empty_or_deleted() const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1),ctrl)));
+        }
+#else
+        const ctrl_t* ctrl;
+    public:
+        explicit Group(const ctrl_t* pos): ctrl(pos) {}
+        uint32_t match(ctrl_t h2) const {
+            uint32_t mask = 0;
+            for (std::size_t i=0;i<GROUP_WIDTH;i++) {
+                mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+            }
+            return mask;
+        }
+        uint32_t match_empty() const {
+            return match(CTRL_EMPTY);
+        }
+        uint32_t match_empty_or_deleted() const {
+            uint32_t mask = 0;
+            for (std::size_t i=0;i<GROUP_WIDTH;i++) {
+                mask |= static_cast<uint32_t>(ctrl[i] < -1) << i;
+            }
+            return mask;
+        }
+#endif
+    };
+}
+
+/**
+ * FlatHashMap
+ *
+ * FlatHashMap is an open-addressing hash map that stores the key-value pairs inline in a flat slot array, with a
+ * separate array of one-byte control words probed GROUP_WIDTH slots at a time (using SSE2 if available). Compared to
+ * std::map, a lookup costs one or two cache misses instead of O(log n) pointer chases, and there is no heap node per
+ * entry. It is used as the kv_map of the stores with integer keys(see KVIndex in cascade.hpp).
+ *
+ * FlatHashMap mimics the subset of the std::map interface used by the stores, with two differences:
+ * - Iteration order is unspecified.
+ * - Any insertion may rehash, which invalidates all iterators and references.
+ *
+ * After keep_key_order(true), FlatHashMap also keeps a side index from the keys in ascending order to their slots, so
+ * that a key scan resumes after a key in O(log n) instead of selecting the next keys in a pass over the whole map. The
+ * side index costs an O(log n) update when a key is added or erased and a hash lookup per entry when the map rehashes;
+ * overwriting the value of an existing key does not touch it. It is off by default, and a copy keeps the setting.
+ *
+ * FlatHashMap is not thread-safe by itself. The stores follow the single-writer/multi-reader pattern: the ordered
+ * handlers hold kv_map_mutex exclusively while updating the map, and the local readers hold it shared.
+ */
+template <typename KT, typename VT, typename Hash = std::hash<KT>>
+class FlatHashMap : public mutils::ByteRepresentable {
+public:
+    using key_type = KT;
+    using mapped_type = VT;
+    using value_type = std::pair<const KT,VT>;
+    using size_type = std::size_t;
+
+private:
+    using ctrl_t = flat_hash_detail::ctrl_t;
+
+    template <bool IsConst>
+    class Iterator {
+        friend class FlatHashMap;
+        friend class Iterator<!IsConst>;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<const KT,VT>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst,const value_type*,value_type*>;
+        using reference = std::conditional_t<IsConst,const value_type&,value_type&>;
+    private:
+        using slot_ptr_t = pointer;
+
+        const ctrl_t* ctrl;
+        const ctrl_t* ctrl_end;
+        slot_ptr_t slot;
+
+        Iterator(const ctrl_t* _ctrl, const ctrl_t* _ctrl_end, slot_ptr_t _slot):
+            ctrl(_ctrl), ctrl_end(_ctrl_end), slot(_slot) {}
+        void skip_empty_or_deleted() {
+            while (ctrl != ctrl_end && *ctrl < 0) {
+                ++ctrl;
+                ++slot;
+            }
+        }
+    public:
+        Iterator(): ctrl(nullptr), ctrl_end(nullptr), slot(nullptr) {}
+        template <bool C = IsConst, typename = std::enable_if_t<C>>
+        Iterator(const Iterator<false>& other): ctrl(other.ctrl), ctrl_end(other.ctrl_end), slot(other.slot) {}
+
+        reference operator*() const {
+            return *slot;
+        }
+        pointer operator->() const {
+            return slot;
+        }
+        Iterator& operator++() {
+            ++ctrl;
+            ++slot;
+            skip_empty_or_deleted();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+        friend bool operator==(const Iterator& lhs, const Iterator& rhs) {
+            return lhs.ctrl == rhs.ctrl;
+        }
+        friend bool operator!=(const Iterator& lhs, const Iterator& rhs) {
+            return lhs.ctrl != rhs.ctrl;
+        }
+    };
+
+    /**
+     * KeyOrderIterator walks the entries in ascending key order through the side index.
+     */
+    class KeyOrderIterator {
+        friend class FlatHashMap;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<const KT,VT>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+    private:
+        typename std::map<KT,std::size_t>::const_iterator it;
+        const value_type* slots;
+
+        KeyOrderIterator(typename std::map<KT,std::size_t>::const_iterator _it, const value_type* _slots):
+            it(_it), slots(_slots) {}
+    public:
+        reference operator*() const {
+            return slots[it->second];
+        }
+        pointer operator->() const {
+            return slots + it->second;
+        }
+        KeyOrderIterator& operator++() {
+            ++it;
+            return *this;
+        }
+        KeyOrderIterator operator++(int) {
+            KeyOrderIterator tmp = *this;
+            ++it;
+            return tmp;
+        }
+        friend bool operator==(const KeyOrderIterator& lhs, const KeyOrderIterator& rhs) {
+            return lhs.it == rhs.it;
+        }
+        friend bool operator!=(const KeyOrderIterator& lhs, const KeyOrderIterator& rhs) {
+            return lhs.it != rhs.it;
+        }
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using key_order_iterator = KeyOrderIterator;
+
+private:
+    ctrl_t* ctrl_;
+    value_type* slots_;
+    size_type capacity_;    // zero, or a power of two no less than GROUP_WIDTH
+    size_type size_;
+    size_type growth_left_; // the number of empty slots we can fill before rehashing
+    Hash hasher_;
+    /* the slots of the keys in ascending key order, or nullptr unless keep_key_order(true) */
+    std::unique_ptr<std::map<KT,size_type>> key_order_;
+
+    static size_type max_load(size_type capacity) {
+        return capacity / flat_hash_detail::MAX_LOAD_DENOMINATOR * flat_hash_detail::MAX_LOAD_NUMERATOR;
+    }
+
+    static size_type capacity_for(size_type n) {
+        size_type capacity = flat_hash_detail::GROUP_WIDTH;
+        while (max_load(capacity) < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    uint64_t hash_of(const KT& key) const {
+        return flat_hash_detail::mix(static_cast<uint64_t>(hasher_(key)));
+    }
+
+    /**
+     * The probe sequence visits the groups in triangular order: g, g+1, g+3, g+6, ..., which covers every group
+     * exactly once when the number of groups is a power of two.
+     */
+    template <typename Func>
+    size_type probe(uint64_t hash, Func&& func) const {
+        const size_type num_groups = capacity_ / flat_hash_detail::GROUP_WIDTH;
+        size_type group = (hash >> 7) & (num_groups - 1);
+        for (size_type step = 1; step <= num_groups; step++) {
+            size_type index;
+            if (func(group * flat_hash_detail::GROUP_WIDTH, index)) {
+                return index;
+            }
+            group = (group + step) & (num_groups - 1);
+        }
+        return capacity_;
+    }
+
+    size_type find_index(const KT& key) const {
+        if (capacity_ == 0) {
+            return 0;
+        }
+        const uint64_t hash = hash_of(key);
+        const ctrl_t h2 = static_cast<ctrl_t>(hash & 0x7f);
+        return probe(hash, [&](size_type offset, size_type& index) {
+            flat_hash_detail::Group group(ctrl_ + offset);
+            for (uint32_t mask = group.match(h2); mask != 0; mask &= (mask - 1)) {
+                index = offset + __builtin_ctz(mask);
+                if (slots_[index].first == key) {
+                    return true;
+                }
+            }
+            if (group.match_empty()) {
+                index = capacity_;
+                return true;
+            }
+            return false;
+        });
+    }
+
+    size_type find_insert_index(uint64_t hash) const {
+        return probe(hash, [&](size_type offset, size_type& index) {
+            uint32_t mask = flat_hash_detail::Group(ctrl_ + offset).match_empty_or_deleted();
+            if (mask != 0) {
+                index = offset + __builtin_ctz(mask);
+                return true;
+            }
+            return false;
+        });
+    }
+
+    void allocate(size_type capacity) {
+        capacity_ = capacity;
+        ctrl_ = new ctrl_t[capacity];
+        std::memset(ctrl_, static_cast<unsigned char>(flat_hash_detail::CTRL_EMPTY), capacity);
+        slots_ = std::allocator<value_type>().allocate(capacity);
+        growth_left_ = max_load(capacity) - size_;
+    }
+
+    void destroy_and_deallocate() {
+        key_order_.reset();
+        if (capacity_ == 0) {
+            return;
+        }
+        if constexpr (!std::is_trivially_destructible<value_type>::value) {
+            for (size_type i = 0; i < capacity_; i++) {
+                if (ctrl_[i] >= 0) {
+                    slots_[i].~value_type();
+                }
+            }
+        }
+        std::allocator<value_type>().deallocate(slots_, capacity_);
+        delete[] ctrl_;
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = 0;
+        growth_left_ = 0;
+    }
+
+    /**
+     * Rehash into 'new_capacity' slots, which also drops all tombstones.
+     */
+    void rehash(size_type new_capacity) {
+        ctrl_t* old_ctrl = ctrl_;
+        value_type* old_slots = slots_;
+        size_type old_capacity = capacity_;
+        allocate(new_capacity);
+        for (size_type i = 0; i < old_capacity; i++) {
+            if (old_ctrl[i] >= 0) {
+                const uint64_t hash = hash_of(old_slots[i].first);
+                size_type index = find_insert_index(hash);
+                new (slots_ + index) value_type(std::move(old_slots[i]));
+                ctrl_[index] = static_cast<ctrl_t>(hash & 0x7f);
+                old_slots[i].~value_type();
+            }
+        }
+        if (old_capacity > 0) {
+            std::allocator<value_type>().deallocate(old_slots, old_capacity);
+            delete[] old_ctrl;
+        }
+        if (key_order_) {
+            for (auto& key_slot : *key_order_) {
+                key_slot.second = find_index(key_slot.first);
+            }
+        }
+    }
+
+    /**
+     * Make room for one more entry. If the table is mostly tombstones, rehash in place; otherwise double it.
+     */
+    void grow() {
+        if (capacity_ == 0) {
+            rehash(flat_hash_detail::GROUP_WIDTH);
+        } else if (size_ * 2 <= max_load(capacity_)) {
+            rehash(capacity_);
+        } else {
+            rehash(capacity_ * 2);
+        }
+    }
+
+    void erase_at(size_type index) {
+        if (key_order_) {
+            key_order_->erase(slots_[index].first);
+        }
+        slots_[index].~value_type();
+        size_--;
+        // If the group has an empty slot, no probe sequence goes beyond this group, so the slot can be empty again.
+        const size_type offset = index & ~(flat_hash_detail::GROUP_WIDTH - 1);
+        if (flat_hash_detail::Group(ctrl_ + offset).match_empty()) {
+            ctrl_[index] = flat_hash_detail::CTRL_EMPTY;
+            growth_left_++;
+        } else {
+            ctrl_[index] = flat_hash_detail::CTRL_DELETED;
+        }
+    }
+
+    iterator iterator_at(size_type index) {
+        iterator it(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+        it.skip_empty_or_deleted();
+        return it;
+    }
+
+    const_iterator iterator_at(size_type index) const {
+        const_iterator it(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+        it.skip_empty_or_deleted();
+        return it;
+    }
+
+public:
+    /**
+     * Constructors
+     */
+    FlatHashMap():
+        ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0), growth_left_(0) {}
+
+    FlatHashMap(const FlatHashMap& other):
+        ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0), growth_left_(0), hasher_(other.hasher_),
+        key_order_(other.key_order_ ? std::make_unique<std::map<KT,size_type>>(*other.key_order_) : nullptr) {
+        if (other.size_ > 0) {
+            // copy the layout as is, there is no need to rehash.
+            allocate(other.capacity_);
+            for (size_type i = 0; i < capacity_; i++) {
+                if (other.ctrl_[i] >= 0) {
+                    new (slots_ + i) value_type(other.slots_[i]);
+                }
+                ctrl_[i] = other.ctrl_[i];
+            }
+            size_ = other.size_;
+            growth_left_ = other.growth_left_;
+        }
+    }
+
+    FlatHashMap(FlatHashMap&& other):
+        ctrl_(other.ctrl_), slots_(other.slots_), capacity_(other.capacity_), size_(other.size_),
+        growth_left_(other.growth_left_), hasher_(std::move(other.hasher_)),
+        key_order_(std::move(other.key_order_)) {
+        other.ctrl_ = nullptr;
+        other.slots_ = nullptr;
+        other.capacity_ = 0;
+        other.size_ = 0;
+        other.growth_left_ = 0;
+    }
+
+    virtual ~FlatHashMap() {
+        destroy_and_deallocate();
+    }
+
+    FlatHashMap& operator=(const FlatHashMap& other) {
+        if (this != &other) {
+            FlatHashMap tmp(other);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    FlatHashMap& operator=(FlatHashMap&& other) {
+        if (this != &other) {
+            destroy_and_deallocate();
+            std::swap(ctrl_, other.ctrl_);
+            std::swap(slots_, other.slots_);
+            std::swap(capacity_, other.capacity_);
+            std::swap(size_, other.size_);
+            std::swap(growth_left_, other.growth_left_);
+            std::swap(hasher_, other.hasher_);
+            std::swap(key_order_, other.key_order_);
+        }
+        return *this;
+    }
+
+    /**
+     * Iterators
+     */
+    iterator begin() {
+        return iterator_at(0);
+    }
+    const_iterator begin() const {
+        return iterator_at(0);
+    }
+    const_iterator cbegin() const {
+        return begin();
+    }
+    iterator end() {
+        return iterator(ctrl_ + capacity_, ctrl_ + capacity_, slots_ + capacity_);
+    }
+    const_iterator end() const {
+        return const_iterator(ctrl_ + capacity_, ctrl_ + capacity_, slots_ + capacity_);
+    }
+    const_iterator cend() const {
+        return end();
+    }
+
+    /**
+     * Capacity
+     */
+    bool empty() const {
+        return size_ == 0;
+    }
+    size_type size() const {
+        return size_;
+    }
+    size_type capacity() const {
+        return capacity_;
+    }
+    /**
+     * Make room for 'n' entries without rehashing.
+     */
+    void reserve(size_type n) {
+        if (n > size_ + growth_left_) {
+            rehash(capacity_for(n));
+        }
+    }
+
+    /**
+     * Lookup
+     */
+    iterator find(const KT& key) {
+        size_type index = find_index(key);
+        return (index == capacity_) ? end() : iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+    }
+    const_iterator find(const KT& key) const {
+        size_type index = find_index(key);
+        return (index == capacity_) ? end() : const_iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+    }
+    size_type count(const KT& key) const {
+        return (find_index(key) == capacity_) ? 0 : 1;
+    }
+    VT& at(const KT& key) {
+        size_type index = find_index(key);
+        if (index == capacity_) {
+            throw std::out_of_range("FlatHashMap::at");
+        }
+        return slots_[index].second;
+    }
+    const VT& at(const KT& key) const {
+        size_type index = find_index(key);
+        if (index == capacity_) {
+            throw std::out_of_range("FlatHashMap::at");
+        }
+        return slots_[index].second;
+    }
+
+    /**
+     * Modifiers
+     */
+    /**
+     * Construct a value in place with 'args' if 'key' does not exist. Same as std::map, an existing value is NOT
+     * overwritten.
+     * @return the iterator to the value with 'key' and a bool denoting whether the insertion took place.
+     */
+    template <typename... Args>
+    std::pair<iterator,bool> emplace(const KT& key, Args&&... args) {
+        size_type index = find_index(key);
+        if (index != capacity_) {
+            return {iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index), false};
+        }
+        const uint64_t hash = hash_of(key);
+        if (capacity_ > 0) {
+            index = find_insert_index(hash);
+        }
+        if (capacity_ == 0 || (growth_left_ == 0 && ctrl_[index] == flat_hash_detail::CTRL_EMPTY)) {
+            grow();
+            index = find_insert_index(hash);
+        }
+        if (key_order_) {
+            key_order_->emplace(key, index);
+        }
+        try {
+            new (slots_ + index) value_type(std::piecewise_construct,
+                                            std::forward_as_tuple(key),
+                                            std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            if (key_order_) {
+                key_order_->erase(key);
+            }
+            throw;
+        }
+        if (ctrl_[index] == flat_hash_detail::CTRL_EMPTY) {
+            growth_left_--;
+        }
+        ctrl_[index] = static_cast<ctrl_t>(hash & 0x7f);
+        size_++;
+        return {iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index), true};
+    }
+    VT& operator[](const KT& key) {
+        return emplace(key).first->second;
+    }
+    /**
+     * @return the number of entries erased, 0 or 1.
+     */
+    size_type erase(const KT& key) {
+        size_type index = find_index(key);
+        if (index == capacity_) {
+            return 0;
+        }
+        erase_at(index);
+        return 1;
+    }
+    /**
+     * Erasing does not move other entries, so it is safe to keep iterating with the returned iterator.
+     * @return the iterator following the erased entry.
+     */
+    iterator erase(const_iterator pos) {
+        size_type index = static_cast<size_type>(pos.slot - slots_);
+        erase_at(index);
+        return iterator_at(index + 1);
+    }
+    void clear() {
+        if (capacity_ == 0) {
+            return;
+        }
+        if constexpr (!std::is_trivially_destructible<value_type>::value) {
+            for (size_type i = 0; i < capacity_; i++) {
+                if (ctrl_[i] >= 0) {
+                    slots_[i].~value_type();
+                }
+            }
+        }
+        std::memset(ctrl_, static_cast<unsigned char>(flat_hash_detail::CTRL_EMPTY), capacity_);
+        if (key_order_) {
+            key_order_->clear();
+        }
+        size_ = 0;
+        growth_left_ = max_load(capacity_);
+    }
+
+    /**
+     * Key order
+     */
+    /**
+     * Start or stop keeping the side index of the ordered keys. Starting it indexes the existing entries.
+     */
+    void keep_key_order(bool enable) {
+        if (!enable) {
+            key_order_.reset();
+        } else if (!key_order_) {
+            key_order_ = std::make_unique<std::map<KT,size_type>>();
+            for (size_type i = 0; i < capacity_; i++) {
+                if (ctrl_[i] >= 0) {
+                    key_order_->emplace(slots_[i].first, i);
+                }
+            }
+        }
+    }
+    bool keeps_key_order() const {
+        return static_cast<bool>(key_order_);
+    }
+    /**
+     * The entries in ascending key order. Only valid if keeps_key_order() is true.
+     */
+    key_order_iterator key_order_begin() const {
+        return key_order_iterator(key_order_->cbegin(), slots_);
+    }
+    key_order_iterator key_order_end() const {
+        return key_order_iterator(key_order_->cend(), slots_);
+    }
+    key_order_iterator key_order_lower_bound(const KT& key) const {
+        return key_order_iterator(key_order_->lower_bound(key), slots_);
+    }
+
+    /**
+     * Serialization supports. The format is the number of entries followed by the serialized key-value pairs.
+     */
+    std::size_t to_bytes(char* v) const {
+        std::size_t offset = mutils::to_bytes(size_, v);
+        for (const auto& kv : *this) {
+            offset += mutils::to_bytes(kv.first, v + offset);
+            offset += mutils::to_bytes(kv.second, v + offset);
+        }
+        return offset;
+    }
+
+    std::size_t bytes_size() const {
+        std::size_t size = mutils::bytes_size(size_);
+        for (const auto& kv : *this) {
+            size += mutils::bytes_size(kv.first) + mutils::bytes_size(kv.second);
+        }
+        return size;
+    }
+
+    void post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+        mutils::post_object(f, size_);
+        for (const auto& kv : *this) {
+            mutils::post_object(f, kv.first);
+            mutils::post_object(f, kv.second);
+        }
+    }
+
+    void ensure_registered(mutils::DeserializationManager&) {}
+
+    static std::unique_ptr<FlatHashMap> from_bytes(mutils::DeserializationManager* dsm, const char* const v) {
+        auto ret = std::make_unique<FlatHashMap>();
+        const size_type num_entries = *mutils::from_bytes<size_type>(dsm, v);
+        std::size_t offset = mutils::bytes_size(num_entries);
+        ret->reserve(num_entries);
+        for (size_type i = 0; i < num_entries; i++) {
+            auto key_ptr = mutils::from_bytes<KT>(dsm, v + offset);
+            offset += mutils::bytes_size(*key_ptr);
+            auto value_ptr = mutils::from_bytes<VT>(dsm, v + offset);
+            offset += mutils::bytes_size(*value_ptr);
+            ret->emplace(*key_ptr, std::move(*value_ptr));
+        }
+        return ret;
+    }
+
+    static mutils::context_ptr<FlatHashMap> from_bytes_noalloc(mutils::DeserializationManager* dsm, const char* const v) {
+        return mutils::context_ptr<FlatHashMap>{from_bytes(dsm, v).release()};
+    }
+
+    static mutils::context_ptr<const FlatHashMap> from_bytes_noalloc_const(mutils::DeserializationManager* dsm, const char* const v) {
+        return mutils::context_ptr<const FlatHashMap>{from_bytes(dsm, v).release()};
+    }
+};
+
+}
+}
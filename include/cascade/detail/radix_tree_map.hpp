@@ -0,0 +1,815 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <derecho/mutils-serialization/SerializationSupport.hpp>
+
+namespace derecho {
+namespace cascade {
+
+/**
+ * RadixTreeMap
+ *
+ * RadixTreeMap is an adaptive radix tree (ART) keyed by std::string. Each node holds the compressed path shared by all
+ * keys below it, so a long common prefix like "pet/" or "flower/" is stored once instead of once per key, and a lookup
+ * compares every key byte at most once, which is O(k) for a key of k bytes. The full key is not stored anywhere: it is
+ * the concatenation of the compressed paths and edge bytes from the root.
+ *
+ * Like ART, the children array of a node adapts to its fanout: it is a sorted array of 4, 16, or 48 edge bytes with the
+ * matching child pointers, or a direct array of 256 child pointers, so that sparse nodes stay small and dense nodes
+ * take one indexed load per byte.
+ *
+ * RadixTreeMap mimics the subset of the std::map interface used by the stores, including the iteration order. The
+ * iterators do not hold a reference to the key: 'it->first' is a key rebuilt during the traversal and 'it->second' is a
+ * reference to the value. Insertion and removal invalidate all iterators but no references to values.
+ *
+ * Use lower_bound/prefix_range for ordered prefix range iteration.
+ *
+ * RadixTreeMap is not thread-safe by itself. The stores follow the single-writer/multi-reader pattern: the ordered
+ * handlers hold kv_map_mutex exclusively while updating the map, and the local readers hold it shared.
+ */
+template <typename VT>
+class RadixTreeMap : public mutils::ByteRepresentable {
+public:
+    using key_type = std::string;
+    using mapped_type = VT;
+    using size_type = std::size_t;
+
+private:
+    struct Node {
+        /* the compressed path following the edge byte from the parent */
+        std::string prefix;
+        /* the value of the key ending at this node, or nullptr */
+        VT* value;
+        /* 'capacity' child pointers, followed by 'capacity' sorted edge bytes unless capacity is 256 */
+        Node** children;
+        uint16_t num_children;
+        uint16_t capacity;
+        /* true if the node is a NodeWithStorage */
+        bool has_storage;
+
+        Node(std::string&& _prefix, bool _has_storage=false):
+            prefix(std::move(_prefix)), value(nullptr), children(nullptr), num_children(0), capacity(0),
+            has_storage(_has_storage) {}
+
+        bool is_direct() const {
+            return capacity == 256;
+        }
+        uint8_t* edge_bytes() const {
+            return reinterpret_cast<uint8_t*>(children + capacity);
+        }
+        /**
+         * @return the index in the children array of the first child with edge byte no less than 'b'.
+         */
+        uint16_t lower_bound_index(uint8_t b) const {
+            if (is_direct()) {
+                return b;
+            }
+            return static_cast<uint16_t>(std::lower_bound(edge_bytes(), edge_bytes() + num_children, b) - edge_bytes());
+        }
+        Node** find_child(uint8_t b) const {
+            if (is_direct()) {
+                return children[b] ? &children[b] : nullptr;
+            }
+            uint16_t index = lower_bound_index(b);
+            return (index < num_children && edge_bytes()[index] == b) ? &children[index] : nullptr;
+        }
+        /**
+         * Get the child at or after 'index' in edge byte order, and move 'index' past it.
+         * @return false if there is no more child.
+         */
+        bool next_child(uint16_t& index, uint8_t& b, Node*& child) const {
+            if (is_direct()) {
+                while (index < 256 && children[index] == nullptr) {
+                    index++;
+                }
+                if (index == 256) {
+                    return false;
+                }
+                b = static_cast<uint8_t>(index);
+                child = children[index++];
+                return true;
+            }
+            if (index >= num_children) {
+                return false;
+            }
+            b = edge_bytes()[index];
+            child = children[index++];
+            return true;
+        }
+        /**
+         * Change the capacity of the children array to one of 0, 4, 16, 48, and 256.
+         */
+        void resize(uint16_t new_capacity) {
+            Node** new_children = nullptr;
+            if (new_capacity > 0) {
+                const std::size_t block_size = new_capacity * sizeof(Node*) + ((new_capacity == 256) ? 0 : new_capacity);
+                new_children = reinterpret_cast<Node**>(new char[block_size]);
+                uint8_t* new_edge_bytes = reinterpret_cast<uint8_t*>(new_children + new_capacity);
+                if (new_capacity == 256) {
+                    std::fill(new_children, new_children + 256, nullptr);
+                }
+                uint16_t index = 0, new_index = 0;
+                uint8_t b;
+                Node* child;
+                while (next_child(index, b, child)) {
+                    if (new_capacity == 256) {
+                        new_children[b] = child;
+                    } else {
+                        new_edge_bytes[new_index] = b;
+                        new_children[new_index++] = child;
+                    }
+                }
+            }
+            delete[] reinterpret_cast<char*>(children);
+            children = new_children;
+            capacity = new_capacity;
+        }
+        void add_child(uint8_t b, Node* child) {
+            if (num_children == capacity) {
+                resize(capacity == 0 ? 4 : (capacity == 4 ? 16 : (capacity == 16 ? 48 : 256)));
+            }
+            if (is_direct()) {
+                children[b] = child;
+            } else {
+                uint16_t index = lower_bound_index(b);
+                std::memmove(children + index + 1, children + index, (num_children - index) * sizeof(Node*));
+                std::memmove(edge_bytes() + index + 1, edge_bytes() + index, num_children - index);
+                children[index] = child;
+                edge_bytes()[index] = b;
+            }
+            num_children++;
+        }
+        void remove_child(uint8_t b) {
+            if (is_direct()) {
+                children[b] = nullptr;
+            } else {
+                uint16_t index = lower_bound_index(b);
+                std::memmove(children + index, children + index + 1, (num_children - index - 1) * sizeof(Node*));
+                std::memmove(edge_bytes() + index, edge_bytes() + index + 1, num_children - index - 1);
+            }
+            num_children--;
+            // shrink with some hysteresis to avoid resizing back and forth.
+            if (num_children == 0) {
+                resize(0);
+            } else if (capacity == 256 && num_children <= 40) {
+                resize(48);
+            } else if (capacity == 48 && num_children <= 12) {
+                resize(16);
+            } else if (capacity == 16 && num_children <= 3) {
+                resize(4);
+            }
+        }
+        Node* only_child(uint8_t& b) const {
+            uint16_t index = 0;
+            Node* child = nullptr;
+            next_child(index, b, child);
+            return child;
+        }
+    };
+
+    /**
+     * Most values are on the leaves, so a leaf is allocated together with the storage of its value.
+     */
+    struct NodeWithStorage : public Node {
+        alignas(VT) unsigned char storage[sizeof(VT)];
+
+        NodeWithStorage(std::string&& _prefix): Node(std::move(_prefix), true) {}
+    };
+
+    template <bool IsConst>
+    class Iterator {
+        friend class RadixTreeMap;
+        friend class Iterator<!IsConst>;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<const std::string, std::conditional_t<IsConst,const VT&,VT&>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+    private:
+        struct Frame {
+            const Node* node;
+            uint16_t next_index;
+            std::size_t path_length;
+        };
+        using tree_ptr_t = std::conditional_t<IsConst,const RadixTreeMap*,RadixTreeMap*>;
+
+        tree_ptr_t tree;
+        /* the node of the current key, nullptr for end() */
+        Node* node;
+        /* the current key and value */
+        std::optional<value_type> current;
+        /* the traversal state; an iterator returned by find() does not have it until it is incremented. */
+        std::vector<Frame> stack;
+        std::string path;
+
+        Iterator(tree_ptr_t _tree, Node* _node, const std::string& key): tree(_tree), node(_node) {
+            if (node) {
+                current.emplace(key,*node->value);
+            }
+        }
+        void set_current() {
+            current.reset();
+            if (node) {
+                current.emplace(path,*node->value);
+            }
+        }
+        /**
+         * Move to the next node with a value in the pre-order traversal, which is the key order.
+         */
+        void advance() {
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                uint8_t b;
+                Node* child;
+                if (frame.node->next_child(frame.next_index, b, child)) {
+                    path.resize(frame.path_length);
+                    path.push_back(static_cast<char>(b));
+                    path.append(child->prefix);
+                    stack.push_back({child,0,path.size()});
+                    if (child->value) {
+                        node = child;
+                        set_current();
+                        return;
+                    }
+                } else {
+                    stack.pop_back();
+                }
+            }
+            node = nullptr;
+            set_current();
+        }
+    public:
+        Iterator(): tree(nullptr), node(nullptr) {}
+        Iterator(const Iterator& other): tree(other.tree), node(other.node), stack(other.stack), path(other.path) {
+            if (other.current) {
+                current.emplace(other.current->first,other.current->second);
+            }
+        }
+        template <bool C = IsConst, typename = std::enable_if_t<C>>
+        Iterator(const Iterator<false>& other): tree(other.tree), node(other.node), path(other.path) {
+            for (const auto& frame: other.stack) {
+                stack.push_back({frame.node,frame.next_index,frame.path_length});
+            }
+            if (other.current) {
+                current.emplace(other.current->first,other.current->second);
+            }
+        }
+        Iterator& operator=(const Iterator& other) {
+            if (this != &other) {
+                tree = other.tree;
+                node = other.node;
+                stack = other.stack;
+                path = other.path;
+                current.reset();
+                if (other.current) {
+                    current.emplace(other.current->first,other.current->second);
+                }
+            }
+            return *this;
+        }
+
+        reference operator*() const {
+            return *current;
+        }
+        pointer operator->() const {
+            return &(*current);
+        }
+        Iterator& operator++() {
+            if (node == nullptr) {
+                return *this;
+            }
+            if (stack.empty()) {
+                // rebuild the traversal state.
+                *this = tree->lower_bound(current->first);
+            }
+            advance();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+        friend bool operator==(const Iterator& lhs, const Iterator& rhs) {
+            return lhs.node == rhs.node;
+        }
+        friend bool operator!=(const Iterator& lhs, const Iterator& rhs) {
+            return lhs.node != rhs.node;
+        }
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using value_type = typename iterator::value_type;
+
+private:
+    /* the root has an empty prefix and is never merged into its children */
+    Node* root;
+    size_type num_values;
+
+    template <typename... Args>
+    static void construct_value(Node* node, Args&&... args) {
+        if (node->has_storage) {
+            node->value = new (static_cast<NodeWithStorage*>(node)->storage) VT(std::forward<Args>(args)...);
+        } else {
+            node->value = new VT(std::forward<Args>(args)...);
+        }
+    }
+
+    static void destroy_value(Node* node) {
+        if (node->has_storage) {
+            node->value->~VT();
+        } else {
+            delete node->value;
+        }
+        node->value = nullptr;
+    }
+
+    /**
+     * Free a node whose value is already destroyed.
+     */
+    static void free_node(Node* node) {
+        delete[] reinterpret_cast<char*>(node->children);
+        if (node->has_storage) {
+            delete static_cast<NodeWithStorage*>(node);
+        } else {
+            delete node;
+        }
+    }
+
+    /**
+     * Create a leaf with a value constructed from 'args'.
+     */
+    template <typename... Args>
+    static Node* create_leaf(std::string&& prefix, Args&&... args) {
+        NodeWithStorage* leaf = new NodeWithStorage(std::move(prefix));
+        try {
+            construct_value(leaf, std::forward<Args>(args)...);
+        } catch (...) {
+            delete leaf;
+            throw;
+        }
+        return leaf;
+    }
+
+    static void destroy(Node* node) {
+        uint16_t index = 0;
+        uint8_t b;
+        Node* child;
+        while (node->next_child(index, b, child)) {
+            destroy(child);
+        }
+        if (node->value) {
+            destroy_value(node);
+        }
+        free_node(node);
+    }
+
+    static Node* clone(const Node* node) {
+        Node* copy = node->value ? create_leaf(std::string(node->prefix), *node->value)
+                                 : new Node(std::string(node->prefix));
+        if (node->capacity > 0) {
+            copy->resize(node->capacity);
+        }
+        uint16_t index = 0;
+        uint8_t b;
+        Node* child;
+        while (node->next_child(index, b, child)) {
+            copy->add_child(b, clone(child));
+        }
+        return copy;
+    }
+
+    /**
+     * Merge a node without value into its only child, which takes the node's place.
+     */
+    static void merge_with_only_child(Node** slot) {
+        Node* node = *slot;
+        uint8_t b = 0;
+        Node* child = node->only_child(b);
+        std::string merged_prefix;
+        merged_prefix.reserve(node->prefix.size() + 1 + child->prefix.size());
+        merged_prefix.append(node->prefix);
+        merged_prefix.push_back(static_cast<char>(b));
+        merged_prefix.append(child->prefix);
+        child->prefix = std::move(merged_prefix);
+        *slot = child;
+        free_node(node);
+    }
+
+    static std::size_t common_prefix_length(const std::string& prefix, const std::string& key, std::size_t pos) {
+        const std::size_t max_length = std::min(prefix.size(), key.size() - pos);
+        std::size_t length = 0;
+        while (length < max_length && prefix[length] == key[pos + length]) {
+            length++;
+        }
+        return length;
+    }
+
+    Node* find_node(const std::string& key) const {
+        if (root == nullptr) {
+            return nullptr;
+        }
+        const Node* node = root;
+        std::size_t pos = 0;
+        while (true) {
+            if (key.size() - pos < node->prefix.size() ||
+                std::memcmp(node->prefix.data(), key.data() + pos, node->prefix.size()) != 0) {
+                return nullptr;
+            }
+            pos += node->prefix.size();
+            if (pos == key.size()) {
+                return node->value ? const_cast<Node*>(node) : nullptr;
+            }
+            Node** slot = node->find_child(static_cast<uint8_t>(key[pos]));
+            if (slot == nullptr) {
+                return nullptr;
+            }
+            node = *slot;
+            pos++;
+        }
+    }
+
+    template <typename IteratorType, typename TreePtr>
+    static IteratorType lower_bound_impl(TreePtr tree, const std::string& key) {
+        IteratorType it;
+        it.tree = tree;
+        if (tree->root == nullptr) {
+            return it;
+        }
+        it.stack.push_back({tree->root,0,0});
+        std::size_t pos = 0;
+        while (true) {
+            auto& frame = it.stack.back();
+            const Node* node = frame.node;
+            if (pos == key.size()) {
+                // every key in this subtree is no less than 'key'.
+                if (node->value) {
+                    it.node = const_cast<Node*>(node);
+                    it.path = key;
+                    it.set_current();
+                    return it;
+                }
+                break;
+            }
+            const uint8_t b = static_cast<uint8_t>(key[pos]);
+            frame.next_index = node->lower_bound_index(b);
+            Node** slot = node->find_child(b);
+            if (slot == nullptr) {
+                break;
+            }
+            const Node* child = *slot;
+            const std::size_t length = common_prefix_length(child->prefix, key, pos + 1);
+            if (length == child->prefix.size()) {
+                // descend
+                frame.next_index++;
+                pos += 1 + length;
+                it.stack.push_back({child,0,pos});
+                continue;
+            }
+            if (pos + 1 + length < key.size() &&
+                static_cast<uint8_t>(child->prefix[length]) < static_cast<uint8_t>(key[pos + 1 + length])) {
+                // every key in the child's subtree is less than 'key'.
+                frame.next_index++;
+            }
+            break;
+        }
+        it.path = key.substr(0, it.stack.back().path_length);
+        it.advance();
+        return it;
+    }
+
+public:
+    /**
+     * Constructors
+     */
+    RadixTreeMap(): root(nullptr), num_values(0) {}
+
+    RadixTreeMap(const RadixTreeMap& other): root(nullptr), num_values(other.num_values) {
+        if (other.root) {
+            root = clone(other.root);
+        }
+    }
+
+    RadixTreeMap(RadixTreeMap&& other): root(other.root), num_values(other.num_values) {
+        other.root = nullptr;
+        other.num_values = 0;
+    }
+
+    virtual ~RadixTreeMap() {
+        clear();
+    }
+
+    RadixTreeMap& operator=(const RadixTreeMap& other) {
+        if (this != &other) {
+            RadixTreeMap tmp(other);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    RadixTreeMap& operator=(RadixTreeMap&& other) {
+        if (this != &other) {
+            clear();
+            std::swap(root, other.root);
+            std::swap(num_values, other.num_values);
+        }
+        return *this;
+    }
+
+    /**
+     * Iterators
+     */
+    iterator begin() {
+        return lower_bound(std::string());
+    }
+    const_iterator begin() const {
+        return lower_bound(std::string());
+    }
+    const_iterator cbegin() const {
+        return begin();
+    }
+    iterator end() {
+        iterator it;
+        it.tree = this;
+        return it;
+    }
+    const_iterator end() const {
+        const_iterator it;
+        it.tree = this;
+        return it;
+    }
+    const_iterator cend() const {
+        return end();
+    }
+
+    /**
+     * Capacity
+     */
+    bool empty() const {
+        return num_values == 0;
+    }
+    size_type size() const {
+        return num_values;
+    }
+
+    /**
+     * Lookup
+     */
+    iterator find(const std::string& key) {
+        return iterator(this, find_node(key), key);
+    }
+    const_iterator find(const std::string& key) const {
+        return const_iterator(this, find_node(key), key);
+    }
+    size_type count(const std::string& key) const {
+        return find_node(key) ? 1 : 0;
+    }
+    VT& at(const std::string& key) {
+        Node* node = find_node(key);
+        if (node == nullptr) {
+            throw std::out_of_range("RadixTreeMap::at");
+        }
+        return *node->value;
+    }
+    const VT& at(const std::string& key) const {
+        Node* node = find_node(key);
+        if (node == nullptr) {
+            throw std::out_of_range("RadixTreeMap::at");
+        }
+        return *node->value;
+    }
+    /**
+     * @return an iterator to the first key no less than 'key'.
+     */
+    iterator lower_bound(const std::string& key) {
+        return lower_bound_impl<iterator>(this, key);
+    }
+    const_iterator lower_bound(const std::string& key) const {
+        return lower_bound_impl<const_iterator>(this, key);
+    }
+    /**
+     * @return the range of the keys starting with 'prefix', in key order.
+     */
+    std::pair<iterator,iterator> prefix_range(const std::string& prefix) {
+        return {lower_bound(prefix), prefix_end<iterator>(prefix)};
+    }
+    std::pair<const_iterator,const_iterator> prefix_range(const std::string& prefix) const {
+        return {lower_bound(prefix), prefix_end<const_iterator>(prefix)};
+    }
+
+private:
+    template <typename IteratorType>
+    IteratorType prefix_end(const std::string& prefix) const {
+        // the first key after the prefix range is the lower bound of the shortest string greater than all keys with
+        // the prefix.
+        std::string successor(prefix);
+        while (!successor.empty() && static_cast<uint8_t>(successor.back()) == 0xff) {
+            successor.pop_back();
+        }
+        if (successor.empty()) {
+            return const_cast<RadixTreeMap*>(this)->end();
+        }
+        successor.back() = static_cast<char>(static_cast<uint8_t>(successor.back()) + 1);
+        return const_cast<RadixTreeMap*>(this)->lower_bound(successor);
+    }
+
+public:
+    /**
+     * Modifiers
+     */
+    /**
+     * Construct a value in place with 'args' if 'key' does not exist. Same as std::map, an existing value is NOT
+     * overwritten.
+     * @return the iterator to the value with 'key' and a bool denoting whether the insertion took place.
+     */
+    template <typename... Args>
+    std::pair<iterator,bool> emplace(const std::string& key, Args&&... args) {
+        if (root == nullptr) {
+            root = new Node(std::string());
+        }
+        Node** slot = &root;
+        std::size_t pos = 0;
+        while (true) {
+            Node* node = *slot;
+            const std::size_t length = common_prefix_length(node->prefix, key, pos);
+            if (length < node->prefix.size()) {
+                // split the compressed path at 'length'.
+                Node* split;
+                Node* target;
+                if (pos + length < key.size()) {
+                    target = create_leaf(key.substr(pos + length + 1), std::forward<Args>(args)...);
+                    split = new Node(node->prefix.substr(0, length));
+                    split->add_child(static_cast<uint8_t>(key[pos + length]), target);
+                } else {
+                    split = create_leaf(node->prefix.substr(0, length), std::forward<Args>(args)...);
+                    target = split;
+                }
+                const uint8_t b = static_cast<uint8_t>(node->prefix[length]);
+                node->prefix.erase(0, length + 1);
+                split->add_child(b, node);
+                *slot = split;
+                num_values++;
+                return {iterator(this, target, key), true};
+            }
+            pos += length;
+            if (pos == key.size()) {
+                if (node->value) {
+                    return {iterator(this, node, key), false};
+                }
+                construct_value(node, std::forward<Args>(args)...);
+                num_values++;
+                return {iterator(this, node, key), true};
+            }
+            Node** child_slot = node->find_child(static_cast<uint8_t>(key[pos]));
+            if (child_slot == nullptr) {
+                Node* leaf = create_leaf(key.substr(pos + 1), std::forward<Args>(args)...);
+                node->add_child(static_cast<uint8_t>(key[pos]), leaf);
+                num_values++;
+                return {iterator(this, leaf, key), true};
+            }
+            slot = child_slot;
+            pos++;
+        }
+    }
+    VT& operator[](const std::string& key) {
+        return emplace(key).first->second;
+    }
+    /**
+     * @return the number of entries erased, 0 or 1.
+     */
+    size_type erase(const std::string& key) {
+        if (root == nullptr) {
+            return 0;
+        }
+        // the slots and the edge bytes on the path
+        std::vector<std::pair<Node**,uint8_t>> path;
+        Node** slot = &root;
+        std::size_t pos = 0;
+        while (true) {
+            Node* node = *slot;
+            if (key.size() - pos < node->prefix.size() ||
+                std::memcmp(node->prefix.data(), key.data() + pos, node->prefix.size()) != 0) {
+                return 0;
+            }
+            pos += node->prefix.size();
+            if (pos == key.size()) {
+                break;
+            }
+            const uint8_t b = static_cast<uint8_t>(key[pos]);
+            Node** child_slot = node->find_child(b);
+            if (child_slot == nullptr) {
+                return 0;
+            }
+            path.emplace_back(slot, b);
+            slot = child_slot;
+            pos++;
+        }
+        Node* node = *slot;
+        if (node->value == nullptr) {
+            return 0;
+        }
+        destroy_value(node);
+        num_values--;
+        if (node == root) {
+            return 1;
+        }
+        // keep the tree compressed: a non-root node without value has at least two children.
+        if (node->num_children == 1) {
+            merge_with_only_child(slot);
+        } else if (node->num_children == 0) {
+            Node** parent_slot = path.back().first;
+            Node* parent = *parent_slot;
+            parent->remove_child(path.back().second);
+            free_node(node);
+            if (parent != root && parent->value == nullptr && parent->num_children == 1) {
+                merge_with_only_child(parent_slot);
+            }
+        }
+        return 1;
+    }
+    /**
+     * @return the iterator following the erased entry.
+     */
+    iterator erase(const_iterator pos) {
+        std::string key = pos->first;
+        erase(key);
+        return lower_bound(key);
+    }
+    void clear() {
+        if (root) {
+            destroy(root);
+            root = nullptr;
+        }
+        num_values = 0;
+    }
+
+    /**
+     * Serialization supports. The format is the number of entries followed by the serialized key-value pairs in key
+     * order.
+     */
+    std::size_t to_bytes(char* v) const {
+        std::size_t offset = mutils::to_bytes(num_values, v);
+        for (const auto& kv : *this) {
+            offset += mutils::to_bytes(kv.first, v + offset);
+            offset += mutils::to_bytes(kv.second, v + offset);
+        }
+        return offset;
+    }
+
+    std::size_t bytes_size() const {
+        std::size_t size = mutils::bytes_size(num_values);
+        for (const auto& kv : *this) {
+            size += mutils::bytes_size(kv.first) + mutils::bytes_size(kv.second);
+        }
+        return size;
+    }
+
+    void post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+        mutils::post_object(f, num_values);
+        for (const auto& kv : *this) {
+            mutils::post_object(f, kv.first);
+            mutils::post_object(f, kv.second);
+        }
+    }
+
+    void ensure_registered(mutils::DeserializationManager&) {}
+
+    static std::unique_ptr<RadixTreeMap> from_bytes(mutils::DeserializationManager* dsm, const char* const v) {
+        auto ret = std::make_unique<RadixTreeMap>();
+        const size_type num_entries = *mutils::from_bytes<size_type>(dsm, v);
+        std::size_t offset = mutils::bytes_size(num_entries);
+        for (size_type i = 0; i < num_entries; i++) {
+            auto key_ptr = mutils::from_bytes<std::string>(dsm, v + offset);
+            offset += mutils::bytes_size(*key_ptr);
+            auto value_ptr = mutils::from_bytes<VT>(dsm, v + offset);
+            offset += mutils::bytes_size(*value_ptr);
+            ret->emplace(*key_ptr, std::move(*value_ptr));
+        }
+        return ret;
+    }
+
+    static mutils::context_ptr<RadixTreeMap> from_bytes_noalloc(mutils::DeserializationManager* dsm, const char* const v) {
+        return mutils::context_ptr<RadixTreeMap>{from_bytes(dsm, v).release()};
+    }
+
+    static mutils::context_ptr<const RadixTreeMap> from_bytes_noalloc_const(mutils::DeserializationManager* dsm, const char* const v) {
+        return mutils::context_ptr<const RadixTreeMap>{from_bytes(dsm, v).release()};
+    }
+};
+
+}
+}
@@ -25,18 +25,34 @@ using derecho::ShardAllocationPolicy;
  */
 SubgroupAllocationPolicy parse_json_subgroup_policy(const json&);
 
+/**
+ * get_type_layout()
+ *
+ * Get the element of a subgroup type in the layout. A layout written before a type was added to the type list has no
+ * element for it, which means no subgroup of that type.
+ * @param layout    user provided layout in json format
+ * @param type_idx  the index of the type in the type list
+ * @return the element of the type
+ */
+inline json get_type_layout(const json& layout, int type_idx) {
+    if (static_cast<std::size_t>(type_idx) < layout.size()) {
+        return layout[type_idx];
+    }
+    return json{{JSON_CONF_LAYOUT,json::array()}};
+}
+
 template <typename CascadeType>
 void populate_policy_by_subgroup_type_map(
         std::map<std::type_index,std::variant<SubgroupAllocationPolicy, CrossProductPolicy>> &dsa_map,
         const json& layout, int type_idx) {
-    dsa_map.emplace(std::type_index(typeid(CascadeType)),parse_json_subgroup_policy(layout[type_idx]));
+    dsa_map.emplace(std::type_index(typeid(CascadeType)),parse_json_subgroup_policy(get_type_layout(layout,type_idx)));
 }
 
 template <typename FirstCascadeType, typename SecondCascadeType, typename... RestCascadeTypes>
 void populate_policy_by_subgroup_type_map(
         std::map<std::type_index,std::variant<SubgroupAllocationPolicy, CrossProductPolicy>> &dsa_map,
         const json& layout, int type_idx) {
-    dsa_map.emplace(std::type_index(typeid(FirstCascadeType)),parse_json_subgroup_policy(layout[type_idx]));
+    dsa_map.emplace(std::type_index(typeid(FirstCascadeType)),parse_json_subgroup_policy(get_type_layout(layout,type_idx)));
     populate_policy_by_subgroup_type_map<SecondCascadeType, RestCascadeTypes...>(dsa_map,layout,type_idx+1);
 }
 
@@ -381,6 +397,56 @@ derecho::rpc::QueryResults<std::tuple<persistent::version_t,uint64_t>> ServiceCl
     }
 }
 
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<std::vector<std::tuple<persistent::version_t,uint64_t>>> ServiceClient<CascadeTypes...>::put_batch(
+        const std::vector<typename SubgroupType::ObjectType>& objects,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do ordered put_batch as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template ordered_send<RPC_NAME(ordered_put_batch)>(objects);
+        } else {
+            // do normal put_batch as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(put_batch)>(node_id,objects);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(put_batch)>(node_id,objects);
+    }
+}
+
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<std::vector<std::tuple<persistent::version_t,uint64_t>>> ServiceClient<CascadeTypes...>::remove_batch(
+        const std::vector<typename SubgroupType::KeyType>& keys,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do ordered remove_batch as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template ordered_send<RPC_NAME(ordered_remove_batch)>(keys);
+        } else {
+            // do normal remove_batch as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(remove_batch)>(node_id,keys);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(remove_batch)>(node_id,keys);
+    }
+}
+
 template <typename... CascadeTypes>
 template <typename SubgroupType>
 derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> ServiceClient<CascadeTypes...>::get(
@@ -407,6 +473,32 @@ derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> ServiceClien
     }
 }
 
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<std::vector<typename SubgroupType::ObjectType>> ServiceClient<CascadeTypes...>::multi_get(
+        const std::vector<typename SubgroupType::KeyType>& keys,
+        const persistent::version_t& version,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do ordered put as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(multi_get)>(group_ptr->get_my_id(),keys,version);
+        } else {
+            // do normal put as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(multi_get)>(node_id,keys,version);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(multi_get)>(node_id,keys,version);
+    }
+}
+
 template <typename... CascadeTypes>
 template <typename SubgroupType>
 derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> ServiceClient<CascadeTypes...>::get_by_time(
@@ -459,6 +551,32 @@ derecho::rpc::QueryResults<uint64_t> ServiceClient<CascadeTypes...>::get_size(
     }
 }
 
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<ObjectMetadata> ServiceClient<CascadeTypes...>::head(
+        const typename SubgroupType::KeyType& key,
+        const persistent::version_t& version,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do head as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(head)>(group_ptr->get_my_id(),key,version,false);
+        } else {
+            // do head as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(head)>(node_id,key,version,false);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(head)>(node_id,key,version,false);
+    }
+}
+
 template <typename... CascadeTypes>
 template <typename SubgroupType>
 derecho::rpc::QueryResults<uint64_t> ServiceClient<CascadeTypes...>::get_size_by_time(
@@ -485,6 +603,148 @@ derecho::rpc::QueryResults<uint64_t> ServiceClient<CascadeTypes...>::get_size_by
     }
 }
 
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> ServiceClient<CascadeTypes...>::get_local(
+        const typename SubgroupType::KeyType& key,
+        const ReadConsistency& consistency,
+        const persistent::version_t& read_point,
+        const uint64_t& max_staleness_us,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do local get as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(get_local)>(group_ptr->get_my_id(),key,consistency,read_point,max_staleness_us);
+        } else {
+            // do local get as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(get_local)>(node_id,key,consistency,read_point,max_staleness_us);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(get_local)>(node_id,key,consistency,read_point,max_staleness_us);
+    }
+}
+
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<uint64_t> ServiceClient<CascadeTypes...>::get_size_local(
+        const typename SubgroupType::KeyType& key,
+        const ReadConsistency& consistency,
+        const persistent::version_t& read_point,
+        const uint64_t& max_staleness_us,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do local get_size as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(get_size_local)>(group_ptr->get_my_id(),key,consistency,read_point,max_staleness_us);
+        } else {
+            // do local get_size as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(get_size_local)>(node_id,key,consistency,read_point,max_staleness_us);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(get_size_local)>(node_id,key,consistency,read_point,max_staleness_us);
+    }
+}
+
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<ScanPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> ServiceClient<CascadeTypes...>::scan(
+        const std::string& prefix,
+        const typename SubgroupType::KeyType& start_after,
+        const uint32_t& limit,
+        bool with_values,
+        const persistent::version_t& version,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do scan as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(scan)>(group_ptr->get_my_id(),prefix,start_after,limit,with_values,version);
+        } else {
+            // do scan as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(scan)>(node_id,prefix,start_after,limit,with_values,version);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(scan)>(node_id,prefix,start_after,limit,with_values,version);
+    }
+}
+
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<ScanPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> ServiceClient<CascadeTypes...>::lookup_by_index(
+        const std::string& secondary_key,
+        const typename SubgroupType::KeyType& start_after,
+        const uint32_t& limit,
+        bool with_values,
+        const persistent::version_t& version,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do lookup_by_index as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(lookup_by_index)>(group_ptr->get_my_id(),secondary_key,start_after,limit,with_values,version);
+        } else {
+            // do lookup_by_index as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(lookup_by_index)>(node_id,secondary_key,start_after,limit,with_values,version);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(lookup_by_index)>(node_id,secondary_key,start_after,limit,with_values,version);
+    }
+}
+
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<QueryPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> ServiceClient<CascadeTypes...>::query(
+        const ShardQuery<typename SubgroupType::KeyType>& query,
+        const typename SubgroupType::KeyType& start_after,
+        const uint32_t& limit,
+        const persistent::version_t& version,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do query as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(query)>(group_ptr->get_my_id(),query,start_after,limit,version);
+        } else {
+            // do query as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(query)>(node_id,query,start_after,limit,version);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(query)>(node_id,query,start_after,limit,version);
+    }
+}
+
 template <typename... CascadeTypes>
 template <typename SubgroupType>
 derecho::rpc::QueryResults<std::vector<typename SubgroupType::KeyType>> ServiceClient<CascadeTypes...>::list_keys(
@@ -535,6 +795,31 @@ derecho::rpc::QueryResults<std::vector<typename SubgroupType::KeyType>> ServiceC
     }
 }
 
+template <typename... CascadeTypes>
+template <typename SubgroupType>
+derecho::rpc::QueryResults<persistent::version_t> ServiceClient<CascadeTypes...>::version_at_time(
+        const uint64_t& ts_us,
+        uint32_t subgroup_index,
+        uint32_t shard_index) {
+    if (group_ptr != nullptr) {
+        if (static_cast<uint32_t>(group_ptr->template get_my_shard<SubgroupType>(subgroup_index)) == shard_index) {
+            // do version_at_time as a member (Replicated).
+            auto& subgroup_handle = group_ptr->template get_subgroup<SubgroupType>(subgroup_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(version_at_time)>(group_ptr->get_my_id(),ts_us);
+        } else {
+            // do version_at_time as a non member (ExternalCaller).
+            auto& subgroup_handle = group_ptr->template get_nonmember_subgroup<SubgroupType>(subgroup_index);
+            node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+            return subgroup_handle.template p2p_send<RPC_NAME(version_at_time)>(node_id,ts_us);
+        }
+    } else {
+        // call as an external client (ExternalClientCaller).
+        auto& caller = external_group_ptr->template get_subgroup_caller<SubgroupType>(subgroup_index);
+        node_id_t node_id = pick_member_by_policy<SubgroupType>(subgroup_index,shard_index);
+        return caller.template p2p_send<RPC_NAME(version_at_time)>(node_id,ts_us);
+    }
+}
+
 template <typename... CascadeTypes>
 CascadeContext<CascadeTypes...>::CascadeContext() {}
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <chrono>
+#include <cstddef>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -25,18 +26,45 @@ using namespace std::chrono_literals;
 namespace derecho{
 namespace cascade{
 
+/* the high bits of the size in a serialized blob mark the compressed layout and a patch */
+#define BLOB_COMPRESSED_FLAG    (0x8000000000000000LLU)
+#define BLOB_PATCH_FLAG         (0x4000000000000000LLU)
+
+/* an owned blob no larger than this is stored inline, configured by BLOB_INLINE_BYTES in cmake; 0 disables it. */
+#ifndef BLOB_INLINE_BYTES
+#define BLOB_INLINE_BYTES       (64)
+#endif
+
+struct CompressedBlobCache;
+
+/**
+ * Blob serializes as [size:size_t][bytes], or, if the BlobCompression of the serializing thread applies and pays off,
+ * as [BLOB_COMPRESSED_FLAG|size:size_t][compressed_size:size_t][codec_id:uint8_t][compressed bytes]. Deserialization
+ * takes both; a compressed blob is decompressed into memory owned by the new Blob. BLOB_PATCH_FLAG marks a blob
+ * holding a BlobPatch, which only the log of PersistentCascadeStore has.
+ *
+ * A blob owning no more than BLOB_INLINE_BYTES bytes keeps them in inline_bytes instead of a heap allocation, so small
+ * objects live inside their ObjectWithUInt64Key/ObjectWithStringKey. A larger blob owns a reference-counted heap buffer,
+ * which its copies share instead of copying the bytes, so getting, storing, observing and queueing a large object
+ * costs a pointer bump. bytes always points to the data: either inline_bytes, the shared heap buffer, or, for a
+ * temporary blob, memory owned by someone else. Because a heap buffer may be shared, bytes is a const pointer; write the
+ * bytes through mutable_bytes(), which copies a shared buffer first.
+ */
 class Blob : public mutils::ByteRepresentable {
 public:
-    char* bytes;
+    /* read-only, since the bytes may be shared with other blobs; write them through mutable_bytes() */
+    const char* bytes;
     std::size_t size;
     bool is_temporary;
+    /* the bytes are a BlobPatch against the blob of the previous version of the key */
+    bool is_patch;
 
     // constructor - copy to own the data
     Blob(const char* const b, const decltype(size) s);
 
     Blob(char* b, const decltype(size) s, bool temporary);
 
-    // copy constructor - copy to own the data
+    // copy constructor - share the heap buffer of the other blob, or copy to own the data
     Blob(const Blob& other);
 
     // move constructor - accept the memory from another object
@@ -61,6 +89,23 @@ public:
 
     void post_object(const std::function<void(char const* const, std::size_t)>& f) const;
 
+    // true if the bytes are stored in the blob itself.
+    inline bool is_inline() const {
+        return bytes == inline_bytes;
+    }
+
+    // true if the heap buffer of the blob is shared with other blobs.
+    inline bool is_shared() const {
+        return shared_bytes.use_count() > 1;
+    }
+
+    /**
+     * Get the bytes for writing. A temporary blob writes the memory it points to; a blob sharing its heap buffer copies
+     * it first, so that the other blobs are not changed. Write them before the blob is serialized again, or call
+     * mutable_bytes() again, since a serialization keeps the compressed form of the content it has seen.
+     */
+    char* mutable_bytes();
+
     void ensure_registered(mutils::DeserializationManager&) {}
 
     static std::unique_ptr<Blob> from_bytes(mutils::DeserializationManager*, const char* const v);
@@ -72,6 +117,40 @@ public:
     mutils::context_ptr<Blob> from_bytes_noalloc_const(
         mutils::DeserializationManager* ctx,
         const char* const v);
+
+private:
+    /**
+     * Decompress a blob serialized in the compressed layout.
+     * @throw derecho::derecho_exception if the codec is unknown or the bytes are corrupted.
+     */
+    static Blob* decompress(const char* const v);
+
+    /**
+     * Get the compressed form of a blob by the compression of this thread.
+     * @return the cache holding the compressed form, or nullptr if the blob is serialized raw.
+     */
+    static CompressedBlobCache* get_compressed_form(const Blob& blob);
+
+    /**
+     * Point bytes to storage owned by this blob for s bytes: inline_bytes if they fit, otherwise a new shared heap
+     * buffer. The blob must not own any bytes yet.
+     * @return the storage, writable.
+     */
+    char* allocate(const std::size_t s);
+
+    /**
+     * Take the bytes of another blob, which is left empty. The blob must not own any bytes yet.
+     */
+    void take(Blob& other);
+
+    // drop the reference to the heap buffer if the blob owns one.
+    void release();
+
+    std::shared_ptr<char[]> shared_bytes;
+    /* the content of the blob: a fresh stamp from every construction and mutable_bytes(), which a copy shares and a move
+     * takes. The compressed form a thread keeps is looked up by it, so that it is never stale. */
+    uint64_t stamp;
+    alignas(std::max_align_t) char inline_bytes[BLOB_INLINE_BYTES > 0 ? BLOB_INLINE_BYTES : 1];
 };
 
 #define INVALID_UINT64_OBJECT_KEY (0xffffffffffffffffLLU)
@@ -79,7 +158,10 @@ public:
 class ObjectWithUInt64Key : public mutils::ByteRepresentable,
                             public ICascadeObject<uint64_t>,
                             public IKeepTimestamp,
-                            public IVerifyPreviousVersion {
+                            public IVerifyPreviousVersion,
+                            public IHasBlob,
+                            public IHasBlobPatch,
+                            public IHasBlobReference {
 public:
     mutable persistent::version_t                       version;
     mutable uint64_t                                    timestamp_us;
@@ -135,7 +217,16 @@ public:
     virtual void set_timestamp(uint64_t ts_us) const override;
     virtual uint64_t get_timestamp() const override;
     virtual void set_previous_version(persistent::version_t prev_ver, persistent::version_t prev_ver_by_key) const override;
+    virtual persistent::version_t get_previous_version() const override;
+    virtual persistent::version_t get_previous_version_by_key() const override;
     virtual bool verify_previous_version(persistent::version_t prev_ver, persistent::version_t prev_ver_by_key) const override;
+    virtual const char* get_blob_bytes() const override;
+    virtual std::size_t get_blob_size() const override;
+    virtual void clear_blob() override;
+    virtual bool is_blob_patch() const override;
+    virtual void set_blob(const char* bytes, const std::size_t size, const bool is_patch) override;
+    virtual void set_blob_reference(const char* bytes, const std::size_t size) override;
+    virtual void post_object_without_blob(const std::function<void(char const* const, std::size_t)>& f) const override;
 
     DEFAULT_SERIALIZATION_SUPPORT(ObjectWithUInt64Key, version, timestamp_us, previous_version, previous_version_by_key, key, blob);
 
@@ -172,7 +263,10 @@ inline std::ostream& operator<<(std::ostream& out, const ObjectWithUInt64Key& o)
 class ObjectWithStringKey : public mutils::ByteRepresentable,
                             public ICascadeObject<std::string>,
                             public IKeepTimestamp,
-                            public IVerifyPreviousVersion {
+                            public IVerifyPreviousVersion,
+                            public IHasBlob,
+                            public IHasBlobPatch,
+                            public IHasBlobReference {
 public:
     mutable persistent::version_t                       version;                // object version
     mutable uint64_t                                    timestamp_us;           // timestamp in microsecond
@@ -228,7 +322,16 @@ public:
     virtual void set_timestamp(uint64_t ts_us) const override;
     virtual uint64_t get_timestamp() const override;
     virtual void set_previous_version(persistent::version_t prev_ver, persistent::version_t perv_ver_by_key) const override;
+    virtual persistent::version_t get_previous_version() const override;
+    virtual persistent::version_t get_previous_version_by_key() const override;
     virtual bool verify_previous_version(persistent::version_t prev_ver, persistent::version_t perv_ver_by_key) const override;
+    virtual const char* get_blob_bytes() const override;
+    virtual std::size_t get_blob_size() const override;
+    virtual void clear_blob() override;
+    virtual bool is_blob_patch() const override;
+    virtual void set_blob(const char* bytes, const std::size_t size, const bool is_patch) override;
+    virtual void set_blob_reference(const char* bytes, const std::size_t size) override;
+    virtual void post_object_without_blob(const std::function<void(char const* const, std::size_t)>& f) const override;
 
     DEFAULT_SERIALIZATION_SUPPORT(ObjectWithStringKey, version, timestamp_us, previous_version, previous_version_by_key, key, blob);
 
@@ -89,9 +89,8 @@ namespace cascade {
     };
     
     #define CONF_ONDATA_LIBRARY     "CASCADE/ondata_library"
-    #define CONF_GROUP_LAYOUT       "CASCADE/group_layout"
+    // CONF_GROUP_LAYOUT and JSON_CONF_LAYOUT are in cascade.hpp, where the stores read the layout of their subgroups.
     #define JSON_CONF_TYPE_ALIAS    "type_alias"
-    #define JSON_CONF_LAYOUT        "layout"
     /**
      * The service will start a cascade service node to serve the client.
      */
@@ -356,6 +355,36 @@ namespace cascade {
         template <typename SubgroupType>
         derecho::rpc::QueryResults<std::tuple<persistent::version_t,uint64_t>> remove(const typename SubgroupType::KeyType& key,
                 uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "put_batch" writes a list of objects in a single ordered send. The objects share one version, so a key may
+         * appear once in the list; the later objects of a repeated key are rejected.
+         *
+         * @param objects           the objects to write, all of which must belong to the shard specified by
+         *                          shard_index. Please see "put" for the requirements on the objects.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the version and timestamp of each object. A rejected object gets INVALID_VERSION.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<std::vector<std::tuple<persistent::version_t,uint64_t>>> put_batch(
+                const std::vector<typename SubgroupType::ObjectType>& objects,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "remove_batch" deletes the objects of a list of keys in a single ordered send.
+         *
+         * @param keys              the object keys, all of which must belong to the shard specified by shard_index.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the version and timestamp of each remove.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<std::vector<std::tuple<persistent::version_t,uint64_t>>> remove_batch(
+                const std::vector<typename SubgroupType::KeyType>& keys,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
     
         /**
          * "get" retrieve the object of a given key
@@ -372,6 +401,23 @@ namespace cascade {
         template <typename SubgroupType>
         derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> get(const typename SubgroupType::KeyType& key, const persistent::version_t& version = CURRENT_VERSION,
                 uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "multi_get" retrieve the objects of a list of keys in one request
+         *
+         * @param keys              the object keys, all of which must be in the shard specified by shard_index.
+         * @param version           if version is CURRENT_VERSION, this "multi_get" will fire a single ordered send to
+         *                          get the latest states of the keys. Otherwise, it will try to read the keys' states
+         *                          at version.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the retrieved objects in the order of keys. A missing key gets an invalid object.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<std::vector<typename SubgroupType::ObjectType>> multi_get(const std::vector<typename SubgroupType::KeyType>& keys,
+                const persistent::version_t& version = CURRENT_VERSION,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
     
         /**
          * "get_by_time" retrieve the object of a given key
@@ -404,6 +450,22 @@ namespace cascade {
         derecho::rpc::QueryResults<uint64_t> get_size(const typename SubgroupType::KeyType& key, const persistent::version_t& version = CURRENT_VERSION,
                 uint32_t subgroup_index=0, uint32_t shard_index=0);
     
+        /**
+         * "head" retrieve the metadata of the object of a given key, without the blob
+         *
+         * @param key               the object key
+         * @param version           if version is CURRENT_VERSION, this "head" will fire a ordered send to get the
+         *                          metadata of the latest state of the key. Otherwise, it will try to read the key's
+         *                          metadata at version.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the retrieved metadata.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<ObjectMetadata> head(const typename SubgroupType::KeyType& key, const persistent::version_t& version = CURRENT_VERSION,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
+    
         /**
          * "get_size_by_time" retrieve size of the object of a given key
          *
@@ -418,7 +480,113 @@ namespace cascade {
         template <typename SubgroupType>
         derecho::rpc::QueryResults<uint64_t> get_size_by_time(const typename SubgroupType::KeyType& key, const uint64_t& ts_us,
                 uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "get_local" retrieve the latest object of a given key from the local state of the contacted member, without
+         * issuing an ordered send in the shard unless the local state does not satisfy the consistency level.
+         *
+         * @param key               the object key
+         * @param consistency       the consistency level, please see ReadConsistency for details.
+         * @param read_point        the request point for ReadConsistency::ReadYourWrites, generally the latest version
+         *                          the caller has observed, e.g. the version returned by its last put.
+         * @param max_staleness_us  the idle bound in microseconds for ReadConsistency::RecentlyDelivered.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the retrieved object.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> get_local(const typename SubgroupType::KeyType& key,
+                const ReadConsistency& consistency = ReadConsistency::ReadYourWrites,
+                const persistent::version_t& read_point = persistent::INVALID_VERSION,
+                const uint64_t& max_staleness_us = 0,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "get_size_local" retrieve size of the latest object of a given key from the local state of the contacted
+         * member. Please see "get_local" for the arguments.
+         *
+         * @return a future to the retrieved size.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<uint64_t> get_size_local(const typename SubgroupType::KeyType& key,
+                const ReadConsistency& consistency = ReadConsistency::ReadYourWrites,
+                const persistent::version_t& read_point = persistent::INVALID_VERSION,
+                const uint64_t& max_staleness_us = 0,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
     
+        /**
+         * "scan" retrieve a page of keys, and optionally their objects, in a shard in ascending key order.
+         *
+         * @param prefix            only the keys starting with prefix are returned. It must be empty unless the key
+         *                          type is std::string.
+         * @param start_after       the last key of the previous page, or SubgroupType::ObjectType::IK for the first
+         *                          page.
+         * @param limit             the maximum number of keys in the page, 0 for no limit other than the page size
+         *                          configured by CASCADE/scan_max_page_bytes.
+         * @param with_values       if true, the page has the objects of the keys.
+         * @param version           if version is CURRENT_VERSION, this "scan" will fire a ordered send to scan the
+         *                          latest state. Otherwise, it will scan the state at version.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the page. Keep scanning from the last key of the page while it has more.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<ScanPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> scan(
+                const std::string& prefix, const typename SubgroupType::KeyType& start_after,
+                const uint32_t& limit = 0, bool with_values = false,
+                const persistent::version_t& version = CURRENT_VERSION,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "lookup_by_index" retrieve a page of keys, and optionally their objects, in a shard by a secondary key, in
+         * ascending key order. The secondary keys are derived by the SecondaryIndexExtractor in the ondata library.
+         *
+         * @param secondary_key     the secondary key.
+         * @param start_after       the last key of the previous page, or SubgroupType::ObjectType::IK for the first
+         *                          page.
+         * @param limit             the maximum number of keys in the page, 0 for no limit other than the page size
+         *                          configured by CASCADE/scan_max_page_bytes.
+         * @param with_values       if true, the page has the objects of the keys.
+         * @param version           only CURRENT_VERSION is supported, which fires a ordered send to look up the latest
+         *                          state.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the page. Keep looking up from the last key of the page while it has more.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<ScanPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> lookup_by_index(
+                const std::string& secondary_key, const typename SubgroupType::KeyType& start_after,
+                const uint32_t& limit = 0, bool with_values = false,
+                const persistent::version_t& version = CURRENT_VERSION,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "query" evaluate a query in a shard, so that only the matching objects, their projections, or an aggregate of
+         * them are returned. Please see ShardQuery for the predicates, projections, and aggregates.
+         *
+         * @param query             the query.
+         * @param start_after       the last key of the previous page, or SubgroupType::ObjectType::IK for the first
+         *                          page.
+         * @param limit             the maximum number of matches in the page, 0 for no limit other than the page size
+         *                          configured by CASCADE/scan_max_page_bytes.
+         * @param version           if version is CURRENT_VERSION, this "query" will fire a ordered send to query the
+         *                          latest state. Otherwise, it will query the state at version.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the page. Keep querying from the last key of the page while it has more.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<QueryPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> query(
+                const ShardQuery<typename SubgroupType::KeyType>& query,
+                const typename SubgroupType::KeyType& start_after,
+                const uint32_t& limit = 0,
+                const persistent::version_t& version = CURRENT_VERSION,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
+
         /**
          * "list_keys" retrieve the list of keys in a shard
          *
@@ -447,6 +615,21 @@ namespace cascade {
         template <typename SubgroupType>
         derecho::rpc::QueryResults<std::vector<typename SubgroupType::KeyType>> list_keys_by_time(const uint64_t& ts_us,
                 uint32_t subgroup_index=0, uint32_t shard_index=0);
+
+        /**
+         * "version_at_time" resolve a timestamp to the version of the latest state of a shard no later than it, so
+         * that the reads of many keys at that time can be exact-version reads.
+         *
+         * @param ts_us             Wall clock time in microseconds.
+         * @subugroup_index         the subgroup index of CascadeType
+         * @shard_index             the shard index.
+         *
+         * @return a future to the version, which is INVALID_VERSION if there is no state at the time or the subgroup
+         *         type keeps no log.
+         */
+        template <typename SubgroupType>
+        derecho::rpc::QueryResults<persistent::version_t> version_at_time(const uint64_t& ts_us,
+                uint32_t subgroup_index=0, uint32_t shard_index=0);
     };
     
     
@@ -11,7 +11,7 @@ namespace cascade {
 /**
  * The client API
  */
-using ServiceClientAPI = ServiceClient<VCSU,VCSS,PCSU,PCSS>;
+using ServiceClientAPI = ServiceClient<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>;
 
 /**
  * Create Linq iterators on keys or versions of keys
@@ -48,7 +48,13 @@ public:
 };
 
 /**
- * Creat a Linq iterating the objects in a shard.
+ * The number of objects a shard linq fetches with one multi_get.
+ */
+#define LINQ_MULTI_GET_BATCH_SIZE   (256)
+
+/**
+ * Creat a Linq iterating the objects in a shard. The objects are fetched in batches of LINQ_MULTI_GET_BATCH_SIZE with
+ * multi_get.
  * @param key_list  This is an output argument to keep the generated key_list. Please keep it alive throughout the life
  *                  time of the Link object.
  * @param capi      The cascade client.
@@ -68,23 +74,110 @@ CascadeShardLinq<CascadeType,ServiceClientType> from_shard(
             key_list = reply_future.second.get();
         }
         /* set up storage and nextFunc*/
+        std::vector<typename CascadeType::ObjectType> batch;
+        std::size_t batch_pos = 0;
         return CascadeShardLinq<CascadeType,ServiceClientType>(capi,subgroup_index,shard_index,version,key_list,
-            [&capi,subgroup_index,shard_index,version](CascadeShardLinqStorageType<CascadeType>& _storage) {
+            [&capi,subgroup_index,shard_index,version,batch,batch_pos](CascadeShardLinqStorageType<CascadeType>& _storage) mutable {
                 if (_storage.first == _storage.second) {
                     throw boolinq::LinqEndException();
                 }
     
-                /* get object */
-                auto result = capi.template get<CascadeType>(*_storage.first,version,subgroup_index,shard_index);
+                /* get the next batch of objects */
+                if (batch_pos == batch.size()) {
+                    auto batch_end = _storage.first;
+                    for (std::size_t i = 0; i < LINQ_MULTI_GET_BATCH_SIZE && batch_end != _storage.second; i++) {
+                        batch_end++;
+                    }
+                    auto result = capi.template multi_get<CascadeType>(
+                        std::vector<typename CascadeType::KeyType>(_storage.first,batch_end),version,subgroup_index,shard_index);
+                    batch.clear();
+                    for (auto& reply_future:result.get()) {
+                        batch = reply_future.second.get();
+                        break;
+                    }
+                    batch_pos = 0;
+                    if (batch.empty()) {
+                        throw boolinq::LinqEndException();
+                    }
+                }
     
                 _storage.first++;
     
-                for (auto& reply_future:result.get()) {
-                    auto object = reply_future.second.get();
-                    return object;
+                return batch[batch_pos++];
+            });
+}
+
+/**
+ * Create a Linq iterating the objects in a shard matching a query. The query is evaluated on the shard, so only the
+ * matching objects are fetched, in pages of LINQ_MULTI_GET_BATCH_SIZE objects. The projection and the aggregate of the
+ * query are ignored; please call ServiceClient::query directly for them.
+ * @param key_list  This is an output argument to keep the keys of the matching objects. Please keep it alive
+ *                  throughout the life time of the Link object.
+ * @param capi      The cascade client.
+ * @param subgroup_index
+ * @param shard_index
+ * @param query     The query
+ * @param version
+ * @return a Linq object
+ */
+template <typename CascadeType, typename ServiceClientType>
+CascadeShardLinq<CascadeType,ServiceClientType> from_shard(
+        std::vector<typename CascadeType::KeyType>& key_list,
+        ServiceClientType& capi, uint32_t subgroup_index,
+        uint32_t shard_index, const ShardQuery<typename CascadeType::KeyType>& query,
+        persistent::version_t version) {
+        using KeyType = typename CascadeType::KeyType;
+        /* load the keys of the matches. */
+        ShardQuery<KeyType> key_query(query);
+        key_query.projection = QueryProjection::Key;
+        key_query.aggregate = QueryAggregate::None;
+        KeyType start_after = CascadeType::ObjectType::IK;
+        bool has_more = true;
+        while (has_more) {
+            auto result = capi.template query<CascadeType>(key_query,start_after,0,version,subgroup_index,shard_index);
+            has_more = false;
+            for (auto& reply_future:result.get()) {
+                auto page = reply_future.second.get();
+                key_list.insert(key_list.end(),page.keys.begin(),page.keys.end());
+                has_more = page.has_more && !page.keys.empty();
+                if (has_more) {
+                    start_after = page.keys.back();
                 }
-    
-                throw boolinq::LinqEndException();
+                break;
+            }
+        }
+        /* set up storage and nextFunc*/
+        ShardQuery<KeyType> object_query(key_query);
+        object_query.projection = QueryProjection::Object;
+        std::vector<typename CascadeType::ObjectType> batch;
+        std::size_t batch_pos = 0;
+        start_after = CascadeType::ObjectType::IK;
+        return CascadeShardLinq<CascadeType,ServiceClientType>(capi,subgroup_index,shard_index,version,key_list,
+            [&capi,subgroup_index,shard_index,version,object_query,batch,batch_pos,start_after](CascadeShardLinqStorageType<CascadeType>& _storage) mutable {
+                if (_storage.first == _storage.second) {
+                    throw boolinq::LinqEndException();
+                }
+
+                /* get the next page of matching objects */
+                if (batch_pos == batch.size()) {
+                    auto result = capi.template query<CascadeType>(object_query,start_after,LINQ_MULTI_GET_BATCH_SIZE,
+                                                                   version,subgroup_index,shard_index);
+                    batch.clear();
+                    for (auto& reply_future:result.get()) {
+                        batch = reply_future.second.get().values;
+                        break;
+                    }
+                    batch_pos = 0;
+                    // the matches might have changed since the keys were loaded unless the version is fixed.
+                    if (batch.empty()) {
+                        throw boolinq::LinqEndException();
+                    }
+                    start_after = batch.back().get_key_ref();
+                }
+
+                _storage.first++;
+
+                return batch[batch_pos++];
             });
 }
 
@@ -198,13 +291,19 @@ CascadeVersionLinq<CascadeType,ServiceClientType> from_versions(
             //     } 
             // }
 
+            // walk the versions with the metadata, and fetch the object only if it is not null.
             do {
-                auto result = capi.template get<CascadeType>(key,ver,subgroup_index,shard_index);
+                auto result = capi.template head<CascadeType>(key,ver,subgroup_index,shard_index);
                 for (auto& reply_future:result.get()) {
-                    auto object = reply_future.second.get();
-                    ver = object.previous_version_by_key; 
-                    if (!object.is_null())
-                        return object;
+                    auto metadata = reply_future.second.get();
+                    persistent::version_t cur_ver = ver;
+                    ver = metadata.previous_version_by_key;
+                    if (!metadata.is_null) {
+                        auto result_get_obj = capi.template get<CascadeType>(key,cur_ver,subgroup_index,shard_index);
+                        for (auto& reply_future_obj:result_get_obj.get()) {
+                            return reply_future_obj.second.get();
+                        }
+                    }
                 }
             } while (ver != INVALID_VERSION);
 
@@ -52,6 +52,38 @@ std::shared_ptr<CriticalDataPathObserver<PCSU>> get_critical_data_path_observer<
 template <>
 std::shared_ptr<CriticalDataPathObserver<PCSS>> get_critical_data_path_observer<PCSS>();
 
+/**
+ * The secondary index extractors
+ *
+ * Application optionally specifies how the objects are indexed for lookup_by_index by providing SecondaryIndexExtractor
+ * implementations for the Cascade subgroup types in the service, exposed like the critical data path observers:
+ *
+ * template <>
+ * std::shared_ptr<SecondaryIndexExtractor<VCSU>> get_secondary_index_extractor<VCSU>();
+ * template <>
+ * std::shared_ptr<SecondaryIndexExtractor<VCSS>> get_secondary_index_extractor<VCSS>();
+ * template <>
+ * std::shared_ptr<SecondaryIndexExtractor<PCSU>> get_secondary_index_extractor<PCSU>();
+ * template <>
+ * std::shared_ptr<SecondaryIndexExtractor<PCSS>> get_secondary_index_extractor<PCSS>();
+ *
+ * A subgroup type without an extractor has no secondary index.
+ *
+ * @return a shared pointer to the SecondaryIndexExtractor implementation. Cascade service will hold this pointer using
+ * its lifetime.
+ */
+template <typename CascadeType>
+std::shared_ptr<SecondaryIndexExtractor<CascadeType>> get_secondary_index_extractor();
+
+template <>
+std::shared_ptr<SecondaryIndexExtractor<VCSU>> get_secondary_index_extractor<VCSU>();
+template <>
+std::shared_ptr<SecondaryIndexExtractor<VCSS>> get_secondary_index_extractor<VCSS>();
+template <>
+std::shared_ptr<SecondaryIndexExtractor<PCSU>> get_secondary_index_extractor<PCSU>();
+template <>
+std::shared_ptr<SecondaryIndexExtractor<PCSS>> get_secondary_index_extractor<PCSS>();
+
 /**
  * The off critical data path observer
  *
@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include <cascade/object.hpp>
 
 namespace derecho {
@@ -8,27 +10,172 @@ ObjectWithUInt64Key ObjectWithUInt64Key::IV;
 std::string ObjectWithStringKey::IK;
 ObjectWithStringKey ObjectWithStringKey::IV;
 
+/* the compressed layout after the flagged size: the compressed size and the codec id */
+#define COMPRESSED_BLOB_HEADER_SIZE         (sizeof(std::size_t) + sizeof(std::size_t) + sizeof(uint8_t))
+/* a thread keeps the buffer for the compressed form of a blob up to this size between serializations */
+#define COMPRESSED_BLOB_CACHE_KEEP_BYTES    (1ull<<20)
+
+/* the blobs take their stamps in per-thread blocks, so that stamping a blob does not contend on one counter */
+#define BLOB_STAMP_BLOCK                    (1ull<<16)
+
+static std::atomic<uint64_t> next_blob_stamp_block{1};
+static thread_local uint64_t next_blob_stamp = 0;
+static thread_local uint64_t blob_stamp_limit = 0;
+
+/* a stamp no other blob content in the process has had, never 0 */
+static inline uint64_t new_blob_stamp() {
+    if (next_blob_stamp == blob_stamp_limit) {
+        next_blob_stamp = next_blob_stamp_block.fetch_add(BLOB_STAMP_BLOCK,std::memory_order_relaxed);
+        blob_stamp_limit = next_blob_stamp + BLOB_STAMP_BLOCK;
+    }
+    return next_blob_stamp++;
+}
+
+/**
+ * The compressed form of the blob content last measured by a thread, by its stamp. mutils asks for bytes_size()
+ * before to_bytes() or post_object(), so a blob is compressed once per serialization. A stamp is never reused, so a
+ * changed blob, or a new blob at the address of a destroyed one, never hits a stale form. compressed_blob_buffer owns
+ * the buffer.
+ */
+struct CompressedBlobCache {
+    /* 0 for none */
+    uint64_t stamp;
+    std::size_t size;
+    uint8_t codec_id;
+    /* 0 if compression does not pay off */
+    std::size_t compressed_size;
+    char* buffer;
+    std::size_t capacity;
+
+    void invalidate() {
+        stamp = 0;
+    }
+};
+
+static thread_local CompressedBlobCache compressed_blob_cache{};
+static thread_local std::unique_ptr<char[]> compressed_blob_buffer;
+
+/* drop a big buffer after it is serialized */
+static inline void release_large_compressed_buffer() {
+    if (compressed_blob_cache.capacity > COMPRESSED_BLOB_CACHE_KEEP_BYTES) {
+        compressed_blob_cache.invalidate();
+        compressed_blob_buffer.reset();
+        compressed_blob_cache.buffer = nullptr;
+        compressed_blob_cache.capacity = 0;
+    }
+}
+
+CompressedBlobCache* Blob::get_compressed_form(const Blob& blob) {
+    const BlobCompression* compression = BlobCompressionScope::current();
+    if (compression == nullptr) {
+        compression = &get_wire_compression();
+    }
+    if (!compression->applies_to(blob.size)) {
+        return nullptr;
+    }
+    auto& cache = compressed_blob_cache;
+    if (cache.stamp != blob.stamp || cache.size != blob.size || cache.codec_id != compression->codec_id) {
+        cache.stamp = blob.stamp;
+        cache.size = blob.size;
+        cache.codec_id = compression->codec_id;
+        cache.compressed_size = 0;
+        IBlobCodec* codec = BlobCodecRegistry::get(compression->codec_id);
+        // it must save an eighth of the blob; the codec gives up once it runs over.
+        std::size_t limit = blob.size - blob.size / 8;
+        if (codec != nullptr && limit > COMPRESSED_BLOB_HEADER_SIZE) {
+            limit -= COMPRESSED_BLOB_HEADER_SIZE;
+            if (cache.capacity < limit) {
+                compressed_blob_buffer.reset(new char[limit]);
+                cache.buffer = compressed_blob_buffer.get();
+                cache.capacity = limit;
+            }
+            cache.compressed_size = codec->compress(blob.bytes,blob.size,cache.buffer,limit);
+        }
+    }
+    return (cache.compressed_size > 0) ? &cache : nullptr;
+}
+
+/* the size and the flags at the head of a serialized blob */
+static inline std::size_t get_serialized_blob_header(const Blob& blob) {
+    return blob.size | (blob.is_patch ? BLOB_PATCH_FLAG : 0);
+}
+
+/* the blob size in the head of a serialized blob */
+static inline std::size_t get_serialized_blob_size(const char* const v) {
+    return ((std::size_t*)(v))[0] & ~(BLOB_COMPRESSED_FLAG | BLOB_PATCH_FLAG);
+}
+
+char* Blob::allocate(const std::size_t s) {
+    char* storage = inline_bytes;
+    if (s > BLOB_INLINE_BYTES) {
+        shared_bytes.reset(new char[s]);
+        storage = shared_bytes.get();
+    }
+    bytes = storage;
+    return storage;
+}
+
+void Blob::take(Blob& other) {
+    stamp = other.stamp;
+    other.stamp = new_blob_stamp();
+    size = other.size;
+    is_temporary = other.is_temporary;
+    is_patch = other.is_patch;
+    if (other.is_inline()) {
+        // the inline bytes cannot change hands, only be copied.
+        memcpy(inline_bytes, other.bytes, size);
+        bytes = inline_bytes;
+    } else {
+        shared_bytes = std::move(other.shared_bytes);
+        bytes = other.bytes;
+    }
+    other.bytes = nullptr;
+    other.size = 0;
+    other.is_temporary = false;
+}
+
+void Blob::release() {
+    shared_bytes.reset();
+    bytes = nullptr;
+}
+
+char* Blob::mutable_bytes() {
+    if (is_shared()) {
+        std::shared_ptr<char[]> shared = std::move(shared_bytes);
+        memcpy(allocate(size), shared.get(), size);
+    }
+    // the caller is going to change the bytes.
+    stamp = new_blob_stamp();
+    if (shared_bytes) {
+        return shared_bytes.get();
+    } else if (is_inline()) {
+        return inline_bytes;
+    }
+    // a temporary blob is constructed from writable memory of its owner.
+    return const_cast<char*>(bytes);
+}
+
 Blob::Blob(const char* const b, const decltype(size) s) :
-    bytes(nullptr), size(0), is_temporary(false) {
+    bytes(nullptr), size(0), is_temporary(false), is_patch(false), stamp(new_blob_stamp()) {
     if(s > 0) {
-        bytes = new char[s];
+        char* storage = allocate(s);
         if (b != nullptr) {
-            memcpy(bytes, b, s);
+            memcpy(storage, b, s);
         } else {
-            bzero(bytes, s);
+            bzero(storage, s);
         }
         size = s;
     }
 }
 
 Blob::Blob(char* b, const decltype(size) s, bool temporary) :
-    bytes(b), size(s), is_temporary(temporary) {
+    bytes(b), size(s), is_temporary(temporary), is_patch(false), stamp(new_blob_stamp()) {
     if ( (size>0) && (is_temporary==false)) {
-        bytes = new char[s];
+        char* storage = allocate(s);
         if (b != nullptr) {
-            memcpy(bytes, b, s);
+            memcpy(storage, b, s);
         } else {
-            bzero(bytes, s);
+            bzero(storage, s);
         }
     }
     // exclude illegal argument combination like (0x982374,0,false)
@@ -37,55 +184,80 @@ Blob::Blob(char* b, const decltype(size) s, bool temporary) :
     }
 }
 
+// the copy has the same content, and so the same stamp.
 Blob::Blob(const Blob& other) :
-    bytes(nullptr), size(0) {
-    if(other.size > 0) {
-        bytes = new char[other.size];
-        memcpy(bytes, other.bytes, other.size);
+    bytes(nullptr), size(0), is_temporary(false), is_patch(other.is_patch), stamp(other.stamp) {
+    if(other.shared_bytes) {
+        shared_bytes = other.shared_bytes;
+        bytes = other.bytes;
+        size = other.size;
+    } else if(other.size > 0) {
+        memcpy(allocate(other.size), other.bytes, other.size);
         size = other.size;
     }
 }
 
 Blob::Blob(Blob&& other) : 
-    bytes(other.bytes), size(other.size) {
-    other.bytes = nullptr;
-    other.size = 0;
+    bytes(nullptr), size(0), is_temporary(false), is_patch(false), stamp(0) {
+    take(other);
 }
 
-Blob::Blob() : bytes(nullptr), size(0) {}
+Blob::Blob() : bytes(nullptr), size(0), is_temporary(false), is_patch(false), stamp(new_blob_stamp()) {}
 
 Blob::~Blob() {
-    if(bytes && !is_temporary) {
-        delete [] bytes;
-    }
+    release();
 }
 
 Blob& Blob::operator=(Blob&& other) {
-    char* swp_bytes = other.bytes;
-    std::size_t swp_size = other.size;
-    other.bytes = bytes;
-    other.size = size;
-    bytes = swp_bytes;
-    size = swp_size;
+    if(this == &other) {
+        return *this;
+    }
+    release();
+    take(other);
     return *this;
 }
 
 Blob& Blob::operator=(const Blob& other) {
-    if(bytes != nullptr) {
-        delete bytes;
+    if(this == &other) {
+        return *this;
+    }
+    stamp = other.stamp;
+    if(other.shared_bytes) {
+        release();
+        shared_bytes = other.shared_bytes;
+        bytes = other.bytes;
+        size = other.size;
+        is_temporary = false;
+        is_patch = other.is_patch;
+        return *this;
+    }
+    // reuse the inline buffer for bytes of the same size
+    char* storage = inline_bytes;
+    if(!is_inline() || size != other.size) {
+        release();
+        is_temporary = false;
+        storage = (other.size > 0) ? allocate(other.size) : nullptr;
     }
     size = other.size;
+    is_patch = other.is_patch;
     if(size > 0) {
-        bytes = new char[size];
-        memcpy(bytes, other.bytes, size);
-    } else {
-        bytes = nullptr;
+        memcpy(storage, other.bytes, size);
     }
     return *this;
 }
 
 std::size_t Blob::to_bytes(char* v) const {
-    ((std::size_t*)(v))[0] = size;
+    CompressedBlobCache* compressed = get_compressed_form(*this);
+    if (compressed != nullptr) {
+        std::size_t compressed_size = compressed->compressed_size;
+        ((std::size_t*)(v))[0] = get_serialized_blob_header(*this) | BLOB_COMPRESSED_FLAG;
+        ((std::size_t*)(v))[1] = compressed_size;
+        v[sizeof(std::size_t) + sizeof(std::size_t)] = static_cast<char>(compressed->codec_id);
+        memcpy(v + COMPRESSED_BLOB_HEADER_SIZE, compressed->buffer, compressed_size);
+        release_large_compressed_buffer();
+        return compressed_size + COMPRESSED_BLOB_HEADER_SIZE;
+    }
+    ((std::size_t*)(v))[0] = get_serialized_blob_header(*this);
     if(size > 0) {
         memcpy(v + sizeof(size), bytes, size);
     }
@@ -93,24 +265,74 @@ std::size_t Blob::to_bytes(char* v) const {
 }
 
 std::size_t Blob::bytes_size() const {
+    const CompressedBlobCache* compressed = get_compressed_form(*this);
+    if (compressed != nullptr) {
+        return compressed->compressed_size + COMPRESSED_BLOB_HEADER_SIZE;
+    }
     return size + sizeof(size);
 }
 
 void Blob::post_object(const std::function<void(char const* const, std::size_t)>& f) const {
-    f((char*)&size, sizeof(size));
+    CompressedBlobCache* compressed = get_compressed_form(*this);
+    if (compressed != nullptr) {
+        char header[COMPRESSED_BLOB_HEADER_SIZE];
+        ((std::size_t*)(header))[0] = get_serialized_blob_header(*this) | BLOB_COMPRESSED_FLAG;
+        ((std::size_t*)(header))[1] = compressed->compressed_size;
+        header[sizeof(std::size_t) + sizeof(std::size_t)] = static_cast<char>(compressed->codec_id);
+        f(header, COMPRESSED_BLOB_HEADER_SIZE);
+        f(compressed->buffer, compressed->compressed_size);
+        release_large_compressed_buffer();
+        return;
+    }
+    std::size_t header = get_serialized_blob_header(*this);
+    f((char*)&header, sizeof(header));
     f(bytes, size);
 }
 
+Blob* Blob::decompress(const char* const v) {
+    std::size_t raw_size = get_serialized_blob_size(v);
+    std::size_t compressed_size = ((std::size_t*)(v))[1];
+    uint8_t codec_id = static_cast<uint8_t>(v[sizeof(std::size_t) + sizeof(std::size_t)]);
+    IBlobCodec* codec = BlobCodecRegistry::get(codec_id);
+    if (codec == nullptr) {
+        throw derecho::derecho_exception("Blob is compressed by an unknown codec " + std::to_string(codec_id) + ".");
+    }
+    std::unique_ptr<Blob> blob = std::make_unique<Blob>();
+    char* raw_bytes = blob->allocate(raw_size);
+    blob->size = raw_size;
+    blob->is_temporary = false;
+    blob->is_patch = (((std::size_t*)(v))[0] & BLOB_PATCH_FLAG) != 0;
+    if (!codec->decompress(v + COMPRESSED_BLOB_HEADER_SIZE, compressed_size, raw_bytes, raw_size)) {
+        throw derecho::derecho_exception("Blob is corrupted: failed to decompress it.");
+    }
+    return blob.release();
+}
+
 mutils::context_ptr<Blob> Blob::from_bytes_noalloc(mutils::DeserializationManager* ctx, const char* const v) {
-    return mutils::context_ptr<Blob>{new Blob(const_cast<char*>(v) + sizeof(std::size_t), ((std::size_t*)(v))[0], true)};
+    if (((std::size_t*)(v))[0] & BLOB_COMPRESSED_FLAG) {
+        return mutils::context_ptr<Blob>{decompress(v)};
+    }
+    mutils::context_ptr<Blob> blob{new Blob(const_cast<char*>(v) + sizeof(std::size_t), get_serialized_blob_size(v), true)};
+    blob->is_patch = (((std::size_t*)(v))[0] & BLOB_PATCH_FLAG) != 0;
+    return blob;
 }
 
 mutils::context_ptr<Blob> Blob::from_bytes_noalloc_const(mutils::DeserializationManager* ctx, const char* const v) {
-    return mutils::context_ptr<Blob>{new Blob(const_cast<char*>(v) + sizeof(std::size_t), ((std::size_t*)(v))[0], true)};
+    if (((std::size_t*)(v))[0] & BLOB_COMPRESSED_FLAG) {
+        return mutils::context_ptr<Blob>{decompress(v)};
+    }
+    mutils::context_ptr<Blob> blob{new Blob(const_cast<char*>(v) + sizeof(std::size_t), get_serialized_blob_size(v), true)};
+    blob->is_patch = (((std::size_t*)(v))[0] & BLOB_PATCH_FLAG) != 0;
+    return blob;
 }
 
 std::unique_ptr<Blob> Blob::from_bytes(mutils::DeserializationManager*, const char* const v) {
-    return std::make_unique<Blob>(v + sizeof(std::size_t), ((std::size_t*)(v))[0]);
+    if (((std::size_t*)(v))[0] & BLOB_COMPRESSED_FLAG) {
+        return std::unique_ptr<Blob>{decompress(v)};
+    }
+    auto blob = std::make_unique<Blob>(v + sizeof(std::size_t), get_serialized_blob_size(v));
+    blob->is_patch = (((std::size_t*)(v))[0] & BLOB_PATCH_FLAG) != 0;
+    return blob;
 }
 
 /*
@@ -228,6 +450,14 @@ void ObjectWithUInt64Key::set_previous_version(persistent::version_t prev_ver, p
     this->previous_version_by_key = prev_ver_by_key;
 }
 
+persistent::version_t ObjectWithUInt64Key::get_previous_version() const {
+    return this->previous_version;
+}
+
+persistent::version_t ObjectWithUInt64Key::get_previous_version_by_key() const {
+    return this->previous_version_by_key;
+}
+
 bool ObjectWithUInt64Key::verify_previous_version(persistent::version_t prev_ver, persistent::version_t prev_ver_by_key) const {
     // NOTICE: We provide the default behaviour of verify_previous_version as a demonstration. Please change the
     // following code or implementing your own Object Types with a verify_previous_version implementation to customize
@@ -238,6 +468,37 @@ bool ObjectWithUInt64Key::verify_previous_version(persistent::version_t prev_ver
            ((this->previous_version_by_key == persistent::INVALID_VERSION)?true:(this->previous_version_by_key >= prev_ver_by_key));
 }
 
+const char* ObjectWithUInt64Key::get_blob_bytes() const {
+    return this->blob.bytes;
+}
+
+std::size_t ObjectWithUInt64Key::get_blob_size() const {
+    return this->blob.size;
+}
+
+void ObjectWithUInt64Key::clear_blob() {
+    // the temporary takes over and releases the old bytes.
+    this->blob = Blob(nullptr,0);
+}
+
+bool ObjectWithUInt64Key::is_blob_patch() const {
+    return this->blob.is_patch;
+}
+
+void ObjectWithUInt64Key::set_blob(const char* bytes, const std::size_t size, const bool is_patch) {
+    this->blob = Blob(bytes,size);
+    this->blob.is_patch = is_patch;
+}
+
+void ObjectWithUInt64Key::set_blob_reference(const char* bytes, const std::size_t size) {
+    // a temporary blob does not own the bytes.
+    this->blob = Blob(const_cast<char*>(bytes),size,true);
+}
+
+void ObjectWithUInt64Key::post_object_without_blob(const std::function<void(char const* const, std::size_t)>& f) const {
+    ObjectWithUInt64Key(version,timestamp_us,previous_version,previous_version_by_key,key,Blob{}).post_object(f);
+}
+
 template <>
 ObjectWithUInt64Key create_null_object_cb<uint64_t,ObjectWithUInt64Key,&ObjectWithUInt64Key::IK,&ObjectWithUInt64Key::IV>(const uint64_t& key) {
     return ObjectWithUInt64Key(key,Blob{});
@@ -356,6 +617,14 @@ void ObjectWithStringKey::set_previous_version(persistent::version_t prev_ver, p
     this->previous_version_by_key = prev_ver_by_key;
 }
 
+persistent::version_t ObjectWithStringKey::get_previous_version() const {
+    return this->previous_version;
+}
+
+persistent::version_t ObjectWithStringKey::get_previous_version_by_key() const {
+    return this->previous_version_by_key;
+}
+
 bool ObjectWithStringKey::verify_previous_version(persistent::version_t prev_ver, persistent::version_t prev_ver_by_key) const {
     // NOTICE: We provide the default behaviour of verify_previous_version as a demonstration. Please change the
     // following code or implementing your own Object Types with a verify_previous_version implementation to customize
@@ -366,6 +635,37 @@ bool ObjectWithStringKey::verify_previous_version(persistent::version_t prev_ver
            ((this->previous_version_by_key == persistent::INVALID_VERSION)?true:(this->previous_version_by_key >= prev_ver_by_key));
 }
 
+const char* ObjectWithStringKey::get_blob_bytes() const {
+    return this->blob.bytes;
+}
+
+std::size_t ObjectWithStringKey::get_blob_size() const {
+    return this->blob.size;
+}
+
+void ObjectWithStringKey::clear_blob() {
+    // the temporary takes over and releases the old bytes.
+    this->blob = Blob(nullptr,0);
+}
+
+bool ObjectWithStringKey::is_blob_patch() const {
+    return this->blob.is_patch;
+}
+
+void ObjectWithStringKey::set_blob(const char* bytes, const std::size_t size, const bool is_patch) {
+    this->blob = Blob(bytes,size);
+    this->blob.is_patch = is_patch;
+}
+
+void ObjectWithStringKey::set_blob_reference(const char* bytes, const std::size_t size) {
+    // a temporary blob does not own the bytes.
+    this->blob = Blob(const_cast<char*>(bytes),size,true);
+}
+
+void ObjectWithStringKey::post_object_without_blob(const std::function<void(char const* const, std::size_t)>& f) const {
+    ObjectWithStringKey(version,timestamp_us,previous_version,previous_version_by_key,key,Blob{}).post_object(f);
+}
+
 template <>
 ObjectWithStringKey create_null_object_cb<std::string,ObjectWithStringKey,&ObjectWithStringKey::IK,&ObjectWithStringKey::IV>(const std::string& key) {
     return ObjectWithStringKey(key,Blob{});
@@ -123,6 +123,10 @@ static void print_red(std::string msg) {
         ft <PCSU>(__VA_ARGS__); \
     } else if ((x) == "PCSS") { \
         ft <PCSS>(__VA_ARGS__); \
+    } else if ((x) == "WBCSU") { \
+        ft <WBCSU>(__VA_ARGS__); \
+    } else if ((x) == "WBCSS") { \
+        ft <WBCSS>(__VA_ARGS__); \
     } else { \
         print_red("unknown subgroup type:" + cmd_tokens[1]); \
     }
@@ -185,6 +189,27 @@ void get(ServiceClientAPI& capi, std::string& key, persistent::version_t ver, ui
     }
 }
 
+template <typename SubgroupType>
+void multi_get(ServiceClientAPI& capi, std::vector<std::string>& keys, persistent::version_t ver, uint32_t subgroup_index, uint32_t shard_index) {
+    std::vector<typename SubgroupType::KeyType> key_list;
+    for (auto& key: keys) {
+        if constexpr (std::is_same<typename SubgroupType::KeyType,uint64_t>::value) {
+            key_list.emplace_back(static_cast<uint64_t>(std::stol(key)));
+        } else if constexpr (std::is_same<typename SubgroupType::KeyType,std::string>::value) {
+            key_list.emplace_back(key);
+        }
+    }
+    derecho::rpc::QueryResults<std::vector<typename SubgroupType::ObjectType>> result = capi.template multi_get<SubgroupType>(
+            key_list,ver,subgroup_index,shard_index);
+    for (auto& reply_future:result.get()) {
+        auto reply = reply_future.second.get();
+        std::cout << "node(" << reply_future.first << ") replied with " << reply.size() << " values:" << std::endl;
+        for (auto& value: reply) {
+            std::cout << "    " << value << std::endl;
+        }
+    }
+}
+
 template <typename SubgroupType>
 void get_by_time(ServiceClientAPI& capi, std::string& key, uint64_t ts_us, uint32_t subgroup_index, uint32_t shard_index) {
     if constexpr (std::is_same<typename SubgroupType::KeyType,uint64_t>::value) {
@@ -211,6 +236,19 @@ void get_size(ServiceClientAPI& capi, std::string& key, persistent::version_t ve
     }
 }
 
+template <typename SubgroupType>
+void head(ServiceClientAPI& capi, std::string& key, persistent::version_t ver, uint32_t subgroup_index,uint32_t shard_index) {
+    if constexpr (std::is_same<typename SubgroupType::KeyType,uint64_t>::value) {
+        derecho::rpc::QueryResults<ObjectMetadata> result = capi.template head<SubgroupType>(
+                static_cast<uint64_t>(std::stol(key)),ver,subgroup_index,shard_index);
+        check_get_result(result);
+    } else if constexpr (std::is_same<typename SubgroupType::KeyType,std::string>::value) {
+        derecho::rpc::QueryResults<ObjectMetadata> result = capi.template head<SubgroupType>(
+                key,ver,subgroup_index,shard_index);
+        check_get_result(result);
+    }
+}
+
 template <typename SubgroupType>
 void get_size_by_time(ServiceClientAPI& capi, std::string& key, uint64_t ts_us, uint32_t subgroup_index, uint32_t shard_index) {
     if constexpr (std::is_same<typename SubgroupType::KeyType,uint64_t>::value) {
@@ -225,6 +263,50 @@ void get_size_by_time(ServiceClientAPI& capi, std::string& key, uint64_t ts_us,
 }
 
 
+static const char* read_consistency_names[] = {
+    "read_your_writes",
+    "recently_delivered",
+    "local",
+    nullptr
+};
+
+inline bool parse_read_consistency_name(const std::string& name, ReadConsistency& consistency) {
+    for (int i=0;read_consistency_names[i];i++) {
+        if (name == read_consistency_names[i]) {
+            consistency = static_cast<ReadConsistency>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename SubgroupType>
+void get_local(ServiceClientAPI& capi, std::string& key, ReadConsistency consistency, persistent::version_t read_point, uint64_t max_staleness_us, uint32_t subgroup_index, uint32_t shard_index) {
+    if constexpr (std::is_same<typename SubgroupType::KeyType,uint64_t>::value) {
+        derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> result = capi.template get_local<SubgroupType>(
+                static_cast<uint64_t>(std::stol(key)),consistency,read_point,max_staleness_us,subgroup_index,shard_index);
+        check_get_result(result);
+    } else if constexpr (std::is_same<typename SubgroupType::KeyType,std::string>::value) {
+        derecho::rpc::QueryResults<const typename SubgroupType::ObjectType> result = capi.template get_local<SubgroupType>(
+                key,consistency,read_point,max_staleness_us,subgroup_index,shard_index);
+        check_get_result(result);
+    }
+}
+
+template <typename SubgroupType>
+void get_size_local(ServiceClientAPI& capi, std::string& key, ReadConsistency consistency, persistent::version_t read_point, uint64_t max_staleness_us, uint32_t subgroup_index, uint32_t shard_index) {
+    if constexpr (std::is_same<typename SubgroupType::KeyType,uint64_t>::value) {
+        derecho::rpc::QueryResults<uint64_t> result = capi.template get_size_local<SubgroupType>(
+                static_cast<uint64_t>(std::stol(key)),consistency,read_point,max_staleness_us,subgroup_index,shard_index);
+        check_get_result(result);
+    } else if constexpr (std::is_same<typename SubgroupType::KeyType,std::string>::value) {
+        derecho::rpc::QueryResults<uint64_t> result = capi.template get_size_local<SubgroupType>(
+                key,consistency,read_point,max_staleness_us,subgroup_index,shard_index);
+        check_get_result(result);
+    }
+}
+
+
 #define check_list_keys_result(result) \
     for (auto& reply_future:result.get()) {\
         auto reply = reply_future.second.get();\
@@ -247,18 +329,91 @@ void list_keys_by_time(ServiceClientAPI& capi, uint64_t ts_us, uint32_t subgroup
     check_list_keys_result(result);
 }
 
+template <typename SubgroupType>
+void version_at_time(ServiceClientAPI& capi, uint64_t ts_us, uint32_t subgroup_index, uint32_t shard_index) {
+    derecho::rpc::QueryResults<persistent::version_t> result = capi.template version_at_time<SubgroupType>(ts_us,subgroup_index,shard_index);
+    check_get_result(result);
+}
+
+template <typename SubgroupType>
+void scan(ServiceClientAPI& capi, std::string prefix, uint32_t limit, bool with_values, persistent::version_t ver, uint32_t subgroup_index, uint32_t shard_index) {
+    typename SubgroupType::KeyType start_after = SubgroupType::ObjectType::IK;
+    uint32_t page_index = 0;
+    bool has_more = true;
+    while (has_more) {
+        derecho::rpc::QueryResults<ScanPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> result =
+            capi.template scan<SubgroupType>(prefix,start_after,limit,with_values,ver,subgroup_index,shard_index);
+        has_more = false;
+        for (auto& reply_future:result.get()) {
+            auto page = reply_future.second.get();
+            std::cout << "Page " << page_index++ << " from node(" << reply_future.first << "):" << std::endl;
+            for (std::size_t i=0;i<page.keys.size();i++) {
+                std::cout << "    " << page.keys[i];
+                if (with_values) {
+                    std::cout << " : " << page.values[i];
+                }
+                std::cout << std::endl;
+            }
+            if (page.has_more && !page.keys.empty()) {
+                start_after = page.keys.back();
+                has_more = true;
+            }
+        }
+    }
+}
+
+template <typename SubgroupType>
+void lookup_by_index(ServiceClientAPI& capi, std::string secondary_key, uint32_t limit, bool with_values, uint32_t subgroup_index, uint32_t shard_index) {
+    typename SubgroupType::KeyType start_after = SubgroupType::ObjectType::IK;
+    uint32_t page_index = 0;
+    bool has_more = true;
+    while (has_more) {
+        derecho::rpc::QueryResults<ScanPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> result =
+            capi.template lookup_by_index<SubgroupType>(secondary_key,start_after,limit,with_values,CURRENT_VERSION,
+                                                        subgroup_index,shard_index);
+        has_more = false;
+        for (auto& reply_future:result.get()) {
+            auto page = reply_future.second.get();
+            std::cout << "Page " << page_index++ << " from node(" << reply_future.first << "):" << std::endl;
+            for (std::size_t i=0;i<page.keys.size();i++) {
+                std::cout << "    " << page.keys[i];
+                if (with_values) {
+                    std::cout << " : " << page.values[i];
+                }
+                std::cout << std::endl;
+            }
+            if (page.has_more && !page.keys.empty()) {
+                start_after = page.keys.back();
+                has_more = true;
+            }
+        }
+    }
+}
+
+template <typename SubgroupType>
+void aggregate_by_prefix(ServiceClientAPI& capi, std::string prefix, QueryAggregate aggregate, QueryField field, persistent::version_t ver, uint32_t subgroup_index, uint32_t shard_index) {
+    ShardQuery<typename SubgroupType::KeyType> query;
+    query.blob_prefix = prefix;
+    query.aggregate = aggregate;
+    query.aggregate_field = field;
+    derecho::rpc::QueryResults<QueryPage<typename SubgroupType::KeyType,typename SubgroupType::ObjectType>> result =
+        capi.template query<SubgroupType>(query,SubgroupType::ObjectType::IK,0,ver,subgroup_index,shard_index);
+    for (auto& reply_future:result.get()) {
+        auto page = reply_future.second.get();
+        std::cout << "node(" << reply_future.first << ") replied with aggregate=" << page.aggregate_value
+                  << " over " << page.num_matches << " objects" << std::endl;
+    }
+}
+
 #ifdef HAS_BOOLINQ
 //    "list_data_by_prefix <type> <prefix> [version] [subgroup_index] [shard_index\n\t test LINQ api\n]"
 template <typename SubgroupType>
 void list_data_by_prefix(ServiceClientAPI& capi, std::string prefix, persistent::version_t ver, uint32_t subgroup_index, uint32_t shard_index) {
     std::vector<typename SubgroupType::KeyType> keys;
-    for (auto& obj : from_shard<SubgroupType,ServiceClientAPI>(keys,capi,subgroup_index,shard_index,ver).where([&prefix](typename SubgroupType::ObjectType o){
-                if (o.blob.size < prefix.size()) {
-                    return false;
-                } else {
-                    return (std::string(o.blob.bytes,prefix.size()) == prefix);
-                }
-            }).toStdVector()) {
+    // the blob prefix is matched in the shard.
+    ShardQuery<typename SubgroupType::KeyType> query;
+    query.blob_prefix = prefix;
+    for (auto& obj : from_shard<SubgroupType,ServiceClientAPI>(keys,capi,subgroup_index,shard_index,query,ver).toStdVector()) {
         std::cout << "Found:" << obj << std::endl;
     }
 }
@@ -362,11 +517,20 @@ void interactive_test(ServiceClientAPI& capi) {
     "put <type> <key> <value> [pver(-1)] [pver_by_key(-1)] [subgroup_index(0)] [shard_index(0)]\n\tput an object\n"
     "remove <type> <key> [subgroup_index(0)] [shard_index(0)]\n\tremove an object\n"
     "get <type> <key> [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\tget an object(by version)\n"
+    "multi_get <type> <version> <subgroup_index> <shard_index> <key> [key ...]\n\tget the objects of a list of keys in one request, version -1 for the latest\n"
     "get_by_time <type> <key> <ts_us> [subgroup_index(0)] [shard_index(0)]\n\tget an object by timestamp\n"
     "get_size <type> <key> [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\tget the size of an object(by version)\n"
+    "head <type> <key> [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\tget the metadata of an object(by version) without the blob\n"
     "get_size_by_time <type> <key> <ts_us> [subgroup_index(0)] [shard_index(0)]\n\tget the size of an object by timestamp\n"
+    "get_local <type> <key> [consistency(read_your_writes)] [read_point(-1)] [max_staleness_us(0)] [subgroup_index(0)] [shard_index(0)]\n\tget the latest object from the local state of a member\n"
+    "get_size_local <type> <key> [consistency(read_your_writes)] [read_point(-1)] [max_staleness_us(0)] [subgroup_index(0)] [shard_index(0)]\n\tget the size of the latest object from the local state of a member\n"
     "list_keys <type> [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\tlist keys in shard (by version)\n"
     "list_keys_by_time <type> <ts_us> [subgroup_index(0)] [shard_index(0)]\n\tlist keys in shard by time\n"
+    "version_at_time <type> <ts_us> [subgroup_index(0)] [shard_index(0)]\n\tget the version of the shard state at a time\n"
+    "scan <type> [prefix(-)] [limit(0)] [with_values(0)] [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\tscan keys in shard page by page, prefix '-' for all keys\n"
+    "lookup_by_index <type> <secondary_key> [limit(0)] [with_values(0)] [subgroup_index(0)] [shard_index(0)]\n\tlook up keys in shard by a secondary key page by page\n"
+    "aggregate_by_prefix <type> <blob_prefix(-)> <count|sum|min|max> [field(size)] [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\taggregate the objects whose blob starts with prefix in the shard, prefix '-' for all objects\n"
+    "\tfield:=size|timestamp|version\n"
 #ifdef HAS_BOOLINQ
     "list_data_by_prefix <type> <prefix> [version(-1)] [subgroup_index(0)] [shard_index(0)]\n\t test LINQ api\n"
     "list_data_between_version <type> <key> <subgroup_index> <shard_index> [version_begin(MIN)] [version_end(MAX)]\n\t test LINQ api - version_iterator \n"
@@ -376,8 +540,9 @@ void interactive_test(ServiceClientAPI& capi) {
     "quit|exit\n\texit the client.\n"
     "help\n\tprint this message.\n"
     "\n"
-    "type:=VCSU|VCSS|PCSU|PCSS\n"
+    "type:=VCSU|VCSS|PCSU|PCSS|WBCSU|WBCSS\n"
     "policy:=FirstMember|LastMember|Random|FixedRandom|RoundRobin|UserSpecified\n"
+    "consistency:=linearizable|bounded_staleness|local\n"
     ;
     // derecho::subgroup_id_t subgroup_id;
     uint32_t subgroup_index,shard_index;
@@ -493,6 +658,16 @@ void interactive_test(ServiceClientAPI& capi) {
             if (cmd_tokens.size() >= 6)
                 shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[5]));
             on_subgroup_type(cmd_tokens[1],get,capi,cmd_tokens[2],version,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "multi_get") {
+            if (cmd_tokens.size() < 6) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            version = static_cast<persistent::version_t>(std::stol(cmd_tokens[2]));
+            subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[3]));
+            shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[4]));
+            std::vector<std::string> keys(cmd_tokens.begin()+5,cmd_tokens.end());
+            on_subgroup_type(cmd_tokens[1],multi_get,capi,keys,version,subgroup_index,shard_index);
         } else if (cmd_tokens[0] == "get_by_time") {
             if (cmd_tokens.size() < 4) {
                 print_red("Invalid format:" + cmdline);
@@ -516,6 +691,18 @@ void interactive_test(ServiceClientAPI& capi) {
             if (cmd_tokens.size() >= 6)
                 shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[5]));
             on_subgroup_type(cmd_tokens[1],get_size,capi,cmd_tokens[2],version,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "head") {
+            if (cmd_tokens.size() < 3) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            if (cmd_tokens.size() >= 4)
+                version = static_cast<persistent::version_t>(std::stol(cmd_tokens[3]));
+            if (cmd_tokens.size() >= 5)
+                subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[4]));
+            if (cmd_tokens.size() >= 6)
+                shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[5]));
+            on_subgroup_type(cmd_tokens[1],head,capi,cmd_tokens[2],version,subgroup_index,shard_index);
         } else if (cmd_tokens[0] == "get_size_by_time") {
             if (cmd_tokens.size() < 4) {
                 print_red("Invalid format:" + cmdline);
@@ -527,6 +714,31 @@ void interactive_test(ServiceClientAPI& capi) {
             if (cmd_tokens.size() >= 6)
                 shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[5]));
             on_subgroup_type(cmd_tokens[1],get_size_by_time,capi,cmd_tokens[2],ts_us,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "get_local" || cmd_tokens[0] == "get_size_local") {
+            if (cmd_tokens.size() < 3) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            ReadConsistency consistency = ReadConsistency::ReadYourWrites;
+            persistent::version_t read_point = persistent::INVALID_VERSION;
+            uint64_t max_staleness_us = 0;
+            if (cmd_tokens.size() >= 4 && !parse_read_consistency_name(cmd_tokens[3],consistency)) {
+                print_red("Invalid consistency name:" + cmd_tokens[3]);
+                continue;
+            }
+            if (cmd_tokens.size() >= 5)
+                read_point = static_cast<persistent::version_t>(std::stol(cmd_tokens[4]));
+            if (cmd_tokens.size() >= 6)
+                max_staleness_us = static_cast<uint64_t>(std::stoul(cmd_tokens[5]));
+            if (cmd_tokens.size() >= 7)
+                subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[6]));
+            if (cmd_tokens.size() >= 8)
+                shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[7]));
+            if (cmd_tokens[0] == "get_local") {
+                on_subgroup_type(cmd_tokens[1],get_local,capi,cmd_tokens[2],consistency,read_point,max_staleness_us,subgroup_index,shard_index);
+            } else {
+                on_subgroup_type(cmd_tokens[1],get_size_local,capi,cmd_tokens[2],consistency,read_point,max_staleness_us,subgroup_index,shard_index);
+            }
         } else if (cmd_tokens[0] == "list_keys") {
             if (cmd_tokens.size() < 2) {
                 print_red("Invalid format:" + cmdline);
@@ -555,6 +767,97 @@ void interactive_test(ServiceClientAPI& capi) {
                 shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[4]));
             }
             on_subgroup_type(cmd_tokens[1],list_keys_by_time,capi,ts_us,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "version_at_time") {
+            if (cmd_tokens.size() < 3) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            uint64_t ts_us = static_cast<uint64_t>(std::stoul(cmd_tokens[2]));
+            if (cmd_tokens.size() >= 4) {
+                subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[3]));
+            }
+            if (cmd_tokens.size() >= 5) {
+                shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[4]));
+            }
+            on_subgroup_type(cmd_tokens[1],version_at_time,capi,ts_us,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "scan") {
+            if (cmd_tokens.size() < 2) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            std::string prefix;
+            uint32_t limit = 0;
+            bool with_values = false;
+            if (cmd_tokens.size() >= 3 && cmd_tokens[2] != "-")
+                prefix = cmd_tokens[2];
+            if (cmd_tokens.size() >= 4)
+                limit = static_cast<uint32_t>(std::stoul(cmd_tokens[3]));
+            if (cmd_tokens.size() >= 5)
+                with_values = (std::stoi(cmd_tokens[4]) != 0);
+            if (cmd_tokens.size() >= 6)
+                version = static_cast<persistent::version_t>(std::stol(cmd_tokens[5]));
+            if (cmd_tokens.size() >= 7)
+                subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[6]));
+            if (cmd_tokens.size() >= 8)
+                shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[7]));
+            on_subgroup_type(cmd_tokens[1],scan,capi,prefix,limit,with_values,version,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "lookup_by_index") {
+            if (cmd_tokens.size() < 3) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            uint32_t limit = 0;
+            bool with_values = false;
+            if (cmd_tokens.size() >= 4)
+                limit = static_cast<uint32_t>(std::stoul(cmd_tokens[3]));
+            if (cmd_tokens.size() >= 5)
+                with_values = (std::stoi(cmd_tokens[4]) != 0);
+            if (cmd_tokens.size() >= 6)
+                subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[5]));
+            if (cmd_tokens.size() >= 7)
+                shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[6]));
+            on_subgroup_type(cmd_tokens[1],lookup_by_index,capi,cmd_tokens[2],limit,with_values,subgroup_index,shard_index);
+        } else if (cmd_tokens[0] == "aggregate_by_prefix") {
+            if (cmd_tokens.size() < 4) {
+                print_red("Invalid format:" + cmdline);
+                continue;
+            }
+            std::string prefix;
+            QueryAggregate aggregate;
+            QueryField field = QueryField::BlobSize;
+            if (cmd_tokens[2] != "-")
+                prefix = cmd_tokens[2];
+            if (cmd_tokens[3] == "count") {
+                aggregate = QueryAggregate::Count;
+            } else if (cmd_tokens[3] == "sum") {
+                aggregate = QueryAggregate::Sum;
+            } else if (cmd_tokens[3] == "min") {
+                aggregate = QueryAggregate::Min;
+            } else if (cmd_tokens[3] == "max") {
+                aggregate = QueryAggregate::Max;
+            } else {
+                print_red("Unknown aggregate:" + cmd_tokens[3]);
+                continue;
+            }
+            if (cmd_tokens.size() >= 5) {
+                if (cmd_tokens[4] == "size") {
+                    field = QueryField::BlobSize;
+                } else if (cmd_tokens[4] == "timestamp") {
+                    field = QueryField::Timestamp;
+                } else if (cmd_tokens[4] == "version") {
+                    field = QueryField::Version;
+                } else {
+                    print_red("Unknown field:" + cmd_tokens[4]);
+                    continue;
+                }
+            }
+            if (cmd_tokens.size() >= 6)
+                version = static_cast<persistent::version_t>(std::stol(cmd_tokens[5]));
+            if (cmd_tokens.size() >= 7)
+                subgroup_index = static_cast<uint32_t>(std::stoi(cmd_tokens[6]));
+            if (cmd_tokens.size() >= 8)
+                shard_index = static_cast<uint32_t>(std::stoi(cmd_tokens[7]));
+            on_subgroup_type(cmd_tokens[1],aggregate_by_prefix,capi,prefix,aggregate,field,version,subgroup_index,shard_index);
 #ifdef HAS_BOOLINQ
         } else if (cmd_tokens[0] == "list_data_by_prefix") {
             if (cmd_tokens.size() < 3) {
@@ -67,6 +67,7 @@ static StaticActionTable static_action_table;
 class ImageFrame: public ActionData,public Blob {
 public:
     std::string key;
+    // the frame shares the image bytes with the stored object.
     ImageFrame(const std::string& k, const Blob& other): Blob(other), key(k) {}
 };
 
@@ -95,7 +96,7 @@ class ClassifierFilter: public CriticalDataPathObserver<CascadeType> {
                   << " and value = " << value
                   << " . cascade_ctxt = " << cascade_ctxt 
                   << std::endl;
-        auto* ctxt = dynamic_cast<CascadeContext<VCSU,VCSS,PCSU,PCSS>*>(cascade_ctxt);
+        auto* ctxt = dynamic_cast<CascadeContext<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>*>(cascade_ctxt);
 
         // skip non VCSS subgroups
         if constexpr (std::is_same<CascadeType,VCSS>::value) {
@@ -345,7 +346,7 @@ public:
             } else {
                 std::tie(name,soft_max) = pet_ie.infer(*frame);
             }
-            auto* ctxt = dynamic_cast<CascadeContext<VCSU,VCSS,PCSU,PCSS>*>(cascade_ctxt);
+            auto* ctxt = dynamic_cast<CascadeContext<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>*>(cascade_ctxt);
             PCSS::ObjectType obj(frame->key,name.c_str(),name.size());
             auto result = ctxt->get_service_client_ref().template put<PCSS>(obj);
             for (auto& reply_future:result.get()) {
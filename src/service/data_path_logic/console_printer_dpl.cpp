@@ -27,7 +27,7 @@ class ExampleCPDO: public CriticalDataPathObserver<CascadeType> {
                   << " and value = " << value
                   << " . cascade_ctxt = " << cascade_ctxt 
                   << std::endl;
-        auto* ctxt = dynamic_cast<CascadeContext<VCSU,VCSS,PCSU,PCSS>*>(cascade_ctxt);
+        auto* ctxt = dynamic_cast<CascadeContext<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>*>(cascade_ctxt);
         Action act;
         act.action_type = static_cast<uint64_t>(typeid(CascadeType).hash_code());
         act.immediate_data = (static_cast<uint64_t>(sgidx)<<32) + shidx; // user defined type, we use subgroup_index(32bit)|shard_index(32bit)
@@ -377,11 +377,12 @@ public:
         dbg_default_trace("[{}]entering {}.", gettid(), __func__);
         ShardINode<CascadeType,ServiceClientType> *pino_shard = reinterpret_cast<ShardINode<CascadeType,ServiceClientType>*>(this->parent);
         SubgroupINode<CascadeType,ServiceClientType> *pino_subgroup = reinterpret_cast<SubgroupINode<CascadeType,ServiceClientType>*>(pino_shard->parent);
-        auto result = capi_ptr->template get_size<CascadeType>(
+        // the file is the serialized object; its size comes with the metadata, without the blob.
+        auto result = capi_ptr->template head<CascadeType>(
                 key,CURRENT_VERSION,pino_subgroup->subgroup_index,pino_shard->shard_index);
         uint64_t fsize = 0;
         for (auto& reply_future:result.get()) {
-            fsize = reply_future.second.get();
+            fsize = reply_future.second.get().object_size;
             break;
         }
         dbg_default_trace("[{}]leaving {}.", gettid(), __func__);
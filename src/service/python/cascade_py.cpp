@@ -21,6 +21,10 @@ namespace py = pybind11;
         ft <PCSU>(__VA_ARGS__); \
     } else if ((x) == "PCSS") { \
         ft <PCSS>(__VA_ARGS__); \
+    } else if ((x) == "WBCSU") { \
+        ft <WBCSU>(__VA_ARGS__); \
+    } else if ((x) == "WBCSS") { \
+        ft <WBCSS>(__VA_ARGS__); \
     } else { \
         print_red("unknown subgroup type:" + x); \
     } \
@@ -29,7 +29,7 @@ get_by_time <type> <key> <ts_us> [subgroup_index] [shard_index]\n\tget an object
 quit|exit\n\texit the client.\n\
 help\n\tprint this message.\n\
 \n\
-type:=VCSU|VCSS|PCSU|PCSS\n\
+type:=VCSU|VCSS|PCSU|PCSS|WBCSU|WBCSS\n\
 policy:=FirstMember|LastMember|Random|FixedRandom|RoundRobin|UserSpecified\n\
 "
 
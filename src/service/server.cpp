@@ -47,6 +47,14 @@ int main(int argc, char** argv) {
     std::shared_ptr<CriticalDataPathObserver<PCSU>> cdpo_pcsu_ptr;
     std::shared_ptr<CriticalDataPathObserver<VCSS>> cdpo_vcss_ptr;
     std::shared_ptr<CriticalDataPathObserver<PCSS>> cdpo_pcss_ptr;
+    std::shared_ptr<CriticalDataPathObserver<WBCSU>> cdpo_wbcsu_ptr;
+    std::shared_ptr<CriticalDataPathObserver<WBCSS>> cdpo_wbcss_ptr;
+    std::shared_ptr<SecondaryIndexExtractor<VCSU>> sie_vcsu_ptr;
+    std::shared_ptr<SecondaryIndexExtractor<PCSU>> sie_pcsu_ptr;
+    std::shared_ptr<SecondaryIndexExtractor<VCSS>> sie_vcss_ptr;
+    std::shared_ptr<SecondaryIndexExtractor<PCSS>> sie_pcss_ptr;
+    std::shared_ptr<SecondaryIndexExtractor<WBCSU>> sie_wbcsu_ptr;
+    std::shared_ptr<SecondaryIndexExtractor<WBCSS>> sie_wbcss_ptr;
     std::shared_ptr<OffCriticalDataPathObserver> ocdpo_ptr;
     void (*on_cascade_initialization)() = nullptr;
     void (*on_cascade_exit)() = nullptr;
@@ -54,6 +62,14 @@ int main(int argc, char** argv) {
     std::shared_ptr<CriticalDataPathObserver<PCSU>> (*get_cdpo_pcsu)() = nullptr;
     std::shared_ptr<CriticalDataPathObserver<VCSS>> (*get_cdpo_vcss)() = nullptr;
     std::shared_ptr<CriticalDataPathObserver<PCSS>> (*get_cdpo_pcss)() = nullptr;
+    std::shared_ptr<CriticalDataPathObserver<WBCSU>> (*get_cdpo_wbcsu)() = nullptr;
+    std::shared_ptr<CriticalDataPathObserver<WBCSS>> (*get_cdpo_wbcss)() = nullptr;
+    std::shared_ptr<SecondaryIndexExtractor<VCSU>> (*get_sie_vcsu)() = nullptr;
+    std::shared_ptr<SecondaryIndexExtractor<PCSU>> (*get_sie_pcsu)() = nullptr;
+    std::shared_ptr<SecondaryIndexExtractor<VCSS>> (*get_sie_vcss)() = nullptr;
+    std::shared_ptr<SecondaryIndexExtractor<PCSS>> (*get_sie_pcss)() = nullptr;
+    std::shared_ptr<SecondaryIndexExtractor<WBCSU>> (*get_sie_wbcsu)() = nullptr;
+    std::shared_ptr<SecondaryIndexExtractor<WBCSS>> (*get_sie_wbcss)() = nullptr;
     std::shared_ptr<OffCriticalDataPathObserver> (*get_ocdpo)() = nullptr;
     void* dl_handle = nullptr;
 
@@ -95,6 +111,14 @@ int main(int argc, char** argv) {
         if (get_cdpo_pcss == nullptr) {
             dbg_default_warn("Failed to load get_cdpo_pcss(). error={}", dlerror());
         }
+        *reinterpret_cast<void **>(&get_cdpo_wbcsu) = dlsym(dl_handle, "_ZN7derecho7cascade31get_critical_data_path_observerINS0_23WriteBehindCascadeStoreImNS0_19ObjectWithUInt64KeyEXadL_ZNS3_2IKEEEXadL_ZNS3_2IVEEEEEEESt10shared_ptrINS0_24CriticalDataPathObserverIT_EEEv");
+        if (get_cdpo_wbcsu == nullptr) {
+            dbg_default_warn("Failed to load get_cdpo_wbcsu(). error={}", dlerror());
+        }
+        *reinterpret_cast<void **>(&get_cdpo_wbcss) = dlsym(dl_handle, "_ZN7derecho7cascade31get_critical_data_path_observerINS0_23WriteBehindCascadeStoreINSt7__cxx1112basic_stringIcSt11char_traitsIcESaIcEEENS0_19ObjectWithStringKeyEXadL_ZNS9_2IKB5cxx11EEEXadL_ZNS9_2IVEEEEEEESt10shared_ptrINS0_24CriticalDataPathObserverIT_EEEv");
+        if (get_cdpo_wbcss == nullptr) {
+            dbg_default_warn("Failed to load get_cdpo_wbcss(). error={}", dlerror());
+        }
         // 4 - get the off critical data path handler
         *reinterpret_cast<void **>(&get_ocdpo) = dlsym(dl_handle, "_ZN7derecho7cascade35get_off_critical_data_path_observerEv");
         if (get_ocdpo == nullptr) {
@@ -102,6 +126,31 @@ int main(int argc, char** argv) {
             dlclose(dl_handle);
             return -1;
         }
+        // 5 - get the secondary index extractors, which are optional.
+        *reinterpret_cast<void **>(&get_sie_vcsu) = dlsym(dl_handle, "_ZN7derecho7cascade29get_secondary_index_extractorINS0_20VolatileCascadeStoreImNS0_19ObjectWithUInt64KeyEXadL_ZNS3_2IKEEEXadL_ZNS3_2IVEEEEEEESt10shared_ptrINS0_23SecondaryIndexExtractorIT_EEEv");
+        if (get_sie_vcsu == nullptr) {
+            dbg_default_debug("No get_sie_vcsu(). error={}", dlerror());
+        }
+        *reinterpret_cast<void **>(&get_sie_pcsu) = dlsym(dl_handle, "_ZN7derecho7cascade29get_secondary_index_extractorINS0_22PersistentCascadeStoreImNS0_19ObjectWithUInt64KeyEXadL_ZNS3_2IKEEEXadL_ZNS3_2IVEEELN10persistent11StorageTypeE0EEEEESt10shared_ptrINS0_23SecondaryIndexExtractorIT_EEEv");
+        if (get_sie_pcsu == nullptr) {
+            dbg_default_debug("No get_sie_pcsu(). error={}", dlerror());
+        }
+        *reinterpret_cast<void **>(&get_sie_vcss) = dlsym(dl_handle, "_ZN7derecho7cascade29get_secondary_index_extractorINS0_20VolatileCascadeStoreINSt7__cxx1112basic_stringIcSt11char_traitsIcESaIcEEENS0_19ObjectWithStringKeyEXadL_ZNS9_2IKB5cxx11EEEXadL_ZNS9_2IVEEEEEEESt10shared_ptrINS0_23SecondaryIndexExtractorIT_EEEv");
+        if (get_sie_vcss == nullptr) {
+            dbg_default_debug("No get_sie_vcss(). error={}", dlerror());
+        }
+        *reinterpret_cast<void **>(&get_sie_pcss) = dlsym(dl_handle, "_ZN7derecho7cascade29get_secondary_index_extractorINS0_22PersistentCascadeStoreINSt7__cxx1112basic_stringIcSt11char_traitsIcESaIcEEENS0_19ObjectWithStringKeyEXadL_ZNS9_2IKB5cxx11EEEXadL_ZNS9_2IVEEELN10persistent11StorageTypeE0EEEEESt10shared_ptrINS0_23SecondaryIndexExtractorIT_EEEv");
+        if (get_sie_pcss == nullptr) {
+            dbg_default_debug("No get_sie_pcss(). error={}", dlerror());
+        }
+        *reinterpret_cast<void **>(&get_sie_wbcsu) = dlsym(dl_handle, "_ZN7derecho7cascade29get_secondary_index_extractorINS0_23WriteBehindCascadeStoreImNS0_19ObjectWithUInt64KeyEXadL_ZNS3_2IKEEEXadL_ZNS3_2IVEEEEEEESt10shared_ptrINS0_23SecondaryIndexExtractorIT_EEEv");
+        if (get_sie_wbcsu == nullptr) {
+            dbg_default_debug("No get_sie_wbcsu(). error={}", dlerror());
+        }
+        *reinterpret_cast<void **>(&get_sie_wbcss) = dlsym(dl_handle, "_ZN7derecho7cascade29get_secondary_index_extractorINS0_23WriteBehindCascadeStoreINSt7__cxx1112basic_stringIcSt11char_traitsIcESaIcEEENS0_19ObjectWithStringKeyEXadL_ZNS9_2IKB5cxx11EEEXadL_ZNS9_2IVEEEEEEESt10shared_ptrINS0_23SecondaryIndexExtractorIT_EEEv");
+        if (get_sie_wbcss == nullptr) {
+            dbg_default_debug("No get_sie_wbcss(). error={}", dlerror());
+        }
     }
 
     // initialize
@@ -122,32 +171,62 @@ int main(int argc, char** argv) {
     if (get_cdpo_pcss) {
         cdpo_pcss_ptr = std::move(get_cdpo_pcss());
     }
+    if (get_cdpo_wbcsu) {
+        cdpo_wbcsu_ptr = std::move(get_cdpo_wbcsu());
+    }
+    if (get_cdpo_wbcss) {
+        cdpo_wbcss_ptr = std::move(get_cdpo_wbcss());
+    }
+    if (get_sie_vcsu) {
+        sie_vcsu_ptr = std::move(get_sie_vcsu());
+    }
+    if (get_sie_pcsu) {
+        sie_pcsu_ptr = std::move(get_sie_pcsu());
+    }
+    if (get_sie_vcss) {
+        sie_vcss_ptr = std::move(get_sie_vcss());
+    }
+    if (get_sie_pcss) {
+        sie_pcss_ptr = std::move(get_sie_pcss());
+    }
+    if (get_sie_wbcsu) {
+        sie_wbcsu_ptr = std::move(get_sie_wbcsu());
+    }
+    if (get_sie_wbcss) {
+        sie_wbcss_ptr = std::move(get_sie_wbcss());
+    }
     if (get_ocdpo) {
         ocdpo_ptr = std::move(get_ocdpo());
     }
 
-    auto vcsu_factory = [&cdpo_vcsu_ptr](persistent::PersistentRegistry*, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
-        return std::make_unique<VCSU>(cdpo_vcsu_ptr.get(),context_ptr);
+    auto vcsu_factory = [&cdpo_vcsu_ptr,&sie_vcsu_ptr](persistent::PersistentRegistry*, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
+        return std::make_unique<VCSU>(cdpo_vcsu_ptr.get(),context_ptr,sie_vcsu_ptr.get());
+    };
+    auto vcss_factory = [&cdpo_vcss_ptr,&sie_vcss_ptr](persistent::PersistentRegistry*, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
+        return std::make_unique<VCSS>(cdpo_vcss_ptr.get(),context_ptr,sie_vcss_ptr.get());
+    };
+    auto pcsu_factory = [&cdpo_pcsu_ptr,&sie_pcsu_ptr](persistent::PersistentRegistry* pr, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
+        return std::make_unique<PCSU>(pr,cdpo_pcsu_ptr.get(),context_ptr,sie_pcsu_ptr.get());
     };
-    auto vcss_factory = [&cdpo_vcss_ptr](persistent::PersistentRegistry*, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
-        return std::make_unique<VCSS>(cdpo_vcss_ptr.get(),context_ptr);
+    auto pcss_factory = [&cdpo_pcss_ptr,&sie_pcss_ptr](persistent::PersistentRegistry* pr, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
+        return std::make_unique<PCSS>(pr,cdpo_pcss_ptr.get(),context_ptr,sie_pcss_ptr.get());
     };
-    auto pcsu_factory = [&cdpo_pcsu_ptr](persistent::PersistentRegistry* pr, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
-        return std::make_unique<PCSU>(pr,cdpo_pcsu_ptr.get(),context_ptr);
+    auto wbcsu_factory = [&cdpo_wbcsu_ptr,&sie_wbcsu_ptr](persistent::PersistentRegistry* pr, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
+        return std::make_unique<WBCSU>(pr,cdpo_wbcsu_ptr.get(),context_ptr,sie_wbcsu_ptr.get());
     };
-    auto pcss_factory = [&cdpo_pcss_ptr](persistent::PersistentRegistry* pr, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
-        return std::make_unique<PCSS>(pr,cdpo_pcss_ptr.get(),context_ptr);
+    auto wbcss_factory = [&cdpo_wbcss_ptr,&sie_wbcss_ptr](persistent::PersistentRegistry* pr, derecho::subgroup_id_t, ICascadeContext* context_ptr) {
+        return std::make_unique<WBCSS>(pr,cdpo_wbcss_ptr.get(),context_ptr,sie_wbcss_ptr.get());
     };
     dbg_default_trace("starting service...");
-    Service<VCSU,VCSS,PCSU,PCSS>::start(group_layout,ocdpo_ptr.get(),{cdpo_vcsu_ptr.get(),cdpo_vcss_ptr.get(),cdpo_pcsu_ptr.get(),cdpo_pcss_ptr.get()},vcsu_factory,vcss_factory,pcsu_factory,pcss_factory);
+    Service<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>::start(group_layout,ocdpo_ptr.get(),{cdpo_vcsu_ptr.get(),cdpo_vcss_ptr.get(),cdpo_pcsu_ptr.get(),cdpo_pcss_ptr.get(),cdpo_wbcsu_ptr.get(),cdpo_wbcss_ptr.get(),sie_vcsu_ptr.get(),sie_vcss_ptr.get(),sie_pcsu_ptr.get(),sie_pcss_ptr.get(),sie_wbcsu_ptr.get(),sie_wbcss_ptr.get()},vcsu_factory,vcss_factory,pcsu_factory,pcss_factory,wbcsu_factory,wbcss_factory);
     dbg_default_trace("started service, waiting till it ends.");
     std::cout << "Press Enter to Shutdown." << std::endl;
     std::cin.get();
     // wait for service to quit.
-    Service<VCSU,VCSS,PCSU,PCSS>::shutdown(false);
+    Service<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>::shutdown(false);
     dbg_default_trace("shutdown service gracefully");
     // you can do something here to parallel the destructing process.
-    Service<VCSU,VCSS,PCSU,PCSS>::wait();
+    Service<VCSU,VCSS,PCSU,PCSS,WBCSU,WBCSS>::wait();
     dbg_default_trace("Finish shutdown.");
 
     // exit
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <cascade/detail/blob_codec.hpp>
+#include <cascade/object.hpp>
+
+/**
+ * blob_codec_test checks the built-in LZ codec and the compressed form of a serialized Blob:
+ * 1) round trip:   compress() and decompress() restore empty, tiny, text, repetitive, and random inputs, with the
+ *                  literal and match lengths on both sides of the length extension thresholds, and matches at the
+ *                  edge of the 64KB window.
+ * 2) bounds:       compress() fits in max_compressed_size(), and returns 0 instead of writing past a small buffer.
+ * 3) corruption:   decompress() rejects a wrong raw size, truncated input, and random byte flips without reading or
+ *                  writing out of bounds.
+ * 4) blob format:  a Blob serialized in a BlobCompressionScope has the compressed header only if LZ saves an eighth
+ *                  of it, and deserializes to the same bytes.
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+std::vector<std::vector<char>> make_inputs() {
+    std::mt19937_64 rng(17);
+    std::vector<std::vector<char>> inputs;
+    inputs.emplace_back();
+    for (std::size_t size: {1,3,4,5,12,13,16}) {
+        inputs.emplace_back(size,'a');
+    }
+    std::string text;
+    while (text.size() < 100000) {
+        text += "the quick brown fox jumps over the lazy dog " + std::to_string(rng() % 1000) + "\n";
+    }
+    inputs.emplace_back(text.begin(),text.end());
+    // literal and match lengths around 15 and 15+255, where the length extensions start and grow a byte.
+    for (std::size_t length: {14,15,16,269,270,271,1000}) {
+        std::vector<char> input;
+        for (std::size_t i = 0; i < length; i++) {
+            input.push_back(static_cast<char>(rng()));
+        }
+        input.insert(input.end(),length,'x');
+        for (std::size_t i = 0; i < 8; i++) {
+            input.push_back(static_cast<char>(rng()));
+        }
+        inputs.emplace_back(std::move(input));
+    }
+    // a block repeated at the edge of the 64KB window, and just beyond it.
+    for (std::size_t distance: {65535,65536}) {
+        std::vector<char> input(distance + 64);
+        for (auto& c: input) {
+            c = static_cast<char>(rng());
+        }
+        std::copy(input.begin(),input.begin() + 64,input.begin() + distance);
+        inputs.emplace_back(std::move(input));
+    }
+    std::vector<char> random_bytes(300000);
+    for (auto& c: random_bytes) {
+        c = static_cast<char>(rng());
+    }
+    inputs.emplace_back(std::move(random_bytes));
+    return inputs;
+}
+
+bool test_round_trip(const IBlobCodec& codec, const std::vector<char>& input) {
+    std::vector<char> compressed(codec.max_compressed_size(input.size()));
+    const std::size_t compressed_size = codec.compress(input.data(),input.size(),compressed.data(),compressed.size());
+    CHECK(compressed_size > 0 || input.empty());
+    CHECK(compressed_size <= compressed.size());
+    std::vector<char> output(input.size());
+    CHECK(codec.decompress(compressed.data(),compressed_size,output.data(),output.size()));
+    CHECK(output == input);
+    // the buffers are exact, so that the sanitizers catch any access beyond them.
+    if (compressed_size > 1) {
+        std::vector<char> short_buffer(compressed_size - 1);
+        CHECK(codec.compress(input.data(),input.size(),short_buffer.data(),short_buffer.size()) == 0);
+        std::vector<char> truncated(compressed.begin(),compressed.begin() + compressed_size - 1);
+        CHECK(!codec.decompress(truncated.data(),truncated.size(),output.data(),output.size()));
+    }
+    if (!input.empty()) {
+        std::vector<char> short_output(input.size() - 1);
+        CHECK(!codec.decompress(compressed.data(),compressed_size,short_output.data(),short_output.size()));
+        std::vector<char> long_output(input.size() + 1);
+        CHECK(!codec.decompress(compressed.data(),compressed_size,long_output.data(),long_output.size()));
+    }
+    return true;
+}
+
+bool test_corruption(const IBlobCodec& codec, const std::vector<char>& input) {
+    std::mt19937_64 rng(input.size());
+    std::vector<char> compressed(codec.max_compressed_size(input.size()));
+    compressed.resize(codec.compress(input.data(),input.size(),compressed.data(),compressed.size()));
+    std::vector<char> output(input.size());
+    for (int i = 0; i < 1000 && !compressed.empty(); i++) {
+        std::vector<char> corrupted(compressed);
+        for (int flips = 1 + rng() % 4; flips > 0; flips--) {
+            corrupted[rng() % corrupted.size()] ^= static_cast<char>(1 + rng() % 255);
+        }
+        // a corrupted input may still decode to raw_size bytes, but never out of bounds.
+        codec.decompress(corrupted.data(),corrupted.size(),output.data(),output.size());
+    }
+    return true;
+}
+
+bool test_blob_format() {
+    std::string text;
+    while (text.size() < 10000) {
+        text += "a compressible line of text\n";
+    }
+    std::mt19937_64 rng(3);
+    std::string random_bytes(10000,'\0');
+    for (auto& c: random_bytes) {
+        c = static_cast<char>(rng());
+    }
+    const BlobCompression lz(BlobCodecRegistry::get_id(BLOB_CODEC_NAME_LZ),1024);
+    const BlobCompression none;
+    struct Case {
+        const std::string& bytes;
+        const BlobCompression& compression;
+        bool compressed;
+    };
+    std::string small(100,'a');
+    for (const Case& c: {Case{text,lz,true}, Case{random_bytes,lz,false}, Case{small,lz,false}, Case{text,none,false}}) {
+        BlobCompressionScope scope(c.compression);
+        Blob blob(c.bytes.data(),c.bytes.size());
+        std::vector<char> buf(mutils::bytes_size(blob));
+        CHECK(mutils::to_bytes(blob,buf.data()) == buf.size());
+        const std::size_t header = reinterpret_cast<const std::size_t*>(buf.data())[0];
+        CHECK(((header & BLOB_COMPRESSED_FLAG) != 0) == c.compressed);
+        CHECK((header & ~BLOB_COMPRESSED_FLAG) == c.bytes.size());
+        if (c.compressed) {
+            CHECK(buf.size() <= c.bytes.size() - c.bytes.size()/8);
+        } else {
+            CHECK(buf.size() == c.bytes.size() + sizeof(std::size_t));
+        }
+        std::vector<char> posted;
+        mutils::post_object([&posted](char const* const bytes, std::size_t size){
+            posted.insert(posted.end(),bytes,bytes+size);
+        },blob);
+        CHECK(posted == buf);
+        auto restored = mutils::from_bytes<Blob>(nullptr,buf.data());
+        CHECK(restored->size == c.bytes.size());
+        CHECK(std::string(restored->bytes,restored->size) == c.bytes);
+    }
+    return true;
+}
+
+int main() {
+    IBlobCodec* codec = BlobCodecRegistry::get(BLOB_CODEC_LZ);
+    bool ok = (codec != nullptr) && (BlobCodecRegistry::get(BLOB_CODEC_NONE) == nullptr) &&
+              (BlobCodecRegistry::get_id(BLOB_CODEC_NAME_LZ) == BLOB_CODEC_LZ);
+    for (const auto& input: make_inputs()) {
+        ok = ok && test_round_trip(*codec,input) && test_corruption(*codec,input);
+    }
+    std::cout << "LZBlobCodec: " << (ok ? "passed" : "FAILED") << std::endl;
+    const bool blob_ok = test_blob_format();
+    std::cout << "compressed Blob: " << (blob_ok ? "passed" : "FAILED") << std::endl;
+    return (ok && blob_ok) ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <limits>
+#include <string>
+#include <cascade/detail/blob_patch.hpp>
+
+/**
+ * blob_patch_test checks the BlobPatch encoder and decoder:
+ * 1) round trip:   a patch decodes to the target for edits in place, insertions, deletions, appends, prepends, an
+ *                  empty base or target, a base shorter than a block, and an unrelated target.
+ * 2) size:         an edit of a few bytes in a large blob makes a small patch, and the encoder gives up beyond
+ *                  max_patch_size.
+ * 3) corruption:   the decoder rejects truncated patches, unknown operations, copies beyond the base, and a patch
+ *                  against a shorter base, and survives random byte flips without reading or writing out of bounds.
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+std::vector<char> random_bytes(std::mt19937_64& rng, const std::size_t size) {
+    std::vector<char> bytes(size);
+    for (auto& c: bytes) {
+        c = static_cast<char>(rng());
+    }
+    return bytes;
+}
+
+bool check_round_trip(const std::vector<char>& base, const std::vector<char>& target, std::size_t* patch_size = nullptr) {
+    std::vector<char> patch;
+    CHECK(BlobPatch::encode(base.data(),base.size(),target.data(),target.size(),patch,
+                            std::numeric_limits<std::size_t>::max()));
+    std::vector<char> decoded;
+    CHECK(BlobPatch::decode(base.data(),base.size(),patch.data(),patch.size(),decoded));
+    CHECK(decoded == target);
+    if (patch_size != nullptr) {
+        *patch_size = patch.size();
+    }
+    return true;
+}
+
+bool test_edits() {
+    std::mt19937_64 rng(18);
+    const std::vector<char> base = random_bytes(rng,1 << 20);
+    std::size_t patch_size = 0;
+    // an edit in place.
+    std::vector<char> target(base);
+    target[500000] ^= 1;
+    target[500001] ^= 1;
+    CHECK(check_round_trip(base,target,&patch_size));
+    CHECK(patch_size < 64);
+    // an insertion, a deletion, an append, and a prepend.
+    target = base;
+    target.insert(target.begin() + 300000,100,'i');
+    CHECK(check_round_trip(base,target,&patch_size));
+    CHECK(patch_size < 200);
+    target = base;
+    target.erase(target.begin() + 700000,target.begin() + 700100);
+    CHECK(check_round_trip(base,target,&patch_size));
+    CHECK(patch_size < 64);
+    target = base;
+    target.insert(target.end(),1000,'a');
+    CHECK(check_round_trip(base,target));
+    target = base;
+    target.insert(target.begin(),1000,'p');
+    CHECK(check_round_trip(base,target));
+    // many scattered edits.
+    target = base;
+    for (int i = 0; i < 1000; i++) {
+        target[rng() % target.size()] = static_cast<char>(rng());
+    }
+    CHECK(check_round_trip(base,target));
+    // the edge cases.
+    CHECK(check_round_trip({},{}));
+    CHECK(check_round_trip({},random_bytes(rng,100)));
+    CHECK(check_round_trip(random_bytes(rng,100),{}));
+    CHECK(check_round_trip(random_bytes(rng,10),random_bytes(rng,10)));
+    CHECK(check_round_trip(base,random_bytes(rng,4096)));
+    CHECK(check_round_trip(std::vector<char>(100000,'z'),std::vector<char>(200000,'z')));
+    return true;
+}
+
+bool test_max_patch_size() {
+    std::mt19937_64 rng(19);
+    const std::vector<char> base = random_bytes(rng,1 << 16);
+    const std::vector<char> unrelated = random_bytes(rng,1 << 16);
+    std::vector<char> patch;
+    // an unrelated target is all ADD, larger than itself.
+    CHECK(!BlobPatch::encode(base.data(),base.size(),unrelated.data(),unrelated.size(),patch,unrelated.size()));
+    std::vector<char> target(base);
+    target[100] ^= 1;
+    CHECK(BlobPatch::encode(base.data(),base.size(),target.data(),target.size(),patch,64));
+    CHECK(patch.size() <= 64);
+    CHECK(!BlobPatch::encode(base.data(),base.size(),target.data(),target.size(),patch,4));
+    return true;
+}
+
+bool test_corruption() {
+    std::mt19937_64 rng(20);
+    const std::vector<char> base = random_bytes(rng,1 << 16);
+    std::vector<char> target(base);
+    for (int i = 0; i < 20; i++) {
+        target[rng() % target.size()] = static_cast<char>(rng());
+    }
+    std::vector<char> patch;
+    CHECK(BlobPatch::encode(base.data(),base.size(),target.data(),target.size(),patch,
+                            std::numeric_limits<std::size_t>::max()));
+    std::vector<char> decoded;
+    // every truncation fails: the patch ends short of the target size.
+    for (std::size_t size = 0; size < patch.size(); size++) {
+        std::vector<char> truncated(patch.begin(),patch.begin() + size);
+        CHECK(!BlobPatch::decode(base.data(),base.size(),truncated.data(),truncated.size(),decoded));
+    }
+    // a shorter base does not have the bytes the COPYs refer to.
+    CHECK(!BlobPatch::decode(base.data(),base.size()/2,patch.data(),patch.size(),decoded));
+    // an unknown operation.
+    std::vector<char> bad_op = {4, 9, 'a', 'b', 'c', 'd'};
+    CHECK(!BlobPatch::decode(base.data(),base.size(),bad_op.data(),bad_op.size(),decoded));
+    // a COPY beyond the base: target size 8, COPY at 65535 of 8 bytes.
+    std::vector<char> bad_copy = {8, 0, static_cast<char>(0xff), static_cast<char>(0xff), 3, 8};
+    CHECK(!BlobPatch::decode(base.data(),base.size(),bad_copy.data(),bad_copy.size(),decoded));
+    // a target size no patch of this size could produce.
+    std::vector<char> huge_target = {static_cast<char>(0xff), static_cast<char>(0xff), static_cast<char>(0xff),
+                                     static_cast<char>(0xff), static_cast<char>(0xff), static_cast<char>(0xff),
+                                     static_cast<char>(0xff), 0x7f, 1, 1, 'a'};
+    CHECK(!BlobPatch::decode(base.data(),base.size(),huge_target.data(),huge_target.size(),decoded));
+    // the flipped bytes may still decode, but never out of bounds.
+    for (int i = 0; i < 10000; i++) {
+        std::vector<char> corrupted(patch);
+        for (int flips = 1 + rng() % 4; flips > 0; flips--) {
+            corrupted[rng() % corrupted.size()] ^= static_cast<char>(1 + rng() % 255);
+        }
+        BlobPatch::decode(base.data(),base.size(),corrupted.data(),corrupted.size(),decoded);
+    }
+    return true;
+}
+
+int main() {
+    const bool ok = test_edits() && test_max_patch_size() && test_corruption();
+    std::cout << "BlobPatch: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cascade/cascade.hpp>
+
+/**
+ * blob_tier_test checks the value file of BlobTier and the layout it saves for the next run, the way
+ * PersistentCascadeStore keeps them across a clean restart:
+ * 1) layout:       save() writes [file size][number of segments]([mapped][file offset][capacity][used][live])*
+ *                  [number of free segments]([segment])*[active segment][number of cold blobs]([key][segment][offset]
+ *                  [size])*.
+ * 2) restart:      a tier reopened with the saved layout maps the same cold blobs, and keeps the saved state until
+ *                  the value file changes.
+ * 3) validation:   a value file shorter than its layout is not mapped.
+ * 4) lifetime:     the value file is removed on destruction once it no longer matches a saved state, and a value file
+ *                  left by the last run is neither truncated nor stripped of its saved state until the first write.
+ * It runs in a scratch directory under the working directory, needs no Derecho group, and returns a non-zero exit
+ * code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+using Tier = BlobTier<uint64_t>;
+
+bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(),&st) == 0;
+}
+
+uint64_t file_size_of(const std::string& path) {
+    struct stat st;
+    return (stat(path.c_str(),&st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+/* save the layout of a tier to the state file, as save_blob_tier_state() does */
+bool save_layout(Tier& tier, const std::string& state_file, std::vector<char>& layout) {
+    layout.clear();
+    CHECK(tier.save([&layout](char const* const bytes, std::size_t size){
+        layout.insert(layout.end(),bytes,bytes+size);
+    }));
+    std::ofstream ofs(state_file,std::ios::binary|std::ios::trunc);
+    ofs.write(layout.data(),layout.size());
+    CHECK(static_cast<bool>(ofs));
+    tier.keep_value_file();
+    return true;
+}
+
+bool check_cold_blobs(const Tier& tier, const std::map<uint64_t,std::string>& blobs) {
+    uint64_t cold_bytes = 0;
+    for (const auto& kv: blobs) {
+        uint64_t size = 0;
+        const char* bytes = tier.get_cold_blob(kv.first,size);
+        CHECK(bytes != nullptr);
+        CHECK(std::string(bytes,size) == kv.second);
+        cold_bytes += size;
+    }
+    CHECK(tier.get_cold_bytes() == cold_bytes);
+    uint64_t size = 0;
+    CHECK(tier.get_cold_blob(12345678,size) == nullptr);
+    return true;
+}
+
+bool put_blobs(Tier& tier, std::map<uint64_t,std::string>& blobs) {
+    for (uint64_t key = 0; key < 100; key++) {
+        blobs[key] = std::string(100 + key*13,static_cast<char>('a' + key%26));
+        const char* copy = tier.put_cold(key,blobs[key].data(),blobs[key].size());
+        CHECK(copy != nullptr);
+        CHECK(std::string(copy,blobs[key].size()) == blobs[key]);
+    }
+    return true;
+}
+
+bool test_layout(const std::string& dir) {
+    const std::string value_file = dir + "/layout.values";
+    const std::string state_file = value_file + ".state";
+    Tier tier;
+    CHECK(tier.open(value_file,state_file));
+    CHECK(tier.is_open());
+    std::map<uint64_t,std::string> blobs;
+    CHECK(put_blobs(tier,blobs));
+    std::vector<char> layout;
+    CHECK(save_layout(tier,state_file,layout));
+    const char* p = layout.data();
+    auto read = [&p](auto& v) {
+        memcpy(&v,p,sizeof(v));
+        p += sizeof(v);
+    };
+    uint64_t file_size = 0;
+    std::size_t num_segments = 0;
+    read(file_size);
+    read(num_segments);
+    CHECK(file_size == Tier::SEGMENT_SIZE);
+    CHECK(num_segments == 1);
+    bool mapped = false;
+    uint64_t file_offset = 0, capacity = 0, used = 0, live = 0;
+    read(mapped);
+    read(file_offset);
+    read(capacity);
+    read(used);
+    read(live);
+    uint64_t expected_used = 0, expected_live = 0;
+    for (const auto& kv: blobs) {
+        expected_used += (kv.second.size() + 7) & ~7ull;
+        expected_live += kv.second.size();
+    }
+    CHECK(mapped && file_offset == 0 && capacity == Tier::SEGMENT_SIZE);
+    CHECK(used == expected_used && live == expected_live);
+    std::size_t num_free_segments = 0;
+    uint64_t active_segment = 0;
+    std::size_t num_cold_blobs = 0;
+    read(num_free_segments);
+    read(active_segment);
+    read(num_cold_blobs);
+    CHECK(num_free_segments == 0 && active_segment == 0 && num_cold_blobs == blobs.size());
+    std::map<uint64_t,std::string> listed;
+    for (std::size_t i = 0; i < num_cold_blobs; i++) {
+        uint64_t key = 0, segment = 0, offset = 0, size = 0;
+        read(key);
+        read(segment);
+        read(offset);
+        read(size);
+        CHECK(segment == 0 && offset % 8 == 0 && offset + size <= used);
+        CHECK(blobs.count(key) == 1 && blobs[key].size() == size);
+    }
+    CHECK(p == layout.data() + layout.size());
+    return true;
+}
+
+bool test_restart(const std::string& dir) {
+    const std::string value_file = dir + "/restart.values";
+    const std::string state_file = value_file + ".state";
+    std::map<uint64_t,std::string> blobs;
+    std::vector<char> layout;
+    {
+        Tier tier;
+        CHECK(tier.open(value_file,state_file));
+        CHECK(put_blobs(tier,blobs));
+        // a removed key gives its bytes back.
+        tier.on_erase(7);
+        blobs.erase(7);
+        CHECK(check_cold_blobs(tier,blobs));
+        CHECK(save_layout(tier,state_file,layout));
+    }
+    // the value file outlives the tier with its saved layout.
+    CHECK(file_exists(value_file) && file_exists(state_file));
+    {
+        Tier tier;
+        CHECK(tier.reopen(value_file,state_file,layout.data()) == layout.size());
+        CHECK(tier.is_open());
+        CHECK(check_cold_blobs(tier,blobs));
+        // nothing changed yet, so the saved state still matches the value file.
+        CHECK(file_exists(state_file));
+        const std::string blob(5000,'n');
+        CHECK(tier.put_cold(1000,blob.data(),blob.size()) != nullptr);
+        blobs[1000] = blob;
+        CHECK(!file_exists(state_file));
+        CHECK(check_cold_blobs(tier,blobs));
+    }
+    // the value file changed after its layout was saved, so it is gone.
+    CHECK(!file_exists(value_file));
+    return true;
+}
+
+bool test_validation(const std::string& dir) {
+    const std::string value_file = dir + "/validation.values";
+    const std::string state_file = value_file + ".state";
+    std::map<uint64_t,std::string> blobs;
+    std::vector<char> layout;
+    {
+        Tier tier;
+        CHECK(tier.open(value_file,state_file));
+        CHECK(put_blobs(tier,blobs));
+        CHECK(save_layout(tier,state_file,layout));
+    }
+    // a value file cut short by something else does not match its layout.
+    CHECK(truncate(value_file.c_str(),4096) == 0);
+    Tier tier;
+    CHECK(tier.reopen(value_file,state_file,layout.data()) == 0);
+    CHECK(!tier.is_open());
+    uint64_t size = 0;
+    CHECK(tier.get_cold_blob(0,size) == nullptr);
+    // a missing value file does not match either.
+    std::remove(value_file.c_str());
+    CHECK(tier.reopen(value_file,state_file,layout.data()) == 0);
+    std::remove(state_file.c_str());
+    return true;
+}
+
+bool test_open_keeps_last_run(const std::string& dir) {
+    const std::string value_file = dir + "/open.values";
+    const std::string state_file = value_file + ".state";
+    std::map<uint64_t,std::string> blobs;
+    std::vector<char> layout;
+    {
+        Tier tier;
+        CHECK(tier.open(value_file,state_file));
+        CHECK(put_blobs(tier,blobs));
+        CHECK(save_layout(tier,state_file,layout));
+    }
+    const uint64_t last_run_size = file_size_of(value_file);
+    CHECK(last_run_size == Tier::SEGMENT_SIZE);
+    {
+        // a tier opened without the saved state leaves the last run alone until it writes.
+        Tier tier;
+        CHECK(tier.open(value_file,state_file));
+        CHECK(tier.get_cold_bytes() == 0);
+        CHECK(file_size_of(value_file) == last_run_size);
+        CHECK(file_exists(state_file));
+    }
+    CHECK(file_exists(value_file) && file_exists(state_file));
+    {
+        // the last run is still there to be mapped.
+        Tier tier;
+        CHECK(tier.reopen(value_file,state_file,layout.data()) == layout.size());
+        CHECK(check_cold_blobs(tier,blobs));
+    }
+    {
+        // the first write drops the saved state, and the value file starts over.
+        Tier tier;
+        CHECK(tier.open(value_file,state_file));
+        const std::string blob(100,'w');
+        CHECK(tier.put_cold(1,blob.data(),blob.size()) != nullptr);
+        CHECK(!file_exists(state_file));
+        CHECK(check_cold_blobs(tier,{{1,blob}}));
+    }
+    CHECK(!file_exists(value_file));
+    return true;
+}
+
+int main() {
+    char dir_template[] = "blob_tier_test.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        std::cerr << "failed to create the scratch directory." << std::endl;
+        return 1;
+    }
+    const std::string dir(dir_template);
+    const bool ok = test_layout(dir) &&
+                    test_restart(dir) &&
+                    test_validation(dir) &&
+                    test_open_keeps_last_run(dir);
+    for (const char* name: {"layout.values", "layout.values.state", "restart.values", "restart.values.state",
+                            "validation.values", "validation.values.state", "open.values", "open.values.state"}) {
+        std::remove((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+    std::cout << "BlobTier: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cascade/cascade.hpp>
+#include <cascade/object.hpp>
+
+/**
+ * delta_format_test checks the log entries of DeltaCascadeStoreCore, as finalizeCurrentDelta hands them to the log
+ * and as LoggedObjects reads them back:
+ * 1) layout:       an entry is [DELTA_FORMAT_MAGIC:u64][num_objects:size_t][value_1]...[value_n], with an empty list
+ *                  for a version without object, and LoggedObjects serializes the same layout.
+ * 2) replay:       applyDelta replays the entries into the same state, the removes included.
+ * 3) legacy:       an entry of an earlier release, a single serialized object, is read as one object, and replayed
+ *                  like the others.
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+using VT = ObjectWithStringKey;
+using DeltaCore = DeltaCascadeStoreCore<std::string,VT,&VT::IK,&VT::IV>;
+
+/* the log, one entry per version */
+using Log = std::vector<std::vector<char>>;
+
+persistent::DeltaFinalizer log_appender(Log& log) {
+    return [&log](const char* data, size_t size) {
+        log.emplace_back(data,data + size);
+    };
+}
+
+std::string blob_of(const VT& value) {
+    return std::string(value.blob.bytes,value.blob.size);
+}
+
+bool same_state(const DeltaCore& a, const DeltaCore& b) {
+    CHECK(a.kv_map.size() == b.kv_map.size());
+    for (const auto& kv: a.kv_map) {
+        auto it = b.kv_map.find(kv.first);
+        CHECK(it != b.kv_map.end());
+        CHECK(blob_of(it->second) == blob_of(kv.second));
+    }
+    return true;
+}
+
+bool test_layout() {
+    DeltaCore core;
+    Log log;
+    const std::string blob1 = "first";
+    const std::string blob2 = "second";
+    core.ordered_put(VT("k1",blob1.c_str(),blob1.size()),persistent::INVALID_VERSION,persistent::INVALID_VERSION);
+    core.ordered_put(VT("k2",blob2.c_str(),blob2.size()),persistent::INVALID_VERSION,persistent::INVALID_VERSION);
+    core.finalizeCurrentDelta(log_appender(log));
+    // a version without object.
+    core.finalizeCurrentDelta(log_appender(log));
+    CHECK(log.size() == 2);
+    for (const auto& entry: log) {
+        CHECK(entry.size() >= sizeof(uint64_t) + sizeof(std::size_t));
+        uint64_t magic;
+        memcpy(&magic,entry.data(),sizeof(magic));
+        CHECK(magic == DELTA_FORMAT_MAGIC);
+    }
+    std::size_t num_objects;
+    memcpy(&num_objects,log[0].data() + sizeof(uint64_t),sizeof(num_objects));
+    CHECK(num_objects == 2);
+    memcpy(&num_objects,log[1].data() + sizeof(uint64_t),sizeof(num_objects));
+    CHECK(num_objects == 0);
+    CHECK(log[1].size() == sizeof(uint64_t) + sizeof(std::size_t));
+    auto logged = mutils::from_bytes<LoggedObjects<VT>>(nullptr,log[0].data());
+    CHECK(logged->values.size() == 2);
+    CHECK(logged->values[0].get_key_ref() == "k1" && blob_of(logged->values[0]) == blob1);
+    CHECK(logged->values[1].get_key_ref() == "k2" && blob_of(logged->values[1]) == blob2);
+    CHECK(mutils::from_bytes<LoggedObjects<VT>>(nullptr,log[1].data())->values.empty());
+    // LoggedObjects serializes the layout it reads.
+    std::vector<char> bytes(mutils::bytes_size(*logged));
+    CHECK(mutils::to_bytes(*logged,bytes.data()) == bytes.size());
+    CHECK(bytes.size() == log[0].size());
+    CHECK(memcmp(bytes.data(),log[0].data(),sizeof(uint64_t) + sizeof(std::size_t)) == 0);
+    auto reread = mutils::from_bytes<LoggedObjects<VT>>(nullptr,bytes.data());
+    CHECK(reread->values.size() == 2);
+    CHECK(blob_of(reread->values[1]) == blob2);
+    return true;
+}
+
+bool test_replay() {
+    DeltaCore core;
+    Log log;
+    for (int i = 0; i < 100; i++) {
+        const std::string key = "key-" + std::to_string(i % 17);
+        if (i % 5 == 4) {
+            core.ordered_remove(VT(key,Blob{}),persistent::INVALID_VERSION);
+        } else {
+            const std::string blob = "value-" + std::to_string(i);
+            core.ordered_put(VT(key,blob.c_str(),blob.size()),persistent::INVALID_VERSION,
+                             persistent::INVALID_VERSION);
+        }
+        core.finalizeCurrentDelta(log_appender(log));
+    }
+    DeltaCore replayed;
+    for (const auto& entry: log) {
+        replayed.applyDelta(entry.data());
+    }
+    CHECK(same_state(core,replayed));
+    return true;
+}
+
+bool test_legacy() {
+    // an earlier release logged the object of a version as it is.
+    Log log;
+    const std::string blob = "legacy";
+    for (const auto& value: {VT("k1",blob.c_str(),blob.size()),
+                             VT("k2",blob.c_str(),blob.size()),
+                             VT("k1",Blob{})}) {
+        log.emplace_back(mutils::bytes_size(value));
+        mutils::to_bytes(value,log.back().data());
+    }
+    auto logged = mutils::from_bytes<LoggedObjects<VT>>(nullptr,log[0].data());
+    CHECK(logged->values.size() == 1);
+    CHECK(logged->values[0].get_key_ref() == "k1" && blob_of(logged->values[0]) == blob);
+    DeltaCore replayed;
+    for (const auto& entry: log) {
+        replayed.applyDelta(entry.data());
+    }
+    CHECK(replayed.kv_map.size() == 1);
+    CHECK(replayed.kv_map.find("k2") != replayed.kv_map.end());
+    // the entries of this release go on after them.
+    Log new_log;
+    replayed.ordered_put(VT("k3",blob.c_str(),blob.size()),persistent::INVALID_VERSION,persistent::INVALID_VERSION);
+    replayed.finalizeCurrentDelta(log_appender(new_log));
+    DeltaCore mixed;
+    for (const auto& entry: log) {
+        mixed.applyDelta(entry.data());
+    }
+    mixed.applyDelta(new_log[0].data());
+    CHECK(same_state(replayed,mixed));
+    return true;
+}
+
+int main() {
+    const bool ok = test_layout() && test_replay() && test_legacy();
+    std::cout << "DeltaCascadeStoreCore log entries: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
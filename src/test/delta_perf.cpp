@@ -0,0 +1,127 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <time.h>
+#include <cascade/cascade.hpp>
+#include <cascade/object.hpp>
+
+/**
+ * delta_perf measures the bytes copied and the time spent to generate the delta of a version in a persistent store,
+ * from ordered_put to finalizeCurrentDelta, for a range of object sizes. For each object size it runs:
+ * 1) single put:   one object per version, as ordered_put does.
+ * 2) batch put:    a batch of objects per version with the delta reserved up front, as ordered_put_batch does.
+ * The log append is simulated by copying the finalized delta into a log buffer. The report shows, per object, the
+ * bytes copied into the delta buffer (serialization and buffer growth), the bytes copied into the log, and the time.
+ */
+
+using namespace derecho::cascade;
+
+using DeltaCore = DeltaCascadeStoreCore<std::string,ObjectWithStringKey,&ObjectWithStringKey::IK,&ObjectWithStringKey::IV>;
+
+/**
+ * The bytes copied into the delta buffer by a call, read from the buffer around it: the bytes it appended, and the
+ * data it moved if it swapped in a bigger buffer.
+ */
+template <typename Func>
+uint64_t delta_bytes_copied(DeltaCore& core, Func&& func) {
+    const std::size_t len = core.delta.len;
+    const char* buffer = core.delta.buffer;
+    func();
+    uint64_t bytes = core.delta.len - len;
+    if (core.delta.buffer != buffer) {
+        bytes += len;
+    }
+    return bytes;
+}
+
+// timing unit.
+inline uint64_t get_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    return ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+static void report(const std::string& test, uint64_t object_size, uint64_t num_objects,
+                   uint64_t delta_bytes, uint64_t log_bytes, uint64_t elapsed_us) {
+    std::cout << test << "\t" << object_size << " bytes\t" << num_objects << " objects\t"
+              << static_cast<double>(delta_bytes) / num_objects << " delta bytes/obj\t"
+              << static_cast<double>(log_bytes) / num_objects << " log bytes/obj\t"
+              << static_cast<double>(delta_bytes + log_bytes) / num_objects / object_size << " copies/obj\t"
+              << static_cast<double>(elapsed_us) / num_objects << " us/obj" << std::endl;
+}
+
+void run(uint64_t object_size, uint64_t num_objects, uint32_t batch_size) {
+    std::vector<char> blob(object_size,'x');
+    std::vector<char> log_buffer;
+    uint64_t log_bytes = 0;
+    // simulate the log, which copies the delta into its own memory.
+    persistent::DeltaFinalizer log_append = [&log_buffer,&log_bytes](const char* data, size_t size) {
+        if (log_buffer.size() < size) {
+            log_buffer.resize(size);
+        }
+        memcpy(log_buffer.data(),data,size);
+        log_bytes += size;
+    };
+    // 1 - single put
+    {
+        DeltaCore core;
+        uint64_t delta_bytes = 0;
+        log_bytes = 0;
+        uint64_t ts = get_time_us();
+        for (uint64_t i=0;i<num_objects;i++) {
+            ObjectWithStringKey object("key-" + std::to_string(i%1024),blob.data(),object_size);
+            delta_bytes += delta_bytes_copied(core,[&](){
+                core.ordered_put(object,persistent::INVALID_VERSION,persistent::INVALID_VERSION);
+            });
+            core.finalizeCurrentDelta(log_append);
+        }
+        report("single put",object_size,num_objects,delta_bytes,log_bytes,get_time_us()-ts);
+    }
+    // 2 - batch put
+    {
+        DeltaCore core;
+        uint64_t delta_bytes = 0;
+        log_bytes = 0;
+        uint64_t ts = get_time_us();
+        for (uint64_t i=0;i<num_objects;i+=batch_size) {
+            std::vector<ObjectWithStringKey> objects;
+            std::size_t batch_bytes = 0;
+            for (uint64_t j=i;j<std::min(i+batch_size,num_objects);j++) {
+                objects.emplace_back("key-" + std::to_string(j%1024),blob.data(),object_size);
+                batch_bytes += mutils::bytes_size(objects.back());
+            }
+            delta_bytes += delta_bytes_copied(core,[&](){core.reserve_delta(batch_bytes);});
+            for (const auto& object: objects) {
+                delta_bytes += delta_bytes_copied(core,[&](){
+                    core.ordered_put(object,persistent::INVALID_VERSION,persistent::INVALID_VERSION);
+                });
+            }
+            core.finalizeCurrentDelta(log_append);
+        }
+        report("batch put(" + std::to_string(batch_size) + ")",object_size,num_objects,delta_bytes,log_bytes,
+               get_time_us()-ts);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <object_size> [num_objects(1000)] [batch_size(16)]" << std::endl;
+        std::cout << "\tThe object sizes of 1KB, 64KB, and 1MB are measured by default." << std::endl;
+    }
+    std::vector<uint64_t> object_sizes;
+    if (argc >= 2) {
+        object_sizes.push_back(std::stoull(argv[1]));
+    } else {
+        object_sizes = {1024,65536,1048576};
+    }
+    uint64_t num_objects = (argc >= 3) ? std::max(std::stoull(argv[2]),1ull) : 1000;
+    uint32_t batch_size = (argc >= 4) ? std::max(static_cast<uint32_t>(std::stoul(argv[3])),1u) : 16;
+    for (auto object_size: object_sizes) {
+        std::cout << "==== object_size=" << object_size << ", num_objects=" << num_objects
+                  << ", batch_size=" << batch_size << " ====" << std::endl;
+        run(object_size,num_objects,batch_size);
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <random>
+#include <string>
+#include <cascade/detail/flat_hash_map.hpp>
+
+/**
+ * flat_hash_map_test checks FlatHashMap against std::map as the reference, with random puts, overwrites, and erases by
+ * key and by iterator:
+ * 1) lookup:       find, count, and at agree with the reference.
+ * 2) iteration:    the iteration visits every entry exactly once, also while erasing with the returned iterators.
+ * 3) key order:    with keep_key_order(true), the key order iterators list the entries in ascending key order after any
+ *                  operation, and a map starting it late indexes its existing entries.
+ * 4) copy/move:    the copies, the moved maps, and the assigned maps have the same entries and key order.
+ * 5) serialization: a map survives to_bytes()/from_bytes().
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+/* a weak hash, so that 16 keys share a hash and the probes cross the deleted slots */
+struct WeakHash {
+    std::size_t operator()(const uint64_t& key) const {
+        return key >> 4;
+    }
+};
+
+template <typename MapType>
+bool check_against(const MapType& map, const std::map<uint64_t,uint64_t>& ref) {
+    CHECK(map.size() == ref.size());
+    CHECK(map.empty() == ref.empty());
+    std::set<uint64_t> visited;
+    for (const auto& kv: map) {
+        CHECK(visited.insert(kv.first).second);
+        auto it = ref.find(kv.first);
+        CHECK(it != ref.end());
+        CHECK(kv.second == it->second);
+    }
+    CHECK(visited.size() == ref.size());
+    for (const auto& kv: ref) {
+        CHECK(map.count(kv.first) == 1);
+        CHECK(map.find(kv.first) != map.end());
+        CHECK(map.at(kv.first) == kv.second);
+    }
+    return true;
+}
+
+template <typename MapType>
+bool check_key_order(const MapType& map, const std::map<uint64_t,uint64_t>& ref) {
+    auto ref_it = ref.begin();
+    for (auto it = map.key_order_begin(); it != map.key_order_end(); it++) {
+        CHECK(ref_it != ref.end());
+        CHECK(it->first == ref_it->first);
+        CHECK(it->second == ref_it->second);
+        ref_it++;
+    }
+    CHECK(ref_it == ref.end());
+    // a scan resumes after a key with lower_bound.
+    if (!ref.empty()) {
+        const uint64_t middle = std::next(ref.begin(),ref.size()/2)->first;
+        auto next = map.key_order_lower_bound(middle + 1);
+        auto ref_next = ref.lower_bound(middle + 1);
+        CHECK((next == map.key_order_end()) == (ref_next == ref.end()));
+        CHECK(next == map.key_order_end() || next->first == ref_next->first);
+    }
+    return true;
+}
+
+template <typename MapType>
+bool check_map(const MapType& map, const std::map<uint64_t,uint64_t>& ref) {
+    if (!check_against(map,ref)) {
+        return false;
+    }
+    return !map.keeps_key_order() || check_key_order(map,ref);
+}
+
+template <typename MapType>
+bool test_random_operations(const uint64_t num_keys, const uint64_t num_ops, const bool key_order) {
+    std::mt19937_64 rng(num_keys);
+    MapType map;
+    std::map<uint64_t,uint64_t> ref;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        // start keeping the key order half way, with the map full of entries and tombstones.
+        if (key_order && i == num_ops/2) {
+            map.keep_key_order(true);
+            CHECK(check_map(map,ref));
+        }
+        const uint64_t key = rng() % num_keys;
+        switch (rng() % 8) {
+        case 0:
+        case 1:
+        case 2:
+            map[key] = i;
+            ref[key] = i;
+            break;
+        case 3: {
+            auto result = map.emplace(key,i);
+            auto ref_result = ref.emplace(key,i);
+            CHECK(result.second == ref_result.second);
+            CHECK(result.first->second == ref_result.first->second);
+            break;
+        }
+        case 4:
+        case 5:
+            CHECK(map.erase(key) == ref.erase(key));
+            break;
+        case 6: {
+            auto it = map.find(key);
+            CHECK((it == map.end()) == (ref.count(key) == 0));
+            if (it != map.end()) {
+                map.erase(typename MapType::const_iterator(it));
+                ref.erase(key);
+            }
+            break;
+        }
+        default:
+            CHECK(map.count(key) == ref.count(key));
+            break;
+        }
+        if (i % (num_ops/4) == 0 && !check_map(map,ref)) {
+            return false;
+        }
+    }
+    return check_map(map,ref);
+}
+
+template <typename MapType>
+bool test_erase_while_iterating(const bool key_order) {
+    MapType map;
+    map.keep_key_order(key_order);
+    std::map<uint64_t,uint64_t> ref;
+    for (uint64_t key = 0; key < 10000; key++) {
+        map.emplace(key,key*2);
+        ref.emplace(key,key*2);
+    }
+    // erase the odd keys while walking the map, which must still visit every entry exactly once.
+    std::set<uint64_t> visited;
+    for (auto it = map.begin(); it != map.end();) {
+        CHECK(visited.insert(it->first).second);
+        if (it->first % 2 == 1) {
+            ref.erase(it->first);
+            it = map.erase(typename MapType::const_iterator(it));
+        } else {
+            ++it;
+        }
+    }
+    CHECK(visited.size() == 10000);
+    if (!check_map(map,ref)) {
+        return false;
+    }
+    // the slots of the erased keys are reused.
+    for (uint64_t key = 1; key < 10000; key += 2) {
+        map[key] = key;
+        ref[key] = key;
+    }
+    return check_map(map,ref);
+}
+
+template <typename MapType>
+bool test_copy_and_move(const bool key_order) {
+    MapType map;
+    map.keep_key_order(key_order);
+    std::map<uint64_t,uint64_t> ref;
+    for (uint64_t key = 0; key < 5000; key++) {
+        map.emplace(key*7,key);
+        ref.emplace(key*7,key);
+    }
+    for (uint64_t key = 0; key < 5000; key += 3) {
+        map.erase(key*7);
+        ref.erase(key*7);
+    }
+    MapType copied(map);
+    CHECK(copied.keeps_key_order() == key_order);
+    CHECK(check_map(copied,ref));
+    MapType moved(std::move(copied));
+    CHECK(moved.keeps_key_order() == key_order);
+    CHECK(check_map(moved,ref));
+    CHECK(copied.empty());
+    MapType assigned;
+    assigned[1] = 1;
+    assigned = moved;
+    CHECK(assigned.keeps_key_order() == key_order);
+    CHECK(check_map(assigned,ref));
+    MapType move_assigned;
+    move_assigned[1] = 1;
+    move_assigned = std::move(assigned);
+    CHECK(check_map(move_assigned,ref));
+    // the copy does not share anything with the source.
+    move_assigned.erase(7);
+    CHECK(check_map(map,ref));
+    map.clear();
+    CHECK(check_map(map,{}));
+    map[3] = 4;
+    CHECK(check_map(map,{{3,4}}));
+    // stopping drops the side index.
+    map.keep_key_order(false);
+    CHECK(!map.keeps_key_order());
+    CHECK(check_map(map,{{3,4}}));
+    return true;
+}
+
+template <typename MapType>
+bool test_serialization() {
+    MapType map;
+    std::map<uint64_t,uint64_t> ref;
+    for (uint64_t key = 0; key < 3000; key++) {
+        map.emplace(key*key,key);
+        ref.emplace(key*key,key);
+    }
+    std::vector<char> buf(mutils::bytes_size(map));
+    CHECK(mutils::to_bytes(map,buf.data()) == buf.size());
+    auto restored = mutils::from_bytes<MapType>(nullptr,buf.data());
+    CHECK(check_map(*restored,ref));
+    std::vector<char> posted;
+    mutils::post_object([&posted](char const* const bytes, std::size_t size){
+        posted.insert(posted.end(),bytes,bytes+size);
+    },map);
+    CHECK(posted == buf);
+    return true;
+}
+
+template <typename MapType>
+bool test_all(const std::string& name, const bool key_order) {
+    bool ok = test_random_operations<MapType>(100,100000,key_order) &&
+              test_random_operations<MapType>(100000,400000,key_order) &&
+              test_erase_while_iterating<MapType>(key_order) &&
+              test_copy_and_move<MapType>(key_order) &&
+              test_serialization<MapType>();
+    std::cout << name << ": " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    bool ok = test_all<FlatHashMap<uint64_t,uint64_t>>("FlatHashMap",false);
+    ok = test_all<FlatHashMap<uint64_t,uint64_t,WeakHash>>("FlatHashMap with colliding keys",false) && ok;
+    ok = test_all<FlatHashMap<uint64_t,uint64_t>>("FlatHashMap with key order",true) && ok;
+    ok = test_all<FlatHashMap<uint64_t,uint64_t,WeakHash>>("FlatHashMap with key order and colliding keys",true) && ok;
+    return ok ? 0 : 1;
+}
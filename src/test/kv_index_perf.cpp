@@ -0,0 +1,177 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <time.h>
+#include <cascade/detail/flat_hash_map.hpp>
+
+/**
+ * kv_index_perf compares the kv_map index candidates for the stores with uint64_t keys: std::map and FlatHashMap. It
+ * measures:
+ * 1) insert:           emplace all keys in random order.
+ * 2) hit lookup:       find existing keys in random order.
+ * 3) miss lookup:      find non-existing keys.
+ * 4) iterate:          walk through all entries, as ordered_list_keys does.
+ * 5) concurrent read:  reader threads holding a shared lock, as the local read path does, while a writer thread keeps
+ *                      replacing entries under the exclusive lock, as the ordered handlers do.
+ * 6) erase:            erase all keys in random order.
+ */
+
+using namespace derecho::cascade;
+
+// timing unit.
+inline uint64_t get_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    return ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+/* a POD value of the same size as the fixed part of ObjectWithUInt64Key */
+struct Value {
+    uint64_t version;
+    uint64_t timestamp_us;
+    uint64_t previous_version;
+    uint64_t previous_version_by_key;
+    uint64_t key;
+    uint64_t blob_size;
+    const char* blob_bytes;
+};
+
+static void report(const std::string& index_name, const std::string& test, uint64_t num_ops, uint64_t elapsed_us) {
+    std::cout << index_name << "\t" << test << "\t" << num_ops << " ops\t" << elapsed_us << " us\t"
+              << (elapsed_us > 0 ? static_cast<double>(num_ops) / elapsed_us : 0.0) << " Mops/s" << std::endl;
+}
+
+template <typename IndexType>
+void run(const std::string& index_name, const std::vector<uint64_t>& keys, uint64_t num_lookups, uint32_t num_readers) {
+    IndexType index;
+    std::mt19937_64 rng(0);
+    uint64_t ts;
+    // 1 - insert
+    ts = get_time_us();
+    for (auto key: keys) {
+        index.emplace(key,Value{key,0,0,0,key,0,nullptr});
+    }
+    report(index_name,"insert",keys.size(),get_time_us()-ts);
+    // 2 - hit lookup
+    uint64_t checksum = 0;
+    std::vector<uint64_t> lookup_keys(num_lookups);
+    for (auto& key: lookup_keys) {
+        key = keys[rng()%keys.size()];
+    }
+    ts = get_time_us();
+    for (auto key: lookup_keys) {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            checksum += it->second.version;
+        }
+    }
+    report(index_name,"hit lookup",num_lookups,get_time_us()-ts);
+    // 3 - miss lookup: keys are even numbers, look up odd numbers.
+    for (auto& key: lookup_keys) {
+        key |= 1;
+    }
+    ts = get_time_us();
+    for (auto key: lookup_keys) {
+        if (index.find(key) != index.end()) {
+            checksum ++;
+        }
+    }
+    report(index_name,"miss lookup",num_lookups,get_time_us()-ts);
+    // 4 - iterate
+    ts = get_time_us();
+    for (auto& kv: index) {
+        checksum += kv.first;
+    }
+    report(index_name,"iterate",keys.size(),get_time_us()-ts);
+    // 5 - concurrent read
+    std::shared_mutex index_mutex;
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> num_reads(0);
+    uint64_t num_writes = 0;
+    std::vector<std::thread> readers;
+    ts = get_time_us();
+    for (uint32_t r=0;r<num_readers;r++) {
+        readers.emplace_back([&,r](){
+            std::mt19937_64 reader_rng(r+1);
+            uint64_t local_reads = 0;
+            uint64_t local_checksum = 0;
+            while (local_reads < num_lookups/num_readers) {
+                uint64_t key = keys[reader_rng()%keys.size()];
+                std::shared_lock<std::shared_mutex> rlck(index_mutex);
+                auto it = index.find(key);
+                if (it != index.end()) {
+                    local_checksum += it->second.version;
+                }
+                local_reads ++;
+            }
+            num_reads += local_reads;
+            if (local_checksum == 0) {
+                std::cerr << "unexpected checksum." << std::endl;
+            }
+        });
+    }
+    std::thread writer([&](){
+        std::mt19937_64 writer_rng(0xffff);
+        while (!stop) {
+            uint64_t key = keys[writer_rng()%keys.size()];
+            std::unique_lock<std::shared_mutex> wlck(index_mutex);
+            index.erase(key);
+            index.emplace(key,Value{key,0,0,0,key,0,nullptr});
+            num_writes ++;
+        }
+    });
+    for (auto& reader: readers) {
+        reader.join();
+    }
+    stop = true;
+    writer.join();
+    uint64_t elapsed_us = get_time_us()-ts;
+    report(index_name,"concurrent read(" + std::to_string(num_readers) + " readers)",num_reads,elapsed_us);
+    report(index_name,"concurrent write",num_writes,elapsed_us);
+    // 6 - erase
+    ts = get_time_us();
+    for (auto key: keys) {
+        index.erase(key);
+    }
+    report(index_name,"erase",keys.size(),get_time_us()-ts);
+    if (index.size() != 0) {
+        std::cerr << index_name << ": index is not empty after erasing all keys." << std::endl;
+    }
+    std::cout << index_name << "\tchecksum=" << checksum << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <num_keys> [num_lookups(=num_keys)] [num_readers(4)]" << std::endl;
+        std::cout << "\tThe index candidates for uint64_t keys are compared with 1M, 10M, and 100M keys by default."
+                  << std::endl;
+    }
+    std::vector<uint64_t> key_counts;
+    if (argc >= 2) {
+        key_counts.push_back(std::stoull(argv[1]));
+    } else {
+        key_counts = {1000000,10000000,100000000};
+    }
+    uint32_t num_readers = (argc >= 4) ? std::max(static_cast<uint32_t>(std::stoul(argv[3])),1u) : 4;
+    for (auto num_keys: key_counts) {
+        uint64_t num_lookups = (argc >= 3) ? std::stoull(argv[2]) : num_keys;
+        std::cout << "==== num_keys=" << num_keys << ", num_lookups=" << num_lookups << ", num_readers=" << num_readers
+                  << " ====" << std::endl;
+        // Object ids are often sequential. Use even numbers so that the odd numbers can be used for miss lookups.
+        std::vector<uint64_t> keys(num_keys);
+        for (uint64_t i=0;i<num_keys;i++) {
+            keys[i] = i*2;
+        }
+        std::shuffle(keys.begin(),keys.end(),std::mt19937_64(num_keys));
+        run<std::map<uint64_t,Value>>("std::map",keys,num_lookups,num_readers);
+        run<FlatHashMap<uint64_t,Value>>("FlatHashMap",keys,num_lookups,num_readers);
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <string>
+#include <cascade/detail/radix_tree_map.hpp>
+
+/**
+ * radix_tree_map_test checks RadixTreeMap against std::map as the reference, with string keys sharing long prefixes,
+ * keys that are prefixes of other keys, the empty key, and bytes above 0x7f:
+ * 1) lookup:       find, count, and at agree with the reference.
+ * 2) iteration:    the iteration visits the keys in the order of std::map, also while erasing with the returned
+ *                  iterators.
+ * 3) ranges:       lower_bound and prefix_range agree with the reference for random probes.
+ * 4) fanout:       the nodes grow through all the children array sizes and shrink back.
+ * 5) copy/move:    the copies, the moved maps, and the assigned maps have the same entries.
+ * 6) serialization: a map survives to_bytes()/from_bytes().
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+using Map = RadixTreeMap<uint64_t>;
+using RefMap = std::map<std::string,uint64_t>;
+
+/* a random key of a few segments from a small alphabet, so that the keys share prefixes and nest */
+std::string random_key(std::mt19937_64& rng) {
+    static const std::vector<std::string> segments = {"", "a", "ab", "abc", "pet/", "pet/cat", "flower/", "\xff", "\x80z"};
+    std::string key;
+    const std::size_t num_segments = rng() % 4;
+    for (std::size_t i = 0; i < num_segments; i++) {
+        key += segments[rng() % segments.size()];
+    }
+    if (rng() % 2) {
+        // no NUL byte, since the serialized keys are NUL-terminated.
+        key += static_cast<char>(1 + rng() % 255);
+    }
+    return key;
+}
+
+bool check_map(const Map& map, const RefMap& ref) {
+    CHECK(map.size() == ref.size());
+    CHECK(map.empty() == ref.empty());
+    auto ref_it = ref.begin();
+    for (const auto& kv: map) {
+        CHECK(ref_it != ref.end());
+        CHECK(kv.first == ref_it->first);
+        CHECK(kv.second == ref_it->second);
+        ref_it++;
+    }
+    CHECK(ref_it == ref.end());
+    for (const auto& kv: ref) {
+        CHECK(map.count(kv.first) == 1);
+        CHECK(map.find(kv.first) != map.end());
+        CHECK(map.at(kv.first) == kv.second);
+    }
+    return true;
+}
+
+bool check_ranges(const Map& map, const RefMap& ref, std::mt19937_64& rng) {
+    for (int i = 0; i < 200; i++) {
+        const std::string probe = random_key(rng);
+        auto it = map.lower_bound(probe);
+        auto ref_it = ref.lower_bound(probe);
+        CHECK((it == map.end()) == (ref_it == ref.end()));
+        CHECK(it == map.end() || it->first == ref_it->first);
+        auto range = map.prefix_range(probe);
+        std::size_t num_keys = 0;
+        for (auto range_it = range.first; range_it != range.second; range_it++) {
+            CHECK(range_it->first.compare(0,probe.size(),probe) == 0);
+            num_keys++;
+        }
+        std::size_t ref_num_keys = 0;
+        for (auto it = ref.lower_bound(probe); it != ref.end() && it->first.compare(0,probe.size(),probe) == 0; it++) {
+            ref_num_keys++;
+        }
+        CHECK(num_keys == ref_num_keys);
+    }
+    return true;
+}
+
+bool test_random_operations(const uint64_t num_ops) {
+    std::mt19937_64 rng(num_ops);
+    Map map;
+    RefMap ref;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        const std::string key = random_key(rng);
+        switch (rng() % 8) {
+        case 0:
+        case 1:
+        case 2:
+            map[key] = i;
+            ref[key] = i;
+            break;
+        case 3: {
+            auto result = map.emplace(key,i);
+            auto ref_result = ref.emplace(key,i);
+            CHECK(result.second == ref_result.second);
+            CHECK(result.first->second == ref_result.first->second);
+            break;
+        }
+        case 4:
+        case 5:
+            CHECK(map.erase(key) == ref.erase(key));
+            break;
+        case 6: {
+            auto it = map.find(key);
+            CHECK((it == map.end()) == (ref.count(key) == 0));
+            if (it != map.end()) {
+                auto next = map.erase(Map::const_iterator(it));
+                auto ref_next = ref.erase(ref.find(key));
+                CHECK((next == map.end()) == (ref_next == ref.end()));
+                CHECK(next == map.end() || next->first == ref_next->first);
+            }
+            break;
+        }
+        default:
+            CHECK(map.count(key) == ref.count(key));
+            break;
+        }
+        if (i % (num_ops/8) == 0 && !(check_map(map,ref) && check_ranges(map,ref,rng))) {
+            return false;
+        }
+    }
+    return check_map(map,ref) && check_ranges(map,ref,rng);
+}
+
+bool test_fanout() {
+    Map map;
+    RefMap ref;
+    // one node grows through the children arrays of 4, 16, 48, and 256 entries, and shrinks back.
+    for (int byte = 1; byte < 256; byte++) {
+        const std::string key = std::string("node/") + static_cast<char>(byte) + "leaf";
+        map[key] = byte;
+        ref[key] = byte;
+        if (byte == 4 || byte == 5 || byte == 16 || byte == 17 || byte == 48 || byte == 49 || byte == 255) {
+            CHECK(check_map(map,ref));
+        }
+    }
+    map["node/"] = 1000;
+    ref["node/"] = 1000;
+    CHECK(check_map(map,ref));
+    for (int byte = 255; byte >= 1; byte -= 2) {
+        const std::string key = std::string("node/") + static_cast<char>(byte) + "leaf";
+        CHECK(map.erase(key) == 1);
+        ref.erase(key);
+    }
+    CHECK(check_map(map,ref));
+    // erase the rest while walking the map.
+    for (auto it = map.begin(); it != map.end();) {
+        CHECK(it->first == ref.begin()->first);
+        ref.erase(ref.begin());
+        it = map.erase(Map::const_iterator(it));
+    }
+    CHECK(ref.empty());
+    return check_map(map,ref);
+}
+
+bool test_copy_and_move() {
+    std::mt19937_64 rng(1);
+    Map map;
+    RefMap ref;
+    for (int i = 0; i < 5000; i++) {
+        const std::string key = random_key(rng);
+        map[key] = i;
+        ref[key] = i;
+    }
+    Map copied(map);
+    CHECK(check_map(copied,ref));
+    Map moved(std::move(copied));
+    CHECK(check_map(moved,ref));
+    CHECK(copied.empty());
+    Map assigned;
+    assigned["x"] = 1;
+    assigned = moved;
+    CHECK(check_map(assigned,ref));
+    Map move_assigned;
+    move_assigned["x"] = 1;
+    move_assigned = std::move(assigned);
+    CHECK(check_map(move_assigned,ref));
+    // the copy does not share any node with the source.
+    move_assigned.clear();
+    CHECK(check_map(map,ref));
+    return true;
+}
+
+bool test_serialization() {
+    std::mt19937_64 rng(2);
+    Map map;
+    RefMap ref;
+    for (int i = 0; i < 3000; i++) {
+        const std::string key = random_key(rng);
+        map[key] = i;
+        ref[key] = i;
+    }
+    std::vector<char> buf(mutils::bytes_size(map));
+    CHECK(mutils::to_bytes(map,buf.data()) == buf.size());
+    auto restored = mutils::from_bytes<Map>(nullptr,buf.data());
+    CHECK(check_map(*restored,ref));
+    std::vector<char> posted;
+    mutils::post_object([&posted](char const* const bytes, std::size_t size){
+        posted.insert(posted.end(),bytes,bytes+size);
+    },map);
+    CHECK(posted == buf);
+    return true;
+}
+
+int main() {
+    bool ok = test_random_operations(200000) &&
+              test_fanout() &&
+              test_copy_and_move() &&
+              test_serialization();
+    std::cout << "RadixTreeMap: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
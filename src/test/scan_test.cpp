@@ -0,0 +1,177 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <cascade/cascade.hpp>
+#include <cascade/object.hpp>
+
+/**
+ * scan_test pages through kv_maps with scan_kv_map(), resuming every page after the last key of the previous one, on
+ * all the kv_map indexes: std::map, and FlatHashMap with and without its side index of the ordered keys, for uint64_t
+ * keys, and std::map and RadixTreeMap for std::string keys. It checks:
+ * 1) the pages list every key once, in ascending order, and only the last page has has_more false.
+ * 2) a page has at most 'limit' keys, stops at max_bytes, and has at least one key unless the scan is over.
+ * 3) the values of a page belong to its keys.
+ * 4) the prefix filter, with the cursor before, inside, and after the prefix range.
+ * 5) a scan resumes after a cursor key removed between two pages, and sees the keys added after the cursor.
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+template <typename KT>
+KT make_key(const uint64_t i);
+
+template <>
+uint64_t make_key<uint64_t>(const uint64_t i) {
+    // spread the keys, so that a hash index does not keep them in order by chance.
+    return i * 7919;
+}
+
+template <>
+std::string make_key<std::string>(const uint64_t i) {
+    static const std::vector<std::string> dirs = {"flower/", "pet/cat/", "pet/dog/", "tree/"};
+    return dirs[i % dirs.size()] + std::to_string(i);
+}
+
+template <typename KT, typename VT, typename MapType>
+void put(MapType& kv_map, std::set<KT>& ref, const uint64_t i) {
+    const KT key = make_key<KT>(i);
+    const std::string blob = "value of " + std::to_string(i);
+    kv_map.emplace(key,VT(key,blob.c_str(),blob.size()));
+    ref.emplace(key);
+}
+
+/* page through a kv_map, and check the pages against the keys with the prefix in 'ref' */
+template <typename KT, typename VT, KT* IK, typename MapType>
+bool check_pages(const MapType& kv_map, const std::set<KT>& ref, const std::string& prefix,
+                 const uint32_t limit, const bool with_values, const uint64_t max_bytes) {
+    std::vector<KT> expected;
+    for (const auto& key: ref) {
+        if (key_has_prefix(key,prefix)) {
+            expected.emplace_back(key);
+        }
+    }
+    std::vector<KT> scanned;
+    KT start_after = *IK;
+    bool has_more = true;
+    while (has_more) {
+        auto page = scan_kv_map<KT,VT,IK>(kv_map,prefix,start_after,limit,with_values,max_bytes);
+        CHECK(limit == 0 || page.keys.size() <= limit);
+        CHECK(page.values.size() == (with_values ? page.keys.size() : 0));
+        for (std::size_t i = 0; i < page.values.size(); i++) {
+            CHECK(page.values[i].get_key_ref() == page.keys[i]);
+            CHECK(page.values[i].get_blob_size() == kv_map.find(page.keys[i])->second.get_blob_size());
+        }
+        // the page stops at the first key reaching max_bytes.
+        uint64_t page_bytes = 0;
+        for (std::size_t i = 0; i < page.keys.size(); i++) {
+            CHECK(i == 0 || page_bytes < max_bytes);
+            page_bytes += mutils::bytes_size(page.keys[i]);
+            if (with_values) {
+                page_bytes += get_raw_size(page.values[i]);
+            }
+        }
+        if (page.has_more) {
+            CHECK(!page.keys.empty());
+            CHECK(page.keys.size() == limit || page_bytes >= max_bytes);
+        }
+        scanned.insert(scanned.end(),page.keys.begin(),page.keys.end());
+        if (!page.keys.empty()) {
+            start_after = page.keys.back();
+        }
+        has_more = page.has_more;
+    }
+    CHECK(scanned == expected);
+    return true;
+}
+
+/* remove the cursor key and add keys between two pages */
+template <typename KT, typename VT, KT* IK, typename MapType>
+bool check_resume_after_update(MapType kv_map, std::set<KT> ref, const uint64_t num_keys) {
+    auto first_page = scan_kv_map<KT,VT,IK>(kv_map,"",*IK,10,false,1ull << 20);
+    CHECK(first_page.keys.size() == 10 && first_page.has_more);
+    const KT cursor = first_page.keys.back();
+    kv_map.erase(cursor);
+    ref.erase(cursor);
+    for (uint64_t i = num_keys; i < num_keys + 100; i++) {
+        put<KT,VT>(kv_map,ref,i);
+    }
+    std::vector<KT> scanned;
+    KT start_after = cursor;
+    bool has_more = true;
+    while (has_more) {
+        auto page = scan_kv_map<KT,VT,IK>(kv_map,"",start_after,7,false,1ull << 20);
+        scanned.insert(scanned.end(),page.keys.begin(),page.keys.end());
+        if (!page.keys.empty()) {
+            start_after = page.keys.back();
+        }
+        has_more = page.has_more;
+    }
+    // the rest of the scan has exactly the keys after the cursor, including the new ones.
+    std::vector<KT> expected(ref.upper_bound(cursor),ref.end());
+    CHECK(scanned == expected);
+    return true;
+}
+
+template <typename KT, typename VT, KT* IK, typename MapType>
+bool test_index(const std::string& name, const std::vector<std::string>& prefixes, const bool key_order = false) {
+    // more keys than an unordered kv_map selects in a pass, so that a page spans several passes.
+    const uint64_t num_keys = 3 * SCAN_SELECTION_KEYS;
+    MapType kv_map;
+    if (key_order) {
+        keep_key_order(kv_map);
+    }
+    std::set<KT> ref;
+    bool ok = check_pages<KT,VT,IK>(kv_map,ref,"",10,true,1ull << 20);
+    for (uint64_t i = 0; i < num_keys; i++) {
+        put<KT,VT>(kv_map,ref,i);
+    }
+    for (const auto& prefix: prefixes) {
+        ok = ok &&
+             check_pages<KT,VT,IK>(kv_map,ref,prefix,0,false,1ull << 20) &&
+             check_pages<KT,VT,IK>(kv_map,ref,prefix,1,true,1ull << 20) &&
+             check_pages<KT,VT,IK>(kv_map,ref,prefix,33,true,1ull << 20) &&
+             check_pages<KT,VT,IK>(kv_map,ref,prefix,num_keys,false,1ull << 20) &&
+             check_pages<KT,VT,IK>(kv_map,ref,prefix,0,true,1) &&
+             check_pages<KT,VT,IK>(kv_map,ref,prefix,50,true,512);
+    }
+    ok = ok && check_resume_after_update<KT,VT,IK>(kv_map,ref,num_keys);
+    if constexpr (std::is_same<KT,std::string>::value) {
+        // a cursor before, inside, and after the prefix range.
+        for (const std::string& start_after: {std::string("a"), std::string("pet/cat/5"), std::string("zzz")}) {
+            auto page = scan_kv_map<KT,VT,IK>(kv_map,"pet/",start_after,0,false,1ull << 20);
+            std::vector<KT> expected;
+            for (const auto& key: ref) {
+                if (key_has_prefix(key,"pet/") && start_after < key) {
+                    expected.emplace_back(key);
+                }
+            }
+            ok = ok && (page.keys == expected) && !page.has_more;
+        }
+    }
+    std::cout << name << ": " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    using UKey = ObjectWithUInt64Key;
+    using SKey = ObjectWithStringKey;
+    bool ok = test_index<uint64_t,UKey,&UKey::IK,std::map<uint64_t,UKey>>("std::map with uint64_t keys",{""});
+    ok = test_index<uint64_t,UKey,&UKey::IK,FlatHashMap<uint64_t,UKey>>("FlatHashMap with uint64_t keys",{""}) && ok;
+    ok = test_index<uint64_t,UKey,&UKey::IK,FlatHashMap<uint64_t,UKey>>(
+            "FlatHashMap with uint64_t keys in key order",{""},true) && ok;
+    const std::vector<std::string> prefixes = {"", "pet/", "pet/cat/", "tree/9", "none/"};
+    ok = test_index<std::string,SKey,&SKey::IK,std::map<std::string,SKey>>("std::map with string keys",prefixes) && ok;
+    ok = test_index<std::string,SKey,&SKey::IK,RadixTreeMap<SKey>>("RadixTreeMap with string keys",prefixes) && ok;
+    return ok ? 0 : 1;
+}
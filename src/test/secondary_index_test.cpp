@@ -0,0 +1,178 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <random>
+#include <string>
+#include <cascade/cascade.hpp>
+#include <cascade/object.hpp>
+
+/**
+ * secondary_index_test checks SecondaryIndex against a reference computed from the whole kv_map, with an extractor
+ * taking the tags in the blob of an object, "red,big" for the secondary keys "red" and "big":
+ * 1) build:        the index ignores the updates until it is built, and is then built from the whole kv_map.
+ * 2) maintenance:  the puts retagging a key, the removes, and the objects without any tag keep the index in step
+ *                  with kv_map, and a tag repeated by the extractor lists the key once.
+ * 3) lookup:       the pages of a secondary key list its primary keys once, in ascending order, bounded like the
+ *                  scans, with the values of kv_map.
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+using VT = ObjectWithUInt64Key;
+using KVMap = std::map<uint64_t,VT>;
+using Index = SecondaryIndex<uint64_t,VT,&VT::IK>;
+
+static const std::vector<std::string> tags = {"red", "green", "blue", "big", "small"};
+
+/* the tags in the blob of an object, separated by commas */
+std::vector<std::string> extract_tags(const uint64_t&, const VT& value) {
+    std::vector<std::string> keys;
+    const std::string blob(value.blob.bytes,value.blob.size);
+    std::size_t start = 0;
+    while (start < blob.size()) {
+        std::size_t end = blob.find(',',start);
+        if (end == std::string::npos) {
+            end = blob.size();
+        }
+        if (end > start) {
+            keys.emplace_back(blob.substr(start,end - start));
+        }
+        start = end + 1;
+    }
+    return keys;
+}
+
+/* a blob of random tags, sometimes none, and sometimes one of them twice */
+std::string random_tags(std::mt19937_64& rng) {
+    std::string blob;
+    for (const auto& tag: tags) {
+        if (rng() % 3 == 0) {
+            blob += tag + ",";
+        }
+    }
+    if (rng() % 8 == 0) {
+        blob += blob;
+    }
+    return blob;
+}
+
+void put(KVMap& kv_map, Index& index, const uint64_t key, const std::string& blob) {
+    kv_map.erase(key);
+    auto it = kv_map.emplace(key,VT(key,blob.c_str(),blob.size())).first;
+    index.on_update(key,it->second);
+}
+
+void remove_key(KVMap& kv_map, Index& index, const uint64_t key) {
+    kv_map.erase(key);
+    index.on_erase(key);
+}
+
+/* page through the keys of a tag, and check the pages against kv_map */
+bool check_lookup(const Index& index, const KVMap& kv_map, const std::string& tag, const uint32_t limit,
+                  const bool with_values, const uint64_t max_bytes) {
+    std::vector<uint64_t> expected;
+    for (const auto& kv: kv_map) {
+        const auto keys = extract_tags(kv.first,kv.second);
+        if (std::find(keys.begin(),keys.end(),tag) != keys.end()) {
+            expected.emplace_back(kv.first);
+        }
+    }
+    std::vector<uint64_t> found;
+    uint64_t start_after = VT::IK;
+    bool has_more = true;
+    while (has_more) {
+        auto page = index.lookup(kv_map,tag,start_after,limit,with_values,max_bytes);
+        CHECK(limit == 0 || page.keys.size() <= limit);
+        CHECK(page.values.size() == (with_values ? page.keys.size() : 0));
+        for (std::size_t i = 0; i < page.values.size(); i++) {
+            CHECK(page.values[i].get_key_ref() == page.keys[i]);
+            const VT& value = kv_map.at(page.keys[i]);
+            CHECK(std::string(page.values[i].blob.bytes,page.values[i].blob.size) ==
+                  std::string(value.blob.bytes,value.blob.size));
+        }
+        CHECK(!page.has_more || !page.keys.empty());
+        found.insert(found.end(),page.keys.begin(),page.keys.end());
+        if (!page.keys.empty()) {
+            start_after = page.keys.back();
+        }
+        has_more = page.has_more;
+    }
+    CHECK(found == expected);
+    return true;
+}
+
+bool check_index(const Index& index, const KVMap& kv_map) {
+    for (const auto& tag: tags) {
+        CHECK(check_lookup(index,kv_map,tag,0,false,1ull << 20));
+        CHECK(check_lookup(index,kv_map,tag,7,true,1ull << 20));
+        CHECK(check_lookup(index,kv_map,tag,0,true,256));
+    }
+    CHECK(check_lookup(index,kv_map,"none",0,true,1ull << 20));
+    return true;
+}
+
+bool test_build() {
+    std::mt19937_64 rng(22);
+    KVMap kv_map;
+    Index index;
+    CHECK(!index.is_built());
+    // the updates before the build are not indexed.
+    for (uint64_t key = 1; key <= 200; key++) {
+        put(kv_map,index,key,random_tags(rng));
+    }
+    auto page = index.lookup(kv_map,"red",VT::IK,0,false,1ull << 20);
+    CHECK(page.keys.empty() && !page.has_more);
+    index.build(extract_tags,kv_map);
+    CHECK(index.is_built());
+    CHECK(check_index(index,kv_map));
+    // building again starts over.
+    KVMap other;
+    put(other,index,1000,"red,");
+    index.build(extract_tags,other);
+    CHECK(check_index(index,other));
+    return true;
+}
+
+bool test_maintenance() {
+    std::mt19937_64 rng(23);
+    KVMap kv_map;
+    Index index;
+    index.build(extract_tags,kv_map);
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 500; i++) {
+            const uint64_t key = 1 + rng() % 300;
+            if (rng() % 4 == 0) {
+                remove_key(kv_map,index,key);
+            } else {
+                put(kv_map,index,key,random_tags(rng));
+            }
+        }
+        CHECK(check_index(index,kv_map));
+    }
+    // a key losing all its tags, and a removed key, are in no page.
+    put(kv_map,index,5000,"red,red,big,");
+    CHECK(check_index(index,kv_map));
+    put(kv_map,index,5000,"");
+    CHECK(check_index(index,kv_map));
+    remove_key(kv_map,index,5000);
+    remove_key(kv_map,index,5000);
+    CHECK(check_index(index,kv_map));
+    return true;
+}
+
+int main() {
+    const bool ok = test_build() && test_maintenance();
+    std::cout << "SecondaryIndex: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cascade/cascade.hpp>
+
+/**
+ * time_version_index_test checks TimeVersionIndex against a linear search in the updates it was given:
+ * 1) find:         a timestamp resolves to the version of the latest update no later than it, with several updates
+ *                  at the same timestamp, and to INVALID_VERSION before the first update.
+ * 2) append:       a version no later than the last one, like another update in the same batch, is ignored.
+ * 3) trim:         the truncated updates are dropped except the latest one, and the timestamps before it resolve to
+ *                  nothing.
+ * 4) coverage:     a complete index covers every timestamp, and an incomplete one only those from its first update.
+ * It does not need a Derecho group, and it returns a non-zero exit code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+/* an update in the reference */
+struct Update {
+    persistent::version_t version;
+    uint64_t timestamp_us;
+};
+
+persistent::version_t reference_find(const std::vector<Update>& updates, const uint64_t ts_us) {
+    persistent::version_t version = persistent::INVALID_VERSION;
+    for (const auto& update: updates) {
+        if (update.timestamp_us <= ts_us) {
+            version = update.version;
+        }
+    }
+    return version;
+}
+
+bool check_index(const TimeVersionIndex& index, const std::vector<Update>& updates) {
+    CHECK(index.size() == updates.size());
+    if (updates.empty()) {
+        CHECK(index.find(12345) == persistent::INVALID_VERSION);
+        return true;
+    }
+    const uint64_t last_us = updates.back().timestamp_us;
+    for (uint64_t ts_us = 0; ts_us <= last_us + 10; ts_us++) {
+        CHECK(index.find(ts_us) == reference_find(updates,ts_us));
+    }
+    CHECK(index.find(std::numeric_limits<uint64_t>::max()) == updates.back().version);
+    return true;
+}
+
+bool test_find() {
+    std::mt19937_64 rng(23);
+    TimeVersionIndex index;
+    std::vector<Update> updates;
+    CHECK(check_index(index,updates));
+    persistent::version_t version = 0;
+    uint64_t timestamp_us = 100;
+    for (int i = 0; i < 2000; i++) {
+        // the versions skip the entries without updates, and the timestamps may repeat.
+        version += 1 + rng() % 3;
+        timestamp_us += rng() % 4;
+        index.append(version,timestamp_us);
+        updates.push_back({version,timestamp_us});
+        if (rng() % 5 == 0) {
+            // another update of the batch, or a replayed one.
+            index.append(version - rng() % 2,timestamp_us + 1);
+        }
+    }
+    CHECK(check_index(index,updates));
+    CHECK(index.find(99) == persistent::INVALID_VERSION);
+    CHECK(index.find(100) == reference_find(updates,100));
+    return true;
+}
+
+bool test_trim() {
+    TimeVersionIndex index;
+    std::vector<Update> updates;
+    for (persistent::version_t version = 10; version <= 1000; version += 10) {
+        index.append(version,static_cast<uint64_t>(version)*2);
+        updates.push_back({version,static_cast<uint64_t>(version)*2});
+    }
+    // nothing before the first update.
+    index.trim(5);
+    CHECK(check_index(index,updates));
+    // the latest truncated update stays, whether the truncation ends at an update or between two.
+    index.trim(100);
+    updates.erase(updates.begin(),updates.begin() + 9);
+    CHECK(updates.front().version == 100);
+    CHECK(check_index(index,updates));
+    index.trim(255);
+    updates.erase(updates.begin(),updates.begin() + 15);
+    CHECK(updates.front().version == 250);
+    CHECK(check_index(index,updates));
+    CHECK(index.find(499) == persistent::INVALID_VERSION);
+    CHECK(index.find(500) == 250);
+    // beyond the last update, only the last one stays.
+    index.trim(5000);
+    updates.erase(updates.begin(),updates.end() - 1);
+    CHECK(check_index(index,updates));
+    return true;
+}
+
+bool test_coverage() {
+    TimeVersionIndex index;
+    CHECK(index.covers(0) && index.covers(1000));
+    index.append(1,100);
+    CHECK(index.covers(0));
+    // an index started after a recovery covers only the timestamps from its first update.
+    index.clear(false);
+    CHECK(index.size() == 0);
+    CHECK(!index.covers(0) && !index.covers(1000));
+    index.append(5,200);
+    index.append(6,300);
+    CHECK(!index.covers(199));
+    CHECK(index.covers(200) && index.covers(1000));
+    CHECK(index.find(250) == 5);
+    index.clear(true);
+    CHECK(index.size() == 0);
+    CHECK(index.covers(0));
+    CHECK(index.find(1000) == persistent::INVALID_VERSION);
+    // a cleared index takes any version again.
+    index.append(1,10);
+    CHECK(index.size() == 1 && index.find(10) == 1);
+    return true;
+}
+
+int main() {
+    const bool ok = test_find() && test_trim() && test_coverage();
+    std::cout << "TimeVersionIndex: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cascade/cascade.hpp>
+#include <cascade/object.hpp>
+
+/**
+ * write_behind_log_test checks the .wbl file of WriteBehindLog, the way WriteBehindCascadeStore writes and recovers it:
+ * 1) format:       a record is [payload size:u64][FNV-1a checksum of the payload:u64][payload], and the payload is
+ *                  [PUT][version][value] or [REMOVE][version][key].
+ * 2) replay:       open() replays the flushed records in order, and nothing of the pending buffer before a flush.
+ * 3) torn tail:    a record cut short or corrupted stops the replay, and the file is cut off before it, so that the
+ *                  next records append after the last good one.
+ * 4) rewrite:      rewrite() replaces the file with a copy of the state, and keeps only the pending records appended
+ *                  after the copy.
+ * It runs in a scratch directory under the working directory, needs no Derecho group, and returns a non-zero exit
+ * code on the first failed check.
+ */
+
+using namespace derecho::cascade;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            return false; \
+        } \
+    } while (0)
+
+using VT = ObjectWithUInt64Key;
+using Log = WriteBehindLog<uint64_t,VT>;
+
+/* a replayed record: the key, the version, and the blob of a put, or "" for a remove */
+struct Record {
+    bool        is_put;
+    uint64_t    key;
+    persistent::version_t version;
+    std::string blob;
+    bool operator==(const Record& rhs) const {
+        return is_put == rhs.is_put && key == rhs.key && version == rhs.version && blob == rhs.blob;
+    }
+};
+
+uint64_t file_size_of(const std::string& path) {
+    struct stat st;
+    return (stat(path.c_str(),&st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+VT make_value(const uint64_t key, const persistent::version_t version) {
+    const std::string blob = "value of " + std::to_string(key) + " at " + std::to_string(version);
+    return VT(key,blob.c_str(),blob.size());
+}
+
+/* open a log on a file, and collect the records it replays */
+bool open_log(Log& log, const std::string& path, std::vector<Record>& replayed) {
+    replayed.clear();
+    CHECK(log.open(path,
+        [&replayed](VT&& value, const persistent::version_t& version){
+            replayed.push_back(Record{true,value.get_key_ref(),version,
+                                      std::string(value.blob.bytes,value.blob.size)});
+        },
+        [&replayed](const uint64_t& key, const persistent::version_t& version){
+            replayed.push_back(Record{false,key,version,""});
+        }));
+    CHECK(log.is_open());
+    return true;
+}
+
+/* append some puts and removes, and the records they should replay to */
+void append_records(Log& log, std::vector<Record>& expected, const persistent::version_t first_version,
+                    const persistent::version_t num_records) {
+    for (persistent::version_t version = first_version; version < first_version + num_records; version++) {
+        const uint64_t key = version % 17;
+        if (version % 5 == 4) {
+            log.append_remove(key,version);
+            expected.push_back(Record{false,key,version,""});
+        } else {
+            VT value = make_value(key,version);
+            log.append_put(value,version);
+            expected.push_back(Record{true,key,version,std::string(value.blob.bytes,value.blob.size)});
+        }
+    }
+}
+
+uint64_t fnv1a(const char* bytes, const std::size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(bytes[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool read_file(const std::string& path, std::vector<char>& bytes) {
+    std::ifstream ifs(path,std::ios::binary);
+    CHECK(static_cast<bool>(ifs));
+    bytes.assign(std::istreambuf_iterator<char>(ifs),std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool test_format(const std::string& dir) {
+    const std::string path = dir + "/format.wbl";
+    Log log;
+    std::vector<Record> replayed;
+    CHECK(open_log(log,path,replayed));
+    CHECK(replayed.empty());
+    VT value = make_value(3,100);
+    log.append_put(value,100);
+    log.append_remove(3,101);
+    CHECK(log.flush());
+    std::vector<char> bytes;
+    CHECK(read_file(path,bytes));
+    // the put.
+    std::size_t offset = 0;
+    uint64_t payload_size = 0;
+    uint64_t payload_checksum = 0;
+    memcpy(&payload_size,bytes.data(),sizeof(payload_size));
+    memcpy(&payload_checksum,bytes.data() + sizeof(payload_size),sizeof(payload_checksum));
+    offset += sizeof(payload_size) + sizeof(payload_checksum);
+    CHECK(payload_size == sizeof(uint8_t) + sizeof(persistent::version_t) + mutils::bytes_size(value));
+    CHECK(offset + payload_size < bytes.size());
+    CHECK(payload_checksum == fnv1a(bytes.data() + offset,payload_size));
+    CHECK(static_cast<uint8_t>(bytes[offset]) == Log::RECORD_PUT);
+    persistent::version_t version = 0;
+    memcpy(&version,bytes.data() + offset + sizeof(uint8_t),sizeof(version));
+    CHECK(version == 100);
+    auto restored = mutils::from_bytes<VT>(nullptr,bytes.data() + offset + sizeof(uint8_t) + sizeof(version));
+    CHECK(restored->get_key_ref() == 3);
+    CHECK(std::string(restored->blob.bytes,restored->blob.size) == std::string(value.blob.bytes,value.blob.size));
+    offset += payload_size;
+    // the remove.
+    memcpy(&payload_size,bytes.data() + offset,sizeof(payload_size));
+    memcpy(&payload_checksum,bytes.data() + offset + sizeof(payload_size),sizeof(payload_checksum));
+    offset += sizeof(payload_size) + sizeof(payload_checksum);
+    CHECK(payload_size == sizeof(uint8_t) + sizeof(persistent::version_t) + sizeof(uint64_t));
+    CHECK(offset + payload_size == bytes.size());
+    CHECK(payload_checksum == fnv1a(bytes.data() + offset,payload_size));
+    CHECK(static_cast<uint8_t>(bytes[offset]) == Log::RECORD_REMOVE);
+    memcpy(&version,bytes.data() + offset + sizeof(uint8_t),sizeof(version));
+    CHECK(version == 101);
+    uint64_t key = 0;
+    memcpy(&key,bytes.data() + offset + sizeof(uint8_t) + sizeof(version),sizeof(key));
+    CHECK(key == 3);
+    return true;
+}
+
+bool test_replay(const std::string& dir) {
+    const std::string path = dir + "/replay.wbl";
+    std::vector<Record> expected;
+    std::vector<Record> replayed;
+    {
+        Log log;
+        CHECK(open_log(log,path,replayed));
+        append_records(log,expected,1,500);
+        CHECK(log.get_pending_size() > 0);
+        CHECK(log.flush());
+        CHECK(log.get_pending_size() == 0);
+        append_records(log,expected,501,500);
+        CHECK(log.flush());
+        // the pending records are lost with the log, as in a crash.
+        std::vector<Record> lost;
+        append_records(log,lost,1001,10);
+    }
+    Log log;
+    CHECK(open_log(log,path,replayed));
+    CHECK(replayed == expected);
+    // the records appended after the replay follow the replayed ones.
+    append_records(log,expected,1001,10);
+    CHECK(log.flush());
+    Log reopened;
+    CHECK(open_log(reopened,path,replayed));
+    CHECK(replayed == expected);
+    return true;
+}
+
+bool test_torn_tail(const std::string& dir) {
+    const std::string path = dir + "/torn.wbl";
+    std::vector<Record> expected;
+    std::vector<Record> replayed;
+    uint64_t good_size = 0;
+    {
+        Log log;
+        CHECK(open_log(log,path,replayed));
+        append_records(log,expected,1,100);
+        CHECK(log.flush());
+        good_size = file_size_of(path);
+        std::vector<Record> torn;
+        append_records(log,torn,101,1);
+        CHECK(log.flush());
+    }
+    // every cut inside the last record drops it, and the file goes back to the last good record.
+    const uint64_t full_size = file_size_of(path);
+    for (uint64_t size = full_size - 1; size > good_size; size -= 7) {
+        CHECK(truncate(path.c_str(),size) == 0);
+        Log log;
+        CHECK(open_log(log,path,replayed));
+        CHECK(replayed == expected);
+        CHECK(file_size_of(path) == good_size);
+        // the good records stay, so the next cut starts from a full file again.
+        std::vector<Record> torn;
+        append_records(log,torn,101,1);
+        CHECK(log.flush());
+        CHECK(file_size_of(path) == full_size);
+    }
+    // a corrupted record stops the replay, and the records after it are cut off.
+    std::vector<char> bytes;
+    CHECK(read_file(path,bytes));
+    uint64_t offset = 0;
+    std::vector<Record> prefix;
+    for (int i = 0; i < 50; i++) {
+        uint64_t payload_size = 0;
+        memcpy(&payload_size,bytes.data() + offset,sizeof(payload_size));
+        offset += sizeof(uint64_t) + sizeof(uint64_t) + payload_size;
+        prefix.push_back(expected[i]);
+    }
+    bytes[offset + sizeof(uint64_t) + sizeof(uint64_t) + 3] ^= 1;
+    {
+        std::ofstream ofs(path,std::ios::binary|std::ios::trunc);
+        ofs.write(bytes.data(),bytes.size());
+        CHECK(static_cast<bool>(ofs));
+    }
+    Log log;
+    CHECK(open_log(log,path,replayed));
+    CHECK(replayed == prefix);
+    CHECK(file_size_of(path) == offset);
+    return true;
+}
+
+bool test_rewrite(const std::string& dir) {
+    const std::string path = dir + "/rewrite.wbl";
+    std::vector<Record> replayed;
+    std::vector<Record> expected;
+    Log log;
+    CHECK(open_log(log,path,replayed));
+    // the state, built from the records.
+    std::vector<Record> history;
+    append_records(log,history,1,300);
+    CHECK(log.flush());
+    KVIndex<uint64_t,VT> kv_map;
+    for (const auto& record: history) {
+        if (record.is_put) {
+            kv_map.erase(record.key);
+            kv_map.emplace(record.key,VT(record.key,record.blob.c_str(),record.blob.size()));
+        } else {
+            kv_map.erase(record.key);
+        }
+    }
+    // some records are pending when the state is copied, and some are appended after the copy.
+    std::vector<Record> included;
+    append_records(log,included,301,20);
+    for (const auto& record: included) {
+        if (record.is_put) {
+            kv_map.erase(record.key);
+            kv_map.emplace(record.key,VT(record.key,record.blob.c_str(),record.blob.size()));
+        } else {
+            kv_map.erase(record.key);
+        }
+    }
+    const std::size_t included_pending = log.get_pending_size();
+    const persistent::version_t state_version = 320;
+    std::vector<Record> appended;
+    append_records(log,appended,321,30);
+    const std::size_t appended_pending = log.get_pending_size() - included_pending;
+    CHECK(log.rewrite(path,kv_map,state_version,included_pending));
+    CHECK(log.get_pending_size() == appended_pending);
+    CHECK(log.flush());
+    // the file has the state at its version, then the records appended after the copy.
+    std::map<uint64_t,Record> state;
+    for (const auto& kv: kv_map) {
+        state.emplace(kv.first,Record{true,kv.first,state_version,
+                                      std::string(kv.second.blob.bytes,kv.second.blob.size)});
+    }
+    Log reopened;
+    CHECK(open_log(reopened,path,replayed));
+    CHECK(replayed.size() == state.size() + appended.size());
+    for (std::size_t i = 0; i < state.size(); i++) {
+        CHECK(state.count(replayed[i].key) == 1);
+        CHECK(replayed[i] == state.at(replayed[i].key));
+        state.erase(replayed[i].key);
+    }
+    CHECK(std::vector<Record>(replayed.begin() + replayed.size() - appended.size(),replayed.end()) == appended);
+    return true;
+}
+
+int main() {
+    char dir_template[] = "write_behind_log_test.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        std::cerr << "failed to create the scratch directory." << std::endl;
+        return 1;
+    }
+    const std::string dir(dir_template);
+    const bool ok = test_format(dir) &&
+                    test_replay(dir) &&
+                    test_torn_tail(dir) &&
+                    test_rewrite(dir);
+    for (const char* name: {"format.wbl", "replay.wbl", "torn.wbl", "rewrite.wbl", "rewrite.wbl.tmp"}) {
+        std::remove((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+    std::cout << "WriteBehindLog: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}